@@ -0,0 +1,383 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cch.hh"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace Tempus
+{
+
+namespace
+{
+const uint32_t no_arc = 0xFFFFFFFF;
+
+// saturated sum of costs
+inline uint32_t add_costs( uint32_t a, uint32_t b )
+{
+    return uint32_t( std::min<uint64_t>( uint64_t( a ) + b, CCHMetric::infinity() ) );
+}
+
+// part of the graph to order, its vertices are given the ranks from begin
+struct Cell
+{
+    std::vector<uint32_t> vertices;
+    uint32_t begin;
+};
+}
+
+std::vector<uint32_t> cch_nested_dissection_order( uint32_t n_vertices, const std::vector<std::pair<uint32_t, uint32_t>>& edges )
+{
+    // undirected adjacency
+    std::vector<uint32_t> first( n_vertices + 1, 0 );
+    for ( const auto& e : edges ) {
+        if ( e.first >= n_vertices || e.second >= n_vertices ) {
+            throw std::invalid_argument( "cch_nested_dissection_order: vertex out of range" );
+        }
+        if ( e.first != e.second ) {
+            first[e.first + 1]++;
+            first[e.second + 1]++;
+        }
+    }
+    for ( uint32_t v = 0; v < n_vertices; v++ ) {
+        first[v + 1] += first[v];
+    }
+    std::vector<uint32_t> adjacent( first.back() );
+    {
+        std::vector<uint32_t> pos( first.begin(), first.end() - 1 );
+        for ( const auto& e : edges ) {
+            if ( e.first != e.second ) {
+                adjacent[pos[e.first]++] = e.second;
+                adjacent[pos[e.second]++] = e.first;
+            }
+        }
+    }
+
+    std::vector<uint32_t> order( n_vertices );
+
+    // cell of each vertex, and BFS level in its cell
+    std::vector<uint32_t> cell_stamp( n_vertices, 0 );
+    std::vector<uint32_t> level_stamp( n_vertices, 0 );
+    std::vector<uint32_t> level( n_vertices, 0 );
+    uint32_t stamp = 0;
+    uint32_t bfs_stamp = 0;
+
+    std::vector<uint32_t> queue;
+    queue.reserve( n_vertices );
+    // BFS restricted to the current cell, returns the number of levels
+    auto bfs = [&]( uint32_t origin ) {
+        bfs_stamp++;
+        queue.clear();
+        queue.push_back( origin );
+        level[origin] = 0;
+        level_stamp[origin] = bfs_stamp;
+        for ( size_t i = 0; i < queue.size(); i++ ) {
+            uint32_t u = queue[i];
+            for ( uint32_t j = first[u]; j < first[u + 1]; j++ ) {
+                uint32_t w = adjacent[j];
+                if ( cell_stamp[w] == stamp && level_stamp[w] != bfs_stamp ) {
+                    level_stamp[w] = bfs_stamp;
+                    level[w] = level[u] + 1;
+                    queue.push_back( w );
+                }
+            }
+        }
+        return level[queue.back()] + 1;
+    };
+
+    std::vector<Cell> cells;
+    {
+        Cell all;
+        all.vertices.resize( n_vertices );
+        for ( uint32_t v = 0; v < n_vertices; v++ ) {
+            all.vertices[v] = v;
+        }
+        all.begin = 0;
+        cells.push_back( std::move( all ) );
+    }
+
+    while ( !cells.empty() ) {
+        Cell cell = std::move( cells.back() );
+        cells.pop_back();
+
+        if ( cell.vertices.size() <= 2 ) {
+            std::copy( cell.vertices.begin(), cell.vertices.end(), order.begin() + cell.begin );
+            continue;
+        }
+
+        stamp++;
+        for ( uint32_t v : cell.vertices ) {
+            cell_stamp[v] = stamp;
+        }
+
+        bfs( cell.vertices[0] );
+        if ( queue.size() < cell.vertices.size() ) {
+            // more than one connected component: no separator needed
+            Cell component, others;
+            component.vertices = queue;
+            component.begin = cell.begin;
+            for ( uint32_t v : cell.vertices ) {
+                if ( level_stamp[v] != bfs_stamp ) {
+                    others.vertices.push_back( v );
+                }
+            }
+            others.begin = cell.begin + uint32_t( component.vertices.size() );
+            cells.push_back( std::move( component ) );
+            cells.push_back( std::move( others ) );
+            continue;
+        }
+
+        // the last visited vertex is far from the first one, start again from it
+        uint32_t n_levels = bfs( queue.back() );
+
+        // first level such that the levels before it hold half of the vertices.
+        // The cell is connected and has more than 2 vertices, there are at least 2 levels and
+        // the cut is not the last one, so that the separator is not empty
+        std::vector<uint32_t> level_size( n_levels, 0 );
+        for ( uint32_t v : queue ) {
+            level_size[level[v]]++;
+        }
+        uint32_t cut = 0;
+        size_t below = 0;
+        while ( cut + 2 < n_levels && below + level_size[cut] < cell.vertices.size() / 2 ) {
+            below += level_size[cut];
+            cut++;
+        }
+
+        // vertices of the cut level that are not linked to the next level are moved to the lower part
+        Cell lower, upper;
+        std::vector<uint32_t> separator;
+        for ( uint32_t v : queue ) {
+            if ( level[v] < cut ) {
+                lower.vertices.push_back( v );
+            }
+            else if ( level[v] > cut ) {
+                upper.vertices.push_back( v );
+            }
+            else {
+                bool linked = false;
+                for ( uint32_t j = first[v]; j < first[v + 1] && !linked; j++ ) {
+                    uint32_t w = adjacent[j];
+                    linked = cell_stamp[w] == stamp && level[w] == cut + 1;
+                }
+                if ( linked ) {
+                    separator.push_back( v );
+                }
+                else {
+                    lower.vertices.push_back( v );
+                }
+            }
+        }
+
+        lower.begin = cell.begin;
+        upper.begin = lower.begin + uint32_t( lower.vertices.size() );
+        std::copy( separator.begin(), separator.end(), order.begin() + upper.begin + upper.vertices.size() );
+        cells.push_back( std::move( lower ) );
+        cells.push_back( std::move( upper ) );
+    }
+
+    return order;
+}
+
+CCHTopology::CCHTopology( uint32_t n_vertices, const std::vector<std::pair<uint32_t, uint32_t>>& edges )
+    : n_vertices_( n_vertices )
+{
+    // upper neighbours of each vertex
+    std::vector<std::vector<uint32_t>> upper( n_vertices );
+    for ( const auto& e : edges ) {
+        if ( e.first >= n_vertices || e.second >= n_vertices ) {
+            throw std::invalid_argument( "CCHTopology: vertex out of range" );
+        }
+        if ( e.first != e.second ) {
+            upper[std::min( e.first, e.second )].push_back( std::max( e.first, e.second ) );
+        }
+    }
+    for ( auto& n : upper ) {
+        std::sort( n.begin(), n.end() );
+        n.erase( std::unique( n.begin(), n.end() ), n.end() );
+    }
+
+    // contraction: upper neighbours of a vertex become a clique. It is enough to link them to
+    // the lowest one, its own contraction will then link them together
+    std::vector<uint32_t> merged;
+    for ( uint32_t u = 0; u < n_vertices; u++ ) {
+        if ( upper[u].size() < 2 ) {
+            continue;
+        }
+        uint32_t parent = upper[u][0];
+        merged.clear();
+        std::set_union( upper[parent].begin(), upper[parent].end(), upper[u].begin() + 1, upper[u].end(), std::back_inserter( merged ) );
+        upper[parent].swap( merged );
+    }
+
+    first_arc_.resize( n_vertices + 1 );
+    first_arc_[0] = 0;
+    for ( uint32_t u = 0; u < n_vertices; u++ ) {
+        first_arc_[u + 1] = first_arc_[u] + uint32_t( upper[u].size() );
+    }
+    arc_tail_.reserve( first_arc_.back() );
+    arc_head_.reserve( first_arc_.back() );
+    for ( uint32_t u = 0; u < n_vertices; u++ ) {
+        for ( uint32_t v : upper[u] ) {
+            arc_tail_.push_back( u );
+            arc_head_.push_back( v );
+        }
+        std::vector<uint32_t>().swap( upper[u] );
+    }
+
+    // arcs by head
+    first_down_arc_.assign( n_vertices + 1, 0 );
+    for ( uint32_t v : arc_head_ ) {
+        first_down_arc_[v + 1]++;
+    }
+    for ( uint32_t v = 0; v < n_vertices; v++ ) {
+        first_down_arc_[v + 1] += first_down_arc_[v];
+    }
+    down_arc_.resize( arc_head_.size() );
+    {
+        std::vector<uint32_t> pos( first_down_arc_.begin(), first_down_arc_.end() - 1 );
+        for ( uint32_t a = 0; a < arc_head_.size(); a++ ) {
+            down_arc_[pos[arc_head_[a]]++] = a;
+        }
+    }
+
+    input_arc_.resize( edges.size() );
+    input_upward_.resize( edges.size() );
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        const auto& e = edges[i];
+        input_upward_[i] = e.first < e.second;
+        input_arc_[i] = e.first == e.second ? no_arc : find_arc( e.first, e.second ).get();
+    }
+
+    // level of a vertex: 0 without lower neighbour, 1 + the highest level of its lower neighbours otherwise
+    std::vector<uint32_t> level( n_vertices, 0 );
+    uint32_t n_levels = n_vertices > 0 ? 1 : 0;
+    for ( uint32_t u = 0; u < n_vertices; u++ ) {
+        for ( uint32_t a = first_arc_[u]; a < first_arc_[u + 1]; a++ ) {
+            uint32_t& l = level[arc_head_[a]];
+            l = std::max( l, level[u] + 1 );
+            n_levels = std::max( n_levels, l + 1 );
+        }
+    }
+    level_first_.assign( n_levels + 1, 0 );
+    for ( uint32_t u = 0; u < n_vertices; u++ ) {
+        level_first_[level[u] + 1]++;
+    }
+    for ( uint32_t l = 0; l < n_levels; l++ ) {
+        level_first_[l + 1] += level_first_[l];
+    }
+    level_vertices_.resize( n_vertices );
+    {
+        std::vector<uint32_t> pos( level_first_.begin(), level_first_.end() - 1 );
+        for ( uint32_t u = 0; u < n_vertices; u++ ) {
+            level_vertices_[pos[level[u]]++] = u;
+        }
+    }
+}
+
+boost::optional<uint32_t> CCHTopology::find_arc( uint32_t u, uint32_t v ) const
+{
+    if ( u > v ) {
+        std::swap( u, v );
+    }
+    auto b = arc_head_.begin() + first_arc_[u];
+    auto e = arc_head_.begin() + first_arc_[u + 1];
+    auto it = std::lower_bound( b, e, v );
+    if ( it != e && *it == v ) {
+        return uint32_t( it - arc_head_.begin() );
+    }
+    return boost::optional<uint32_t>();
+}
+
+CCHMetric CCHTopology::customize( const std::vector<uint32_t>& weights ) const
+{
+    if ( weights.size() != input_arc_.size() ) {
+        throw std::invalid_argument( "CCHTopology::customize: one weight per input edge is expected" );
+    }
+
+    CCHMetric m;
+    m.up_cost.assign( num_arcs(), CCHMetric::infinity() );
+    m.down_cost.assign( num_arcs(), CCHMetric::infinity() );
+    m.up_middle.assign( num_arcs(), CCHMetric::no_middle() );
+    m.down_middle.assign( num_arcs(), CCHMetric::no_middle() );
+    m.up_edge.assign( num_arcs(), no_arc );
+    m.down_edge.assign( num_arcs(), no_arc );
+
+    // costs of input edges, the lowest one for parallel edges
+    for ( uint32_t i = 0; i < input_arc_.size(); i++ ) {
+        uint32_t a = input_arc_[i];
+        uint32_t w = std::min( weights[i], CCHMetric::infinity() );
+        if ( a == no_arc ) {
+            continue;
+        }
+        if ( input_upward_[i] ) {
+            if ( w < m.up_cost[a] ) {
+                m.up_cost[a] = w;
+                m.up_edge[a] = i;
+            }
+        }
+        else if ( w < m.down_cost[a] ) {
+            m.down_cost[a] = w;
+            m.down_edge[a] = i;
+        }
+    }
+
+    // Lower triangles: an arc (u,v) may be replaced by a path through a lower vertex w linked to both.
+    // Arcs of w have been computed in a previous level
+    for ( size_t l = 0; l < num_levels(); l++ ) {
+        #pragma omp parallel for schedule(dynamic, 64)
+        for ( int i = int( level_first_[l] ); i < int( level_first_[l + 1] ); i++ ) {
+            uint32_t u = level_vertices_[i];
+            for ( uint32_t k = first_down_arc_[u]; k < first_down_arc_[u + 1]; k++ ) {
+                uint32_t a_wu = down_arc_[k];
+                uint32_t w = arc_tail_[a_wu];
+                // common upper neighbours of w and u, both lists are sorted by head
+                uint32_t a_wv = a_wu + 1;
+                uint32_t a_uv = first_arc_[u];
+                while ( a_wv < first_arc_[w + 1] && a_uv < first_arc_[u + 1] ) {
+                    if ( arc_head_[a_wv] < arc_head_[a_uv] ) {
+                        a_wv++;
+                    }
+                    else if ( arc_head_[a_uv] < arc_head_[a_wv] ) {
+                        a_uv++;
+                    }
+                    else {
+                        // u -> w -> v
+                        uint32_t c = add_costs( m.down_cost[a_wu], m.up_cost[a_wv] );
+                        if ( c < m.up_cost[a_uv] ) {
+                            m.up_cost[a_uv] = c;
+                            m.up_middle[a_uv] = w;
+                        }
+                        // v -> w -> u
+                        c = add_costs( m.down_cost[a_wv], m.up_cost[a_wu] );
+                        if ( c < m.down_cost[a_uv] ) {
+                            m.down_cost[a_uv] = c;
+                            m.down_middle[a_uv] = w;
+                        }
+                        a_wv++;
+                        a_uv++;
+                    }
+                }
+            }
+        }
+    }
+
+    return m;
+}
+
+} // namespace Tempus
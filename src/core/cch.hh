@@ -0,0 +1,139 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_CCH_HH
+#define TEMPUS_CCH_HH
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include <boost/optional.hpp>
+
+namespace Tempus
+{
+
+//
+// Customizable Contraction Hierarchies.
+//
+// The preprocessing is split in two phases:
+// - a metric-independent phase: a node ordering computed by nested dissection, then the
+//   contraction of the graph without witness search, which gives the CCHTopology;
+// - a customization phase that computes the costs of the arcs of the topology from the costs
+//   of the input edges. It only depends on the number of arcs and can be run again for each metric.
+//
+// Vertices of a CCHTopology are numbered by rank. Each arc links a lower vertex to an upper vertex and
+// has a cost in both directions, so that a customized topology is a regular CH query graph.
+
+///
+/// Metric-independent node ordering by recursive nested dissection.
+/// Each part of the graph is cut along a level of a breadth-first search started from a
+/// pseudo-peripheral vertex, so that the level splits the part in halves.
+/// Vertices of the cut are ranked after the two halves, they are then contracted last.
+/// \param n_vertices Number of vertices
+/// \param edges Edges of the graph, their direction is ignored
+/// \returns the vertices, by increasing rank
+std::vector<uint32_t> cch_nested_dissection_order( uint32_t n_vertices, const std::vector<std::pair<uint32_t, uint32_t>>& edges );
+
+///
+/// Costs of the arcs of a CCHTopology, for a given metric
+struct CCHMetric
+{
+    /// Cost of a forbidden or unreachable arc
+    static uint32_t infinity() { return 0x7FFFFFFF; }
+
+    /// Value of up_middle / down_middle for arcs whose cost is the one of an input edge
+    static uint32_t no_middle() { return 0xFFFFFFFF; }
+
+    /// Cost of each arc, from its lower to its upper vertex
+    std::vector<uint32_t> up_cost;
+    /// Cost of each arc, from its upper to its lower vertex
+    std::vector<uint32_t> down_cost;
+
+    /// Middle vertex of the shortcut, or no_middle()
+    std::vector<uint32_t> up_middle;
+    std::vector<uint32_t> down_middle;
+
+    /// Input edge the cost comes from, when the arc is not a shortcut
+    std::vector<uint32_t> up_edge;
+    std::vector<uint32_t> down_edge;
+};
+
+///
+/// Metric-independent part of a CCH: the input graph augmented with every shortcut
+/// that a contraction without witness search would add.
+class CCHTopology
+{
+public:
+    ///
+    /// Contract a graph
+    /// \param n_vertices Number of vertices, numbered by rank
+    /// \param edges Input edges (tail, head). Parallel edges and loops are allowed.
+    CCHTopology( uint32_t n_vertices, const std::vector<std::pair<uint32_t, uint32_t>>& edges );
+
+    uint32_t num_vertices() const { return n_vertices_; }
+
+    size_t num_arcs() const { return arc_head_.size(); }
+
+    size_t num_input_edges() const { return input_arc_.size(); }
+
+    ///
+    /// Arcs of u to its upper neighbours are numbered from first_arc(u) to first_arc(u+1) excluded,
+    /// by increasing head
+    uint32_t first_arc( uint32_t u ) const { return first_arc_[u]; }
+
+    uint32_t arc_tail( uint32_t a ) const { return arc_tail_[a]; }
+
+    uint32_t arc_head( uint32_t a ) const { return arc_head_[a]; }
+
+    ///
+    /// Arc linking two vertices, if any
+    boost::optional<uint32_t> find_arc( uint32_t u, uint32_t v ) const;
+
+    ///
+    /// Number of levels of the elimination tree, i.e. number of sequential steps of a customization
+    size_t num_levels() const { return level_first_.size() - 1; }
+
+    ///
+    /// Compute arc costs from the costs of the input edges.
+    /// Vertices of the same level of the elimination tree are processed in parallel.
+    /// \param weights Cost of each input edge, CCHMetric::infinity() for a forbidden edge
+    CCHMetric customize( const std::vector<uint32_t>& weights ) const;
+
+private:
+    uint32_t n_vertices_;
+
+    // upward arcs, by tail
+    std::vector<uint32_t> first_arc_;
+    std::vector<uint32_t> arc_tail_;
+    std::vector<uint32_t> arc_head_;
+
+    // arcs coming from lower neighbours, by head then by increasing tail
+    std::vector<uint32_t> first_down_arc_;
+    std::vector<uint32_t> down_arc_;
+
+    // arc of each input edge, or no_arc for loops
+    std::vector<uint32_t> input_arc_;
+    std::vector<bool> input_upward_;
+
+    // vertices sorted by level
+    std::vector<uint32_t> level_first_;
+    std::vector<uint32_t> level_vertices_;
+};
+
+} // namespace Tempus
+
+#endif
@@ -0,0 +1,460 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ch_customizer.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+
+namespace Tempus
+{
+
+static const uint32_t no_arc = 0xFFFFFFFF;
+
+// saturated sum of costs
+static uint32_t add_costs( uint32_t a, uint32_t b )
+{
+    return uint32_t( std::min<uint64_t>( uint64_t( a ) + b, CCHMetric::infinity() ) );
+}
+
+std::vector<CHCostChange> read_ch_cost_changes( std::istream& istr )
+{
+    std::vector<CHCostChange> changes;
+    std::string line;
+    size_t line_number = 0;
+    while ( std::getline( istr, line ) ) {
+        line_number++;
+        std::istringstream fields( line );
+        std::string id, cost, extra;
+        if ( !( fields >> id ) || id[0] == '#' ) {
+            continue;
+        }
+        CHCostChange change;
+        try {
+            size_t end = 0;
+            change.db_id = std::stoull( id, &end );
+            if ( end != id.size() || !( fields >> cost ) || fields >> extra ) {
+                throw std::invalid_argument( id );
+            }
+            if ( cost == "closed" ) {
+                change.cost = CCHMetric::infinity();
+            }
+            else {
+                const unsigned long long c = std::stoull( cost, &end );
+                if ( end != cost.size() || c >= CCHMetric::infinity() ) {
+                    throw std::invalid_argument( cost );
+                }
+                change.cost = uint32_t( c );
+            }
+        }
+        catch ( std::logic_error& ) {
+            throw std::runtime_error( (boost::format( "Line %1%: <section id> <cost> or <section id> closed expected" ) % line_number).str() );
+        }
+        changes.push_back( change );
+    }
+    return changes;
+}
+
+CHCustomizer::CHCustomizer( const CHQuery& graph ) : n_vertices_( uint32_t( num_vertices( graph ) ) )
+{
+    // both directions of the edges between a vertex and its upper neighbours, gathered by neighbour
+    first_arc_.push_back( 0 );
+    for ( CHVertex w = 0; w < n_vertices_; w++ ) {
+        std::map<CHVertex, std::pair<uint32_t, uint32_t>> upper;
+        for ( auto oei = out_edges( w, graph ).first; oei != out_edges( w, graph ).second; oei++ ) {
+            upper.insert( std::make_pair( target( *oei, graph ), std::make_pair( no_arc, no_arc ) ) ).first->second.first = graph.edge_index( *oei );
+        }
+        for ( auto iei = in_edges( w, graph ).first; iei != in_edges( w, graph ).second; iei++ ) {
+            upper.insert( std::make_pair( source( *iei, graph ), std::make_pair( no_arc, no_arc ) ) ).first->second.second = graph.edge_index( *iei );
+        }
+        for ( const auto& u : upper ) {
+            const uint32_t a = uint32_t( arc_upper_.size() );
+            arc_lower_.push_back( w );
+            arc_upper_.push_back( u.first );
+            const uint32_t edges[2] = { u.second.first, u.second.second };
+            for ( uint32_t d = 0; d < 2; d++ ) {
+                input_cost_.push_back( CCHMetric::infinity() );
+                input_db_id_.push_back( 0 );
+                cost_.push_back( CCHMetric::infinity() );
+                middle_.push_back( CCHMetric::no_middle() );
+                if ( edges[d] == no_arc ) {
+                    continue;
+                }
+                cost_.back() = graph.edge_property( edges[d] ).b.cost;
+                if ( graph.edge_property( edges[d] ).b.is_shortcut ) {
+                    middle_.back() = graph.edge_details( edges[d] ).middle;
+                }
+                else {
+                    input_cost_.back() = cost_.back();
+                    input_db_id_.back() = graph.edge_details( edges[d] ).db_id;
+                    section_edges_.push_back( std::make_pair( input_db_id_.back(), 2 * a + d ) );
+                }
+            }
+        }
+        first_arc_.push_back( uint32_t( arc_upper_.size() ) );
+    }
+    std::sort( section_edges_.begin(), section_edges_.end() );
+    base_input_cost_ = input_cost_;
+
+    // a shortcut must be made of the edges from and to its middle vertex
+    for ( uint32_t a = 0; a < arc_upper_.size(); a++ ) {
+        for ( uint32_t d = 0; d < 2; d++ ) {
+            const uint32_t m = middle_[2 * a + d];
+            if ( m != CCHMetric::no_middle() && ( m >= arc_lower_[a] || find_arc_( m, arc_lower_[a] ) == no_arc || find_arc_( m, arc_upper_[a] ) == no_arc ) ) {
+                throw std::invalid_argument( (boost::format( "CHCustomizer: inconsistent shortcut %1% -> %2% -> %3%" )
+                                              % arc_lower_[a] % m % arc_upper_[a]).str() );
+            }
+        }
+    }
+
+    // arcs by upper vertex
+    first_lower_arc_.assign( n_vertices_ + 1, 0 );
+    for ( uint32_t u : arc_upper_ ) {
+        first_lower_arc_[u + 1]++;
+    }
+    for ( uint32_t v = 0; v < n_vertices_; v++ ) {
+        first_lower_arc_[v + 1] += first_lower_arc_[v];
+    }
+    lower_arc_.resize( arc_upper_.size() );
+    std::vector<uint32_t> next( first_lower_arc_.begin(), first_lower_arc_.end() - 1 );
+    // arcs are sorted by lower vertex, so are the lists
+    for ( uint32_t a = 0; a < arc_upper_.size(); a++ ) {
+        lower_arc_[next[arc_upper_[a]]++] = a;
+    }
+}
+
+uint32_t CHCustomizer::find_arc_( uint32_t u, uint32_t v ) const
+{
+    if ( u > v ) {
+        std::swap( u, v );
+    }
+    auto b = arc_upper_.begin() + first_arc_[u];
+    auto e = arc_upper_.begin() + first_arc_[u + 1];
+    auto it = std::lower_bound( b, e, v );
+    return it != e && *it == v ? uint32_t( it - arc_upper_.begin() ) : no_arc;
+}
+
+bool CHCustomizer::customize_arc_( uint32_t a )
+{
+    const uint32_t u = arc_lower_[a];
+    const uint32_t v = arc_upper_[a];
+    uint32_t up = input_cost_[2 * a], down = input_cost_[2 * a + 1];
+    uint32_t up_middle = CCHMetric::no_middle(), down_middle = CCHMetric::no_middle();
+
+    // common lower neighbours w of u and v, both lists are sorted by lower vertex
+    uint32_t i = first_lower_arc_[u], j = first_lower_arc_[v];
+    while ( i < first_lower_arc_[u + 1] && j < first_lower_arc_[v + 1] ) {
+        const uint32_t a_wu = lower_arc_[i];
+        const uint32_t a_wv = lower_arc_[j];
+        if ( arc_lower_[a_wu] < arc_lower_[a_wv] ) {
+            i++;
+        }
+        else if ( arc_lower_[a_wv] < arc_lower_[a_wu] ) {
+            j++;
+        }
+        else {
+            // u -> w -> v
+            uint32_t c = add_costs( cost_[2 * a_wu + 1], cost_[2 * a_wv] );
+            if ( c < up ) {
+                up = c;
+                up_middle = arc_lower_[a_wu];
+            }
+            // v -> w -> u
+            c = add_costs( cost_[2 * a_wv + 1], cost_[2 * a_wu] );
+            if ( c < down ) {
+                down = c;
+                down_middle = arc_lower_[a_wu];
+            }
+            i++;
+            j++;
+        }
+    }
+
+    const bool changed = up != cost_[2 * a] || down != cost_[2 * a + 1];
+    cost_[2 * a] = up;
+    cost_[2 * a + 1] = down;
+    middle_[2 * a] = up_middle;
+    middle_[2 * a + 1] = down_middle;
+    return changed;
+}
+
+CHCustomizationStatistics CHCustomizer::update( const std::vector<CHCostChange>& changes )
+{
+    CHCustomizationStatistics stats;
+    std::vector<uint32_t> input_cost( input_cost_ );
+    apply_changes_( changes, input_cost, stats );
+    customize_( input_cost, stats );
+    return stats;
+}
+
+CHCustomizationStatistics CHCustomizer::replace( const std::vector<CHCostChange>& changes )
+{
+    CHCustomizationStatistics stats;
+    std::vector<uint32_t> input_cost( base_input_cost_ );
+    apply_changes_( changes, input_cost, stats );
+    customize_( input_cost, stats );
+    return stats;
+}
+
+void CHCustomizer::apply_changes_( const std::vector<CHCostChange>& changes, std::vector<uint32_t>& input_cost, CHCustomizationStatistics& stats ) const
+{
+    for ( const CHCostChange& change : changes ) {
+        auto it = std::lower_bound( section_edges_.begin(), section_edges_.end(), std::make_pair( change.db_id, uint32_t( 0 ) ) );
+        if ( it == section_edges_.end() || it->first != change.db_id ) {
+            stats.unknown_sections++;
+            continue;
+        }
+        for ( ; it != section_edges_.end() && it->first == change.db_id; it++ ) {
+            input_cost[it->second] = std::min( change.cost, CCHMetric::infinity() );
+        }
+    }
+}
+
+void CHCustomizer::customize_( const std::vector<uint32_t>& input_cost, CHCustomizationStatistics& stats )
+{
+    // arcs to compute again, by lowest vertex: the arcs of a lower triangle are computed before the upper arc
+    typedef std::pair<uint32_t, uint32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    std::vector<bool> queued( arc_upper_.size(), false );
+    auto push = [&]( uint32_t a ) {
+        if ( !queued[a] ) {
+            queued[a] = true;
+            queue.push( Entry( arc_lower_[a], a ) );
+        }
+    };
+
+    // only original edges may have a finite input cost
+    for ( const auto& section_edge : section_edges_ ) {
+        const uint32_t e = section_edge.second;
+        if ( input_cost_[e] != input_cost[e] ) {
+            input_cost_[e] = input_cost[e];
+            stats.changed_edges++;
+            push( e / 2 );
+        }
+    }
+
+    while ( !queue.empty() ) {
+        const uint32_t a = queue.top().second;
+        queue.pop();
+        queued[a] = false;
+        stats.customized_arcs++;
+        const uint32_t before[2] = { cost_[2 * a], cost_[2 * a + 1] };
+        if ( !customize_arc_( a ) ) {
+            continue;
+        }
+        stats.updated_edges += ( before[0] != cost_[2 * a] ) + ( before[1] != cost_[2 * a + 1] );
+
+        // upper arcs of the triangles a is a lower arc of: w is the lower vertex of a, u its upper vertex,
+        // v any other upper neighbour of w
+        const uint32_t w = arc_lower_[a];
+        const uint32_t u = arc_upper_[a];
+        for ( uint32_t a_wv = first_arc_[w]; a_wv < first_arc_[w + 1]; a_wv++ ) {
+            const uint32_t v = arc_upper_[a_wv];
+            if ( v == u ) {
+                continue;
+            }
+            const uint32_t a_uv = find_arc_( u, v );
+            if ( a_uv != no_arc ) {
+                push( a_uv );
+            }
+        }
+    }
+}
+
+std::unique_ptr<CHQuery> CHCustomizer::query_graph() const
+{
+    typedef CHQuery::FirstEdgeIndex FirstEdgeIndex;
+    typedef CHQuery::EdgeData EdgeData;
+
+    // index of each directed edge in the new graph, upward edges of a vertex then its downward edges
+    std::vector<uint32_t> new_index( cost_.size(), no_arc );
+    std::vector<FirstEdgeIndex> edge_index( n_vertices_ + 1 );
+    uint32_t n_edges = 0;
+    for ( uint32_t w = 0; w < n_vertices_; w++ ) {
+        for ( uint32_t d = 0; d < 2; d++ ) {
+            ( d == 0 ? edge_index[w].first_upward_edge : edge_index[w].first_downward_edge ) = n_edges;
+            for ( uint32_t a = first_arc_[w]; a < first_arc_[w + 1]; a++ ) {
+                if ( cost_[2 * a + d] < CCHMetric::infinity() ) {
+                    new_index[2 * a + d] = n_edges++;
+                }
+            }
+        }
+    }
+    edge_index[n_vertices_].first_upward_edge = n_edges;
+    edge_index[n_vertices_].first_downward_edge = n_edges;
+
+    std::vector<EdgeData> edges( n_edges );
+    std::vector<CHEdgeDetails> details( n_edges );
+    // no garbage in the padding bytes, that are written as is to flat files
+    if ( n_edges > 0 ) {
+        std::memset( &edges[0], 0, sizeof( EdgeData ) * edges.size() );
+        std::memset( &details[0], 0, sizeof( CHEdgeDetails ) * details.size() );
+    }
+    for ( uint32_t a = 0; a < arc_upper_.size(); a++ ) {
+        for ( uint32_t d = 0; d < 2; d++ ) {
+            const uint32_t i = new_index[2 * a + d];
+            if ( i == no_arc ) {
+                continue;
+            }
+            const uint32_t m = middle_[2 * a + d];
+            edges[i].target = arc_upper_[a];
+            edges[i].property.b.cost = cost_[2 * a + d];
+            edges[i].property.b.is_shortcut = m != CCHMetric::no_middle();
+            if ( m == CCHMetric::no_middle() ) {
+                details[i].db_id = input_db_id_[2 * a + d];
+                continue;
+            }
+            // from the lower vertex: lower -> m -> upper, from the upper vertex: upper -> m -> lower
+            const uint32_t a_lower = find_arc_( m, arc_lower_[a] );
+            const uint32_t a_upper = find_arc_( m, arc_upper_[a] );
+            details[i].middle = m;
+            details[i].unpack.first = new_index[d == 0 ? 2 * a_lower + 1 : 2 * a_upper + 1];
+            details[i].unpack.second = new_index[d == 0 ? 2 * a_upper : 2 * a_lower];
+        }
+    }
+
+    return std::unique_ptr<CHQuery>( new CHQuery( FlatArray<FirstEdgeIndex>( std::move( edge_index ) ),
+                                                  FlatArray<EdgeData>( std::move( edges ) ),
+                                                  FlatArray<CHEdgeDetails>( std::move( details ) ) ) );
+}
+
+CHGraphVersions::CHGraphVersions( const CHRoutingData& rd, size_t unpack_cache_size )
+    : rd_( rd ), unpack_cache_size_( unpack_cache_size )
+{
+    // the graphs are owned by the routing data
+    std::vector<std::string> metrics = rd_.metric_names();
+    metrics.push_back( rd_.default_metric_name() );
+    for ( const std::string& metric : metrics ) {
+        std::shared_ptr<CHGraphVersion> version( new CHGraphVersion );
+        version->graph.reset( &rd_.ch_query( metric ), []( const CHQuery* ) {} );
+        if ( unpack_cache_size_ ) {
+            version->unpack_cache.reset( new CHUnpackCache( unpack_cache_size_ ) );
+        }
+        versions_[metric] = version;
+    }
+}
+
+std::string CHGraphVersions::metric_key( const std::string& metric ) const
+{
+    if ( metric.empty() ) {
+        return rd_.default_metric_name();
+    }
+    if ( versions_.find( metric ) == versions_.end() ) {
+        throw std::invalid_argument( "Unknown metric " + metric );
+    }
+    return metric;
+}
+
+std::shared_ptr<const CHGraphVersion> CHGraphVersions::current( const std::string& metric ) const
+{
+    return std::atomic_load( &versions_.find( metric_key( metric ) )->second );
+}
+
+void CHGraphVersions::set_hub_labels( std::shared_ptr<const CHHubLabels> labels )
+{
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    const std::string key = metric_key( labels->metric() );
+    std::shared_ptr<const CHGraphVersion> current_version = current( key );
+    if ( labels->fingerprint() != ch_hub_label_fingerprint( *current_version->graph ) ) {
+        throw std::runtime_error( "The hub labels have not been computed on the graph of metric " + key );
+    }
+    std::shared_ptr<CHGraphVersion> version( new CHGraphVersion );
+    version->graph = current_version->graph;
+    if ( unpack_cache_size_ ) {
+        version->unpack_cache.reset( new CHUnpackCache( unpack_cache_size_ ) );
+    }
+    version->hub_labels = labels;
+    version->changed_costs = current_version->changed_costs;
+    std::atomic_store( &versions_.find( key )->second, std::shared_ptr<const CHGraphVersion>( version ) );
+}
+
+CHCustomizationStatistics CHGraphVersions::update_costs( const std::string& metric, const std::vector<CHCostChange>& changes )
+{
+    return customize_( metric, changes, false );
+}
+
+CHCustomizationStatistics CHGraphVersions::replace_costs( const std::string& metric, const std::vector<CHCostChange>& changes )
+{
+    return customize_( metric, changes, true );
+}
+
+CHCustomizationStatistics CHGraphVersions::customize_( const std::string& metric, const std::vector<CHCostChange>& changes, bool replace )
+{
+    std::lock_guard<std::mutex> lock( update_mutex_ );
+    const std::string key = metric_key( metric );
+    std::unique_ptr<CHCustomizer>& customizer = customizers_[key];
+    if ( !customizer ) {
+        customizer.reset( new CHCustomizer( *current( key )->graph ) );
+    }
+    CHCustomizationStatistics stats = replace ? customizer->replace( changes ) : customizer->update( changes );
+
+    // hub labels are not valid anymore, the new version has none
+    std::shared_ptr<CHGraphVersion> version( new CHGraphVersion );
+    version->graph.reset( customizer->query_graph().release() );
+    if ( !replace ) {
+        version->changed_costs = current( key )->changed_costs;
+    }
+    for ( const CHCostChange& change : changes ) {
+        version->changed_costs[change.db_id] = change.cost;
+    }
+    if ( unpack_cache_size_ ) {
+        version->unpack_cache.reset( new CHUnpackCache( unpack_cache_size_ ) );
+    }
+    std::atomic_store( &versions_.find( key )->second, std::shared_ptr<const CHGraphVersion>( version ) );
+    return stats;
+}
+
+CHCostChangesFile::CHCostChangesFile( const std::string& filename, const std::string& metric )
+    : filename_( filename ), metric_( metric ), applied_( false ), hash_( 0 )
+{
+}
+
+bool CHCostChangesFile::update_if_modified( CHGraphVersions& versions, CHCustomizationStatistics& stats )
+{
+    std::lock_guard<std::mutex> lock( mutex_ );
+    // the modification time may only have a one second resolution, a file rewritten within the same second
+    // with the same size would be missed: the contents are compared
+    std::ifstream file( filename_ );
+    if ( !file ) {
+        throw std::runtime_error( "Cannot open " + filename_ );
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    if ( file.bad() ) {
+        throw std::runtime_error( "Cannot read " + filename_ );
+    }
+    const size_t hash = std::hash<std::string>()( contents.str() );
+    if ( applied_ && hash == hash_ ) {
+        return false;
+    }
+    applied_ = false;
+    std::istringstream changes( contents.str() );
+    stats = versions.replace_costs( metric_, read_ch_cost_changes( changes ) );
+    applied_ = true;
+    hash_ = hash;
+    return true;
+}
+
+} // namespace Tempus
@@ -0,0 +1,228 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_CH_CUSTOMIZER_HH
+#define TEMPUS_CH_CUSTOMIZER_HH
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <istream>
+
+#include "ch_routing_data.hh"
+#include "ch_hub_labels.hh"
+
+namespace Tempus
+{
+
+//
+// Partial re-customization of a CH query graph after changes of the costs of some road sections
+// (closures, traffic incidents), without running the contraction again.
+//
+// The edges of the graph are seen as the arcs of a CCH topology (see cch.hh): the cost of an arc is the lowest
+// of the cost of its road section, if any, and of the costs of its lower triangles, i.e. of the paths
+// through a lower vertex linked to both ends. Only the arcs that depend on a changed section are computed again,
+// by increasing lowest vertex.
+//
+// Costs are exact on graphs built as a CCH (ch_preprocess --cch), where every lower triangle is an edge.
+// On a CH built with witness searches, each edge keeps the cost of an actual path, but a query may miss
+// a shortest path that needs a shortcut the contraction has not added.
+//
+// Edges of the query graph cannot be added: a section can only be updated if it is an original edge of the
+// graph, and an arc closed by the customization of a CCH metric cannot be opened again.
+
+///
+/// New cost of a road section, in the integer unit of the query graph
+struct CHCostChange
+{
+    db_id_t db_id;
+    /// CCHMetric::infinity() closes the section
+    uint32_t cost;
+};
+
+///
+/// Read cost changes from a text stream, one "<section id> <cost>" per line, the cost being an integer
+/// or "closed". Empty lines and lines starting with # are ignored.
+/// Throws std::runtime_error on a line that cannot be read
+std::vector<CHCostChange> read_ch_cost_changes( std::istream& istr );
+
+struct CHCustomizationStatistics
+{
+    /// Number of original edges whose cost has been changed
+    size_t changed_edges = 0;
+    /// Number of sections that are not an original edge of the graph
+    size_t unknown_sections = 0;
+    /// Number of arcs whose costs have been computed again
+    size_t customized_arcs = 0;
+    /// Number of edges whose cost is not the same anymore, shortcuts included
+    size_t updated_edges = 0;
+};
+
+///
+/// Costs of the edges of a CH query graph, that can be updated
+class CHCustomizer
+{
+public:
+    ///
+    /// Customizer of the costs of a graph, whose shortcuts are linked to their edges (see link_ch_shortcuts()).
+    /// Throws std::invalid_argument if a shortcut is not made of edges of the graph
+    explicit CHCustomizer( const CHQuery& graph );
+
+    ///
+    /// Apply cost changes, then compute again the arcs that depend on them.
+    /// Changes are cumulative: a section keeps its last cost until it is changed again
+    CHCustomizationStatistics update( const std::vector<CHCostChange>& changes );
+
+    ///
+    /// Apply a complete set of cost changes: the sections that are not changed get back their base cost,
+    /// the one of the graph the customizer has been built with. Then compute again the arcs that depend on them
+    CHCustomizationStatistics replace( const std::vector<CHCostChange>& changes );
+
+    ///
+    /// Query graph of the current costs, with its shortcuts linked. Closed edges are not part of it
+    std::unique_ptr<CHQuery> query_graph() const;
+
+private:
+    // compute both costs of an arc from its sections and its lower triangles, returns whether one of them has changed
+    bool customize_arc_( uint32_t a );
+
+    // set the input costs of the edges to these ones, then compute again the arcs that depend on the changed ones
+    void customize_( const std::vector<uint32_t>& input_cost, CHCustomizationStatistics& stats );
+
+    // set the costs of the edges of the changed sections in input_cost
+    void apply_changes_( const std::vector<CHCostChange>& changes, std::vector<uint32_t>& input_cost, CHCustomizationStatistics& stats ) const;
+
+    // arc between two vertices, no_arc if none
+    uint32_t find_arc_( uint32_t u, uint32_t v ) const;
+
+    uint32_t n_vertices_;
+
+    // arcs to upper vertices, by lower vertex then by increasing upper vertex
+    std::vector<uint32_t> first_arc_;
+    std::vector<uint32_t> arc_lower_;
+    std::vector<uint32_t> arc_upper_;
+
+    // arcs from lower vertices, by upper vertex then by increasing lower vertex
+    std::vector<uint32_t> first_lower_arc_;
+    std::vector<uint32_t> lower_arc_;
+
+    // directed edges of the arcs: 2a from the lower vertex to the upper one, 2a + 1 from the upper one to the lower one
+    std::vector<uint32_t> input_cost_;
+    // input costs of the graph the customizer has been built with
+    std::vector<uint32_t> base_input_cost_;
+    std::vector<db_id_t> input_db_id_;
+    std::vector<uint32_t> cost_;
+    // middle vertex of a shortcut, CCHMetric::no_middle() if the cost is the one of the section
+    std::vector<uint32_t> middle_;
+
+    // (section, directed edge), sorted by section
+    std::vector<std::pair<db_id_t, uint32_t>> section_edges_;
+};
+
+///
+/// Published version of the query graph of a metric, with the cache of its unpacked shortcuts.
+/// A request keeps the version it has started with, so that costs can be updated while it runs
+struct CHGraphVersion
+{
+    std::shared_ptr<const CHQuery> graph;
+    /// null if unpack caches are not used
+    std::unique_ptr<CHUnpackCache> unpack_cache;
+    /// Hub labels of the graph, null if none have been set or if the costs have been updated
+    std::shared_ptr<const CHHubLabels> hub_labels;
+    /// Costs of the road sections changed since the graphs have been loaded, by section (see CHCostChange)
+    std::map<db_id_t, uint32_t> changed_costs;
+};
+
+///
+/// Current version of the query graph of each metric of a routing data.
+/// Versions are read and replaced atomically, cost updates publish a new version of a metric.
+class CHGraphVersions
+{
+public:
+    ///
+    /// First versions: the graphs of the routing data, that must outlive this object
+    /// \param unpack_cache_size Size of the unpack cache of each version, 0 for none
+    CHGraphVersions( const CHRoutingData& rd, size_t unpack_cache_size );
+
+    ///
+    /// Name of a metric, the default one if the name is empty.
+    /// Throws std::invalid_argument on an unknown metric
+    std::string metric_key( const std::string& metric ) const;
+
+    ///
+    /// Current version of the graph of a metric.
+    /// Throws std::invalid_argument on an unknown metric
+    std::shared_ptr<const CHGraphVersion> current( const std::string& metric ) const;
+
+    ///
+    /// Publish a version of the graph of the metric of hub labels, with these labels.
+    /// Throws std::runtime_error if they have not been computed on this graph
+    void set_hub_labels( std::shared_ptr<const CHHubLabels> labels );
+
+    ///
+    /// Update the costs of road sections of a metric (see CHCustomizer), then publish the new version of its graph.
+    /// Concurrent updates are serialized.
+    /// Throws std::invalid_argument on an unknown metric
+    CHCustomizationStatistics update_costs( const std::string& metric, const std::vector<CHCostChange>& changes );
+
+    ///
+    /// Replace all the cost changes of a metric by these ones (see CHCustomizer::replace()), then publish the new version of its graph.
+    /// Throws std::invalid_argument on an unknown metric
+    CHCustomizationStatistics replace_costs( const std::string& metric, const std::vector<CHCostChange>& changes );
+
+private:
+    // update or replace the costs of a metric, then publish its new version
+    CHCustomizationStatistics customize_( const std::string& metric, const std::vector<CHCostChange>& changes, bool replace );
+
+    const CHRoutingData& rd_;
+    size_t unpack_cache_size_;
+    // keys are set by the constructor, values are read and replaced atomically
+    std::map<std::string, std::shared_ptr<const CHGraphVersion>> versions_;
+    // customizers of the updated metrics
+    std::map<std::string, std::unique_ptr<CHCustomizer>> customizers_;
+    std::mutex update_mutex_;
+};
+
+///
+/// File of cost changes of a metric (see read_ch_cost_changes()), applied again each time it is modified.
+/// The file is the complete set of changes: a section whose line is removed gets back its base cost (see CHGraphVersions::replace_costs())
+class CHCostChangesFile
+{
+public:
+    CHCostChangesFile( const std::string& filename, const std::string& metric );
+
+    const std::string& filename() const { return filename_; }
+
+    ///
+    /// Apply the changes of the file to versions if its contents have changed since the last call.
+    /// The file is read at each call, a hash of its contents is compared with the one of the applied changes.
+    /// \returns whether the changes have been applied
+    /// Throws std::runtime_error if the file cannot be read, the changes are then applied again on the next call
+    bool update_if_modified( CHGraphVersions& versions, CHCustomizationStatistics& stats );
+
+private:
+    std::string filename_;
+    std::string metric_;
+    std::mutex mutex_;
+    bool applied_;
+    // hash of the contents of the applied file
+    size_t hash_;
+};
+
+} // namespace Tempus
+
+#endif
@@ -0,0 +1,448 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+#include <boost/format.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ch_hub_labels.hh"
+#include "utils/timer.hh"
+
+namespace Tempus
+{
+
+CHHubLabelFingerprint ch_hub_label_fingerprint( const CHQuery& graph )
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash]( uint64_t x ) {
+        for ( int i = 0; i < 8; i++ ) {
+            hash ^= ( x >> ( 8 * i ) ) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    const size_t n = graph.num_vertices();
+    for ( CHVertex v = 0; v < n; v++ ) {
+        add( v );
+        auto oe = graph.out_edges( v );
+        for ( auto it = oe.first; it != oe.second; it++ ) {
+            add( it->target() );
+            add( it->property().b.cost );
+        }
+        auto ie = graph.in_edges( v );
+        for ( auto it = ie.first; it != ie.second; it++ ) {
+            add( it->source() );
+            add( it->property().b.cost );
+        }
+    }
+    CHHubLabelFingerprint fp;
+    fp.num_vertices = n;
+    fp.num_edges = graph.edge_array().size();
+    fp.hash = hash;
+    return fp;
+}
+
+CHHubLabels::CHHubLabels( const std::string& metric,
+                          const CHHubLabelFingerprint& fingerprint,
+                          FlatArray<uint64_t>&& forward_index,
+                          FlatArray<CHHubLabelEntry>&& forward,
+                          FlatArray<uint64_t>&& backward_index,
+                          FlatArray<CHHubLabelEntry>&& backward ) :
+    metric_( metric ),
+    fingerprint_( fingerprint ),
+    forward_index_( std::move( forward_index ) ),
+    forward_( std::move( forward ) ),
+    backward_index_( std::move( backward_index ) ),
+    backward_( std::move( backward ) )
+{
+    if ( forward_index_.empty() || forward_index_.size() != backward_index_.size() ) {
+        throw std::invalid_argument( "Hub labels: forward and backward labels have different numbers of vertices" );
+    }
+    if ( forward_index_[forward_index_.size() - 1] != forward_.size() || backward_index_[backward_index_.size() - 1] != backward_.size() ) {
+        throw std::invalid_argument( "Hub labels: inconsistent label index" );
+    }
+}
+
+namespace
+{
+
+typedef std::vector<CHHubLabelEntry> Label;
+
+struct LabelArrays
+{
+    std::vector<uint64_t> forward_index;
+    std::vector<CHHubLabelEntry> forward;
+    std::vector<uint64_t> backward_index;
+    std::vector<CHHubLabelEntry> backward;
+};
+
+void flatten_labels( const std::vector<Label>& labels, std::vector<uint64_t>& index, std::vector<CHHubLabelEntry>& entries )
+{
+    index.resize( labels.size() + 1 );
+    index[0] = 0;
+    for ( size_t v = 0; v < labels.size(); v++ ) {
+        index[v + 1] = index[v] + labels[v].size();
+    }
+    entries.clear();
+    entries.reserve( index.back() );
+    for ( const Label& l : labels ) {
+        entries.insert( entries.end(), l.begin(), l.end() );
+    }
+}
+
+void write_labels( const std::string& filename,
+                   const std::string& metric,
+                   const CHHubLabelFingerprint& fingerprint,
+                   const uint64_t* forward_index, const CHHubLabelEntry* forward, size_t forward_size,
+                   const uint64_t* backward_index, const CHHubLabelEntry* backward, size_t backward_size,
+                   size_t n_vertices,
+                   const uint64_t* completed_levels = nullptr )
+{
+    std::ofstream ofs( filename, std::ios::binary );
+    if ( ofs.fail() ) {
+        throw std::runtime_error( "Problem opening output file " + filename );
+    }
+    FlatFileWriter writer;
+    writer.add( "hub_labels/metric", metric.data(), metric.size() );
+    writer.add( "hub_labels/fingerprint", &fingerprint, 1 );
+    writer.add( "hub_labels/forward_index", forward_index, n_vertices + 1 );
+    writer.add( "hub_labels/forward", forward, forward_size );
+    writer.add( "hub_labels/backward_index", backward_index, n_vertices + 1 );
+    writer.add( "hub_labels/backward", backward, backward_size );
+    if ( completed_levels ) {
+        writer.add( "hub_labels/completed_levels", completed_levels, 1 );
+    }
+    writer.write( ofs, 0 );
+    if ( ofs.fail() ) {
+        throw std::runtime_error( "Problem writing " + filename );
+    }
+}
+
+// Levels of the vertices, from the top of the hierarchy: a vertex is one level below the lowest of its upper neighbours
+void vertex_levels( const CHQuery& graph, std::vector<std::vector<CHVertex>>& level_vertices )
+{
+    const size_t n = graph.num_vertices();
+    std::vector<uint32_t> remaining_upper( n );
+    std::vector<uint64_t> lower_index( n + 1, 0 );
+    for ( CHVertex v = 0; v < n; v++ ) {
+        remaining_upper[v] = uint32_t( graph.out_degree( v ) + graph.in_degree( v ) );
+        auto oe = graph.out_edges( v );
+        for ( auto it = oe.first; it != oe.second; it++ ) {
+            lower_index[it->target() + 1]++;
+        }
+        auto ie = graph.in_edges( v );
+        for ( auto it = ie.first; it != ie.second; it++ ) {
+            lower_index[it->source() + 1]++;
+        }
+    }
+    for ( size_t v = 0; v < n; v++ ) {
+        lower_index[v + 1] += lower_index[v];
+    }
+    std::vector<CHVertex> lower( lower_index[n] );
+    std::vector<uint64_t> fill( lower_index.begin(), lower_index.end() - 1 );
+    for ( CHVertex v = 0; v < n; v++ ) {
+        auto oe = graph.out_edges( v );
+        for ( auto it = oe.first; it != oe.second; it++ ) {
+            lower[fill[it->target()]++] = v;
+        }
+        auto ie = graph.in_edges( v );
+        for ( auto it = ie.first; it != ie.second; it++ ) {
+            lower[fill[it->source()]++] = v;
+        }
+    }
+
+    std::vector<CHVertex> current;
+    for ( CHVertex v = 0; v < n; v++ ) {
+        if ( remaining_upper[v] == 0 ) {
+            current.push_back( v );
+        }
+    }
+    level_vertices.clear();
+    size_t processed = 0;
+    while ( !current.empty() ) {
+        std::vector<CHVertex> next;
+        for ( CHVertex u : current ) {
+            for ( uint64_t k = lower_index[u]; k < lower_index[u + 1]; k++ ) {
+                CHVertex v = lower[k];
+                if ( --remaining_upper[v] == 0 ) {
+                    next.push_back( v );
+                }
+            }
+        }
+        processed += current.size();
+        level_vertices.push_back( std::move( current ) );
+        current = std::move( next );
+    }
+    if ( processed != n ) {
+        throw std::invalid_argument( "Hub labels: the upward graph has a cycle" );
+    }
+}
+
+// Cost of the shortest path through the common hubs of a forward and a backward label
+uint32_t merge_distance( const Label& f, const Label& b )
+{
+    uint64_t best = CHHubLabels::infinity();
+    auto fi = f.begin();
+    auto bi = b.begin();
+    while ( fi != f.end() && bi != b.end() ) {
+        if ( fi->hub < bi->hub ) {
+            fi++;
+        }
+        else if ( bi->hub < fi->hub ) {
+            bi++;
+        }
+        else {
+            best = std::min( best, uint64_t( fi->cost ) + bi->cost );
+            fi++;
+            bi++;
+        }
+    }
+    return uint32_t( best );
+}
+
+// Lowest cost of each hub while a label is computed, one per thread
+struct LabelScratch
+{
+    explicit LabelScratch( size_t n ) : cost( n, CHHubLabels::infinity() ) {}
+    std::vector<uint32_t> cost;
+    std::vector<CHVertex> hubs;
+    Label candidates;
+};
+
+// Label of v from the labels of its upper neighbours, then pruned with the labels of the other direction of its hubs.
+// Returns the number of pruned entries
+template <typename EdgeRange, typename UpperVertex>
+size_t compute_label( CHVertex v, EdgeRange edges, UpperVertex upper, const std::vector<Label>& labels, const std::vector<Label>& other_labels, bool forward,
+                      LabelScratch& scratch, Label& label )
+{
+    // upper vertices may have many upper neighbours in common, hubs are merged in a dense array rather than sorted
+    scratch.hubs.clear();
+    scratch.hubs.push_back( v );
+    scratch.cost[v] = 0;
+    for ( auto it = edges.first; it != edges.second; it++ ) {
+        const uint64_t c = it->property().b.cost;
+        for ( const CHHubLabelEntry& e : labels[upper( *it )] ) {
+            const uint64_t d = c + e.cost;
+            if ( d < scratch.cost[e.hub] ) {
+                if ( scratch.cost[e.hub] == CHHubLabels::infinity() ) {
+                    scratch.hubs.push_back( e.hub );
+                }
+                scratch.cost[e.hub] = uint32_t( d );
+            }
+        }
+    }
+    std::sort( scratch.hubs.begin(), scratch.hubs.end() );
+    Label& candidates = scratch.candidates;
+    candidates.clear();
+    for ( CHVertex h : scratch.hubs ) {
+        candidates.push_back( CHHubLabelEntry{ h, scratch.cost[h] } );
+        scratch.cost[h] = CHHubLabels::infinity();
+    }
+
+    // an entry is not needed if there is a shorter path to its hub through another hub
+    label.clear();
+    label.reserve( candidates.size() );
+    for ( const CHHubLabelEntry& e : candidates ) {
+        if ( e.hub != v ) {
+            const uint32_t d = forward ? merge_distance( candidates, other_labels[e.hub] ) : merge_distance( other_labels[e.hub], candidates );
+            if ( d < e.cost ) {
+                continue;
+            }
+        }
+        label.push_back( e );
+    }
+    label.shrink_to_fit();
+    return candidates.size() - label.size();
+}
+
+// Labels of a checkpoint, returns the number of completed levels, 0 if the checkpoint cannot be used
+size_t load_checkpoint( const std::string& filename, const CHHubLabelFingerprint& fingerprint, std::vector<Label>& forward, std::vector<Label>& backward )
+{
+    if ( !std::ifstream( filename ).good() ) {
+        return 0;
+    }
+    std::unique_ptr<FlatFileReader> file;
+    try {
+        file.reset( new FlatFileReader( filename, 0 ) );
+    }
+    catch ( std::runtime_error& ) {
+        // probably interrupted while written, it will be overwritten
+        return 0;
+    }
+    if ( !file->has_section( "hub_labels/completed_levels" ) ) {
+        return 0;
+    }
+    FlatArray<CHHubLabelFingerprint> fp = file->section<CHHubLabelFingerprint>( "hub_labels/fingerprint" );
+    if ( fp.size() != 1 || fp[0] != fingerprint ) {
+        return 0;
+    }
+    auto load = [&file]( const std::string& name, std::vector<Label>& labels ) {
+        FlatArray<uint64_t> index = file->section<uint64_t>( "hub_labels/" + name + "_index" );
+        FlatArray<CHHubLabelEntry> entries = file->section<CHHubLabelEntry>( "hub_labels/" + name );
+        for ( size_t v = 0; v < labels.size(); v++ ) {
+            labels[v].assign( entries.begin() + index[v], entries.begin() + index[v + 1] );
+        }
+    };
+    load( "forward", forward );
+    load( "backward", backward );
+    return size_t( file->section<uint64_t>( "hub_labels/completed_levels" )[0] );
+}
+
+}
+
+std::unique_ptr<CHHubLabels> CHHubLabels::load( const std::string& filename )
+{
+    std::unique_ptr<FlatFileReader> file( new FlatFileReader( filename, 0 ) );
+    if ( !file->has_section( "hub_labels/forward" ) ) {
+        throw std::runtime_error( "No hub labels in " + filename );
+    }
+    if ( file->has_section( "hub_labels/completed_levels" ) ) {
+        throw std::runtime_error( filename + " is the checkpoint of an unfinished computation of hub labels" );
+    }
+    FlatArray<char> metric = file->section<char>( "hub_labels/metric" );
+    FlatArray<CHHubLabelFingerprint> fp = file->section<CHHubLabelFingerprint>( "hub_labels/fingerprint" );
+    if ( fp.size() != 1 ) {
+        throw std::runtime_error( "Invalid hub label fingerprint in " + filename );
+    }
+    std::unique_ptr<CHHubLabels> labels;
+    try {
+        labels.reset( new CHHubLabels( std::string( metric.begin(), metric.end() ),
+                                       fp[0],
+                                       file->section<uint64_t>( "hub_labels/forward_index" ),
+                                       file->section<CHHubLabelEntry>( "hub_labels/forward" ),
+                                       file->section<uint64_t>( "hub_labels/backward_index" ),
+                                       file->section<CHHubLabelEntry>( "hub_labels/backward" ) ) );
+    }
+    catch ( std::invalid_argument& e ) {
+        throw std::runtime_error( ( boost::format( "%1% in %2%" ) % e.what() % filename ).str() );
+    }
+    labels->file_ = std::move( file );
+    return labels;
+}
+
+void CHHubLabels::save( const std::string& filename ) const
+{
+    write_labels( filename, metric_, fingerprint_,
+                  forward_index_.data(), forward_.data(), forward_.size(),
+                  backward_index_.data(), backward_.data(), backward_.size(),
+                  num_vertices() );
+}
+
+std::unique_ptr<CHHubLabels> build_ch_hub_labels( const CHQuery& graph,
+                                                  const std::string& metric,
+                                                  CHHubLabelStatistics& stats,
+                                                  const std::string& checkpoint_file,
+                                                  double checkpoint_interval,
+                                                  ProgressionCallback& progression )
+{
+    Timer timer;
+    const size_t n = graph.num_vertices();
+    const CHHubLabelFingerprint fingerprint = ch_hub_label_fingerprint( graph );
+
+    std::vector<std::vector<CHVertex>> level_vertices;
+    vertex_levels( graph, level_vertices );
+    stats.levels = level_vertices.size();
+
+    std::vector<Label> forward( n ), backward( n );
+    size_t first_level = 0;
+    if ( !checkpoint_file.empty() ) {
+        first_level = std::min( load_checkpoint( checkpoint_file, fingerprint, forward, backward ), level_vertices.size() );
+    }
+    stats.resumed_levels = first_level;
+
+    auto write_checkpoint = [&]( uint64_t completed_levels ) {
+        LabelArrays arrays;
+        flatten_labels( forward, arrays.forward_index, arrays.forward );
+        flatten_labels( backward, arrays.backward_index, arrays.backward );
+        // the previous checkpoint is only replaced by a complete one
+        const std::string tmp_file = checkpoint_file + ".tmp";
+        write_labels( tmp_file, metric, fingerprint,
+                      arrays.forward_index.data(), arrays.forward.data(), arrays.forward.size(),
+                      arrays.backward_index.data(), arrays.backward.data(), arrays.backward.size(),
+                      n, &completed_levels );
+        if ( std::rename( tmp_file.c_str(), checkpoint_file.c_str() ) != 0 ) {
+            throw std::runtime_error( "Cannot rename " + tmp_file + " to " + checkpoint_file );
+        }
+    };
+
+    size_t done = 0;
+    for ( size_t l = 0; l < first_level; l++ ) {
+        done += level_vertices[l].size();
+    }
+    Timer checkpoint_timer;
+    size_t pruned = 0;
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    // allocated once, their cost arrays are restored after each label
+    std::vector<LabelScratch> scratches( num_threads, LabelScratch( n ) );
+    for ( size_t l = first_level; l < level_vertices.size(); l++ ) {
+        const std::vector<CHVertex>& vertices = level_vertices[l];
+        // upper vertices are on previous levels, their labels are complete
+        #pragma omp parallel reduction(+:pruned)
+        {
+            int thread_id = 0;
+#ifdef _OPENMP
+            thread_id = omp_get_thread_num();
+#endif
+            LabelScratch& scratch = scratches[thread_id];
+            #pragma omp for schedule(dynamic, 16)
+            for ( int i = 0; i < int( vertices.size() ); i++ ) {
+                const CHVertex v = vertices[i];
+                pruned += compute_label( v, graph.out_edges( v ), []( const CHQuery::edge_descriptor& e ) { return e.target(); },
+                                         forward, backward, true, scratch, forward[v] );
+                pruned += compute_label( v, graph.in_edges( v ), []( const CHQuery::edge_descriptor& e ) { return e.source(); },
+                                         backward, forward, false, scratch, backward[v] );
+            }
+        }
+        if ( !checkpoint_file.empty() && l + 1 < level_vertices.size() && checkpoint_timer.elapsed() >= checkpoint_interval ) {
+            write_checkpoint( l + 1 );
+            checkpoint_timer.restart();
+        }
+        done += vertices.size();
+        progression( float( done ) / float( n ) );
+    }
+    progression( 1.0, true );
+
+    LabelArrays arrays;
+    flatten_labels( forward, arrays.forward_index, arrays.forward );
+    flatten_labels( backward, arrays.backward_index, arrays.backward );
+    forward.clear();
+    backward.clear();
+    stats.forward_entries = arrays.forward.size();
+    stats.backward_entries = arrays.backward.size();
+    stats.pruned_entries = pruned;
+    stats.build_time = timer.elapsed();
+
+    if ( !checkpoint_file.empty() ) {
+        std::remove( checkpoint_file.c_str() );
+    }
+
+    return std::unique_ptr<CHHubLabels>( new CHHubLabels( metric, fingerprint,
+                                                          FlatArray<uint64_t>( std::move( arrays.forward_index ) ),
+                                                          FlatArray<CHHubLabelEntry>( std::move( arrays.forward ) ),
+                                                          FlatArray<uint64_t>( std::move( arrays.backward_index ) ),
+                                                          FlatArray<CHHubLabelEntry>( std::move( arrays.backward ) ) ) );
+}
+
+} // namespace Tempus
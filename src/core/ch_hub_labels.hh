@@ -0,0 +1,167 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_CH_HUB_LABELS_HH
+#define TEMPUS_CH_HUB_LABELS_HH
+
+#include <string>
+#include <memory>
+#include <limits>
+
+#include "ch_routing_data.hh"
+#include "flat_file.hh"
+#include "progression.hh"
+
+namespace Tempus
+{
+
+//
+// Hub labels derived from a CH query graph.
+//
+// The forward label of a vertex v is a list of (hub, cost) where the hubs are vertices of the upward search space of v,
+// the backward label is the same for the downward edges. The cost of a shortest path from s to t is the lowest
+// Lf(s)[h] + Lb(t)[h] over the hubs h common to both labels, which is a merge of two lists sorted by hub.
+//
+// Labels are computed top-down: the label of a vertex is its own entry merged with the labels of its upper neighbours,
+// then pruned of the entries whose cost is not the one of a shortest path, which is known from the labels of the upper vertices.
+// Vertices of the same level, i.e. the same distance to the top of the hierarchy, are processed in parallel.
+
+///
+/// Entry of a hub label
+struct CHHubLabelEntry
+{
+    CHVertex hub;
+    uint32_t cost;
+};
+
+///
+/// Identification of the costs of a query graph, labels cannot be used with another graph
+struct CHHubLabelFingerprint
+{
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    /// Hash of the targets and costs of the edges
+    uint64_t hash;
+
+    bool operator==( const CHHubLabelFingerprint& other ) const
+    {
+        return num_vertices == other.num_vertices && num_edges == other.num_edges && hash == other.hash;
+    }
+    bool operator!=( const CHHubLabelFingerprint& other ) const { return !( *this == other ); }
+};
+
+CHHubLabelFingerprint ch_hub_label_fingerprint( const CHQuery& graph );
+
+struct CHHubLabelStatistics
+{
+    /// Computation time, in seconds, without the levels loaded from a checkpoint
+    double build_time = 0.0;
+    size_t levels = 0;
+    /// Levels loaded from a checkpoint
+    size_t resumed_levels = 0;
+    size_t forward_entries = 0;
+    size_t backward_entries = 0;
+    /// Entries removed by pruning
+    size_t pruned_entries = 0;
+};
+
+///
+/// Forward and backward labels of each vertex of a query graph, sorted by hub.
+/// Arrays can be views of a mapped file
+class CHHubLabels
+{
+public:
+    static uint32_t infinity() { return std::numeric_limits<uint32_t>::max(); }
+
+    CHHubLabels( const std::string& metric,
+                 const CHHubLabelFingerprint& fingerprint,
+                 FlatArray<uint64_t>&& forward_index,
+                 FlatArray<CHHubLabelEntry>&& forward,
+                 FlatArray<uint64_t>&& backward_index,
+                 FlatArray<CHHubLabelEntry>&& backward );
+
+    ///
+    /// Map a file written by save(). Throws std::runtime_error if it cannot be read
+    static std::unique_ptr<CHHubLabels> load( const std::string& filename );
+
+    ///
+    /// Write the labels to a file. Throws std::runtime_error if it cannot be written
+    void save( const std::string& filename ) const;
+
+    ///
+    /// Metric of the graph the labels have been computed on
+    const std::string& metric() const { return metric_; }
+    const CHHubLabelFingerprint& fingerprint() const { return fingerprint_; }
+
+    size_t num_vertices() const { return forward_index_.size() - 1; }
+
+    ///
+    /// Cost of a shortest path from s to t, infinity() if there is none
+    uint32_t distance( CHVertex s, CHVertex t ) const
+    {
+        const CHHubLabelEntry* f = forward_.data() + forward_index_[s];
+        const CHHubLabelEntry* f_end = forward_.data() + forward_index_[s + 1];
+        const CHHubLabelEntry* b = backward_.data() + backward_index_[t];
+        const CHHubLabelEntry* b_end = backward_.data() + backward_index_[t + 1];
+        uint64_t best = infinity();
+        while ( f != f_end && b != b_end ) {
+            if ( f->hub < b->hub ) {
+                f++;
+            }
+            else if ( b->hub < f->hub ) {
+                b++;
+            }
+            else {
+                best = std::min( best, uint64_t( f->cost ) + b->cost );
+                f++;
+                b++;
+            }
+        }
+        return uint32_t( best );
+    }
+
+    const FlatArray<uint64_t>& forward_index_array() const { return forward_index_; }
+    const FlatArray<CHHubLabelEntry>& forward_array() const { return forward_; }
+    const FlatArray<uint64_t>& backward_index_array() const { return backward_index_; }
+    const FlatArray<CHHubLabelEntry>& backward_array() const { return backward_; }
+
+private:
+    std::string metric_;
+    CHHubLabelFingerprint fingerprint_;
+    FlatArray<uint64_t> forward_index_;
+    FlatArray<CHHubLabelEntry> forward_;
+    FlatArray<uint64_t> backward_index_;
+    FlatArray<CHHubLabelEntry> backward_;
+    // mapped file, if any
+    std::unique_ptr<FlatFileReader> file_;
+};
+
+///
+/// Compute the hub labels of a query graph.
+/// \param metric Name of the metric of the graph, stored with the labels
+/// \param checkpoint_file If not empty, labels of the completed levels are written to this file from time to time,
+/// and the computation starts again from it if it exists and has been written for the same graph. It is removed at the end
+/// \param checkpoint_interval Minimum time between two checkpoints, in seconds
+std::unique_ptr<CHHubLabels> build_ch_hub_labels( const CHQuery& graph,
+                                                  const std::string& metric,
+                                                  CHHubLabelStatistics& stats,
+                                                  const std::string& checkpoint_file = "",
+                                                  double checkpoint_interval = 60.0,
+                                                  ProgressionCallback& progression = null_progression_callback );
+
+} // namespace Tempus
+
+#endif
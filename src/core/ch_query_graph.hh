@@ -19,11 +19,34 @@
 
 #include <type_traits>
 #include <iterator>
+#include <cstring>
 #include "serializers.hh"
+#include "flat_file.hh"
 
 namespace Tempus
 {
 
+///
+/// Layout of the edge properties of a CHQueryGraph.
+///
+/// By default, the whole property of an edge is stored next to its target (array of structures).
+/// A property type may instead be split in a hot part, stored next to the target and read by searches
+/// (usually the cost), and a cold part stored in a parallel array (e.g. database IDs),
+/// by specializing this template with:
+/// - Input: type of the properties given to the constructor of the graph
+/// - HotProperty, ColdProperty and is_split = true
+/// - hot() and cold(), extracting each part from an Input
+template <typename EP>
+struct CHEdgeLayout
+{
+    typedef EP Input;
+    typedef EP HotProperty;
+    typedef EP ColdProperty;
+    static const bool is_split = false;
+    static const HotProperty& hot( const Input& p ) { return p; }
+    static const ColdProperty& cold( const Input& p ) { return p; }
+};
+
 //
 // Data structure used for storing CH graph dedicated to queries.
 // It consists of an upward and a downward graph stored together.
@@ -33,7 +56,14 @@ namespace Tempus
 // Since during a CH query, adjacency of a node always consists of ascending successors or descending predecessors,
 // two indices are stored : the index of the first upward edge and the index of the first downward edge.
 //
-// EdgeProperty: data type of each edge (usually a cost and a shortcut flag)
+// With a split layout (see CHEdgeLayout), cold parts of the properties are stored in a third array (cold_), in the order of edges_.
+// property() of an edge descriptor is then its hot part, edge_details() gives the cold part.
+// Otherwise both return the whole property.
+//
+// These arrays are FlatArrays: they are either built in memory or directly mapped from a file (see flat_file.hh).
+// In the latter case properties must be plain data.
+//
+// EdgeProperty: data type of each edge (usually a cost and a shortcut flag), its layout is given by CHEdgeLayout<EdgeProperty>
 // EdgeIndex: type of an index in the edge array
 //
 // Vertex are represented by their CH ordering number
@@ -46,16 +76,59 @@ public:
     typedef VI VertexIndex;
     typedef EI EdgeIndex;
     typedef EP EdgeProperty;
+    typedef CHEdgeLayout<EP> Layout;
+    typedef typename Layout::HotProperty HotProperty;
+    typedef typename Layout::ColdProperty ColdProperty;
 
     // default constructor
     CHQueryGraph() {}
 
+    struct FirstEdgeIndex {
+        EdgeIndex first_upward_edge;
+        EdgeIndex first_downward_edge;
+    };
+
+    struct EdgeData
+    {
+        VertexIndex target;
+        HotProperty property;
+        void serialize( std::ostream& ostr, binary_serialization_t t ) const
+        {
+            Tempus::serialize( ostr, target, t );
+            Tempus::serialize( ostr, property, t );
+        }
+        void unserialize( std::istream& istr, binary_serialization_t t )
+        {
+            Tempus::unserialize( istr, target, t );
+            Tempus::unserialize( istr, property, t );
+        }
+    };
+
+    ///
+    /// Graph out of its arrays, for instance views of a mapped file
+    /// (see edge_index_array(), edge_array() and cold_array()).
+    /// The array of cold properties is only used, and mandatory, with a split layout
+    CHQueryGraph( FlatArray<FirstEdgeIndex>&& edge_index, FlatArray<EdgeData>&& edges, FlatArray<ColdProperty>&& cold = FlatArray<ColdProperty>() )
+        : edge_index_( std::move( edge_index ) ), edges_( std::move( edges ) ), cold_( std::move( cold ) )
+    {
+        if ( edge_index_.empty() ) {
+            throw std::invalid_argument( "CHQueryGraph: the edge index must have at least one element" );
+        }
+        const FirstEdgeIndex& last = edge_index_[edge_index_.size() - 1];
+        if ( last.first_upward_edge != edges_.size() || last.first_downward_edge != edges_.size() ) {
+            throw std::invalid_argument( "CHQueryGraph: the edge index does not match the edges" );
+        }
+        if ( Layout::is_split && cold_.size() != edges_.size() ) {
+            throw std::invalid_argument( "CHQueryGraph: one cold property per edge is expected" );
+        }
+    }
+
     /**
      * @param vp iterator pointing to pairs of vertices
      * @param vp_end iterator pointing to the end of the pairs of vertices
      * @param num_vertices number of vertices
      * @param up_it iterator pointing to the number of upward edges for each vertex
-     * @param ep iterator pointing to the edge property of each edge
+     * @param ep iterator pointing to the edge property of each edge, of type Layout::Input
      *
      * Vertices are represented by their CH ordering
      * Edges are organized in the following way: pairs of vertices are sorted in ascending order by the first element of the pair.
@@ -77,12 +150,14 @@ public:
     {
         static_assert( std::is_same<typename std::iterator_traits<VertexPairIterator>::value_type, std::pair<VI,VI>>::value, "Wrong VertexPairIterator type" );
         static_assert( std::is_convertible<typename std::iterator_traits<DegreeIterator>::value_type, size_t>::value, "Wrong DegreeIterator type" );
-        static_assert( std::is_same<typename std::iterator_traits<EdgePropertyIterator>::value_type, EdgeProperty>::value, "Wrong EdgePropertyIterator type" );
+        static_assert( std::is_same<typename std::iterator_traits<EdgePropertyIterator>::value_type, typename Layout::Input>::value, "Wrong EdgePropertyIterator type" );
 
-        edge_index_.resize( n_vertices + 1 );
+        std::vector<FirstEdgeIndex> edge_index( n_vertices + 1 );
+        std::vector<EdgeData> edges;
+        std::vector<ColdProperty> cold;
 
         for ( VI v = 0; v < n_vertices; v++, up_it++ ) {
-            edge_index_[v].first_upward_edge = edges_.size();
+            edge_index[v].first_upward_edge = edges.size();
             BOOST_ASSERT( vp == vp_end || vp->first < vp->second ); // always u < v
             BOOST_ASSERT( vp == vp_end || v <= vp->first ); // edges must be sorted
             if ( vp != vp_end && vp->first == v ) {
@@ -90,25 +165,34 @@ public:
                 for ( size_t j = 0; j < *up_it; j++, vp++, ep++ ) {
                     BOOST_ASSERT( vp->first == v ); // check the upward degree is ok
                     EdgeData data;
+                    // no garbage in the padding bytes, that are written as is to flat files
+                    std::memset( &data, 0, sizeof( data ) );
                     data.target = vp->second;
-                    data.property = *ep;
-                    edges_.emplace_back( data );
+                    data.property = Layout::hot( *ep );
+                    edges.emplace_back( data );
+                    add_cold_( cold, *ep );
                 }
             }
 
-            edge_index_[v].first_downward_edge = edges_.size();
+            edge_index[v].first_downward_edge = edges.size();
             if ( vp != vp_end && vp->first == v ) {
-                for ( ; v == vp->first; vp++, ep++ ) {
+                for ( ; vp != vp_end && v == vp->first; vp++, ep++ ) {
                     BOOST_ASSERT( vp->first == v ); // check the downward degreee is ok
                     EdgeData data;
+                    // no garbage in the padding bytes, that are written as is to flat files
+                    std::memset( &data, 0, sizeof( data ) );
                     data.target = vp->second;
-                    data.property = *ep;
-                    edges_.emplace_back( data );
+                    data.property = Layout::hot( *ep );
+                    edges.emplace_back( data );
+                    add_cold_( cold, *ep );
                 }
             }
         }
-        edge_index_[n_vertices].first_upward_edge = edges_.size();
-        edge_index_[n_vertices].first_downward_edge = edges_.size();
+        edge_index[n_vertices].first_upward_edge = edges.size();
+        edge_index[n_vertices].first_downward_edge = edges.size();
+        edge_index_ = FlatArray<FirstEdgeIndex>( std::move( edge_index ) );
+        edges_ = FlatArray<EdgeData>( std::move( edges ) );
+        cold_ = FlatArray<ColdProperty>( std::move( cold ) );
     }
 
     void debug_print( std::ostream& ostr )
@@ -123,34 +207,20 @@ public:
         ostr << std::endl;
     }
 
-    struct EdgeData
-    {
-        VertexIndex target;
-        EdgeProperty property;
-        void serialize( std::ostream& ostr, binary_serialization_t t ) const
-        {
-            Tempus::serialize( ostr, target, t );
-            Tempus::serialize( ostr, property, t );
-        }
-        void unserialize( std::istream& istr, binary_serialization_t t )
-        {
-            Tempus::unserialize( istr, target, t );
-            Tempus::unserialize( istr, property, t );
-        }
-    };
-
     class EdgeDescriptor
     {
     public:
-        EdgeDescriptor() : prop_(nullptr) {}
-        EdgeDescriptor( VertexIndex src, VertexIndex tgt, const EdgeProperty* prop, bool upward ) : source_(src), target_(tgt), prop_(prop), upward_(upward) {}
+        EdgeDescriptor() : data_(nullptr) {}
+        EdgeDescriptor( VertexIndex src, VertexIndex tgt, const EdgeData* data, bool upward ) : source_(src), target_(tgt), data_(data), upward_(upward) {}
         VertexIndex source() const { return source_; }
         VertexIndex target() const { return target_; }
-        const EdgeProperty& property() const { return *prop_; }
+        const HotProperty& property() const { return data_->property; }
         bool is_upward() const { return upward_; }
+        /// Position of the edge in the edge array, see CHQueryGraph::edge_index()
+        const EdgeData* data() const { return data_; }
     private:
         VertexIndex source_, target_;
-        const EdgeProperty* prop_;
+        const EdgeData* data_;
         bool upward_;
     };
 
@@ -159,10 +229,10 @@ public:
     class OutEdgeIterator
     {
     public:
-        OutEdgeIterator( VertexIndex source, const EdgeData* data ) : source_(source), data_(data), v_( source, data->target, &data->property, true ) {}
-        EdgeDescriptor operator*() { return v_; }
-        EdgeDescriptor* operator->() { return &v_; }
-        void operator++() { data_++; v_ = EdgeDescriptor(source_, data_->target, &data_->property, true); }
+        OutEdgeIterator( VertexIndex source, const EdgeData* data ) : source_(source), data_(data) {}
+        EdgeDescriptor operator*() { return EdgeDescriptor( source_, data_->target, data_, true ); }
+        EdgeDescriptor* operator->() { v_ = this->operator*(); return &v_; }
+        void operator++() { data_++; }
         void operator++(int) { this->operator++(); }
         bool operator==( const OutEdgeIterator& other ) const { return other.source_ == source_ && other.data_ == data_; }
         bool operator!=( const OutEdgeIterator& other ) const { return !(*this == other); }
@@ -175,10 +245,10 @@ public:
     class InEdgeIterator
     {
     public:
-        InEdgeIterator( VertexIndex source, const EdgeData* data ) : source_(source), data_(data), v_( data->target, source_, &data_->property, false ) {}
-        EdgeDescriptor operator*() { return v_; }
-        EdgeDescriptor* operator->() { return &v_; }
-        void operator++() { data_++; v_ = EdgeDescriptor(data_->target, source_, &data_->property, false ); }
+        InEdgeIterator( VertexIndex source, const EdgeData* data ) : source_(source), data_(data) {}
+        EdgeDescriptor operator*() { return EdgeDescriptor( data_->target, source_, data_, false ); }
+        EdgeDescriptor* operator->() { v_ = this->operator*(); return &v_; }
+        void operator++() { data_++; }
         void operator++(int) { this->operator++(); }
         bool operator==( const InEdgeIterator& other ) const { return other.source_ == source_ && other.data_ == data_; }
         bool operator!=( const InEdgeIterator& other ) const { return !(*this == other); }
@@ -190,8 +260,8 @@ public:
 
     std::pair<OutEdgeIterator, OutEdgeIterator> out_edges( VertexIndex v ) const
     {
-        return std::make_pair( OutEdgeIterator( v, &edges_[edge_index_[v].first_upward_edge] ),
-                               OutEdgeIterator( v, &edges_[edge_index_[v].first_downward_edge] ) );
+        return std::make_pair( OutEdgeIterator( v, edges_.data() + edge_index_[v].first_upward_edge ),
+                               OutEdgeIterator( v, edges_.data() + edge_index_[v].first_downward_edge ) );
     }
 
     size_t out_degree( VertexIndex v ) const
@@ -201,8 +271,8 @@ public:
 
     std::pair<InEdgeIterator, InEdgeIterator> in_edges( VertexIndex v ) const
     {
-        return std::make_pair( InEdgeIterator( v, &edges_[edge_index_[v].first_downward_edge] ),
-                               InEdgeIterator( v, &edges_[edge_index_[v+1].first_upward_edge] ) );
+        return std::make_pair( InEdgeIterator( v, edges_.data() + edge_index_[v].first_downward_edge ),
+                               InEdgeIterator( v, edges_.data() + edge_index_[v+1].first_upward_edge ) );
     }
 
     size_t in_degree( VertexIndex v ) const
@@ -217,8 +287,7 @@ public:
     public:
         EdgeIterator( VertexIndex source, EdgeIndex edge, CHQueryGraph<EdgeProperty, VertexIndex, EdgeIndex>& graph )
             :
-            source_(source), edge_(edge), graph_(graph),
-            v_( source_, graph_.edges_[edge_].target, &graph_.edges_[edge_].property, true )
+            source_(source), edge_(edge), graph_(graph)
         {
             update_();
         }
@@ -245,6 +314,10 @@ public:
     private:
         void update_()
         {
+            if ( edge_ >= graph_.edges_.size() ) {
+                // end iterator
+                return;
+            }
             bool out = true;
             while ( source_ < graph_.edge_index_.size() ) {
                 if ( edge_ < graph_.edge_index_[source_].first_downward_edge ) {
@@ -260,10 +333,10 @@ public:
             }
 
             if ( out ) {
-                v_ = EdgeDescriptor( source_, graph_.edges_[edge_].target, &graph_.edges_[edge_].property, true );
+                v_ = EdgeDescriptor( source_, graph_.edges_[edge_].target, &graph_.edges_[edge_], true );
             }
             else {
-                v_ = EdgeDescriptor( graph_.edges_[edge_].target, source_, &graph_.edges_[edge_].property, false );
+                v_ = EdgeDescriptor( graph_.edges_[edge_].target, source_, &graph_.edges_[edge_], false );
             }
         }
         VertexIndex source_;
@@ -277,6 +350,54 @@ public:
         return std::make_pair( EdgeIterator( 0, 0, *this ), EdgeIterator( edge_index_.size()-1, edges_.size(), *this ) );
     }
 
+    ///
+    /// Index of an edge in the edge array, stable for the life of the graph
+    EdgeIndex edge_index( const EdgeDescriptor& e ) const
+    {
+        return EdgeIndex( e.data() - edges_.data() );
+    }
+
+    ///
+    /// Property of an edge, given its index. Only its hot part with a split layout
+    const HotProperty& edge_property( EdgeIndex i ) const
+    {
+        return edges_[i].property;
+    }
+
+    ///
+    /// Cold part of the property of an edge, the whole property if the layout is not split
+    const ColdProperty& edge_details( EdgeIndex i ) const
+    {
+        return details_( i, std::integral_constant<bool, Layout::is_split>() );
+    }
+
+    const ColdProperty& edge_details( const EdgeDescriptor& e ) const
+    {
+        return edge_details( edge_index( e ) );
+    }
+
+    ///
+    /// Copy of the graph where the cold property of each edge is modified by f( edge, cold property& ).
+    /// The edge descriptors given to f are the ones of this graph
+    template <typename Function>
+    CHQueryGraph copy_with_details( Function f ) const
+    {
+        std::vector<EdgeData> edges( edges_.begin(), edges_.end() );
+        std::vector<ColdProperty> cold( cold_.begin(), cold_.end() );
+        const std::integral_constant<bool, Layout::is_split> split;
+        for ( VertexIndex v = 0; v < num_vertices(); v++ ) {
+            for ( auto oei = out_edges( v ).first; oei != out_edges( v ).second; oei++ ) {
+                f( *oei, mutable_details_( edges, cold, edge_index( *oei ), split ) );
+            }
+            for ( auto iei = in_edges( v ).first; iei != in_edges( v ).second; iei++ ) {
+                f( *iei, mutable_details_( edges, cold, edge_index( *iei ), split ) );
+            }
+        }
+        return CHQueryGraph( FlatArray<FirstEdgeIndex>( std::vector<FirstEdgeIndex>( edge_index_.begin(), edge_index_.end() ) ),
+                             FlatArray<EdgeData>( std::move( edges ) ),
+                             FlatArray<ColdProperty>( std::move( cold ) ) );
+    }
+
     std::pair<EdgeDescriptor, bool> edge( VertexIndex u, VertexIndex v ) const
     {
         if ( v > u ) { // we are looking for an upward edge
@@ -284,7 +405,7 @@ public:
             EdgeIndex t = edge_index_[u].first_downward_edge;
             for ( EdgeIndex i = s; i < t; i++ ) {
                 if ( edges_[i].target == v ) {
-                    return std::make_pair(EdgeDescriptor( u, v, &edges_[i].property, true ), true);
+                    return std::make_pair(EdgeDescriptor( u, v, &edges_[i], true ), true);
                 }
             }
         }
@@ -293,7 +414,7 @@ public:
             EdgeIndex t = edge_index_[v+1].first_upward_edge;
             for ( EdgeIndex i = s; i < t; i++ ) {
                 if ( edges_[i].target == u ) {
-                    return std::make_pair(EdgeDescriptor( u, v, &edges_[i].property, false ), true);
+                    return std::make_pair(EdgeDescriptor( u, v, &edges_[i], false ), true);
                 }
             }
         }
@@ -304,34 +425,72 @@ public:
     {
         EdgeIndex n = edge_index_.size();
         Tempus::serialize( ostr, n, t );
-        Tempus::serialize( ostr, reinterpret_cast<const char*>( &edge_index_[0] ), n * sizeof( FirstEdgeIndex ), t );
+        Tempus::serialize( ostr, reinterpret_cast<const char*>( edge_index_.data() ), n * sizeof( FirstEdgeIndex ), t );
         EdgeIndex m = edges_.size();
         Tempus::serialize( ostr, m, t );
         for ( EdgeIndex i = 0; i < m; i++ )
             Tempus::serialize( ostr, edges_[i], t );
+        serialize_cold_( ostr, t, std::integral_constant<bool, Layout::is_split>() );
     }
         
     void unserialize( std::istream& istr, binary_serialization_t t )
     {
         EdgeIndex n = 0;
         Tempus::unserialize( istr, n, t );
-        edge_index_.resize( n );
-        Tempus::unserialize( istr, reinterpret_cast<char*>( &edge_index_[0] ), n * sizeof( FirstEdgeIndex ), t );
+        std::vector<FirstEdgeIndex> edge_index( n );
+        Tempus::unserialize( istr, reinterpret_cast<char*>( &edge_index[0] ), n * sizeof( FirstEdgeIndex ), t );
         EdgeIndex m = 0;
         Tempus::unserialize( istr, m, t );
-        edges_.resize( m );
+        std::vector<EdgeData> edges( m );
         for ( EdgeIndex i = 0; i < m; i++ )
-            Tempus::unserialize( istr, edges_[i], t );
+            Tempus::unserialize( istr, edges[i], t );
+        edge_index_ = FlatArray<FirstEdgeIndex>( std::move( edge_index ) );
+        edges_ = FlatArray<EdgeData>( std::move( edges ) );
+        unserialize_cold_( istr, t, std::integral_constant<bool, Layout::is_split>() );
     }
+
+    ///
+    /// Arrays of the graph, to be written to a flat file.
+    /// The array of cold properties is empty if the layout is not split
+    const FlatArray<FirstEdgeIndex>& edge_index_array() const { return edge_index_; }
+    const FlatArray<EdgeData>& edge_array() const { return edges_; }
+    const FlatArray<ColdProperty>& cold_array() const { return cold_; }
+
 private:
     //FIXME : only one index and a local linear search for out_edges and in_edges may be sufficient
-    struct FirstEdgeIndex {
-        EdgeIndex first_upward_edge;
-        EdgeIndex first_downward_edge;
-    };
+    FlatArray<FirstEdgeIndex> edge_index_;
+    FlatArray<EdgeData> edges_;
+    FlatArray<ColdProperty> cold_;
+
+    // dispatch on Layout::is_split
+    const ColdProperty& details_( EdgeIndex i, std::true_type ) const { return cold_[i]; }
+    const ColdProperty& details_( EdgeIndex i, std::false_type ) const { return edges_[i].property; }
+    static ColdProperty& mutable_details_( std::vector<EdgeData>&, std::vector<ColdProperty>& cold, EdgeIndex i, std::true_type ) { return cold[i]; }
+    static ColdProperty& mutable_details_( std::vector<EdgeData>& edges, std::vector<ColdProperty>&, EdgeIndex i, std::false_type ) { return edges[i].property; }
+
+    template <typename Input>
+    static void add_cold_( std::vector<ColdProperty>& cold, const Input& p )
+    {
+        if ( Layout::is_split ) {
+            cold.push_back( Layout::cold( p ) );
+        }
+    }
 
-    std::vector<FirstEdgeIndex> edge_index_;
-    std::vector<EdgeData> edges_;
+    void serialize_cold_( std::ostream&, binary_serialization_t, std::false_type ) const {}
+    void serialize_cold_( std::ostream& ostr, binary_serialization_t t, std::true_type ) const
+    {
+        for ( EdgeIndex i = 0; i < cold_.size(); i++ )
+            Tempus::serialize( ostr, cold_[i], t );
+    }
+
+    void unserialize_cold_( std::istream&, binary_serialization_t, std::false_type ) {}
+    void unserialize_cold_( std::istream& istr, binary_serialization_t t, std::true_type )
+    {
+        std::vector<ColdProperty> cold( edges_.size() );
+        for ( EdgeIndex i = 0; i < cold.size(); i++ )
+            Tempus::unserialize( istr, cold[i], t );
+        cold_ = FlatArray<ColdProperty>( std::move( cold ) );
+    }
 };
 
 template <typename EdgeProperty,
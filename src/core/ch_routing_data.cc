@@ -18,28 +18,347 @@
 #include "db.hh"
 
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <tuple>
 #include <boost/format.hpp>
+#include <boost/algorithm/string.hpp>
 
 namespace Tempus
 {
 
+bool CHUnpackCache::find( uint32_t shortcut, std::vector<uint32_t>& out ) const
+{
+    boost::shared_lock<boost::shared_mutex> lock( mutex_ );
+    auto it = entries_.find( shortcut );
+    if ( it == entries_.end() ) {
+        return false;
+    }
+    out.insert( out.end(), edges_.begin() + it->second.first, edges_.begin() + it->second.first + it->second.second );
+    return true;
+}
+
+void CHUnpackCache::insert( uint32_t shortcut, const uint32_t* begin, const uint32_t* end )
+{
+    boost::unique_lock<boost::shared_mutex> lock( mutex_ );
+    const size_t n = end - begin;
+    if ( edges_.size() + n > max_edges_ || entries_.find( shortcut ) != entries_.end() ) {
+        return;
+    }
+    entries_[shortcut] = std::make_pair( edges_.size(), n );
+    edges_.insert( edges_.end(), begin, end );
+}
+
+size_t CHUnpackCache::size() const
+{
+    boost::shared_lock<boost::shared_mutex> lock( mutex_ );
+    return edges_.size();
+}
+
+///
+/// Query graph with the split layout out of a graph with whole properties, edges keep their index
+static std::unique_ptr<CHQuery> split_query_graph( const CHQueryAoS& graph )
+{
+    typedef CHEdgeLayout<CHSplitEdgeProperty> Layout;
+    std::vector<CHQuery::FirstEdgeIndex> edge_index( graph.edge_index_array().size() );
+    for ( size_t i = 0; i < edge_index.size(); i++ ) {
+        edge_index[i].first_upward_edge = graph.edge_index_array()[i].first_upward_edge;
+        edge_index[i].first_downward_edge = graph.edge_index_array()[i].first_downward_edge;
+    }
+    std::vector<CHQuery::EdgeData> edges( graph.edge_array().size() );
+    std::vector<CHEdgeDetails> details;
+    details.reserve( edges.size() );
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        std::memset( &edges[i], 0, sizeof( CHQuery::EdgeData ) );
+        edges[i].target = graph.edge_array()[i].target;
+        edges[i].property = Layout::hot( graph.edge_array()[i].property );
+        details.push_back( Layout::cold( graph.edge_array()[i].property ) );
+    }
+    return std::unique_ptr<CHQuery>( new CHQuery( FlatArray<CHQuery::FirstEdgeIndex>( std::move( edge_index ) ),
+                                                  FlatArray<CHQuery::EdgeData>( std::move( edges ) ),
+                                                  FlatArray<CHEdgeDetails>( std::move( details ) ) ) );
+}
+
+static std::unique_ptr<CHQuery> link_shortcuts( const CHQuery& graph, const MiddleNodeMap& middle_node )
+{
+    return std::unique_ptr<CHQuery>( new CHQuery( link_ch_shortcuts( graph, middle_node ) ) );
+}
+
+CHTurnGraph::CHTurnGraph( std::unique_ptr<CHQuery> graph,
+                          FlatArray<CHTurnVertex>&& vertices,
+                          FlatArray<uint32_t>&& out_index,
+                          FlatArray<uint32_t>&& out_vertices,
+                          FlatArray<uint32_t>&& in_index,
+                          FlatArray<uint32_t>&& in_vertices ) :
+    graph_( std::move( graph ) ),
+    vertices_( std::move( vertices ) ),
+    out_index_( std::move( out_index ) ),
+    out_vertices_( std::move( out_vertices ) ),
+    in_index_( std::move( in_index ) ),
+    in_vertices_( std::move( in_vertices ) )
+{
+    if ( vertices_.size() != num_vertices( *graph_ ) ) {
+        throw std::invalid_argument( "CHTurnGraph: one section per vertex is expected" );
+    }
+    if ( out_index_.empty() || in_index_.size() != out_index_.size() ||
+         out_index_[out_index_.size() - 1] != out_vertices_.size() || in_index_[in_index_.size() - 1] != in_vertices_.size() ) {
+        throw std::invalid_argument( "CHTurnGraph: inconsistent indexes of nodes" );
+    }
+}
+
+///
+/// Sections of each node, by means of a counting sort
+/// \param node Node of each section
+static void index_turn_vertices( const std::vector<CHVertex>& node, size_t num_nodes, std::vector<uint32_t>& index, std::vector<uint32_t>& sections )
+{
+    index.assign( num_nodes + 1, 0 );
+    for ( CHVertex n : node ) {
+        index[n + 1]++;
+    }
+    for ( size_t i = 0; i < num_nodes; i++ ) {
+        index[i + 1] += index[i];
+    }
+    sections.resize( node.size() );
+    std::vector<uint32_t> next( index.begin(), index.end() - 1 );
+    for ( uint32_t v = 0; v < node.size(); v++ ) {
+        sections[next[node[v]]++] = v;
+    }
+}
+
+CHTurnGraph::CHTurnGraph( std::unique_ptr<CHQuery> graph, std::vector<CHTurnVertex>&& vertices, size_t num_nodes ) :
+    graph_( std::move( graph ) )
+{
+    if ( vertices.size() != num_vertices( *graph_ ) ) {
+        throw std::invalid_argument( "CHTurnGraph: one section per vertex is expected" );
+    }
+    std::vector<CHVertex> from( vertices.size() ), to( vertices.size() );
+    for ( size_t v = 0; v < vertices.size(); v++ ) {
+        if ( vertices[v].from >= num_nodes || vertices[v].to >= num_nodes ) {
+            throw std::invalid_argument( (boost::format( "CHTurnGraph: the section %1% is not between two nodes" ) % vertices[v].db_id).str() );
+        }
+        from[v] = vertices[v].from;
+        to[v] = vertices[v].to;
+        // no garbage in the padding bytes, that are written as is to flat files
+        CHTurnVertex tv;
+        std::memset( &tv, 0, sizeof( tv ) );
+        tv.db_id = vertices[v].db_id;
+        tv.from = vertices[v].from;
+        tv.to = vertices[v].to;
+        tv.cost = vertices[v].cost;
+        std::memcpy( &vertices[v], &tv, sizeof( tv ) );
+    }
+    std::vector<uint32_t> out_index, out_vertices, in_index, in_vertices;
+    index_turn_vertices( from, num_nodes, out_index, out_vertices );
+    index_turn_vertices( to, num_nodes, in_index, in_vertices );
+
+    vertices_ = FlatArray<CHTurnVertex>( std::move( vertices ) );
+    out_index_ = FlatArray<uint32_t>( std::move( out_index ) );
+    out_vertices_ = FlatArray<uint32_t>( std::move( out_vertices ) );
+    in_index_ = FlatArray<uint32_t>( std::move( in_index ) );
+    in_vertices_ = FlatArray<uint32_t>( std::move( in_vertices ) );
+}
+
+std::unique_ptr<CHTurnGraph> CHTurnGraph::renumbered_nodes( const std::vector<CHVertex>& new_number ) const
+{
+    if ( new_number.size() != num_nodes() ) {
+        throw std::invalid_argument( "renumbered_nodes: one number per node is expected" );
+    }
+    std::vector<CHTurnVertex> vertices( vertices_.begin(), vertices_.end() );
+    for ( CHTurnVertex& v : vertices ) {
+        v.from = new_number[v.from];
+        v.to = new_number[v.to];
+    }
+    // the graph is copied, it may view a mapped file
+    std::unique_ptr<CHQuery> graph( new CHQuery( graph_->copy_with_details( []( const CHEdge&, CHEdgeDetails& ) {} ) ) );
+    return std::unique_ptr<CHTurnGraph>( new CHTurnGraph( std::move( graph ), std::move( vertices ), num_nodes() ) );
+}
+
+CHSectionIndex::CHSectionIndex( FlatArray<CHSection>&& sections,
+                                FlatArray<CHSectionGrid>&& grid,
+                                FlatArray<uint32_t>&& cell_index,
+                                FlatArray<uint32_t>&& cell_sections ) :
+    sections_( std::move( sections ) ),
+    grid_( std::move( grid ) ),
+    cell_index_( std::move( cell_index ) ),
+    cell_sections_( std::move( cell_sections ) )
+{
+    if ( grid_.size() != 1 || cell_index_.size() != size_t( grid_[0].columns ) * grid_[0].rows + 1 ||
+         cell_index_[cell_index_.size() - 1] != cell_sections_.size() ) {
+        throw std::invalid_argument( "CHSectionIndex: inconsistent grid" );
+    }
+}
+
+CHSectionIndex::CHSectionIndex( std::vector<CHSection>&& sections )
+{
+    CHSectionGrid grid;
+    std::memset( &grid, 0, sizeof( grid ) );
+    grid.cell_size = 1.0f;
+    grid.columns = 1;
+    grid.rows = 1;
+    if ( !sections.empty() ) {
+        float x_min = sections[0].x1, x_max = x_min, y_min = sections[0].y1, y_max = y_min;
+        for ( const CHSection& s : sections ) {
+            x_min = std::min( { x_min, s.x1, s.x2 } );
+            x_max = std::max( { x_max, s.x1, s.x2 } );
+            y_min = std::min( { y_min, s.y1, s.y2 } );
+            y_max = std::max( { y_max, s.y1, s.y2 } );
+        }
+        // about two sections per cell, and not more cells than sections along a side
+        const double width = x_max - x_min, height = y_max - y_min;
+        double cell_size = std::max( std::sqrt( width * height * 2.0 / sections.size() ), std::max( width, height ) / sections.size() );
+        if ( cell_size <= 0 ) {
+            cell_size = 1.0;
+        }
+        grid.x0 = x_min;
+        grid.y0 = y_min;
+        grid.cell_size = float( cell_size );
+        grid.columns = uint32_t( width / cell_size ) + 1;
+        grid.rows = uint32_t( height / cell_size ) + 1;
+    }
+
+    // cells of the bounding box of each section, then a counting sort
+    auto cell_range = [&grid]( float a, float b, float origin, uint32_t n ) {
+        const float lo = std::min( a, b ) - origin, hi = std::max( a, b ) - origin;
+        return std::make_pair( std::min( uint32_t( std::max( lo / grid.cell_size, 0.0f ) ), n - 1 ),
+                               std::min( uint32_t( std::max( hi / grid.cell_size, 0.0f ) ), n - 1 ) );
+    };
+    const size_t n_cells = size_t( grid.columns ) * grid.rows;
+    std::vector<uint32_t> cell_index( n_cells + 1, 0 );
+    for ( int pass = 0; pass < 2; pass++ ) {
+        std::vector<uint32_t> next( cell_index.begin(), cell_index.end() - 1 );
+        std::vector<uint32_t> cell_sections( pass == 0 ? 0 : cell_index.back() );
+        for ( uint32_t i = 0; i < sections.size(); i++ ) {
+            const CHSection& s = sections[i];
+            const auto columns = cell_range( s.x1, s.x2, grid.x0, grid.columns );
+            const auto rows = cell_range( s.y1, s.y2, grid.y0, grid.rows );
+            for ( uint32_t r = rows.first; r <= rows.second; r++ ) {
+                for ( uint32_t c = columns.first; c <= columns.second; c++ ) {
+                    if ( pass == 0 ) {
+                        cell_index[r * grid.columns + c + 1]++;
+                    }
+                    else {
+                        cell_sections[next[r * grid.columns + c]++] = i;
+                    }
+                }
+            }
+        }
+        if ( pass == 0 ) {
+            for ( size_t c = 0; c < n_cells; c++ ) {
+                cell_index[c + 1] += cell_index[c];
+            }
+        }
+        else {
+            cell_sections_ = FlatArray<uint32_t>( std::move( cell_sections ) );
+        }
+    }
+
+    sections_ = FlatArray<CHSection>( std::move( sections ) );
+    grid_ = FlatArray<CHSectionGrid>( std::vector<CHSectionGrid>( 1, grid ) );
+    cell_index_ = FlatArray<uint32_t>( std::move( cell_index ) );
+}
+
+boost::optional<CHPhantomNode> CHSectionIndex::nearest( float x, float y, float max_distance ) const
+{
+    boost::optional<CHPhantomNode> best;
+    if ( sections_.empty() ) {
+        return best;
+    }
+    const CHSectionGrid& grid = grid_[0];
+    auto clamped_cell = []( float v, float origin, float cell_size, uint32_t n ) {
+        return int( std::min( std::max( std::floor( ( v - origin ) / cell_size ), 0.0f ), float( n - 1 ) ) );
+    };
+    const int column = clamped_cell( x, grid.x0, grid.cell_size, grid.columns );
+    const int row = clamped_cell( y, grid.y0, grid.cell_size, grid.rows );
+
+    auto scan_cell = [&]( int c, int r ) {
+        if ( c < 0 || r < 0 || c >= int( grid.columns ) || r >= int( grid.rows ) ) {
+            return;
+        }
+        const size_t cell = size_t( r ) * grid.columns + c;
+        for ( uint32_t k = cell_index_[cell]; k < cell_index_[cell + 1]; k++ ) {
+            const CHSection& s = sections_[cell_sections_[k]];
+            // projection of the point on the segment
+            const double dx = s.x2 - s.x1, dy = s.y2 - s.y1;
+            const double length2 = dx * dx + dy * dy;
+            double t = length2 > 0 ? ( ( x - s.x1 ) * dx + ( y - s.y1 ) * dy ) / length2 : 0.0;
+            t = std::min( std::max( t, 0.0 ), 1.0 );
+            const double px = s.x1 + t * dx - x, py = s.y1 + t * dy - y;
+            const float d = float( std::sqrt( px * px + py * py ) );
+            if ( !best || d < best->distance ) {
+                best = CHPhantomNode{ cell_sections_[k], float( t ), d };
+            }
+        }
+    };
+
+    // sections of ring r + 1 are at least r cells away from the point
+    const int max_ring = int( std::max( grid.columns, grid.rows ) );
+    for ( int ring = 0; ring <= max_ring; ring++ ) {
+        const float lower_bound = ( ring - 1 ) * grid.cell_size;
+        if ( ring > 0 && ( ( best && best->distance <= lower_bound ) || lower_bound > max_distance ) ) {
+            break;
+        }
+        for ( int r = row - ring; r <= row + ring; r++ ) {
+            if ( r == row - ring || r == row + ring ) {
+                for ( int c = column - ring; c <= column + ring; c++ ) {
+                    scan_cell( c, r );
+                }
+            }
+            else {
+                scan_cell( column - ring, r );
+                scan_cell( column + ring, r );
+            }
+        }
+    }
+    if ( best && best->distance > max_distance ) {
+        best.reset();
+    }
+    return best;
+}
+
+std::unique_ptr<CHSectionIndex> CHSectionIndex::renumbered_vertices( const std::vector<CHVertex>& new_number ) const
+{
+    std::vector<CHSection> sections( sections_.begin(), sections_.end() );
+    for ( CHSection& s : sections ) {
+        if ( s.from >= new_number.size() || s.to >= new_number.size() ) {
+            throw std::invalid_argument( "renumbered_vertices: one number per vertex is expected" );
+        }
+        s.from = new_number[s.from];
+        s.to = new_number[s.to];
+    }
+    // the grid does not depend on the numbering
+    return std::unique_ptr<CHSectionIndex>( new CHSectionIndex( FlatArray<CHSection>( std::move( sections ) ),
+                                                                FlatArray<CHSectionGrid>( std::vector<CHSectionGrid>( grid_.begin(), grid_.end() ) ),
+                                                                FlatArray<uint32_t>( std::vector<uint32_t>( cell_index_.begin(), cell_index_.end() ) ),
+                                                                FlatArray<uint32_t>( std::vector<uint32_t>( cell_sections_.begin(), cell_sections_.end() ) ) ) );
+}
+
+CHRoutingData::CHRoutingData() :
+    RoutingData( "ch_graph" )
+{
+}
+
 CHRoutingData::CHRoutingData( std::unique_ptr<CHQuery> a_ch_query, MiddleNodeMap&& a_middle_node, std::vector<db_id_t>&& a_node_id) :
     RoutingData( "ch_graph" ),
-    ch_query_( std::move(a_ch_query) ),
-    middle_node_( a_middle_node ),
-    node_id_( a_node_id )
+    ch_query_( link_shortcuts( *a_ch_query, a_middle_node ) )
 {
     // update the reverse id map
-    for ( size_t i = 0; i < node_id_.size(); i++ ) {
-        rnode_id_[node_id_[i]] = i;
+    std::vector<NodeIdIndex> rnode_id( a_node_id.size() );
+    for ( size_t i = 0; i < a_node_id.size(); i++ ) {
+        rnode_id[i].id = a_node_id[i];
+        rnode_id[i].index = i;
     }
+    std::sort( rnode_id.begin(), rnode_id.end(), []( const NodeIdIndex& a, const NodeIdIndex& b ) { return a.id < b.id; } );
+    rnode_id_ = FlatArray<NodeIdIndex>( std::move( rnode_id ) );
+    node_id_ = FlatArray<db_id_t>( std::move( a_node_id ) );
 }
 
 boost::optional<CHVertex> CHRoutingData::vertex_from_id( db_id_t id ) const
 {
-    auto it = rnode_id_.find( id );
-    if ( it != rnode_id_.end() ) {
-        return it->second;
+    auto it = std::lower_bound( rnode_id_.begin(), rnode_id_.end(), id,
+                                []( const NodeIdIndex& n, db_id_t i ) { return n.id < i; } );
+    if ( it != rnode_id_.end() && it->id == id ) {
+        return CHVertex( it->index );
     }
     return boost::optional<CHVertex>();
 }
@@ -49,146 +368,575 @@ db_id_t CHRoutingData::vertex_id( CHVertex v ) const
     return node_id_[v];
 }
 
-std::unique_ptr<RoutingData> CHRoutingDataBuilder::pg_import( const std::string& pg_options, ProgressionCallback&, const VariantMap& options ) const
+///
+/// Throws std::invalid_argument if a numbering is not a permutation of n vertices
+static void check_permutation( const std::vector<CHVertex>& new_number, size_t n, const std::string& caller )
 {
-    std::unique_ptr<CHQuery> ch_query;
-    MiddleNodeMap middle_node;
-    std::vector<db_id_t> node_id;
+    if ( new_number.size() != n ) {
+        throw std::invalid_argument( caller + ": one number per vertex is expected" );
+    }
+    std::vector<bool> used( n, false );
+    for ( CHVertex v : new_number ) {
+        if ( v >= n || used[v] ) {
+            throw std::invalid_argument( caller + ": the numbering is not a permutation" );
+        }
+        used[v] = true;
+    }
+}
 
-    std::string schema = "ch";
-    if ( options.find( "ch/schema" ) != options.end() ) {
-        schema = options.find( "ch/schema" )->second.str();
+///
+/// Ranks of a metric along with the vertex of each rank
+static CHMetricRanks inverse_ranks( std::vector<CHVertex>&& rank )
+{
+    std::vector<CHVertex> vertex( rank.size() );
+    for ( CHVertex v = 0; v < rank.size(); v++ ) {
+        vertex[rank[v]] = v;
     }
-    std::cout << "schema : " << schema << std::endl;
-    
-    Db::Connection conn( pg_options );
+    CHMetricRanks ranks;
+    ranks.rank = FlatArray<CHVertex>( std::move( rank ) );
+    ranks.vertex = FlatArray<CHVertex>( std::move( vertex ) );
+    return ranks;
+}
 
-    uint32_t num_nodes = 0;
-    {
-        Db::Result r( conn.exec( (boost::format("select count(*) from %1%.ordered_nodes") % schema).str() ) );
-        BOOST_ASSERT( r.size() == 1 );
-        r[0][0] >> num_nodes;
+void CHRoutingData::add_metric( const std::string& name, std::unique_ptr<CHQuery> a_ch_query, MiddleNodeMap&& a_middle_node, std::vector<CHVertex>&& rank )
+{
+    if ( name.empty() ) {
+        throw std::invalid_argument( "A metric must have a name" );
     }
-    {
-        Db::ResultIterator res_it = conn.exec_it( (boost::format( "select * from\n"
-                                                                  "(\n"
-                                                  // the upward part
-                                                  "select o1.sort_order as id1, o2.sort_order as id2, weight, o3.sort_order as mid, 0 as dir, rs1.id as eid1, rs2.id as eid2, o1.node_id, o2.node_id, o3.node_id\n"
-                                                  "from %1%.query_graph\n"
-                                                  "left join %1%.ordered_nodes as o3 on o3.node_id = contracted_id\n"
-                                                  "left join tempus.road_section as rs1 on rs1.node_from = node_inf and rs1.node_to = node_sup\n"
-                                                  "left join tempus.road_section as rs2 on rs2.node_from = node_sup and rs2.node_to = node_inf\n"
-                                                  ", %1%.ordered_nodes as o1, %1%.ordered_nodes as o2\n"
-                                                  "where o1.node_id = node_inf and o2.node_id = node_sup\n"
-                                                  "and query_graph.\"constraints\" & 1 > 0\n"
-
-                                                  // union with the downward part
-                                                  "union all\n"
-                                                  "select o1.sort_order as id1, o2.sort_order as id2, weight, o3.sort_order as mid, 1 as dir, rs1.id as eid1, rs2.id as eid2, o1.node_id, o2.node_id, o3.node_id\n"
-                                                  "from %1%.query_graph\n"
-                                                  "left join %1%.ordered_nodes as o3 on o3.node_id = contracted_id\n"
-                                                  "left join tempus.road_section as rs1 on rs1.node_from = node_inf and rs1.node_to = node_sup\n"
-                                                  "left join tempus.road_section as rs2 on rs2.node_from = node_sup and rs2.node_to = node_inf\n"
-                                                  ", %1%.ordered_nodes as o1, %1%.ordered_nodes as o2\n"
-                                                  "where o1.node_id = node_inf and o2.node_id = node_sup\n"
-                                                  "and query_graph.\"constraints\" & 2 > 0\n"
-                                                                 ") t order by id1, dir, id2, weight asc" ) % schema).str()
-                                                  );
-        Db::ResultIterator it_end;
-
-        std::vector<std::pair<uint32_t,uint32_t>> targets;
-        std::vector<CHEdgeProperty> properties;
-        std::vector<uint16_t> up_degrees;
-
-        uint16_t upd = 0;
-        uint32_t old_id1 = 0;
-        uint32_t old_id2 = 0;
-        int old_dir = 0;
-        bool first = true;
-        for ( ; res_it != it_end; res_it++ ) {
-            Db::RowValue res_i = *res_it;
-            uint32_t id1 = res_i[0].as<uint32_t>();
-            uint32_t id2 = res_i[1].as<uint32_t>();
-            int dir = res_i[4];
-            if ( first ) {
-                first = false;
-            }
-            else {
-                if ( (id1 == old_id1) && (id2 == old_id2) && (dir == old_dir) ) {
-                    // we may have the same edges with different costs
-                    // we then skip the duplicates and only take
-                    // the first one (the one with the smallest weight)
-                    continue;
-                }
-                if ( id1 > old_id1 ) {
-                    up_degrees.push_back( upd );
-                    if ( id1 > old_id1 + 1 ) {
-                        // update up_degrees for vertex without outgoing edges
-                        for ( uint32_t i = 0; i < id1 - old_id1 - 1; i++ ) {
-                            up_degrees.push_back( 0 );
-                        }
-                    }
-                    upd = 0;
-                }
+    if ( name == default_metric_name_ ) {
+        throw std::invalid_argument( "The metric " + name + " is the default one" );
+    }
+    if ( num_vertices( *a_ch_query ) != num_vertices( *ch_query_ ) ) {
+        throw std::invalid_argument( "The graph of metric " + name + " does not have the vertices of the CH graph" );
+    }
+    if ( !rank.empty() ) {
+        check_permutation( rank, num_vertices( *ch_query_ ), "add_metric" );
+    }
+    metrics_[name] = link_shortcuts( *a_ch_query, a_middle_node );
+    metric_ranks_.erase( name );
+    if ( !rank.empty() ) {
+        metric_ranks_[name] = inverse_ranks( std::move( rank ) );
+    }
+}
+
+std::vector<std::string> CHRoutingData::metric_names() const
+{
+    std::vector<std::string> names;
+    for ( const auto& p : metrics_ ) {
+        names.push_back( p.first );
+    }
+    return names;
+}
+
+bool CHRoutingData::has_metric( const std::string& metric ) const
+{
+    return metric == default_metric_name_ || metrics_.find( metric ) != metrics_.end();
+}
+
+void CHRoutingData::set_td_graph( std::unique_ptr<TDCHGraph> td_graph, const std::string& metric )
+{
+    if ( td_graph && td_graph->num_vertices() != num_vertices( *ch_query_ ) ) {
+        throw std::invalid_argument( "The time-dependent graph does not have the vertices of the CH graph" );
+    }
+    if ( td_graph && !metric.empty() && !has_metric( metric ) ) {
+        throw std::invalid_argument( "Unknown metric " + metric + " of the time-dependent graph" );
+    }
+    td_graph_ = std::move( td_graph );
+    td_graph_metric_ = td_graph_ ? metric : std::string();
+}
+
+void CHRoutingData::set_turn_graph( const std::string& metric, std::unique_ptr<CHTurnGraph> turn_graph )
+{
+    if ( turn_graph && turn_graph->num_nodes() != num_vertices( *ch_query_ ) ) {
+        throw std::invalid_argument( "The edge-based graph does not have the vertices of the CH graph" );
+    }
+    turn_graph_ = std::move( turn_graph );
+    turn_graph_metric_ = turn_graph_ ? metric : std::string();
+}
+
+void CHRoutingData::set_section_index( std::unique_ptr<CHSectionIndex> section_index )
+{
+    if ( section_index ) {
+        const size_t n = num_vertices( *ch_query_ );
+        for ( const CHSection& s : section_index->section_array() ) {
+            if ( s.from >= n || s.to >= n ) {
+                throw std::invalid_argument( (boost::format( "The section %1% is not between vertices of the CH graph" ) % s.db_id).str() );
             }
-            old_id1 = id1;
-            old_id2 = id2;
-            old_dir = dir;
+        }
+    }
+    section_index_ = std::move( section_index );
+    section_costs_.clear();
+}
+
+const FlatArray<CHSectionCosts>* CHRoutingData::section_costs( const std::string& metric ) const
+{
+    auto it = section_costs_.find( metric == default_metric_name_ ? std::string() : metric );
+    return it == section_costs_.end() ? nullptr : &it->second;
+}
 
-            db_id_t vid1, vid2;
-            res_i[7] >> vid1;
-            res_i[8] >> vid2;
+void CHRoutingData::set_section_costs( const std::string& metric, FlatArray<CHSectionCosts>&& costs )
+{
+    if ( !metric.empty() && !has_metric( metric ) ) {
+        throw std::invalid_argument( "Unknown metric " + metric );
+    }
+    if ( !section_index_ || costs.size() != section_index_->size() ) {
+        throw std::invalid_argument( "Section costs of metric " + metric + " do not match the sections of the index" );
+    }
+    section_costs_[metric == default_metric_name_ ? std::string() : metric] = std::move( costs );
+}
+
+std::string CHRoutingData::transport_mode_metric( db_id_t mode ) const
+{
+    std::string metric;
+    switch ( mode ) {
+    case TransportModeWalking:
+        // graphs without metric name are pedestrian ones
+        if ( default_metric_name_.empty() ) {
+            return metric;
+        }
+        metric = "pedestrian";
+        break;
+    case TransportModePrivateBicycle:
+        metric = "bicycle";
+        break;
+    case TransportModePrivateCar:
+        metric = "car";
+        break;
+    default:
+        throw std::runtime_error( (boost::format( "Unsupported transport mode %1%" ) % mode).str() );
+    }
+    if ( !has_metric( metric ) ) {
+        throw std::runtime_error( "No contraction hierarchy for the " + metric + " transport mode" );
+    }
+    return metric;
+}
+
+const CHQuery& CHRoutingData::ch_query( const std::string& metric ) const
+{
+    if ( metric.empty() || metric == default_metric_name_ ) {
+        return *ch_query_;
+    }
+    auto it = metrics_.find( metric );
+    if ( it == metrics_.end() ) {
+        throw std::invalid_argument( "Unknown metric " + metric );
+    }
+    return *it->second;
+}
 
-            db_id_t eid = 0;
-            if ( !res_i[5].is_null() ) {
-                res_i[5] >> eid;
+const CHMetricRanks* CHRoutingData::metric_ranks( const std::string& metric ) const
+{
+    auto it = metric_ranks_.find( metric );
+    return it == metric_ranks_.end() ? nullptr : &it->second;
+}
+
+///
+/// Locality order of the vertices shared by query graphs and a time-dependent graph, if not null, see CHRoutingData::locality_order()
+static std::vector<CHVertex> locality_order_of( size_t n, const std::vector<const CHQuery*>& graphs, const TDCHGraph* td_graph )
+{
+    // lower neighbours of each vertex, in every graph
+    std::vector<std::vector<CHVertex>> lower( n );
+    auto add_lower = [&lower]( const CHQuery& graph ) {
+        // each edge is stored at its lowest vertex
+        for ( CHVertex u = 0; u < num_vertices( graph ); u++ ) {
+            for ( auto oei = out_edges( u, graph ).first; oei != out_edges( u, graph ).second; oei++ ) {
+                lower[target( *oei, graph )].push_back( u );
             }
-            else if ( !res_i[6].is_null() ) {
-                res_i[6] >> eid;
+            for ( auto iei = in_edges( u, graph ).first; iei != in_edges( u, graph ).second; iei++ ) {
+                lower[source( *iei, graph )].push_back( u );
             }
-            if ( dir == 0 ) {
-                upd++;
+        }
+    };
+    for ( const CHQuery* graph : graphs ) {
+        add_lower( *graph );
+    }
+    if ( td_graph ) {
+        for ( uint32_t u = 0; u < td_graph->num_vertices(); u++ ) {
+            for ( uint32_t e = td_graph->out_edges( u ).first; e != td_graph->out_edges( u ).second; e++ ) {
+                const uint32_t v = td_graph->edge( e ).target;
+                lower[std::max( u, v )].push_back( std::min( u, v ) );
             }
-            CHEdgeProperty p;
-            p.b.cost = res_i[2];
-            p.db_id = eid;
-            p.b.is_shortcut = 0;
-            if ( !res_i[3].is_null() ) {
-                uint32_t middle = res_i[3].as<uint32_t>();
-                // we have a middle node, it is a shortcut
-                p.b.is_shortcut = 1;
-                if ( dir == 0 ) {
-                    middle_node[std::make_pair(id1, id2)] = middle;
-                }
-                else {
-                    middle_node[std::make_pair(id2, id1)] = middle;
+        }
+    }
+
+    // Post-order of an iterative depth-first search down the hierarchy, from the highest vertices.
+    // A lower neighbour of a vertex cannot be on the stack above it, it is then numbered before.
+    std::vector<CHVertex> new_number( n );
+    std::vector<bool> visited( n, false );
+    std::vector<std::pair<CHVertex, size_t>> stack;
+    CHVertex next = 0;
+    for ( CHVertex root = CHVertex( n ); root-- > 0; ) {
+        if ( visited[root] ) {
+            continue;
+        }
+        visited[root] = true;
+        stack.push_back( std::make_pair( root, 0 ) );
+        while ( !stack.empty() ) {
+            const CHVertex v = stack.back().first;
+            if ( stack.back().second < lower[v].size() ) {
+                const CHVertex u = lower[v][stack.back().second++];
+                if ( !visited[u] ) {
+                    visited[u] = true;
+                    stack.push_back( std::make_pair( u, 0 ) );
                 }
             }
-            properties.emplace_back( p );
-            targets.emplace_back( std::make_pair(id1, id2) );
+            else {
+                new_number[v] = next++;
+                stack.pop_back();
+            }
         }
-        up_degrees.push_back( upd );
+    }
+    return new_number;
+}
 
-        for ( uint32_t i = 0; i < num_nodes - up_degrees.size(); i++ ) {
-            up_degrees.push_back( 0 );
+std::vector<CHVertex> CHRoutingData::locality_order() const
+{
+    std::vector<const CHQuery*> graphs( 1, ch_query_.get() );
+    for ( const auto& p : metrics_ ) {
+        if ( !metric_ranks( p.first ) ) {
+            graphs.push_back( p.second.get() );
         }
+    }
+    // a time-dependent graph in the order of a metric is renumbered with it
+    return locality_order_of( num_vertices( *ch_query_ ), graphs, metric_ranks( td_graph_metric_ ) ? nullptr : td_graph_.get() );
+}
 
-        ch_query.reset( new CHQueryGraph<CHEdgeProperty>( targets.begin(), targets.end(), num_nodes, up_degrees.begin(), properties.begin() ) );
-        std::cout << "OK" << std::endl;
+std::vector<CHVertex> CHRoutingData::locality_order( const std::string& metric ) const
+{
+    if ( !metric_ranks( metric ) ) {
+        throw std::invalid_argument( "The metric " + metric + " has the vertices of the CH graph" );
     }
+    const CHQuery& graph = ch_query( metric );
+    return locality_order_of( num_vertices( graph ), std::vector<const CHQuery*>( 1, &graph ), metric == td_graph_metric_ ? td_graph_.get() : nullptr );
+}
+
+///
+/// Copy of a query graph that does not view any memory it does not own
+static std::unique_ptr<CHQuery> owned_query_graph( const CHQuery& graph )
+{
+    return std::unique_ptr<CHQuery>( new CHQuery( FlatArray<CHQuery::FirstEdgeIndex>( std::vector<CHQuery::FirstEdgeIndex>( graph.edge_index_array().begin(), graph.edge_index_array().end() ) ),
+                                                  FlatArray<CHQuery::EdgeData>( std::vector<CHQuery::EdgeData>( graph.edge_array().begin(), graph.edge_array().end() ) ),
+                                                  FlatArray<CHEdgeDetails>( std::vector<CHEdgeDetails>( graph.cold_array().begin(), graph.cold_array().end() ) ) ) );
+}
+
+///
+/// Copy of a linked query graph with renumbered vertices, shortcuts linked again
+static std::unique_ptr<CHQuery> renumber_query_graph( const CHQuery& graph, const std::vector<CHVertex>& new_number )
+{
+    struct RenumberedEdge
     {
-        node_id.resize( num_nodes );
-        Db::ResultIterator res_it = conn.exec_it( (boost::format("select node_id from %1%.ordered_nodes order by id asc") % schema).str() );
-        Db::ResultIterator it_end;
-        uint32_t v = 0;
-        for ( ; res_it != it_end; res_it++, v++ ) {
-            Db::RowValue res_i = *res_it;
-            db_id_t id = res_i[0];
-            BOOST_ASSERT( v < node_id.size() );
-            node_id[v] = id;
+        CHVertex lowest;
+        bool downward;
+        CHVertex highest;
+        CHEdgeProperty property;
+    };
+    std::vector<RenumberedEdge> edges;
+    edges.reserve( graph.edge_array().size() );
+    MiddleNodeMap middle_node;
+
+    auto add = [&]( const CHEdge& e ) {
+        const CHVertex u = new_number[e.source()];
+        const CHVertex v = new_number[e.target()];
+        const bool upward = e.source() < e.target();
+        if ( ( u < v ) != upward ) {
+            throw std::invalid_argument( (boost::format( "The new numbering inverts the edge %1% -> %2%" ) % e.source() % e.target()).str() );
+        }
+        RenumberedEdge re;
+        std::memset( &re.property, 0, sizeof( re.property ) );
+        re.lowest = std::min( u, v );
+        re.downward = !upward;
+        re.highest = std::max( u, v );
+        re.property.data = e.property().data;
+        if ( e.property().b.is_shortcut ) {
+            middle_node[std::make_pair( u, v )] = new_number[graph.edge_details( e ).middle];
+        }
+        else {
+            re.property.db_id = graph.edge_details( e ).db_id;
+        }
+        edges.push_back( re );
+    };
+    for ( CHVertex u = 0; u < num_vertices( graph ); u++ ) {
+        for ( auto oei = out_edges( u, graph ).first; oei != out_edges( u, graph ).second; oei++ ) {
+            add( *oei );
+        }
+        for ( auto iei = in_edges( u, graph ).first; iei != in_edges( u, graph ).second; iei++ ) {
+            add( *iei );
+        }
+    }
+
+    // order of the query graph constructor: by lowest vertex, upward edges first
+    std::sort( edges.begin(), edges.end(), []( const RenumberedEdge& a, const RenumberedEdge& b ) {
+            return std::tie( a.lowest, a.downward, a.highest ) < std::tie( b.lowest, b.downward, b.highest );
+        });
+    std::vector<std::pair<CHVertex, CHVertex>> targets;
+    std::vector<CHEdgeProperty> properties;
+    std::vector<uint32_t> up_degrees( new_number.size(), 0 );
+    targets.reserve( edges.size() );
+    properties.reserve( edges.size() );
+    for ( const RenumberedEdge& re : edges ) {
+        targets.push_back( std::make_pair( re.lowest, re.highest ) );
+        properties.push_back( re.property );
+        if ( !re.downward ) {
+            up_degrees[re.lowest]++;
+        }
+    }
+    CHQuery renumbered( targets.begin(), targets.end(), new_number.size(), up_degrees.begin(), properties.begin() );
+    return link_shortcuts( renumbered, middle_node );
+}
+
+void CHRoutingData::renumber_vertices( const std::vector<CHVertex>& new_number )
+{
+    const size_t n = num_vertices( *ch_query_ );
+    check_permutation( new_number, n, "renumber_vertices" );
+
+    // every graph is renumbered before anything is replaced
+    std::unique_ptr<CHQuery> ch_query = renumber_query_graph( *ch_query_, new_number );
+    std::map<std::string, std::unique_ptr<CHQuery>> metrics;
+    std::map<std::string, CHMetricRanks> ranks_by_metric;
+    for ( const auto& p : metrics_ ) {
+        const CHMetricRanks* ranks = metric_ranks( p.first );
+        if ( !ranks ) {
+            metrics[p.first] = renumber_query_graph( *p.second, new_number );
+            continue;
+        }
+        // the graph keeps its ranks, it is only copied out of the mapped file
+        metrics[p.first] = owned_query_graph( *p.second );
+        std::vector<CHVertex> rank( n );
+        for ( CHVertex v = 0; v < n; v++ ) {
+            rank[new_number[v]] = ranks->rank[v];
+        }
+        ranks_by_metric[p.first] = inverse_ranks( std::move( rank ) );
+    }
+    std::map<std::string, FlatArray<CHSectionCosts>> section_costs;
+    for ( const auto& p : section_costs_ ) {
+        section_costs[p.first] = FlatArray<CHSectionCosts>( std::vector<CHSectionCosts>( p.second.begin(), p.second.end() ) );
+    }
+    std::unique_ptr<TDCHGraph> td_graph;
+    if ( td_graph_ && metric_ranks( td_graph_metric_ ) ) {
+        // it keeps the ranks of its metric, it is only copied out of the mapped file
+        std::vector<uint32_t> same_number( n );
+        for ( uint32_t v = 0; v < n; v++ ) {
+            same_number[v] = v;
         }
+        td_graph = td_graph_->renumbered( same_number );
+    }
+    else if ( td_graph_ ) {
+        td_graph = td_graph_->renumbered( new_number );
+    }
+    std::unique_ptr<CHTurnGraph> turn_graph;
+    if ( turn_graph_ ) {
+        turn_graph = turn_graph_->renumbered_nodes( new_number );
+    }
+    std::unique_ptr<CHSectionIndex> section_index;
+    if ( section_index_ ) {
+        section_index = section_index_->renumbered_vertices( new_number );
+    }
+
+    std::vector<db_id_t> node_id( n );
+    for ( CHVertex v = 0; v < n; v++ ) {
+        node_id[new_number[v]] = node_id_[v];
+    }
+    std::vector<NodeIdIndex> rnode_id( rnode_id_.begin(), rnode_id_.end() );
+    for ( NodeIdIndex& ni : rnode_id ) {
+        ni.index = new_number[ni.index];
     }
 
+    ch_query_ = std::move( ch_query );
+    metrics_ = std::move( metrics );
+    metric_ranks_ = std::move( ranks_by_metric );
+    td_graph_ = std::move( td_graph );
+    turn_graph_ = std::move( turn_graph );
+    section_index_ = std::move( section_index );
+    section_costs_ = std::move( section_costs );
+    node_id_ = FlatArray<db_id_t>( std::move( node_id ) );
+    rnode_id_ = FlatArray<NodeIdIndex>( std::move( rnode_id ) );
+    // nothing views the mapped file anymore
+    file_.reset();
+}
+
+void CHRoutingData::renumber_metric_vertices( const std::string& metric, const std::vector<CHVertex>& new_number )
+{
+    const CHMetricRanks* ranks = metric_ranks( metric );
+    if ( !ranks ) {
+        throw std::invalid_argument( "The metric " + metric + " has the vertices of the CH graph, see renumber_vertices()" );
+    }
+    const size_t n = num_vertices( *ch_query_ );
+    check_permutation( new_number, n, "renumber_metric_vertices" );
+
+    std::unique_ptr<CHQuery> graph = renumber_query_graph( *metrics_[metric], new_number );
+    std::unique_ptr<TDCHGraph> td_graph;
+    if ( td_graph_ && metric == td_graph_metric_ ) {
+        td_graph = td_graph_->renumbered( new_number );
+    }
+    std::vector<CHVertex> rank( n );
+    for ( CHVertex v = 0; v < n; v++ ) {
+        rank[v] = new_number[ranks->rank[v]];
+    }
+    // other arrays may still view the mapped file, it is kept
+    metrics_[metric] = std::move( graph );
+    if ( td_graph ) {
+        td_graph_ = std::move( td_graph );
+    }
+    metric_ranks_[metric] = inverse_ranks( std::move( rank ) );
+}
+
+std::unique_ptr<CHQuery> cch_query_graph( const CCHTopology& topology, const CCHMetric& metric, const std::vector<db_id_t>& edge_db_id, MiddleNodeMap& middle_node )
+{
+    if ( edge_db_id.size() != topology.num_input_edges() ) {
+        throw std::invalid_argument( "cch_query_graph: one ID per input edge is expected" );
+    }
+
+    std::vector<std::pair<uint32_t,uint32_t>> targets;
+    std::vector<CHEdgeProperty> properties;
+    std::vector<uint32_t> up_degrees( topology.num_vertices(), 0 );
+
+    auto add_property = [&]( uint32_t cost, uint32_t middle, uint32_t input_edge ) {
+        CHEdgeProperty p;
+        p.b.cost = cost;
+        p.b.is_shortcut = middle != CCHMetric::no_middle();
+        p.db_id = p.b.is_shortcut ? 0 : edge_db_id[input_edge];
+        properties.push_back( p );
+    };
+
+    // forbidden arcs (infinite costs) are not part of the query graph
+    for ( CHVertex u = 0; u < topology.num_vertices(); u++ ) {
+        // upward edges u -> v
+        for ( uint32_t a = topology.first_arc( u ); a < topology.first_arc( u + 1 ); a++ ) {
+            if ( metric.up_cost[a] < CCHMetric::infinity() ) {
+                CHVertex v = topology.arc_head( a );
+                add_property( metric.up_cost[a], metric.up_middle[a], metric.up_edge[a] );
+                targets.push_back( std::make_pair( u, v ) );
+                up_degrees[u]++;
+                if ( metric.up_middle[a] != CCHMetric::no_middle() ) {
+                    middle_node[std::make_pair( u, v )] = metric.up_middle[a];
+                }
+            }
+        }
+        // downward edges v -> u
+        for ( uint32_t a = topology.first_arc( u ); a < topology.first_arc( u + 1 ); a++ ) {
+            if ( metric.down_cost[a] < CCHMetric::infinity() ) {
+                CHVertex v = topology.arc_head( a );
+                add_property( metric.down_cost[a], metric.down_middle[a], metric.down_edge[a] );
+                targets.push_back( std::make_pair( u, v ) );
+                if ( metric.down_middle[a] != CCHMetric::no_middle() ) {
+                    middle_node[std::make_pair( v, u )] = metric.down_middle[a];
+                }
+            }
+        }
+    }
+
+    return std::unique_ptr<CHQuery>( new CHQuery( targets.begin(), targets.end(), topology.num_vertices(), up_degrees.begin(), properties.begin() ) );
+}
+
+///
+/// Load a query graph from a table of a CH schema, with vertices numbered following an ordering table of the schema, e.g. ordered_nodes
+static std::unique_ptr<CHQuery> load_query_graph( Db::Connection& conn, const std::string& schema, const std::string& table, const std::string& ordering,
+                                                  uint32_t num_nodes, MiddleNodeMap& middle_node )
+{
+    // read by means of a COPY, much faster than a cursor on large graphs
+    Db::CopyReader res_i = conn.copy_out( (boost::format( "select * from\n"
+                                                              "(\n"
+                                              // the upward part
+                                              "select o1.sort_order as id1, o2.sort_order as id2, weight, o3.sort_order as mid, 0 as dir, rs1.id as eid1, rs2.id as eid2, o1.node_id, o2.node_id, o3.node_id\n"
+                                              "from %1%.%2%\n"
+                                              "left join %1%.%3% as o3 on o3.node_id = contracted_id\n"
+                                              "left join tempus.road_section as rs1 on rs1.node_from = node_inf and rs1.node_to = node_sup\n"
+                                              "left join tempus.road_section as rs2 on rs2.node_from = node_sup and rs2.node_to = node_inf\n"
+                                              ", %1%.%3% as o1, %1%.%3% as o2\n"
+                                              "where o1.node_id = node_inf and o2.node_id = node_sup\n"
+                                              "and %2%.\"constraints\" & 1 > 0\n"
+
+                                              // union with the downward part
+                                              "union all\n"
+                                              "select o1.sort_order as id1, o2.sort_order as id2, weight, o3.sort_order as mid, 1 as dir, rs1.id as eid1, rs2.id as eid2, o1.node_id, o2.node_id, o3.node_id\n"
+                                              "from %1%.%2%\n"
+                                              "left join %1%.%3% as o3 on o3.node_id = contracted_id\n"
+                                              "left join tempus.road_section as rs1 on rs1.node_from = node_inf and rs1.node_to = node_sup\n"
+                                              "left join tempus.road_section as rs2 on rs2.node_from = node_sup and rs2.node_to = node_inf\n"
+                                              ", %1%.%3% as o1, %1%.%3% as o2\n"
+                                              "where o1.node_id = node_inf and o2.node_id = node_sup\n"
+                                              "and %2%.\"constraints\" & 2 > 0\n"
+                                                             ") t order by id1, dir, id2, weight asc" ) % schema % table % ordering).str()
+                                              );
+
+    std::vector<std::pair<uint32_t,uint32_t>> targets;
+    std::vector<CHEdgeProperty> properties;
+    std::vector<uint16_t> up_degrees;
+
+    uint16_t upd = 0;
+    uint32_t old_id1 = 0;
+    uint32_t old_id2 = 0;
+    int old_dir = 0;
+    bool first = true;
+    while ( res_i.next() ) {
+        uint32_t id1 = res_i[0].as<uint32_t>();
+        uint32_t id2 = res_i[1].as<uint32_t>();
+        int dir = res_i[4];
+        if ( first ) {
+            first = false;
+        }
+        else {
+            if ( (id1 == old_id1) && (id2 == old_id2) && (dir == old_dir) ) {
+                // we may have the same edges with different costs
+                // we then skip the duplicates and only take
+                // the first one (the one with the smallest weight)
+                continue;
+            }
+            if ( id1 > old_id1 ) {
+                up_degrees.push_back( upd );
+                if ( id1 > old_id1 + 1 ) {
+                    // update up_degrees for vertex without outgoing edges
+                    for ( uint32_t i = 0; i < id1 - old_id1 - 1; i++ ) {
+                        up_degrees.push_back( 0 );
+                    }
+                }
+                upd = 0;
+            }
+        }
+        old_id1 = id1;
+        old_id2 = id2;
+        old_dir = dir;
+
+        db_id_t vid1, vid2;
+        res_i[7] >> vid1;
+        res_i[8] >> vid2;
+
+        db_id_t eid = 0;
+        if ( !res_i[5].is_null() ) {
+            res_i[5] >> eid;
+        }
+        else if ( !res_i[6].is_null() ) {
+            res_i[6] >> eid;
+        }
+        if ( dir == 0 ) {
+            upd++;
+        }
+        CHEdgeProperty p;
+        p.b.cost = res_i[2];
+        p.db_id = eid;
+        p.b.is_shortcut = 0;
+        if ( !res_i[3].is_null() ) {
+            uint32_t middle = res_i[3].as<uint32_t>();
+            // we have a middle node, it is a shortcut
+            p.b.is_shortcut = 1;
+            if ( dir == 0 ) {
+                middle_node[std::make_pair(id1, id2)] = middle;
+            }
+            else {
+                middle_node[std::make_pair(id2, id1)] = middle;
+            }
+        }
+        properties.emplace_back( p );
+        targets.emplace_back( std::make_pair(id1, id2) );
+    }
+    up_degrees.push_back( upd );
+
+    for ( uint32_t i = 0; i < num_nodes - up_degrees.size(); i++ ) {
+        up_degrees.push_back( 0 );
+    }
+
+    std::unique_ptr<CHQuery> ch_query( new CHQuery( targets.begin(), targets.end(), num_nodes, up_degrees.begin(), properties.begin() ) );
+    std::cout << "OK" << std::endl;
+
     // check consistency
     {
         CHQuery& ch = *ch_query;
@@ -203,8 +951,8 @@ std::unique_ptr<RoutingData> CHRoutingDataBuilder::pg_import( const std::string&
     }
     {
         CHQuery& ch = *ch_query;
-        auto it_end = edges( ch ).second;
-        for ( auto it = edges( ch ).first; it != it_end; it++ ) {
+        auto eit_end = edges( ch ).second;
+        for ( auto it = edges( ch ).first; it != eit_end; it++ ) {
             CHVertex u = source( *it, ch );
             CHVertex v = target( *it, ch );
             bool found = false;
@@ -217,30 +965,263 @@ std::unique_ptr<RoutingData> CHRoutingDataBuilder::pg_import( const std::string&
         }
     }
 
-    std::unique_ptr<RoutingData> rd( new CHRoutingData( std::move(ch_query), std::move(middle_node), std::move(node_id) ) );
+    return ch_query;
+}
+
+std::unique_ptr<RoutingData> CHRoutingDataBuilder::pg_import( const std::string& pg_options, ProgressionCallback&, const VariantMap& options ) const
+{
+    std::unique_ptr<CHQuery> ch_query;
+    MiddleNodeMap middle_node;
+    std::vector<db_id_t> node_id;
 
-    // import transport modes
+    std::string schema = "ch";
+    if ( options.find( "ch/schema" ) != options.end() ) {
+        schema = options.find( "ch/schema" )->second.str();
+    }
+    std::cout << "schema : " << schema << std::endl;
+    
+    Db::Connection conn( pg_options );
+
+    uint32_t num_nodes = 0;
+    {
+        Db::Result r( conn.exec( (boost::format("select count(*) from %1%.ordered_nodes") % schema).str() ) );
+        BOOST_ASSERT( r.size() == 1 );
+        r[0][0] >> num_nodes;
+    }
+    ch_query = load_query_graph( conn, schema, "query_graph", "ordered_nodes", num_nodes, middle_node );
+    {
+        node_id.resize( num_nodes );
+        Db::CopyReader res_i = conn.copy_out( (boost::format("select node_id from %1%.ordered_nodes order by id asc") % schema).str() );
+        uint32_t v = 0;
+        for ( ; res_i.next(); v++ ) {
+            db_id_t id = res_i[0];
+            BOOST_ASSERT( v < node_id.size() );
+            node_id[v] = id;
+        }
+    }
+
+    std::unique_ptr<CHRoutingData> ch_rd( new CHRoutingData( std::move(ch_query), std::move(middle_node), std::move(node_id) ) );
+
+    // metric of the query_graph table, e.g. its transport mode
+    if ( options.find( "ch/default_metric" ) != options.end() ) {
+        ch_rd->set_default_metric_name( options.find( "ch/default_metric" )->second.str() );
+    }
+
+    // additional metrics, stored in query_graph_<metric> tables.
+    // A metric contracted in its own order has an ordered_nodes_<metric> table
+    if ( options.find( "ch/metrics" ) != options.end() ) {
+        std::vector<std::string> metrics;
+        std::string metrics_str = options.find( "ch/metrics" )->second.str();
+        boost::split( metrics, metrics_str, boost::is_any_of( "," ), boost::token_compress_on );
+        for ( const std::string& metric : metrics ) {
+            if ( metric.empty() ) {
+                continue;
+            }
+            std::cout << "metric : " << metric << std::endl;
+            bool has_ordering = false;
+            {
+                Db::Result r( conn.exec( (boost::format( "select * from information_schema.tables where table_name='ordered_nodes_%1%' and table_schema='%2%'" ) % metric % schema).str() ) );
+                has_ordering = r.size() == 1;
+            }
+            MiddleNodeMap metric_middle_node;
+            std::unique_ptr<CHQuery> metric_query = load_query_graph( conn, schema, "query_graph_" + metric, has_ordering ? "ordered_nodes_" + metric : "ordered_nodes",
+                                                                      num_nodes, metric_middle_node );
+            std::vector<CHVertex> rank;
+            if ( has_ordering ) {
+                rank.resize( num_nodes );
+                Db::CopyReader res_i = conn.copy_out( (boost::format( "select o.sort_order, m.sort_order from %1%.ordered_nodes as o join %1%.ordered_nodes_%2% as m on m.node_id = o.node_id" ) % schema % metric).str() );
+                while ( res_i.next() ) {
+                    // add_metric() checks that the ranks are a permutation
+                    const uint32_t v = res_i[0].as<uint32_t>();
+                    if ( v < num_nodes ) {
+                        rank[v] = res_i[1].as<uint32_t>();
+                    }
+                }
+            }
+            ch_rd->add_metric( metric, std::move( metric_query ), std::move( metric_middle_node ), std::move( rank ) );
+        }
+    }
+    // road sections between vertices of the graph, straight segments between their nodes
+    {
+        std::vector<CHSection> sections;
+        Db::CopyReader res_i = conn.copy_out( "select rs.id, rs.node_from, rs.node_to, st_x(n1.geom), st_y(n1.geom), st_x(n2.geom), st_y(n2.geom)\n"
+                                              "from tempus.road_section as rs\n"
+                                              "join tempus.road_node as n1 on n1.id = rs.node_from\n"
+                                              "join tempus.road_node as n2 on n2.id = rs.node_to\n"
+                                              "order by rs.id" );
+        while ( res_i.next() ) {
+            boost::optional<CHVertex> from = ch_rd->vertex_from_id( res_i[1].as<db_id_t>() );
+            boost::optional<CHVertex> to = ch_rd->vertex_from_id( res_i[2].as<db_id_t>() );
+            if ( !from || !to ) {
+                continue;
+            }
+            sections.push_back( CHSection{ res_i[0].as<db_id_t>(), from.get(), to.get(),
+                                           res_i[3].as<float>(), res_i[4].as<float>(), res_i[5].as<float>(), res_i[6].as<float>() } );
+        }
+        std::cout << "sections : " << sections.size() << std::endl;
+        ch_rd->set_section_index( std::unique_ptr<CHSectionIndex>( new CHSectionIndex( std::move( sections ) ) ) );
+    }
+
+    // import transport modes, the ones of the imported metrics: the default one and each query_graph_<metric>
     RoutingData::TransportModes all_modes = load_transport_modes( conn );
     RoutingData::TransportModes modes;
-    // keep only pedestrian
-    modes[TransportModeWalking] = all_modes[TransportModeWalking];
-    rd->set_transport_modes( modes );
+    for ( db_id_t mode : { db_id_t( TransportModeWalking ), db_id_t( TransportModePrivateBicycle ), db_id_t( TransportModePrivateCar ) } ) {
+        try {
+            ch_rd->transport_mode_metric( mode );
+        }
+        catch ( std::runtime_error& ) {
+            continue;
+        }
+        auto it = all_modes.find( mode );
+        if ( it != all_modes.end() ) {
+            modes[mode] = it->second;
+        }
+    }
+    ch_rd->set_transport_modes( modes );
+
+    std::unique_ptr<RoutingData> rd( ch_rd.release() );
 
     return std::move( rd );
 }
 
+// names of the sections of a flat file: graph/edges, metric/<name>/edges, etc.
+static const std::string metric_section_prefix = "metric/";
+static const std::string metric_edges_suffix = "/edges";
+
+static std::string graph_section_prefix( const std::string& metric )
+{
+    return metric.empty() ? "graph/" : metric_section_prefix + metric + "/";
+}
+
+// middle nodes of a version 3 flat file, sorted by (from, to)
+struct FlatMiddleNode
+{
+    CHVertex from;
+    CHVertex to;
+    CHVertex middle;
+};
+
 std::unique_ptr<RoutingData> CHRoutingDataBuilder::file_import( const std::string& filename, ProgressionCallback& /*progression**/, const VariantMap& /*options*/ ) const
 {
-    std::ifstream ifs( filename );
+    std::ifstream ifs( filename, std::ios::binary );
     if ( ifs.fail() ) {
         throw std::runtime_error( "Problem opening input file " + filename );
     }
 
-    read_header( ifs );
+    uint32_t file_version = read_header( ifs );
+
+    if ( file_version >= 3 ) {
+        // flat file, arrays are used in place
+        std::unique_ptr<FlatFileReader> file( new FlatFileReader( filename, size_t( ifs.tellg() ) ) );
+        ifs.close();
+
+        std::unique_ptr<CHRoutingData> ch_rd( new CHRoutingData() );
+        auto load_graph = [&file, file_version]( const std::string& metric, std::unique_ptr<CHQuery>& query ) {
+            const std::string prefix = graph_section_prefix( metric );
+            if ( file_version >= 5 ) {
+                query.reset( new CHQuery( file->section<CHQuery::FirstEdgeIndex>( prefix + "edge_index" ),
+                                          file->section<CHQuery::EdgeData>( prefix + "edges" ),
+                                          file->section<CHEdgeDetails>( prefix + "edge_details" ) ) );
+                return;
+            }
+            // whole properties next to the targets, the graph is copied to the split layout
+            query = split_query_graph( CHQueryAoS( file->section<CHQueryAoS::FirstEdgeIndex>( prefix + "edge_index" ),
+                                                   file->section<CHQueryAoS::EdgeData>( prefix + "edges" ) ) );
+            if ( file_version == 3 ) {
+                // shortcuts are not linked to their edges yet, the graph is copied
+                MiddleNodeMap middle_node;
+                for ( const FlatMiddleNode& m : file->section<FlatMiddleNode>( prefix + "middle_node" ) ) {
+                    middle_node[std::make_pair( m.from, m.to )] = m.middle;
+                }
+                query = link_shortcuts( *query, middle_node );
+            }
+        };
+
+        std::cout << "map graph" << std::endl;
+        load_graph( "", ch_rd->ch_query_ );
+        ch_rd->node_id_ = file->section<db_id_t>( "node_id" );
+        ch_rd->rnode_id_ = file->section<CHRoutingData::NodeIdIndex>( "node_id_index" );
+        if ( file->has_section( "default_metric" ) ) {
+            FlatArray<char> name = file->section<char>( "default_metric" );
+            ch_rd->default_metric_name_.assign( name.begin(), name.end() );
+        }
+        if ( ch_rd->node_id_.size() != num_vertices( *ch_rd->ch_query_ ) || ch_rd->rnode_id_.size() != ch_rd->node_id_.size() ) {
+            throw std::runtime_error( "Inconsistent number of vertices in " + filename );
+        }
+
+        // metrics are found from their sections
+        for ( const std::string& section : file->section_names() ) {
+            if ( boost::starts_with( section, metric_section_prefix ) && boost::ends_with( section, metric_edges_suffix ) ) {
+                std::string name = section.substr( metric_section_prefix.size(), section.size() - metric_section_prefix.size() - metric_edges_suffix.size() );
+                std::cout << "map metric " << name << std::endl;
+                std::unique_ptr<CHQuery>& metric_query = ch_rd->metrics_[name];
+                load_graph( name, metric_query );
+                if ( num_vertices( *metric_query ) != num_vertices( *ch_rd->ch_query_ ) ) {
+                    throw std::runtime_error( "The graph of metric " + name + " does not have the vertices of the CH graph" );
+                }
+                if ( file->has_section( graph_section_prefix( name ) + "rank" ) ) {
+                    CHMetricRanks& ranks = ch_rd->metric_ranks_[name];
+                    ranks.rank = file->section<CHVertex>( graph_section_prefix( name ) + "rank" );
+                    ranks.vertex = file->section<CHVertex>( graph_section_prefix( name ) + "rank_vertex" );
+                    if ( ranks.rank.size() != num_vertices( *metric_query ) || ranks.vertex.size() != ranks.rank.size() ) {
+                        throw std::runtime_error( "Inconsistent node ordering of metric " + name + " in " + filename );
+                    }
+                }
+            }
+        }
+
+        if ( file->has_section( "td_graph/edge_index" ) ) {
+            std::cout << "map time-dependent graph" << std::endl;
+            std::string td_metric;
+            if ( file->has_section( "td_graph/metric" ) ) {
+                FlatArray<char> name = file->section<char>( "td_graph/metric" );
+                td_metric.assign( name.begin(), name.end() );
+            }
+            ch_rd->set_td_graph( std::unique_ptr<TDCHGraph>( new TDCHGraph( file->section<uint32_t>( "td_graph/edge_index" ),
+                                                                             file->section<TDCHEdge>( "td_graph/edges" ),
+                                                                             file->section<TTFPoint>( "td_graph/points" ),
+                                                                             file->section<uint32_t>( "td_graph/down_index" ),
+                                                                             file->section<TDCHDownEdge>( "td_graph/down_edges" ) ) ),
+                                  td_metric );
+        }
+
+        if ( file->has_section( "turn_graph/vertices" ) ) {
+            std::cout << "map edge-based graph" << std::endl;
+            std::unique_ptr<CHQuery> turn_query( new CHQuery( file->section<CHQuery::FirstEdgeIndex>( "turn_graph/edge_index" ),
+                                                              file->section<CHQuery::EdgeData>( "turn_graph/edges" ),
+                                                              file->section<CHEdgeDetails>( "turn_graph/edge_details" ) ) );
+            FlatArray<char> name = file->section<char>( "turn_graph/metric" );
+            ch_rd->set_turn_graph( std::string( name.begin(), name.end() ),
+                                   std::unique_ptr<CHTurnGraph>( new CHTurnGraph( std::move( turn_query ),
+                                                                                  file->section<CHTurnVertex>( "turn_graph/vertices" ),
+                                                                                  file->section<uint32_t>( "turn_graph/out_index" ),
+                                                                                  file->section<uint32_t>( "turn_graph/out_vertices" ),
+                                                                                  file->section<uint32_t>( "turn_graph/in_index" ),
+                                                                                  file->section<uint32_t>( "turn_graph/in_vertices" ) ) ) );
+        }
+
+        if ( file->has_section( "section_index/sections" ) ) {
+            std::cout << "map section index" << std::endl;
+            ch_rd->set_section_index( std::unique_ptr<CHSectionIndex>( new CHSectionIndex( file->section<CHSection>( "section_index/sections" ),
+                                                                                           file->section<CHSectionGrid>( "section_index/grid" ),
+                                                                                           file->section<uint32_t>( "section_index/cell_index" ),
+                                                                                           file->section<uint32_t>( "section_index/cell_sections" ) ) ) );
+            std::vector<std::string> metrics = ch_rd->metric_names();
+            metrics.push_back( "" );
+            for ( const std::string& metric : metrics ) {
+                if ( file->has_section( graph_section_prefix( metric ) + "section_costs" ) ) {
+                    ch_rd->set_section_costs( metric, file->section<CHSectionCosts>( graph_section_prefix( metric ) + "section_costs" ) );
+                }
+            }
+        }
+
+        ch_rd->file_ = std::move( file );
+        return std::unique_ptr<RoutingData>( ch_rd.release() );
+    }
 
     std::cout << "read graph" << std::endl;
-    std::unique_ptr<CHQuery> query( new CHQuery() );
-    query->unserialize( ifs, binary_serialization_t() );
+    CHQueryAoS query;
+    query.unserialize( ifs, binary_serialization_t() );
 
     std::cout << "read middle node" << std::endl;
     MiddleNodeMap middle_node;
@@ -250,24 +1231,96 @@ std::unique_ptr<RoutingData> CHRoutingDataBuilder::file_import( const std::strin
     std::vector<db_id_t> node_id;
     unserialize( ifs, node_id, binary_serialization_t() );
 
-    std::unique_ptr<RoutingData> rd( new CHRoutingData( std::move( query ), std::move( middle_node ), std::move( node_id ) ) );
+    std::unique_ptr<CHRoutingData> ch_rd( new CHRoutingData( split_query_graph( query ), std::move( middle_node ), std::move( node_id ) ) );
+
+    // additional metrics, since version 2
+    if ( file_version >= 2 ) {
+        uint32_t n_metrics = 0;
+        unserialize( ifs, n_metrics, binary_serialization_t() );
+        for ( uint32_t i = 0; i < n_metrics; i++ ) {
+            std::string name;
+            unserialize( ifs, name, binary_serialization_t() );
+            std::cout << "read metric " << name << std::endl;
+            CHQueryAoS metric_query;
+            metric_query.unserialize( ifs, binary_serialization_t() );
+            MiddleNodeMap metric_middle_node;
+            unserialize( ifs, metric_middle_node, binary_serialization_t() );
+            ch_rd->add_metric( name, split_query_graph( metric_query ), std::move( metric_middle_node ) );
+        }
+    }
+
+    std::unique_ptr<RoutingData> rd( ch_rd.release() );
     return rd;
 }
 
 void CHRoutingDataBuilder::file_export( const RoutingData* rd, const std::string& filename, ProgressionCallback& /*progression*/, const VariantMap& /*options*/ ) const
 {
-    std::ofstream ofs( filename );
+    std::ofstream ofs( filename, std::ios::binary );
+    if ( ofs.fail() ) {
+        throw std::runtime_error( "Problem opening output file " + filename );
+    }
 
     write_header( ofs );
 
     const CHRoutingData* mrd = static_cast<const CHRoutingData*>( rd );
 
-    // serialize the graph
-    mrd->ch_query_->serialize( ofs, binary_serialization_t() );
+    FlatFileWriter writer;
+    // shortcuts are written linked to their edges
+    auto add_graph = [&writer]( const std::string& metric, const CHQuery& query ) {
+        const std::string prefix = graph_section_prefix( metric );
+        writer.add( prefix + "edge_index", query.edge_index_array() );
+        writer.add( prefix + "edges", query.edge_array() );
+        writer.add( prefix + "edge_details", query.cold_array() );
+    };
+
+    add_graph( "", *mrd->ch_query_ );
+    writer.add( "node_id", mrd->node_id_ );
+    writer.add( "node_id_index", mrd->rnode_id_ );
+    if ( !mrd->default_metric_name_.empty() ) {
+        writer.add( "default_metric", mrd->default_metric_name_.data(), mrd->default_metric_name_.size() );
+    }
+    for ( const auto& p : mrd->metrics_ ) {
+        add_graph( p.first, *p.second );
+    }
+    for ( const auto& p : mrd->metric_ranks_ ) {
+        writer.add( graph_section_prefix( p.first ) + "rank", p.second.rank );
+        writer.add( graph_section_prefix( p.first ) + "rank_vertex", p.second.vertex );
+    }
+    if ( mrd->td_graph_ ) {
+        if ( !mrd->td_graph_metric_.empty() ) {
+            writer.add( "td_graph/metric", mrd->td_graph_metric_.data(), mrd->td_graph_metric_.size() );
+        }
+        writer.add( "td_graph/edge_index", mrd->td_graph_->edge_index_array() );
+        writer.add( "td_graph/edges", mrd->td_graph_->edge_array() );
+        writer.add( "td_graph/points", mrd->td_graph_->point_array() );
+        writer.add( "td_graph/down_index", mrd->td_graph_->down_index_array() );
+        writer.add( "td_graph/down_edges", mrd->td_graph_->down_edge_array() );
+    }
+
+    if ( mrd->turn_graph_ ) {
+        const CHTurnGraph& turn_graph = *mrd->turn_graph_;
+        writer.add( "turn_graph/metric", mrd->turn_graph_metric_.data(), mrd->turn_graph_metric_.size() );
+        writer.add( "turn_graph/edge_index", turn_graph.query_graph().edge_index_array() );
+        writer.add( "turn_graph/edges", turn_graph.query_graph().edge_array() );
+        writer.add( "turn_graph/edge_details", turn_graph.query_graph().cold_array() );
+        writer.add( "turn_graph/vertices", turn_graph.vertex_array() );
+        writer.add( "turn_graph/out_index", turn_graph.out_index_array() );
+        writer.add( "turn_graph/out_vertices", turn_graph.out_vertex_array() );
+        writer.add( "turn_graph/in_index", turn_graph.in_index_array() );
+        writer.add( "turn_graph/in_vertices", turn_graph.in_vertex_array() );
+    }
+
+    if ( mrd->section_index_ ) {
+        writer.add( "section_index/sections", mrd->section_index_->section_array() );
+        writer.add( "section_index/grid", mrd->section_index_->grid_array() );
+        writer.add( "section_index/cell_index", mrd->section_index_->cell_index_array() );
+        writer.add( "section_index/cell_sections", mrd->section_index_->cell_section_array() );
+        for ( const auto& p : mrd->section_costs_ ) {
+            writer.add( graph_section_prefix( p.first ) + "section_costs", p.second );
+        }
+    }
 
-    // middle node
-    serialize( ofs, mrd->middle_node_, binary_serialization_t() );
-    serialize( ofs, mrd->node_id_, binary_serialization_t() );
+    writer.write( ofs, size_t( ofs.tellp() ) );
 }
 
 REGISTER_BUILDER( CHRoutingDataBuilder )
@@ -18,8 +18,17 @@
 #define TEMPUS_CH_ROUTING_DATA_HH
 
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/format.hpp>
 
 #include "ch_query_graph.hh"
+#include "cch.hh"
+#include "ch_time_dependent.hh"
+#include "flat_file.hh"
 #include "routing_data.hh"
 #include "routing_data_builder.hh"
 #include "serializers.hh"
@@ -27,6 +36,8 @@
 namespace Tempus
 {
 
+///
+/// Property of an edge of a CH query graph, as given to its constructor
 struct CHEdgeProperty
 {
     union {
@@ -36,17 +47,30 @@ struct CHEdgeProperty
         } b;
         uint32_t data;
     };
-    db_id_t db_id;
+    /// Middle vertex of a shortcut, 0 for an original edge
+    uint32_t middle;
+    union {
+        /// Database ID of an original edge
+        db_id_t db_id;
+        /// Edges a shortcut is made of, by their index in the query graph (see CHQueryGraph::edge_index())
+        struct {
+            uint32_t first;
+            uint32_t second;
+        } unpack;
+    };
 
+    // middle vertices and unpacking indexes are not part of the stream format,
+    // they are set when a CHRoutingData is built
     void serialize( std::ostream& ostr, binary_serialization_t t ) const
     {
         Tempus::serialize( ostr, data, t );
-        Tempus::serialize( ostr, db_id, t );
+        Tempus::serialize( ostr, b.is_shortcut ? db_id_t( 0 ) : db_id, t );
     }
     void unserialize( std::istream& istr, binary_serialization_t t )
     {
         Tempus::unserialize( istr, data, t );
         Tempus::unserialize( istr, db_id, t );
+        middle = 0;
     }
 };
 
@@ -56,16 +80,376 @@ inline std::ostream& operator<<( std::ostream& ostr, const CHEdgeProperty& e )
     return ostr;
 }
 
-using CHQuery = CHQueryGraph<CHEdgeProperty>;
+///
+/// Hot part of a CHEdgeProperty, the only one read by searches
+struct CHEdgeCost
+{
+    union {
+        struct {
+            uint32_t cost        :31;
+            uint32_t is_shortcut :1;
+        } b;
+        uint32_t data;
+    };
+};
+
+///
+/// Cold part of a CHEdgeProperty, read when a path is unpacked or converted to a roadmap
+struct CHEdgeDetails
+{
+    uint32_t middle;
+    union {
+        db_id_t db_id;
+        struct {
+            uint32_t first;
+            uint32_t second;
+        } unpack;
+    };
+};
+
+///
+/// Tag selecting the split layout of CHEdgeProperty in a CHQueryGraph:
+/// costs are stored next to the targets (8 bytes per edge) and details in a parallel array
+struct CHSplitEdgeProperty;
+
+template <>
+struct CHEdgeLayout<CHSplitEdgeProperty>
+{
+    typedef CHEdgeProperty Input;
+    typedef CHEdgeCost HotProperty;
+    typedef CHEdgeDetails ColdProperty;
+    static const bool is_split = true;
+    static HotProperty hot( const Input& p )
+    {
+        HotProperty h;
+        h.data = p.data;
+        return h;
+    }
+    static ColdProperty cold( const Input& p )
+    {
+        ColdProperty c;
+        // no garbage in the padding bytes, that are written as is to flat files
+        std::memset( &c, 0, sizeof( c ) );
+        c.middle = p.middle;
+        c.db_id = p.db_id;
+        return c;
+    }
+};
+
+///
+/// Query graph of a CHRoutingData.
+/// Queries are faster with the split layout, see tests/ch_layout_benchmark.cc
+using CHQuery = CHQueryGraph<CHSplitEdgeProperty>;
+
+///
+/// Query graph with the whole properties next to the targets, the layout of version 4 files
+using CHQueryAoS = CHQueryGraph<CHEdgeProperty>;
 
 using CHVertex = uint32_t;
-using CHEdge = CHQueryGraph<CHEdgeProperty>::edge_descriptor;
+using CHEdge = CHQuery::edge_descriptor;
 
 ///
 /// storage of the "middle" node, i.e. the node involved
-/// in a shortcut
+/// in a shortcut, used to build a CHRoutingData.
+/// Once built, each shortcut of the query graph knows its middle node and the edges it is made of
 using MiddleNodeMap = std::map<std::pair<CHVertex, CHVertex>, CHVertex>;
 
+///
+/// Expansions of shortcuts, shared by concurrent queries on the same query graph.
+/// The cache is filled on the fly until it holds max_edges original edges, nothing is evicted afterwards
+class CHUnpackCache
+{
+public:
+    explicit CHUnpackCache( size_t max_edges ) : max_edges_( max_edges ) {}
+
+    ///
+    /// Append the original edges of a shortcut to out, if they are cached
+    bool find( uint32_t shortcut, std::vector<uint32_t>& out ) const;
+
+    ///
+    /// Store the original edges of a shortcut, unless the cache is full
+    void insert( uint32_t shortcut, const uint32_t* begin, const uint32_t* end );
+
+    ///
+    /// Number of cached original edges
+    size_t size() const;
+
+private:
+    size_t max_edges_;
+    mutable boost::shared_mutex mutex_;
+    // shortcut -> (offset, number) of its original edges in edges_
+    std::unordered_map<uint32_t, std::pair<size_t, size_t>> entries_;
+    std::vector<uint32_t> edges_;
+};
+
+///
+/// Replace the shortcuts of a path by the original edges they are made of.
+/// Edges are given by their index in the query graph (see CHQueryGraph::edge_index()).
+/// The expansion is iterative and does not allocate once the vectors have grown.
+/// \param graph The query graph, with its shortcuts linked (see link_ch_shortcuts())
+/// \param path Edges of the path, in order
+/// \param[out] out Original edges of the path are appended to it
+/// \param stack Storage for the expansion
+/// \param cache Cache of the expansions of the edges of path, if not null
+template <typename Graph>
+void unpack_ch_path( const Graph& graph, const std::vector<uint32_t>& path, std::vector<uint32_t>& out, std::vector<uint32_t>& stack, CHUnpackCache* cache = nullptr )
+{
+    for ( uint32_t e : path ) {
+        if ( !graph.edge_property( e ).b.is_shortcut ) {
+            out.push_back( e );
+            continue;
+        }
+        if ( cache && cache->find( e, out ) ) {
+            continue;
+        }
+
+        const size_t first = out.size();
+        // depth-first expansion, the first half of a shortcut is on top of the stack
+        stack.clear();
+        stack.push_back( e );
+        while ( !stack.empty() ) {
+            const uint32_t top = stack.back();
+            if ( graph.edge_property( top ).b.is_shortcut ) {
+                stack.back() = graph.edge_details( top ).unpack.second;
+                stack.push_back( graph.edge_details( top ).unpack.first );
+            }
+            else {
+                out.push_back( top );
+                stack.pop_back();
+            }
+        }
+
+        if ( cache ) {
+            cache->insert( e, out.data() + first, out.data() + out.size() );
+        }
+    }
+}
+
+///
+/// Copy of a query graph where each shortcut knows its middle vertex and the two edges it is made of.
+/// Throws std::runtime_error if the middle node or an edge of a shortcut is missing
+template <typename Graph>
+Graph link_ch_shortcuts( const Graph& graph, const MiddleNodeMap& middle_node )
+{
+    typedef typename Graph::edge_descriptor Edge;
+    return graph.copy_with_details( [&]( const Edge& e, typename Graph::ColdProperty& p ) {
+        if ( !graph.edge_property( graph.edge_index( e ) ).b.is_shortcut ) {
+            p.middle = 0;
+            return;
+        }
+        auto it = middle_node.find( std::make_pair( e.source(), e.target() ) );
+        if ( it == middle_node.end() ) {
+            throw std::runtime_error( (boost::format( "No middle node for the shortcut %1% -> %2%" ) % e.source() % e.target()).str() );
+        }
+        const CHVertex m = it->second;
+        // the middle node is contracted before the ends, so that unpacking terminates
+        Edge e1, e2;
+        bool found1 = false, found2 = false;
+        std::tie( e1, found1 ) = edge( e.source(), m, graph );
+        std::tie( e2, found2 ) = edge( m, e.target(), graph );
+        if ( m >= std::min( e.source(), e.target() ) || !found1 || !found2 ) {
+            throw std::runtime_error( (boost::format( "Inconsistent shortcut %1% -> %2% -> %3%" ) % e.source() % m % e.target()).str() );
+        }
+        p.middle = m;
+        p.unpack.first = graph.edge_index( e1 );
+        p.unpack.second = graph.edge_index( e2 );
+    } );
+}
+
+///
+/// Road section in one direction, vertex of a CHTurnGraph
+struct CHTurnVertex
+{
+    /// Database ID of the section
+    db_id_t db_id;
+    /// Vertices of the node-based graph the section goes from and to
+    CHVertex from;
+    CHVertex to;
+    /// Cost of the section, in the integer unit of the hierarchy
+    uint32_t cost;
+};
+
+///
+/// Edge-based hierarchy, that takes turn restrictions into account.
+///
+/// Vertices of the hierarchy are road sections in one direction ("turn vertices"), an edge x -> y is a turn
+/// from the section x onto the section y, whose cost is the cost of y plus the penalty of the turn, if any.
+/// Forbidden turns are not edges.
+/// A path between two nodes of the node-based graph starts at a section leaving the origin, with the cost
+/// of this section, and ends at a section reaching the destination (see bidirectional_ch_dijkstra()).
+class CHTurnGraph
+{
+public:
+    ///
+    /// Edge-based hierarchy out of its arrays, e.g. mapped from a file.
+    /// Throws std::invalid_argument if the sizes of the arrays are not consistent
+    /// \param graph The hierarchy of turn vertices, with its shortcuts linked
+    /// \param vertices Section of each vertex of graph
+    /// \param out_index Sections leaving node n are out_vertices[out_index[n]] to out_vertices[out_index[n+1]-1]
+    /// \param in_index Sections reaching node n are in_vertices[in_index[n]] to in_vertices[in_index[n+1]-1]
+    CHTurnGraph( std::unique_ptr<CHQuery> graph,
+                 FlatArray<CHTurnVertex>&& vertices,
+                 FlatArray<uint32_t>&& out_index,
+                 FlatArray<uint32_t>&& out_vertices,
+                 FlatArray<uint32_t>&& in_index,
+                 FlatArray<uint32_t>&& in_vertices );
+
+    ///
+    /// Edge-based hierarchy, sections leaving and reaching each node are computed.
+    /// Throws std::invalid_argument if a section is not between two nodes
+    /// \param num_nodes Number of vertices of the node-based graph
+    CHTurnGraph( std::unique_ptr<CHQuery> graph, std::vector<CHTurnVertex>&& vertices, size_t num_nodes );
+
+    const CHQuery& query_graph() const { return *graph_; }
+
+    const CHTurnVertex& turn_vertex( CHVertex v ) const { return vertices_[v]; }
+
+    size_t num_nodes() const { return out_index_.size() - 1; }
+
+    ///
+    /// Turn vertices of the sections leaving a node
+    std::pair<const uint32_t*, const uint32_t*> out_vertices( CHVertex node ) const
+    {
+        return std::make_pair( out_vertices_.data() + out_index_[node], out_vertices_.data() + out_index_[node + 1] );
+    }
+
+    ///
+    /// Turn vertices of the sections reaching a node
+    std::pair<const uint32_t*, const uint32_t*> in_vertices( CHVertex node ) const
+    {
+        return std::make_pair( in_vertices_.data() + in_index_[node], in_vertices_.data() + in_index_[node + 1] );
+    }
+
+    ///
+    /// Copy where the vertices of the node-based graph are renumbered, see CHRoutingData::renumber_vertices()
+    std::unique_ptr<CHTurnGraph> renumbered_nodes( const std::vector<CHVertex>& new_number ) const;
+
+    const FlatArray<CHTurnVertex>& vertex_array() const { return vertices_; }
+    const FlatArray<uint32_t>& out_index_array() const { return out_index_; }
+    const FlatArray<uint32_t>& out_vertex_array() const { return out_vertices_; }
+    const FlatArray<uint32_t>& in_index_array() const { return in_index_; }
+    const FlatArray<uint32_t>& in_vertex_array() const { return in_vertices_; }
+
+private:
+    std::unique_ptr<CHQuery> graph_;
+    FlatArray<CHTurnVertex> vertices_;
+    FlatArray<uint32_t> out_index_;
+    FlatArray<uint32_t> out_vertices_;
+    FlatArray<uint32_t> in_index_;
+    FlatArray<uint32_t> in_vertices_;
+};
+
+///
+/// Road section between two vertices of the CH graph, seen as a straight segment between the coordinates of its nodes
+struct CHSection
+{
+    /// Database ID of the section
+    db_id_t db_id;
+    CHVertex from;
+    CHVertex to;
+    /// Coordinates of the from and to nodes
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+};
+
+///
+/// Costs of a CHSection in both directions, in the integer unit of a query graph.
+/// The original edge of a section is not always an edge of the graph: among parallel sections only the cheapest one is kept,
+/// and a shortcut may replace an edge when it is cheaper
+struct CHSectionCosts
+{
+    /// Cost from the from vertex to the to vertex, or no_cost()
+    uint32_t forward;
+    /// Cost from the to vertex to the from vertex, or no_cost()
+    uint32_t backward;
+
+    /// Cost of a direction the section cannot be traveled in
+    static uint32_t no_cost() { return 0xFFFFFFFF; }
+};
+
+///
+/// Point of a road section a query starts or ends at, between the two vertices of the section ("phantom node")
+struct CHPhantomNode
+{
+    /// Index of the section in its CHSectionIndex
+    uint32_t section;
+    /// Position along the section, from 0 at its from vertex to 1 at its to vertex
+    float ratio;
+    /// Distance between the snapped point and the section, in the unit of the coordinates
+    float distance;
+};
+
+///
+/// Uniform grid of a CHSectionIndex
+struct CHSectionGrid
+{
+    /// Lower corner of the first cell
+    float x0;
+    float y0;
+    float cell_size;
+    uint32_t columns;
+    uint32_t rows;
+};
+
+///
+/// In-memory spatial index of the road sections of a CH graph, to snap coordinates to the nearest section
+/// without going through the database.
+/// Each section is stored in every cell of a uniform grid its bounding box overlaps.
+class CHSectionIndex
+{
+public:
+    ///
+    /// Index out of its arrays, e.g. mapped from a file.
+    /// Throws std::invalid_argument if the sizes of the arrays are not consistent
+    /// \param cell_index Sections of cell c (row * columns + column) are cell_sections[cell_index[c]] to cell_sections[cell_index[c+1]-1]
+    CHSectionIndex( FlatArray<CHSection>&& sections,
+                    FlatArray<CHSectionGrid>&& grid,
+                    FlatArray<uint32_t>&& cell_index,
+                    FlatArray<uint32_t>&& cell_sections );
+
+    ///
+    /// Index of sections, with cells of about two sections
+    explicit CHSectionIndex( std::vector<CHSection>&& sections );
+
+    size_t size() const { return sections_.size(); }
+
+    const CHSection& section( uint32_t i ) const { return sections_[i]; }
+
+    ///
+    /// Nearest point of the sections, none if there is no section within max_distance.
+    /// Cells are scanned by rings around the one of the point, until no closer section can be found
+    boost::optional<CHPhantomNode> nearest( float x, float y, float max_distance ) const;
+
+    ///
+    /// Copy where the vertices of the sections are renumbered, see CHRoutingData::renumber_vertices()
+    std::unique_ptr<CHSectionIndex> renumbered_vertices( const std::vector<CHVertex>& new_number ) const;
+
+    const FlatArray<CHSection>& section_array() const { return sections_; }
+    const FlatArray<CHSectionGrid>& grid_array() const { return grid_; }
+    const FlatArray<uint32_t>& cell_index_array() const { return cell_index_; }
+    const FlatArray<uint32_t>& cell_section_array() const { return cell_sections_; }
+
+private:
+    FlatArray<CHSection> sections_;
+    // a single grid
+    FlatArray<CHSectionGrid> grid_;
+    FlatArray<uint32_t> cell_index_;
+    FlatArray<uint32_t> cell_sections_;
+};
+
+///
+/// Node ordering of a metric contracted in its own order, e.g. the hierarchy of another transport mode.
+/// The query graph of such a metric has the number of vertices of the CH graph, each vertex being numbered by its rank in the metric
+struct CHMetricRanks
+{
+    /// Rank in the metric of each vertex of the CH graph
+    FlatArray<CHVertex> rank;
+    /// Vertex of the CH graph of each rank, the inverse of rank
+    FlatArray<CHVertex> vertex;
+};
+
 ///
 /// Routing data out of a CH query graph
 class CHRoutingData : public RoutingData
@@ -79,24 +463,172 @@ public:
 
     const CHQuery& ch_query() const { return *ch_query_; }
 
-    const MiddleNodeMap& middle_node() const { return middle_node_; }
+    ///
+    /// Whether the graphs are read from a mapped file rather than stored in memory
+    bool is_mapped() const { return bool( file_ ); }
+
+    ///
+    /// Add a metric, i.e. a query graph on the same vertices with other costs,
+    /// usually coming from the customization of a CCH (see cch.hh).
+    /// Throws std::invalid_argument if the graph does not have the vertices of the CH graph, or if rank is not a permutation of them
+    /// \param rank Empty if the graph shares the node ordering of the CH graph,
+    /// else the rank of each vertex of the CH graph in the query graph, that has been contracted in its own order (see metric_ranks())
+    void add_metric( const std::string& name, std::unique_ptr<CHQuery> ch_query, MiddleNodeMap&& middle_node, std::vector<CHVertex>&& rank = std::vector<CHVertex>() );
+
+    ///
+    /// Names of the additional metrics
+    std::vector<std::string> metric_names() const;
+
+    ///
+    /// Name of the metric of the default query graph, e.g. the transport mode it has been built for.
+    /// Empty if unknown
+    const std::string& default_metric_name() const { return default_metric_name_; }
+    void set_default_metric_name( const std::string& name ) { default_metric_name_ = name; }
+
+    ///
+    /// Whether a metric is available, either as the default one or as an additional metric
+    bool has_metric( const std::string& metric ) const;
+
+    ///
+    /// Metric of the hierarchy built for a transport mode by ch_preprocess (see its --modes option): pedestrian, bicycle or car.
+    /// The default metric of a graph without metric name is the pedestrian one.
+    /// Throws std::runtime_error if the transport mode is not supported or has no hierarchy
+    std::string transport_mode_metric( db_id_t mode ) const;
+
+    ///
+    /// Query graph of a metric, the default one if the name is empty or is the default metric name.
+    /// Throws std::invalid_argument on an unknown metric
+    const CHQuery& ch_query( const std::string& metric ) const;
+
+    ///
+    /// Node ordering of a metric that has been contracted in its own order, null if the vertices of its query graph are the ones of the CH graph
+    const CHMetricRanks* metric_ranks( const std::string& metric ) const;
+
+    ///
+    /// Time-dependent hierarchy, e.g. built from the speed profiles of cars. Null if none.
+    /// Its vertices are the ones of the query graph of td_graph_metric(), see metric_ranks()
+    const TDCHGraph* td_graph() const { return td_graph_.get(); }
+
+    ///
+    /// Name of the metric whose node ordering the time-dependent hierarchy has been contracted in, empty for the one of the CH graph
+    const std::string& td_graph_metric() const { return td_graph_metric_; }
+
+    ///
+    /// Set the time-dependent hierarchy, contracted in the node ordering of a metric.
+    /// Throws std::invalid_argument on an unknown metric, or if it does not have the vertices of the CH graph
+    void set_td_graph( std::unique_ptr<TDCHGraph> td_graph, const std::string& metric = std::string() );
+
+    ///
+    /// Edge-based hierarchy on the vertices of the CH graph, that takes turn restrictions into account. Null if none
+    const CHTurnGraph* turn_graph() const { return turn_graph_.get(); }
+
+    ///
+    /// Name of the metric the edge-based hierarchy has been built for, e.g. a transport mode
+    const std::string& turn_graph_metric() const { return turn_graph_metric_; }
+
+    ///
+    /// Set the edge-based hierarchy. Throws std::invalid_argument if it does not have the vertices of the CH graph
+    void set_turn_graph( const std::string& metric, std::unique_ptr<CHTurnGraph> turn_graph );
+
+    ///
+    /// Spatial index of the road sections between vertices of the CH graph, to start and end queries along them. Null if none
+    const CHSectionIndex* section_index() const { return section_index_.get(); }
+
+    ///
+    /// Set the spatial index of the road sections. Throws std::invalid_argument if a section is not between vertices of the CH graph
+    void set_section_index( std::unique_ptr<CHSectionIndex> section_index );
+
+    ///
+    /// Costs of the sections of the spatial index in the graph of a metric (see ch_query()), by index of section.
+    /// Null if they are not known, e.g. for graphs loaded from the database
+    const FlatArray<CHSectionCosts>* section_costs( const std::string& metric ) const;
+
+    ///
+    /// Set the costs of the sections of the spatial index in a metric. They are removed when the index is set again.
+    /// Throws std::invalid_argument on an unknown metric or if there is not one cost per section of the index
+    void set_section_costs( const std::string& metric, FlatArray<CHSectionCosts>&& costs );
+
+    ///
+    /// Vertex numbering that improves the locality of searches: a depth-first order following
+    /// the edges of every graph from the highest vertices down, each vertex being numbered right
+    /// after the lower vertices it is linked to.
+    /// It is still a contraction order: each edge keeps its lowest vertex.
+    /// Metrics with their own node ordering are not followed, see locality_order( const std::string& ).
+    /// \returns the new number of each vertex
+    std::vector<CHVertex> locality_order() const;
+
+    ///
+    /// Locality order of the query graph of a metric that has its own node ordering (see metric_ranks()).
+    /// Throws std::invalid_argument if the metric shares the vertices of the CH graph
+    /// \returns the new number of each rank
+    std::vector<CHVertex> locality_order( const std::string& metric ) const;
+
+    ///
+    /// Renumber the vertices of every graph, e.g. with locality_order().
+    /// The query graphs of metrics with their own node ordering are kept, only their ranks are updated.
+    /// Throws std::invalid_argument if the numbering is not a permutation,
+    /// or if the lowest vertex of an edge would not be the lowest anymore
+    /// \param new_number New number of each vertex
+    void renumber_vertices( const std::vector<CHVertex>& new_number );
+
+    ///
+    /// Renumber the vertices of the query graph of a metric that has its own node ordering, e.g. with locality_order( metric ).
+    /// Throws std::invalid_argument if the metric shares the vertices of the CH graph, if the numbering is not a permutation,
+    /// or if the lowest vertex of an edge would not be the lowest anymore
+    /// \param new_number New number of each rank
+    void renumber_metric_vertices( const std::string& metric, const std::vector<CHVertex>& new_number );
 
 private:
-    // the CH graph
+    // used by the builder to map a file
+    CHRoutingData();
+
+    // mapped file the arrays below may view
+    std::unique_ptr<FlatFileReader> file_;
+
+    // the CH graph, with its shortcuts linked to their edges
     std::unique_ptr<CHQuery> ch_query_;
 
-    // middle node of a shortcut
-    MiddleNodeMap middle_node_;
+    // additional metrics, by name
+    std::map<std::string, std::unique_ptr<CHQuery>> metrics_;
+
+    // node orderings of the metrics contracted in their own order
+    std::map<std::string, CHMetricRanks> metric_ranks_;
+
+    std::string default_metric_name_;
+
+    std::unique_ptr<TDCHGraph> td_graph_;
+    std::string td_graph_metric_;
+
+    std::unique_ptr<CHTurnGraph> turn_graph_;
+    std::string turn_graph_metric_;
+
+    std::unique_ptr<CHSectionIndex> section_index_;
+
+    // costs of the sections by metric, the default one being the empty name
+    std::map<std::string, FlatArray<CHSectionCosts>> section_costs_;
 
     // node index -> node id
-    std::vector<db_id_t> node_id_;
+    FlatArray<db_id_t> node_id_;
 
-    // node id -> index
-    std::map<db_id_t, size_t> rnode_id_;
+    struct NodeIdIndex
+    {
+        db_id_t id;
+        uint64_t index;
+    };
+    // node id -> index, sorted by id
+    FlatArray<NodeIdIndex> rnode_id_;
 
     friend class CHRoutingDataBuilder;
 };
 
+///
+/// Build a query graph out of a customized CCH
+/// \param topology The CCH, its vertices are the ones of the query graph
+/// \param metric Arc costs
+/// \param edge_db_id Database ID of each input edge of the CCH
+/// \param[out] middle_node Middle node of each shortcut
+std::unique_ptr<CHQuery> cch_query_graph( const CCHTopology& topology, const CCHMetric& metric, const std::vector<db_id_t>& edge_db_id, MiddleNodeMap& middle_node );
+
 class CHRoutingDataBuilder : public RoutingDataBuilder
 {
 public:
@@ -107,7 +639,12 @@ public:
     virtual std::unique_ptr<RoutingData> file_import( const std::string& filename, ProgressionCallback& progression, const VariantMap& options = VariantMap() ) const override;
     virtual void file_export( const RoutingData* rd, const std::string& filename, ProgressionCallback& progression, const VariantMap& options = VariantMap() ) const override;
 
-    uint32_t version() const { return 1; }
+    ///
+    /// Version 3 files are flat files (see flat_file.hh) that are mapped in memory rather than read.
+    /// Since version 4, shortcuts of the mapped graphs are already linked to their edges.
+    /// Since version 5, edge properties are stored with the split layout of CHQuery.
+    /// Since version 6, a metric may have its own node ordering (see CHMetricRanks)
+    uint32_t version() const { return 6; }
 };
 
 } // namespace Tempus
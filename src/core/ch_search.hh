@@ -0,0 +1,1058 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_CH_SEARCH_HH
+#define TEMPUS_CH_SEARCH_HH
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <boost/property_map/function_property_map.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEMPUS_CH_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "ch_routing_data.hh"
+#include "ch_search_workspace.hh"
+
+namespace Tempus
+{
+
+///
+/// Counters of a CH query
+struct CHQueryStatistics
+{
+    CHQueryStatistics() : settled_nodes(0), stalled_nodes(0) {}
+    size_t settled_nodes;
+    size_t stalled_nodes;
+
+    CHQueryStatistics& operator+=( const CHQueryStatistics& other )
+    {
+        settled_nodes += other.settled_nodes;
+        stalled_nodes += other.stalled_nodes;
+        return *this;
+    }
+};
+
+///
+/// Is a vertex "stalled" ?
+/// A vertex v settled in the forward (resp. backward) direction is stalled if it can be reached
+/// with a lower cost through a higher vertex u, by means of a downward edge u->v (resp. an upward edge v->u).
+/// In this case, its cost is not the right one and there is no need to relax its edges.
+template <typename Graph, typename Workspace, typename WeightMap>
+bool is_stalled( const Graph& graph, Workspace& ws, int dir, CHVertex v, typename Workspace::Cost cost, WeightMap weight_map )
+{
+    if ( dir == 0 ) {
+        for ( auto iei = in_edges( v, graph ).first; iei != in_edges( v, graph ).second; iei++ ) {
+            typename Workspace::Cost u_cost = ws.cost( dir, source( *iei, graph ) );
+            if ( u_cost != Workspace::infinity() && u_cost + get( weight_map, *iei ) < cost ) {
+                return true;
+            }
+        }
+    }
+    else {
+        for ( auto oei = out_edges( v, graph ).first; oei != out_edges( v, graph ).second; oei++ ) {
+            typename Workspace::Cost u_cost = ws.cost( dir, target( *oei, graph ) );
+            if ( u_cost != Workspace::infinity() && u_cost + get( weight_map, *oei ) < cost ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+///
+/// Complete upward search from a vertex, in one direction of the workspace.
+/// The forward direction (0) follows upward edges, the backward direction (1) follows downward edges reversed.
+/// The search is not bounded: every vertex reachable by an upward path is settled.
+/// The visitor is called with (vertex, cost) on each settled vertex that is not stalled.
+/// The caller is responsible for calling new_query() on the workspace before.
+template <typename Graph, typename Workspace, typename WeightMap, typename Visitor>
+void ch_upward_search( const Graph& graph,
+                       Workspace& ws,
+                       int dir,
+                       CHVertex origin,
+                       WeightMap weight_map,
+                       bool stall_on_demand,
+                       CHQueryStatistics& stats,
+                       Visitor visitor )
+{
+    typedef typename Workspace::Cost CostType;
+
+    ws.set_label( dir, origin, 0, origin );
+    ws.push( dir, origin, 0 );
+
+    while ( !ws.empty( dir ) ) {
+        CHVertex min_v = ws.top_vertex( dir );
+        CostType min_pi = ws.top_cost( dir );
+        ws.pop( dir );
+
+        if ( min_pi > ws.cost( dir, min_v ) ) {
+            // outdated heap entry
+            continue;
+        }
+        stats.settled_nodes++;
+
+        if ( stall_on_demand && is_stalled( graph, ws, dir, min_v, min_pi, weight_map ) ) {
+            stats.stalled_nodes++;
+            continue;
+        }
+
+        visitor( min_v, min_pi );
+
+        if ( dir == 0 ) {
+            for ( auto oei = out_edges( min_v, graph ).first; oei != out_edges( min_v, graph ).second; oei++ ) {
+                CHVertex vv = target( *oei, graph );
+                CostType c = min_pi + get( weight_map, *oei );
+                if ( c < ws.cost( dir, vv ) ) {
+                    ws.set_label( dir, vv, c, min_v, graph.edge_index( *oei ) );
+                    ws.push( dir, vv, c );
+                }
+            }
+        }
+        else {
+            for ( auto iei = in_edges( min_v, graph ).first; iei != in_edges( min_v, graph ).second; iei++ ) {
+                CHVertex vv = source( *iei, graph );
+                CostType c = min_pi + get( weight_map, *iei );
+                if ( c < ws.cost( dir, vv ) ) {
+                    ws.set_label( dir, vv, c, min_v, graph.edge_index( *iei ) );
+                    ws.push( dir, vv, c );
+                }
+            }
+        }
+    }
+}
+
+///
+/// Bidirectional search between two sets of vertices, each one with an initial cost,
+/// e.g. the sections leaving and reaching two nodes on an edge-based hierarchy (see CHTurnGraph).
+/// The cost of a path is the initial cost of its first vertex, plus the cost of its edges, plus the initial cost of its last vertex.
+/// Returns true if a path has been found, its edges are then stored in ws.path_edges(), by their index in the graph
+/// \param sources_begin, sources_end (vertex, initial cost) pairs the path may start from
+/// \param targets_begin, targets_end (vertex, initial cost) pairs the path may end at
+/// \param[out] path_source First vertex of the path
+/// \param[out] path_target Last vertex of the path
+template <typename Graph, typename Workspace, typename WeightMap, typename EndpointIterator>
+bool bidirectional_ch_dijkstra( const Graph& graph,
+                                EndpointIterator sources_begin,
+                                EndpointIterator sources_end,
+                                EndpointIterator targets_begin,
+                                EndpointIterator targets_end,
+                                WeightMap weight_map,
+                                Workspace& ws,
+                                bool stall_on_demand,
+                                typename Workspace::Cost& ret_cost,
+                                CHVertex& path_source,
+                                CHVertex& path_target,
+                                CHQueryStatistics& stats )
+{
+    typedef typename Workspace::Cost CostType;
+
+    const CostType infinity = Workspace::infinity();
+
+    BOOST_ASSERT( ws.num_vertices() == num_vertices( graph ) );
+
+    // Since the graph is partitioned in two acyclic graphs with a topological order on nodes,
+    // one-to-all queries do not need a heap for the downward part, see ch_phast()
+    for ( EndpointIterator it = sources_begin; it != sources_end; it++ ) {
+        if ( it->second < ws.cost( 0, it->first ) ) {
+            ws.set_label( 0, it->first, it->second, it->first );
+            ws.push( 0, it->first, it->second );
+        }
+    }
+    for ( EndpointIterator it = targets_begin; it != targets_end; it++ ) {
+        if ( it->second < ws.cost( 1, it->first ) ) {
+            ws.set_label( 1, it->first, it->second, it->first );
+            ws.push( 1, it->first, it->second );
+        }
+    }
+
+    // direction : 0 = forward, 1 = backward
+    int dir = 1;
+
+    CHVertex top_node = 0;
+    CostType total_cost = infinity;
+    bool path_found = false;
+
+    auto get_min_pi = [&ws]( int ldir ) {
+        if ( !ws.empty( ldir ) ) {
+            return ws.top_cost( ldir );
+        }
+        return Workspace::infinity();
+    };
+
+    while ( !ws.empty( 0 ) || !ws.empty( 1 ) ) {
+
+        if ( std::min( get_min_pi(dir), get_min_pi(1-dir) ) > total_cost ) {
+            // we've reached the best path
+            break;
+        }
+
+        // interleave directions
+        dir = 1 - dir;
+
+        if ( ws.empty( dir ) )
+            dir = 1 - dir;
+
+        CHVertex min_v = ws.top_vertex( dir );
+        CostType min_pi = ws.top_cost( dir );
+        ws.pop( dir );
+
+        if ( min_pi > ws.cost( dir, min_v ) ) {
+            // outdated heap entry, the vertex has already been settled with a lower cost
+            continue;
+        }
+        stats.settled_nodes++;
+
+        {
+            CostType min_pi2 = ws.cost( 1-dir, min_v );
+            // if min_pi2 is not infinity, it means this node has already been seen
+            // in the other direction
+            // so it is a candidate top node
+            if ( min_pi2 != infinity && min_pi + min_pi2 < total_cost ) {
+                top_node = min_v;
+                total_cost = min_pi + min_pi2;
+                path_found = true;
+            }
+        }
+
+        if ( stall_on_demand && is_stalled( graph, ws, dir, min_v, min_pi, weight_map ) ) {
+            stats.stalled_nodes++;
+            continue;
+        }
+
+        if ( dir == 0 ) {
+            for ( auto oei = out_edges( min_v, graph ).first;
+                  oei != out_edges( min_v, graph ).second;
+                  oei++ ) {
+                CHVertex vv = target( *oei, graph );
+
+                CostType new_pi = ws.cost( dir, vv );
+                CostType cost = get( weight_map, *oei );
+                if ( min_pi + cost < new_pi ) {
+                    // relax edge
+                    ws.set_label( dir, vv, min_pi + cost, min_v, graph.edge_index( *oei ) );
+                    ws.push( dir, vv, min_pi + cost );
+                }
+            }
+        }
+        else {
+            for ( auto iei = in_edges( min_v, graph ).first;
+                  iei != in_edges( min_v, graph ).second;
+                  iei++ ) {
+                CHVertex vv = source( *iei, graph );
+
+                CostType new_pi = ws.cost( dir, vv );
+                CostType cost = get( weight_map, *iei );
+                if ( min_pi + cost < new_pi ) {
+                    // relax edge
+                    ws.set_label( dir, vv, min_pi + cost, min_v, graph.edge_index( *iei ) );
+                    ws.push( dir, vv, min_pi + cost );
+                }
+            }
+        }
+    }
+
+    if ( !path_found ) {
+        return false;
+    }
+
+    std::vector<uint32_t>& path = ws.path_edges();
+    path.clear();
+
+    // edges from the top node (x) back to a source, then reversed.
+    // Sources and targets are the only reached vertices without a predecessor edge
+    CHVertex x = top_node;
+    BOOST_ASSERT_MSG( ws.reached( 0, x ), "Can't find upward predecessor" );
+    while ( ws.predecessor_edge( 0, x ) != Workspace::no_edge() ) {
+        path.push_back( ws.predecessor_edge( 0, x ) );
+        x = ws.predecessor( 0, x );
+        BOOST_ASSERT_MSG( ws.reached( 0, x ), "Can't find upward predecessor" );
+    }
+    std::reverse( path.begin(), path.end() );
+    path_source = x;
+
+    // edges from the top node to a target
+    CHVertex t = top_node;
+    BOOST_ASSERT_MSG( ws.reached( 1, t ), "Can't find downward predecessor" );
+    while ( ws.predecessor_edge( 1, t ) != Workspace::no_edge() ) {
+        path.push_back( ws.predecessor_edge( 1, t ) );
+        t = ws.predecessor( 1, t );
+        BOOST_ASSERT_MSG( ws.reached( 1, t ), "Can't find downward predecessor" );
+    }
+    path_target = t;
+
+    ret_cost = total_cost;
+    return true;
+}
+
+///
+/// Bidirectional search on the query graph.
+/// Returns true if a path has been found, its edges are then stored in ws.path_edges(), by their index in the graph
+template <typename Graph, typename Workspace, typename WeightMap>
+bool bidirectional_ch_dijkstra( const Graph& graph,
+                                CHVertex origin,
+                                CHVertex destination,
+                                WeightMap weight_map,
+                                Workspace& ws,
+                                bool stall_on_demand,
+                                typename Workspace::Cost& ret_cost,
+                                CHQueryStatistics& stats )
+{
+    const std::pair<CHVertex, typename Workspace::Cost> source( origin, 0 ), target( destination, 0 );
+    CHVertex path_source, path_target;
+    return bidirectional_ch_dijkstra( graph, &source, &source + 1, &target, &target + 1, weight_map, ws, stall_on_demand, ret_cost, path_source, path_target, stats );
+}
+
+///
+/// Bidirectional search that only looks for a path cheaper than a given bound, e.g. to check that a known path is a shortest one.
+/// Labels are not set beyond the bound and the search stops at the first path found, which makes it faster
+/// than a complete query when the bound is low.
+/// The caller is responsible for calling new_query() on the workspace before.
+template <typename Graph, typename Workspace, typename WeightMap>
+bool ch_has_path_cheaper_than( const Graph& graph,
+                               CHVertex origin,
+                               CHVertex destination,
+                               typename Workspace::Cost bound,
+                               WeightMap weight_map,
+                               Workspace& ws,
+                               bool stall_on_demand,
+                               CHQueryStatistics& stats )
+{
+    typedef typename Workspace::Cost CostType;
+
+    if ( origin == destination ) {
+        return bound > 0;
+    }
+    ws.set_label( 0, origin, 0, origin );
+    ws.push( 0, origin, 0 );
+    ws.set_label( 1, destination, 0, destination );
+    ws.push( 1, destination, 0 );
+
+    int dir = 1;
+    while ( !ws.empty( 0 ) || !ws.empty( 1 ) ) {
+        dir = 1 - dir;
+        if ( ws.empty( dir ) )
+            dir = 1 - dir;
+
+        CHVertex min_v = ws.top_vertex( dir );
+        CostType min_pi = ws.top_cost( dir );
+        ws.pop( dir );
+
+        if ( min_pi > ws.cost( dir, min_v ) ) {
+            // outdated heap entry
+            continue;
+        }
+        stats.settled_nodes++;
+
+        if ( ws.cost( 1-dir, min_v ) != Workspace::infinity() && min_pi + ws.cost( 1-dir, min_v ) < bound ) {
+            return true;
+        }
+
+        if ( stall_on_demand && is_stalled( graph, ws, dir, min_v, min_pi, weight_map ) ) {
+            stats.stalled_nodes++;
+            continue;
+        }
+
+        if ( dir == 0 ) {
+            for ( auto oei = out_edges( min_v, graph ).first; oei != out_edges( min_v, graph ).second; oei++ ) {
+                CHVertex vv = target( *oei, graph );
+                CostType c = min_pi + get( weight_map, *oei );
+                if ( c < bound && c < ws.cost( dir, vv ) ) {
+                    ws.set_label( dir, vv, c, min_v, graph.edge_index( *oei ) );
+                    ws.push( dir, vv, c );
+                }
+            }
+        }
+        else {
+            for ( auto iei = in_edges( min_v, graph ).first; iei != in_edges( min_v, graph ).second; iei++ ) {
+                CHVertex vv = source( *iei, graph );
+                CostType c = min_pi + get( weight_map, *iei );
+                if ( c < bound && c < ws.cost( dir, vv ) ) {
+                    ws.set_label( dir, vv, c, min_v, graph.edge_index( *iei ) );
+                    ws.push( dir, vv, c );
+                }
+            }
+        }
+    }
+    return false;
+}
+
+///
+/// Thresholds of alternative routes (see ch_alternative_routes()), as fractions of the cost of the shortest path
+struct CHAlternativeParameters
+{
+    CHAlternativeParameters() : max_routes( 3 ), max_stretch( 0.25 ), max_sharing( 0.8 ), local_optimality( 0.25 ) {}
+
+    /// Maximum number of routes, the shortest one included
+    size_t max_routes;
+    /// Bounded stretch: an alternative costs at most (1 + max_stretch) times the shortest path
+    double max_stretch;
+    /// Limited sharing: an alternative shares edges of at most max_sharing times the shortest path with the routes found before
+    double max_sharing;
+    /// Local optimality: the subpath of an alternative around its via vertex, up to local_optimality times
+    /// the shortest path on each side, is a shortest path
+    double local_optimality;
+};
+
+///
+/// Route found by ch_alternative_routes()
+struct CHRoute
+{
+    uint32_t cost;
+    /// Original edges, by their index in the query graph
+    std::vector<uint32_t> edges;
+    /// Vertex the route goes through, the top vertex of the shortest path
+    CHVertex via;
+};
+
+///
+/// Shortest path and alternative routes, by the via vertex method.
+///
+/// Complete upward searches are run from the origin and from the destination. Each vertex v settled by both
+/// of them gives a candidate route: the path of the forward search from the origin to v, then the path of the
+/// backward search from v to the destination. The cheapest candidate is the shortest path.
+/// Other candidates are tried by increasing cost and are kept if they are admissible:
+/// - bounded stretch, they are not much longer than the shortest path;
+/// - limited sharing with the routes already kept;
+/// - local optimality, checked by a bounded point-to-point query around v (T-test), so that they do not make detours;
+/// - they go through each vertex at most once.
+/// Costs of the search are the ones of the edges.
+/// The caller is responsible for calling new_query() on the workspace before.
+/// \returns the shortest path first, then the alternatives. Empty if there is no path
+template <typename Workspace>
+std::vector<CHRoute> ch_alternative_routes( const CHQuery& graph,
+                                            CHVertex origin,
+                                            CHVertex destination,
+                                            Workspace& ws,
+                                            bool stall_on_demand,
+                                            const CHAlternativeParameters& params,
+                                            CHQueryStatistics& stats )
+{
+    typedef typename Workspace::Cost CostType;
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+    std::vector<CHRoute> routes;
+    if ( origin == destination ) {
+        routes.push_back( CHRoute{ 0, std::vector<uint32_t>(), origin } );
+        return routes;
+    }
+
+    // via vertices: settled by both searches, stalled vertices excepted
+    std::vector<CHVertex> forward;
+    ch_upward_search( graph, ws, 0, origin, weight_map, stall_on_demand, stats, [&forward]( CHVertex v, CostType ) {
+            forward.push_back( v );
+        });
+    std::sort( forward.begin(), forward.end() );
+    std::vector<std::pair<CostType, CHVertex>> candidates;
+    ch_upward_search( graph, ws, 1, destination, weight_map, stall_on_demand, stats, [&]( CHVertex v, CostType c ) {
+            if ( std::binary_search( forward.begin(), forward.end(), v ) ) {
+                candidates.push_back( std::make_pair( ws.cost( 0, v ) + c, v ) );
+            }
+        });
+    if ( candidates.empty() ) {
+        return routes;
+    }
+    std::sort( candidates.begin(), candidates.end() );
+    const CostType shortest = candidates[0].first;
+    const double max_cost = shortest * ( 1.0 + params.max_stretch );
+    while ( candidates.back().first > max_cost ) {
+        candidates.pop_back();
+    }
+
+    // Edges of the query graph of each candidate, with their ends, taken from the labels of the searches
+    // before they are overwritten by local optimality queries
+    struct PathEdge
+    {
+        uint32_t edge;
+        CHVertex from;
+        CHVertex to;
+    };
+    std::vector<std::vector<PathEdge>> ch_paths( candidates.size() );
+    for ( size_t i = 0; i < candidates.size(); i++ ) {
+        std::vector<PathEdge>& path = ch_paths[i];
+        for ( CHVertex x = candidates[i].second; ws.predecessor_edge( 0, x ) != Workspace::no_edge(); x = ws.predecessor( 0, x ) ) {
+            path.push_back( PathEdge{ ws.predecessor_edge( 0, x ), ws.predecessor( 0, x ), x } );
+        }
+        std::reverse( path.begin(), path.end() );
+        for ( CHVertex x = candidates[i].second; ws.predecessor_edge( 1, x ) != Workspace::no_edge(); x = ws.predecessor( 1, x ) ) {
+            path.push_back( PathEdge{ ws.predecessor_edge( 1, x ), x, ws.predecessor( 1, x ) } );
+        }
+    }
+
+    // original edges of the routes kept, sorted
+    std::vector<uint32_t> kept_edges;
+    std::vector<PathEdge> stack, edges;
+    std::vector<CHVertex> vertices;
+    std::vector<CostType> prefix;
+    for ( size_t i = 0; i < candidates.size() && routes.size() < params.max_routes; i++ ) {
+        const CHVertex via = candidates[i].second;
+
+        // original edges, with their ends; shortcuts are linked to their halves through their middle vertex
+        edges.clear();
+        size_t via_index = 0;
+        for ( const PathEdge& pe : ch_paths[i] ) {
+            stack.push_back( pe );
+            while ( !stack.empty() ) {
+                const PathEdge top = stack.back();
+                stack.pop_back();
+                if ( graph.edge_property( top.edge ).b.is_shortcut ) {
+                    const CHEdgeDetails& d = graph.edge_details( top.edge );
+                    stack.push_back( PathEdge{ d.unpack.second, d.middle, top.to } );
+                    stack.push_back( PathEdge{ d.unpack.first, top.from, d.middle } );
+                }
+                else {
+                    edges.push_back( top );
+                }
+            }
+            if ( pe.to == via ) {
+                via_index = edges.size();
+            }
+        }
+        vertices.clear();
+        prefix.assign( 1, 0 );
+        vertices.push_back( origin );
+        for ( const PathEdge& e : edges ) {
+            vertices.push_back( e.to );
+            prefix.push_back( prefix.back() + graph.edge_property( e.edge ).b.cost );
+        }
+
+        if ( !routes.empty() ) {
+            // each vertex at most once
+            std::vector<CHVertex> sorted_vertices( vertices );
+            std::sort( sorted_vertices.begin(), sorted_vertices.end() );
+            if ( std::adjacent_find( sorted_vertices.begin(), sorted_vertices.end() ) != sorted_vertices.end() ) {
+                continue;
+            }
+
+            // limited sharing
+            double shared = 0;
+            for ( const PathEdge& e : edges ) {
+                if ( std::binary_search( kept_edges.begin(), kept_edges.end(), e.edge ) ) {
+                    shared += graph.edge_property( e.edge ).b.cost;
+                }
+            }
+            if ( shared > shortest * params.max_sharing ) {
+                continue;
+            }
+
+            // local optimality: the subpath from the last vertex at least T before the via vertex
+            // to the first vertex at least T after it must be a shortest path
+            const double t = shortest * params.local_optimality;
+            size_t first = via_index;
+            while ( first > 0 && prefix[via_index] - prefix[first] < t ) {
+                first--;
+            }
+            size_t last = via_index;
+            while ( last + 1 < prefix.size() && prefix[last] - prefix[via_index] < t ) {
+                last++;
+            }
+            ws.new_query();
+            if ( ch_has_path_cheaper_than( graph, vertices[first], vertices[last], prefix[last] - prefix[first], weight_map, ws, stall_on_demand, stats ) ) {
+                continue;
+            }
+        }
+
+        CHRoute route;
+        route.cost = uint32_t( candidates[i].first );
+        route.via = via;
+        for ( const PathEdge& e : edges ) {
+            route.edges.push_back( e.edge );
+        }
+        kept_edges.insert( kept_edges.end(), route.edges.begin(), route.edges.end() );
+        std::sort( kept_edges.begin(), kept_edges.end() );
+        routes.push_back( std::move( route ) );
+    }
+    return routes;
+}
+
+///
+/// Time-dependent point-to-point query on a TDCHGraph (see ch_time_dependent.hh), in three phases:
+/// - a backward search on downward edges from the destination, on upper bounds of travel times, marks the vertices
+///   the destination can be reached from and gives an upper bound of the arrival time from each of them;
+/// - a time-dependent Dijkstra search on upward edges from the origin, whose costs are arrival times, until they
+///   exceed the upper bound of the arrival time through the marked vertices reached so far;
+/// - a time-dependent Dijkstra search on downward edges to marked vertices, from the marked vertices reached
+///   by the upward search.
+/// \param departure Departure time (minutes since the beginning of the day)
+/// \param[out] path Edges of the path, with their source vertex (see td_unpack_path())
+/// \returns the arrival time, none if there is no path
+template <typename Workspace>
+boost::optional<double> td_ch_query( const TDCHGraph& graph,
+                                     CHVertex origin,
+                                     CHVertex destination,
+                                     double departure,
+                                     Workspace& ws,
+                                     CHQueryStatistics& stats,
+                                     std::vector<std::pair<uint32_t, uint32_t>>& path )
+{
+    BOOST_ASSERT( ws.num_vertices() == graph.num_vertices() );
+
+    ws.set_label( 1, destination, 0, destination );
+    ws.push( 1, destination, 0 );
+    while ( !ws.empty( 1 ) ) {
+        const CHVertex v = ws.top_vertex( 1 );
+        const double cost = ws.top_cost( 1 );
+        ws.pop( 1 );
+        if ( cost > ws.cost( 1, v ) ) {
+            continue;
+        }
+        for ( uint32_t i = graph.down_edges( v ).first; i != graph.down_edges( v ).second; i++ ) {
+            const TDCHDownEdge& de = graph.down_edge( i );
+            const double u_cost = cost + graph.edge( de.edge ).max_travel_time;
+            if ( u_cost < ws.cost( 1, de.source ) ) {
+                ws.set_label( 1, de.source, u_cost, v, de.edge );
+                ws.push( 1, de.source, u_cost );
+            }
+        }
+    }
+
+    // upper bound of the arrival time
+    double best = Workspace::infinity();
+    // marked vertices settled by the upward search
+    std::vector<uint32_t>& meeting = ws.unpack_stack();
+    meeting.clear();
+    ws.set_label( 0, origin, departure, origin );
+    ws.push( 0, origin, departure );
+    while ( !ws.empty( 0 ) ) {
+        const CHVertex u = ws.top_vertex( 0 );
+        const double arrival = ws.top_cost( 0 );
+        ws.pop( 0 );
+        if ( arrival > ws.cost( 0, u ) ) {
+            // outdated heap entry
+            continue;
+        }
+        if ( arrival > best ) {
+            break;
+        }
+        stats.settled_nodes++;
+        if ( ws.reached( 1, u ) ) {
+            meeting.push_back( u );
+            best = std::min( best, arrival + ws.cost( 1, u ) );
+        }
+        for ( uint32_t e = graph.out_edges( u ).first; e != graph.out_edges( u ).second; e++ ) {
+            const CHVertex v = graph.edge( e ).target;
+            if ( v < u || arrival + graph.edge( e ).min_travel_time >= ws.cost( 0, v ) ) {
+                continue;
+            }
+            const double v_arrival = arrival + graph.ttf( e ).evaluate( arrival );
+            if ( v_arrival < ws.cost( 0, v ) ) {
+                ws.set_label( 0, v, v_arrival, u, e );
+                ws.push( 0, v, v_arrival );
+            }
+        }
+    }
+
+    // the heap of the backward search is empty, it is used by the downward search
+    for ( uint32_t x : meeting ) {
+        ws.push( 1, x, ws.cost( 0, x ) );
+    }
+    bool found = false;
+    while ( !ws.empty( 1 ) ) {
+        const CHVertex u = ws.top_vertex( 1 );
+        const double arrival = ws.top_cost( 1 );
+        ws.pop( 1 );
+        if ( arrival > ws.cost( 0, u ) ) {
+            continue;
+        }
+        stats.settled_nodes++;
+        if ( u == destination ) {
+            found = true;
+            break;
+        }
+        for ( uint32_t e = graph.out_edges( u ).first; e != graph.out_edges( u ).second; e++ ) {
+            const CHVertex v = graph.edge( e ).target;
+            if ( v > u || !ws.reached( 1, v ) ) {
+                // the destination cannot be reached downward from v
+                continue;
+            }
+            if ( arrival + graph.edge( e ).min_travel_time >= ws.cost( 0, v ) ) {
+                continue;
+            }
+            const double v_arrival = arrival + graph.ttf( e ).evaluate( arrival );
+            if ( v_arrival < ws.cost( 0, v ) ) {
+                ws.set_label( 0, v, v_arrival, u, e );
+                ws.push( 1, v, v_arrival );
+            }
+        }
+    }
+    if ( !found ) {
+        return boost::optional<double>();
+    }
+
+    path.clear();
+    for ( CHVertex v = destination; v != origin; v = ws.predecessor( 0, v ) ) {
+        path.push_back( std::make_pair( ws.predecessor( 0, v ), ws.predecessor_edge( 0, v ) ) );
+    }
+    std::reverse( path.begin(), path.end() );
+    return ws.cost( 0, destination );
+}
+
+///
+/// Many-to-many shortest path costs, by means of buckets.
+///
+/// A backward upward search is run from each target. Each vertex x it settles receives
+/// a bucket entry (target, cost(x->target)).
+/// A forward upward search is then run from each source and, for each vertex x it settles,
+/// the bucket of x is scanned: cost(source->x) + cost(x->target) is a candidate for the (source, target) cell.
+/// Since every shortest path on a CH has a top vertex reached by both upward searches, the minimum
+/// of the candidates is the shortest path cost.
+///
+/// Searches are independent and are run in parallel, each thread borrowing its own workspace from the pool.
+///
+/// \returns a dense row-major matrix: cost from sources[i] to targets[j] at index i * targets.size() + j,
+/// Workspace::infinity() if the target cannot be reached
+template <typename Workspace, typename WeightMap>
+std::vector<typename Workspace::Cost> ch_many_to_many( const CHQuery& graph,
+                                                       const std::vector<CHVertex>& sources,
+                                                       const std::vector<CHVertex>& targets,
+                                                       WeightMap weight_map,
+                                                       CHSearchWorkspacePool<Workspace>& pool,
+                                                       bool stall_on_demand,
+                                                       CHQueryStatistics& stats )
+{
+    typedef typename Workspace::Cost CostType;
+
+    struct BucketEntry
+    {
+        CHVertex vertex;
+        uint32_t target;
+        CostType cost;
+        bool operator<( const BucketEntry& other ) const { return vertex < other.vertex; }
+    };
+
+    const int n_sources = int( sources.size() );
+    const int n_targets = int( targets.size() );
+
+    std::vector<CostType> matrix( sources.size() * targets.size(), Workspace::infinity() );
+
+    // backward searches, each thread fills its own buckets that are merged afterwards
+    std::vector<BucketEntry> buckets;
+    #pragma omp parallel
+    {
+        typename CHSearchWorkspacePool<Workspace>::Handle ws = pool.borrow();
+        std::vector<BucketEntry> local_buckets;
+        CHQueryStatistics local_stats;
+
+        #pragma omp for schedule(dynamic)
+        for ( int j = 0; j < n_targets; j++ ) {
+            ws->new_query();
+            ch_upward_search( graph, *ws, 1, targets[j], weight_map, stall_on_demand, local_stats,
+                              [&local_buckets, j]( CHVertex v, CostType c ) {
+                                  local_buckets.push_back( BucketEntry{ v, uint32_t(j), c } );
+                              } );
+        }
+
+        #pragma omp critical
+        {
+            buckets.insert( buckets.end(), local_buckets.begin(), local_buckets.end() );
+            stats += local_stats;
+        }
+    }
+    std::sort( buckets.begin(), buckets.end() );
+
+    // forward searches, each one fills its own row of the matrix
+    #pragma omp parallel
+    {
+        typename CHSearchWorkspacePool<Workspace>::Handle ws = pool.borrow();
+        CHQueryStatistics local_stats;
+
+        #pragma omp for schedule(dynamic)
+        for ( int i = 0; i < n_sources; i++ ) {
+            ws->new_query();
+            CostType* row = matrix.data() + size_t(i) * targets.size();
+            ch_upward_search( graph, *ws, 0, sources[i], weight_map, stall_on_demand, local_stats,
+                              [&buckets, row]( CHVertex v, CostType c ) {
+                                  BucketEntry key{ v, 0, 0 };
+                                  auto range = std::equal_range( buckets.begin(), buckets.end(), key );
+                                  for ( auto it = range.first; it != range.second; it++ ) {
+                                      if ( c + it->cost < row[it->target] ) {
+                                          row[it->target] = c + it->cost;
+                                      }
+                                  }
+                              } );
+        }
+
+        #pragma omp critical
+        stats += local_stats;
+    }
+
+    return matrix;
+}
+
+
+///
+/// One-to-all shortest path costs (PHAST).
+///
+/// The graph of downward edges is acyclic and vertices are numbered by CH order, so that after an
+/// upward search from the origin, the cost of every vertex can be computed by a single linear sweep
+/// over vertices in decreasing order: each downward edge x->v (with x > v) is scanned once, when
+/// v is processed and the cost of x is already final.
+///
+/// \param[out] costs Costs from the origin to each vertex, Workspace::infinity() if not reachable
+template <typename Workspace, typename WeightMap>
+void ch_phast( const CHQuery& graph,
+               CHVertex origin,
+               WeightMap weight_map,
+               Workspace& ws,
+               bool stall_on_demand,
+               std::vector<typename Workspace::Cost>& costs,
+               CHQueryStatistics& stats )
+{
+    typedef typename Workspace::Cost CostType;
+    const CostType infinity = Workspace::infinity();
+    const size_t n = num_vertices( graph );
+
+    // upward phase. Labels of stalled vertices are not final, but they are
+    // costs of actual paths and will be corrected by the sweep
+    ch_upward_search( graph, ws, 0, origin, weight_map, stall_on_demand, stats, []( CHVertex, CostType ) {} );
+
+    costs.resize( n );
+    for ( size_t v = 0; v < n; v++ ) {
+        costs[v] = ws.cost( 0, CHVertex(v) );
+    }
+
+    // downward sweep
+    for ( size_t i = n; i > 0; i-- ) {
+        const CHVertex v = CHVertex(i - 1);
+        CostType c = costs[v];
+        for ( auto iei = in_edges( v, graph ).first; iei != in_edges( v, graph ).second; iei++ ) {
+            CostType cx = costs[source( *iei, graph )];
+            if ( cx != infinity && cx + get( weight_map, *iei ) < c ) {
+                c = cx + get( weight_map, *iei );
+            }
+        }
+        costs[v] = c;
+    }
+}
+
+
+///
+/// One-to-all costs from several sources.
+/// Sources are independent and are processed in parallel, each thread borrowing its own workspace from the pool.
+///
+/// \returns a dense row-major matrix: cost from sources[i] to vertex v at index i * num_vertices + v,
+/// Workspace::infinity() if v cannot be reached
+template <typename Workspace, typename WeightMap>
+std::vector<typename Workspace::Cost> ch_one_to_all( const CHQuery& graph,
+                                                     const std::vector<CHVertex>& sources,
+                                                     WeightMap weight_map,
+                                                     CHSearchWorkspacePool<Workspace>& pool,
+                                                     bool stall_on_demand,
+                                                     CHQueryStatistics& stats )
+{
+    typedef typename Workspace::Cost CostType;
+    const size_t n = num_vertices( graph );
+    const int n_sources = int( sources.size() );
+
+    std::vector<CostType> matrix( sources.size() * n );
+
+    #pragma omp parallel
+    {
+        typename CHSearchWorkspacePool<Workspace>::Handle ws = pool.borrow();
+        std::vector<CostType> costs;
+        CHQueryStatistics local_stats;
+
+        #pragma omp for schedule(dynamic)
+        for ( int i = 0; i < n_sources; i++ ) {
+            ws->new_query();
+            ch_phast( graph, sources[i], weight_map, *ws, stall_on_demand, costs, local_stats );
+            std::copy( costs.begin(), costs.end(), matrix.begin() + size_t(i) * n );
+        }
+
+        #pragma omp critical
+        stats += local_stats;
+    }
+
+    return matrix;
+}
+
+
+///
+/// Multi-source PHAST.
+///
+/// Labels of K sources are interleaved: the K costs of a vertex v are stored at labels[v * K .. v * K + K - 1],
+/// so that the downward sweep relaxes the K sources of an edge with a few SIMD add / min operations.
+/// Unreachable vertices have a cost of ch_multi_infinity, which is low enough so that adding an edge
+/// weight (31 bits) never overflows: costs must then stay below 2^31 - 1.
+const uint32_t ch_multi_infinity = 0x7FFFFFFF;
+
+///
+/// Is AVX2 available on this CPU ?
+inline bool ch_has_avx2()
+{
+#ifdef TEMPUS_CH_AVX2_DISPATCH
+    static const bool has_avx2 = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) != 0;
+    }();
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+///
+/// Downward sweep of the multi-source PHAST, scalar version
+template <size_t K, typename WeightMap>
+void ch_multi_sweep_scalar( const CHQuery& graph, WeightMap weight_map, uint32_t* labels )
+{
+    const size_t n = num_vertices( graph );
+    for ( size_t i = n; i > 0; i-- ) {
+        uint32_t* lv = labels + ( i - 1 ) * K;
+        for ( auto iei = in_edges( CHVertex(i - 1), graph ).first; iei != in_edges( CHVertex(i - 1), graph ).second; iei++ ) {
+            const uint32_t* lx = labels + size_t( source( *iei, graph ) ) * K;
+            const uint32_t w = get( weight_map, *iei );
+            for ( size_t k = 0; k < K; k++ ) {
+                uint32_t c = lx[k] + w;
+                if ( c < lv[k] ) {
+                    lv[k] = c;
+                }
+            }
+        }
+    }
+}
+
+#ifdef TEMPUS_CH_AVX2_DISPATCH
+///
+/// Downward sweep of the multi-source PHAST, AVX2 version.
+/// Must only be called if ch_has_avx2() is true
+template <size_t K, typename WeightMap>
+__attribute__((target("avx2")))
+void ch_multi_sweep_avx2( const CHQuery& graph, WeightMap weight_map, uint32_t* labels )
+{
+    static_assert( K % 8 == 0, "The number of sources must be a multiple of 8" );
+    const size_t n = num_vertices( graph );
+    for ( size_t i = n; i > 0; i-- ) {
+        uint32_t* lv = labels + ( i - 1 ) * K;
+        __m256i acc[K / 8];
+        for ( size_t j = 0; j < K / 8; j++ ) {
+            acc[j] = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( lv + j * 8 ) );
+        }
+        for ( auto iei = in_edges( CHVertex(i - 1), graph ).first; iei != in_edges( CHVertex(i - 1), graph ).second; iei++ ) {
+            const uint32_t* lx = labels + size_t( source( *iei, graph ) ) * K;
+            const __m256i w = _mm256_set1_epi32( int( get( weight_map, *iei ) ) );
+            for ( size_t j = 0; j < K / 8; j++ ) {
+                __m256i c = _mm256_add_epi32( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( lx + j * 8 ) ), w );
+                acc[j] = _mm256_min_epu32( acc[j], c );
+            }
+        }
+        for ( size_t j = 0; j < K / 8; j++ ) {
+            _mm256_storeu_si256( reinterpret_cast<__m256i*>( lv + j * 8 ), acc[j] );
+        }
+    }
+}
+#endif
+
+///
+/// One-to-all costs from up to K sources at once.
+/// An upward search is run from each source, then a single downward sweep computes the costs of all sources.
+/// The sweep uses AVX2 when the CPU supports it (and if allow_simd is true), scalar code otherwise.
+///
+/// \param[out] labels Interleaved costs, see ch_multi_infinity. Lanes without source are left unreachable
+template <size_t K, typename Workspace, typename WeightMap>
+void ch_phast_multi( const CHQuery& graph,
+                     const CHVertex* sources,
+                     size_t n_sources,
+                     WeightMap weight_map,
+                     Workspace& ws,
+                     bool stall_on_demand,
+                     std::vector<uint32_t>& labels,
+                     CHQueryStatistics& stats,
+                     bool allow_simd = true )
+{
+    static_assert( std::is_same<typename Workspace::Cost, uint32_t>::value, "Multi-source PHAST needs uint32_t costs" );
+    static_assert( K % 8 == 0, "The number of sources must be a multiple of 8" );
+    BOOST_ASSERT( n_sources <= K );
+
+    const size_t n = num_vertices( graph );
+    labels.assign( n * K, ch_multi_infinity );
+
+    for ( size_t k = 0; k < n_sources; k++ ) {
+        ws.new_query();
+        // stalled vertices are skipped, their cost will be given by the sweep
+        ch_upward_search( graph, ws, 0, sources[k], weight_map, stall_on_demand, stats,
+                          [&labels, k]( CHVertex v, uint32_t c ) {
+                              labels[size_t(v) * K + k] = std::min( c, ch_multi_infinity );
+                          } );
+    }
+
+#ifdef TEMPUS_CH_AVX2_DISPATCH
+    if ( allow_simd && ch_has_avx2() ) {
+        ch_multi_sweep_avx2<K>( graph, weight_map, labels.data() );
+        return;
+    }
+#else
+    (void)allow_simd;
+#endif
+    ch_multi_sweep_scalar<K>( graph, weight_map, labels.data() );
+}
+
+///
+/// One-to-all costs from a large set of sources.
+/// Sources are split in groups of K, processed by ch_phast_multi(). Groups are processed in parallel,
+/// each thread borrowing its own workspace from the pool.
+///
+/// \returns the same matrix as ch_one_to_all()
+template <size_t K, typename Workspace, typename WeightMap>
+std::vector<uint32_t> ch_one_to_all_batch( const CHQuery& graph,
+                                           const std::vector<CHVertex>& sources,
+                                           WeightMap weight_map,
+                                           CHSearchWorkspacePool<Workspace>& pool,
+                                           bool stall_on_demand,
+                                           CHQueryStatistics& stats )
+{
+    const size_t n = num_vertices( graph );
+    const int n_groups = int( ( sources.size() + K - 1 ) / K );
+
+    std::vector<uint32_t> matrix( sources.size() * n );
+
+    #pragma omp parallel
+    {
+        typename CHSearchWorkspacePool<Workspace>::Handle ws = pool.borrow();
+        std::vector<uint32_t> labels;
+        CHQueryStatistics local_stats;
+
+        #pragma omp for schedule(dynamic)
+        for ( int g = 0; g < n_groups; g++ ) {
+            const size_t first = size_t(g) * K;
+            const size_t n_sources = std::min( K, sources.size() - first );
+            ch_phast_multi<K>( graph, &sources[first], n_sources, weight_map, *ws, stall_on_demand, labels, local_stats );
+
+            for ( size_t k = 0; k < n_sources; k++ ) {
+                uint32_t* row = matrix.data() + ( first + k ) * n;
+                for ( size_t v = 0; v < n; v++ ) {
+                    uint32_t c = labels[v * K + k];
+                    row[v] = c < ch_multi_infinity ? c : Workspace::infinity();
+                }
+            }
+        }
+
+        #pragma omp critical
+        stats += local_stats;
+    }
+
+    return matrix;
+}
+
+} // namespace Tempus
+
+#endif
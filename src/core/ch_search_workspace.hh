@@ -0,0 +1,263 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_CH_SEARCH_WORKSPACE_HH
+#define TEMPUS_CH_SEARCH_WORKSPACE_HH
+
+#include <vector>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#ifdef _WIN32
+#pragma warning(push, 0)
+#endif
+#include <boost/assert.hpp>
+#include <boost/thread.hpp>
+#ifdef _WIN32
+#pragma warning(pop)
+#endif
+
+namespace Tempus
+{
+
+//
+// Binary heap of (cost, vertex) on top of a std::vector.
+// Vertices may be pushed several times, outdated entries must be filtered by the caller.
+template <typename CostType, typename VertexIndex>
+class CHBinaryHeap
+{
+public:
+    void push( CostType c, VertexIndex v )
+    {
+        heap_.push_back( Entry{ c, v } );
+        std::push_heap( heap_.begin(), heap_.end() );
+    }
+
+    bool empty() const { return heap_.empty(); }
+
+    CostType top_key() const { return heap_.front().cost; }
+
+    VertexIndex top_value() const { return heap_.front().vertex; }
+
+    void pop()
+    {
+        std::pop_heap( heap_.begin(), heap_.end() );
+        heap_.pop_back();
+    }
+
+    void clear() { heap_.clear(); }
+
+private:
+    struct Entry
+    {
+        CostType cost;
+        VertexIndex vertex;
+        // reversed, to have a min heap with std::push_heap / std::pop_heap
+        bool operator<( const Entry& other ) const { return cost > other.cost; }
+    };
+    std::vector<Entry> heap_;
+};
+
+//
+// Storage needed by a bidirectional search on a CH query graph.
+//
+// Labels (cost, predecessor and edge to the predecessor) of each direction are allocated once for the whole graph.
+// A label is only valid if its timestamp equals the timestamp of the current query.
+// Starting a new query is then only a matter of incrementing the current timestamp,
+// so that the cost of a query depends on the number of vertices it touches, not on the size of the graph.
+//
+// The heaps of each direction are kept between queries, so that their memory is reused.
+// Heap is the priority queue type, CHBinaryHeap or a RadixHeap for integer costs.
+template <typename CostType,
+          typename VertexIndex = uint32_t,
+          typename Heap = CHBinaryHeap<CostType, VertexIndex>>
+class CHSearchWorkspace
+{
+public:
+    typedef CostType Cost;
+    typedef VertexIndex Vertex;
+
+    static CostType infinity() { return std::numeric_limits<CostType>::max(); }
+
+    /// Predecessor edge of an origin, or of a label set without edge
+    static uint32_t no_edge() { return std::numeric_limits<uint32_t>::max(); }
+
+    explicit CHSearchWorkspace( size_t n_vertices ) : stamp_( 0 )
+    {
+        labels_[0].resize( n_vertices );
+        labels_[1].resize( n_vertices );
+    }
+
+    size_t num_vertices() const { return labels_[0].size(); }
+
+    ///
+    /// Invalidate every label and empty the heaps
+    void new_query()
+    {
+        stamp_++;
+        if ( stamp_ == 0 ) {
+            // the timestamp has wrapped around, old labels could be seen as valid
+            for ( int dir = 0; dir < 2; dir++ ) {
+                for ( Label& l : labels_[dir] ) {
+                    l.stamp = 0;
+                }
+            }
+            stamp_ = 1;
+        }
+        heap_[0].clear();
+        heap_[1].clear();
+    }
+
+    ///
+    /// Is the vertex reached in the given direction during the current query ?
+    bool reached( int dir, VertexIndex v ) const
+    {
+        return labels_[dir][v].stamp == stamp_;
+    }
+
+    ///
+    /// Cost of a vertex in the given direction, infinity if not reached
+    CostType cost( int dir, VertexIndex v ) const
+    {
+        const Label& l = labels_[dir][v];
+        return l.stamp == stamp_ ? l.cost : infinity();
+    }
+
+    ///
+    /// Predecessor of a reached vertex in the given direction
+    VertexIndex predecessor( int dir, VertexIndex v ) const
+    {
+        BOOST_ASSERT( reached( dir, v ) );
+        return labels_[dir][v].predecessor;
+    }
+
+    ///
+    /// Index in the query graph of the edge between a reached vertex and its predecessor, or no_edge()
+    uint32_t predecessor_edge( int dir, VertexIndex v ) const
+    {
+        BOOST_ASSERT( reached( dir, v ) );
+        return labels_[dir][v].predecessor_edge;
+    }
+
+    ///
+    /// Update the label of a vertex
+    void set_label( int dir, VertexIndex v, CostType c, VertexIndex pred, uint32_t pred_edge = no_edge() )
+    {
+        Label& l = labels_[dir][v];
+        l.cost = c;
+        l.predecessor = pred;
+        l.predecessor_edge = pred_edge;
+        l.stamp = stamp_;
+    }
+
+    ///
+    /// Scratch buffers for the edges of a path and the unpacking of its shortcuts (see unpack_ch_path()).
+    /// They are kept between queries, so that their memory is reused
+    std::vector<uint32_t>& path_edges() { return path_edges_; }
+    std::vector<uint32_t>& unpack_stack() { return unpack_stack_; }
+
+    ///
+    /// Heap operations. Vertices may be pushed several times, outdated entries
+    /// must be skipped by the caller by comparing them to the current label
+    void push( int dir, VertexIndex v, CostType c ) { heap_[dir].push( c, v ); }
+
+    bool empty( int dir ) const { return heap_[dir].empty(); }
+
+    CostType top_cost( int dir ) { return heap_[dir].top_key(); }
+
+    VertexIndex top_vertex( int dir ) { return heap_[dir].top_value(); }
+
+    void pop( int dir ) { heap_[dir].pop(); }
+
+private:
+    struct Label
+    {
+        Label() : cost( infinity() ), predecessor( 0 ), predecessor_edge( no_edge() ), stamp( 0 ) {}
+        CostType cost;
+        VertexIndex predecessor;
+        uint32_t predecessor_edge;
+        uint32_t stamp;
+    };
+
+    // labels for each direction (0: forward, 1: backward)
+    std::vector<Label> labels_[2];
+    Heap heap_[2];
+
+    std::vector<uint32_t> path_edges_;
+    std::vector<uint32_t> unpack_stack_;
+
+    // timestamp of the current query
+    uint32_t stamp_;
+};
+
+//
+// Pool of workspaces shared by concurrent requests.
+//
+// A workspace is borrowed by a request for the duration of a query and is used exclusively by
+// the borrowing thread. It goes back to the pool when the returned handle is destroyed.
+// The pool only grows up to the number of concurrent queries.
+template <typename Workspace>
+class CHSearchWorkspacePool
+{
+public:
+    typedef std::unique_ptr<Workspace, std::function<void(Workspace*)>> Handle;
+
+    explicit CHSearchWorkspacePool( size_t n_vertices ) : n_vertices_( n_vertices ) {}
+
+    ///
+    /// Get a workspace, ready for a new query
+    Handle borrow()
+    {
+        std::unique_ptr<Workspace> ws;
+        {
+            boost::lock_guard<boost::mutex> lock( mutex_ );
+            if ( !free_.empty() ) {
+                ws = std::move( free_.back() );
+                free_.pop_back();
+            }
+        }
+        if ( !ws ) {
+            ws.reset( new Workspace( n_vertices_ ) );
+        }
+        ws->new_query();
+        return Handle( ws.release(), [this]( Workspace* w ) { this->give_back( w ); } );
+    }
+
+    ///
+    /// Number of idle workspaces
+    size_t size() const
+    {
+        boost::lock_guard<boost::mutex> lock( mutex_ );
+        return free_.size();
+    }
+
+private:
+    void give_back( Workspace* w )
+    {
+        boost::lock_guard<boost::mutex> lock( mutex_ );
+        free_.emplace_back( w );
+    }
+
+    size_t n_vertices_;
+    mutable boost::mutex mutex_;
+    std::vector<std::unique_ptr<Workspace>> free_;
+};
+
+} // namespace Tempus
+
+#endif
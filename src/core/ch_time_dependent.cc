@@ -0,0 +1,777 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ch_time_dependent.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <queue>
+#include <unordered_map>
+#include <stdexcept>
+#include <tuple>
+
+#include <boost/format.hpp>
+
+namespace Tempus
+{
+
+// times closer than this are the same point (minutes)
+static const double ttf_epsilon = 1e-9;
+
+static double time_of_day( double t )
+{
+    double tod = std::fmod( t, ttf_period() );
+    if ( tod < 0 ) {
+        tod += ttf_period();
+    }
+    return tod >= ttf_period() - ttf_epsilon ? 0.0 : tod;
+}
+
+size_t TTFView::segment( double t ) const
+{
+    const TTFPoint* it = std::upper_bound( points_, points_ + size_, t, []( double time, const TTFPoint& p ) { return time < p.time; } );
+    return it == points_ ? size_ - 1 : size_t( it - points_ ) - 1;
+}
+
+double TTFView::evaluate( double time ) const
+{
+    if ( size_ == 1 ) {
+        return points_[0].travel_time;
+    }
+    const double t = time_of_day( time );
+    const size_t i = segment( t );
+    const TTFPoint& p = points_[i];
+    const TTFPoint& next = points_[i + 1 < size_ ? i + 1 : 0];
+    double t0 = p.time;
+    double t1 = next.time;
+    if ( t < points_[0].time ) {
+        // last segment of the previous day
+        t0 -= ttf_period();
+    }
+    else if ( i + 1 == size_ ) {
+        t1 += ttf_period();
+    }
+    return p.travel_time + ( next.travel_time - p.travel_time ) * ( t - t0 ) / ( t1 - t0 );
+}
+
+uint32_t TTFView::middle( double time ) const
+{
+    return points_[segment( time_of_day( time ) )].middle;
+}
+
+double TTFView::min_travel_time() const
+{
+    return std::min_element( begin(), end(), []( const TTFPoint& a, const TTFPoint& b ) { return a.travel_time < b.travel_time; } )->travel_time;
+}
+
+double TTFView::max_travel_time() const
+{
+    return std::max_element( begin(), end(), []( const TTFPoint& a, const TTFPoint& b ) { return a.travel_time < b.travel_time; } )->travel_time;
+}
+
+namespace
+{
+///
+/// Evaluation of a function at increasing times, the segment of the previous time being the start of the next search
+class TTFCursor
+{
+public:
+    explicit TTFCursor( const TTFView& f ) : f_( f ), i_( 0 ), last_( 0.0 ) {}
+
+    double evaluate( double time )
+    {
+        const TTFPoint* p = f_.begin();
+        const size_t n = f_.size();
+        if ( n == 1 ) {
+            return p[0].travel_time;
+        }
+        const double t = time_of_day( time );
+        if ( t < last_ ) {
+            // next day
+            i_ = 0;
+        }
+        last_ = t;
+        while ( i_ + 1 < n && p[i_ + 1].time <= t ) {
+            i_++;
+        }
+        if ( t < p[0].time ) {
+            // last segment of the previous day
+            const TTFPoint& a = p[n - 1];
+            return a.travel_time + ( p[0].travel_time - a.travel_time ) * ( t - ( a.time - ttf_period() ) ) / ( p[0].time + ttf_period() - a.time );
+        }
+        const TTFPoint& a = p[i_];
+        const TTFPoint& b = p[i_ + 1 < n ? i_ + 1 : 0];
+        const double t1 = i_ + 1 < n ? b.time : b.time + ttf_period();
+        return a.travel_time + ( b.travel_time - a.travel_time ) * ( t - a.time ) / ( t1 - a.time );
+    }
+
+    ///
+    /// Middle vertex of the segment of the last evaluated time
+    uint32_t middle() const
+    {
+        return f_.begin()[last_ < f_.begin()[0].time ? f_.size() - 1 : i_].middle;
+    }
+
+private:
+    const TTFView& f_;
+    size_t i_;
+    double last_;
+};
+}
+
+TravelTimeFunction::TravelTimeFunction( std::vector<TTFPoint>&& points ) : points_( std::move( points ) )
+{
+    if ( points_.empty() ) {
+        throw std::invalid_argument( "A travel time function needs at least one point" );
+    }
+    for ( size_t i = 0; i < points_.size(); i++ ) {
+        if ( points_[i].time < 0 || points_[i].time >= ttf_period() || ( i > 0 && points_[i].time <= points_[i - 1].time ) ) {
+            throw std::invalid_argument( "The points of a travel time function must be sorted by time of the day" );
+        }
+    }
+}
+
+TravelTimeFunction TravelTimeFunction::constant( double travel_time, uint32_t middle )
+{
+    return TravelTimeFunction( std::vector<TTFPoint>( 1, TTFPoint{ 0.0, travel_time, middle } ) );
+}
+
+///
+/// Sorted times of the day, without duplicates
+static std::vector<double> unique_times( std::vector<double>&& times )
+{
+    for ( double& t : times ) {
+        t = time_of_day( t );
+    }
+    std::sort( times.begin(), times.end() );
+    std::vector<double> unique;
+    for ( double t : times ) {
+        if ( unique.empty() || t - unique.back() > ttf_epsilon ) {
+            unique.push_back( t );
+        }
+    }
+    return unique;
+}
+
+///
+/// Function of sorted points, without the points that are on the line of their neighbours in the same piece
+static TravelTimeFunction simplified( const std::vector<TTFPoint>& points )
+{
+    std::vector<TTFPoint> kept;
+    kept.reserve( points.size() );
+    for ( const TTFPoint& p : points ) {
+        if ( kept.size() >= 2 && kept.back().middle == p.middle && kept[kept.size() - 2].middle == p.middle ) {
+            const TTFPoint& a = kept[kept.size() - 2];
+            const TTFPoint& b = kept.back();
+            const double on_line = a.travel_time + ( p.travel_time - a.travel_time ) * ( b.time - a.time ) / ( p.time - a.time );
+            if ( std::abs( on_line - b.travel_time ) < ttf_epsilon ) {
+                kept.pop_back();
+            }
+        }
+        kept.push_back( p );
+    }
+    return TravelTimeFunction( std::move( kept ) );
+}
+
+///
+/// Function of the points computed at the given times
+template <typename Evaluate>
+static TravelTimeFunction sample( const std::vector<double>& times, Evaluate evaluate )
+{
+    std::vector<TTFPoint> points;
+    points.reserve( times.size() );
+    for ( double t : times ) {
+        double travel_time;
+        uint32_t middle;
+        std::tie( travel_time, middle ) = evaluate( t );
+        points.push_back( TTFPoint{ t, travel_time, middle } );
+    }
+    return simplified( points );
+}
+
+TravelTimeFunction TravelTimeFunction::from_speeds( double length, const std::vector<std::pair<double, double>>& speeds )
+{
+    if ( speeds.empty() ) {
+        throw std::invalid_argument( "At least one speed is needed" );
+    }
+    for ( size_t i = 0; i < speeds.size(); i++ ) {
+        if ( speeds[i].second <= 0 ) {
+            throw std::invalid_argument( "Speeds must be positive" );
+        }
+        if ( speeds[i].first < 0 || speeds[i].first >= ttf_period() || ( i > 0 && speeds[i].first <= speeds[i - 1].first ) ) {
+            throw std::invalid_argument( "Speed changes must be sorted by time of the day" );
+        }
+    }
+    // km/h -> m/min
+    auto speed = [&speeds]( size_t k ) { return speeds[k].second * 1000.0 / 60.0; };
+    if ( speeds.size() == 1 ) {
+        return constant( length / speed( 0 ) );
+    }
+    const size_t n = speeds.size();
+    auto period_start = [&speeds]( double day, size_t k ) { return day * ttf_period() + speeds[k].first; };
+
+    // travel time of a departure, going through the periods of speed
+    auto travel_time = [&]( double departure ) {
+        double day = std::floor( departure / ttf_period() );
+        const double tod = departure - day * ttf_period();
+        size_t k = std::upper_bound( speeds.begin(), speeds.end(), tod, []( double t, const std::pair<double, double>& s ) { return t < s.first; } ) - speeds.begin();
+        if ( k == 0 ) {
+            k = n - 1;
+            day -= 1;
+        }
+        else {
+            k--;
+        }
+        double remaining = length;
+        double t = departure;
+        while ( true ) {
+            const double end = k + 1 < n ? period_start( day, k + 1 ) : period_start( day + 1, 0 );
+            if ( speed( k ) * ( end - t ) >= remaining ) {
+                return t + remaining / speed( k ) - departure;
+            }
+            remaining -= speed( k ) * ( end - t );
+            t = end;
+            if ( ++k == n ) {
+                k = 0;
+                day += 1;
+            }
+        }
+    };
+    // departure time of an arrival, going back through the periods of speed
+    auto departure_time = [&]( double arrival ) {
+        double day = std::floor( arrival / ttf_period() );
+        const double tod = arrival - day * ttf_period();
+        size_t k = std::lower_bound( speeds.begin(), speeds.end(), tod, []( const std::pair<double, double>& s, double t ) { return s.first < t; } ) - speeds.begin();
+        if ( k == 0 ) {
+            k = n - 1;
+            day -= 1;
+        }
+        else {
+            k--;
+        }
+        double remaining = length;
+        double t = arrival;
+        while ( true ) {
+            const double start = period_start( day, k );
+            if ( speed( k ) * ( t - start ) >= remaining ) {
+                return t - remaining / speed( k );
+            }
+            remaining -= speed( k ) * ( t - start );
+            t = start;
+            if ( k-- == 0 ) {
+                k = n - 1;
+                day -= 1;
+            }
+        }
+    };
+
+    // the travel time is linear between departures at a change of speed and departures arriving at one
+    std::vector<double> times;
+    for ( const auto& s : speeds ) {
+        times.push_back( s.first );
+        times.push_back( departure_time( s.first ) );
+    }
+    return sample( unique_times( std::move( times ) ), [&]( double t ) {
+            return std::make_pair( travel_time( t ), TTFPoint::no_middle() );
+        });
+}
+
+TravelTimeFunction TravelTimeFunction::link( const TTFView& f, const TTFView& g, uint32_t middle )
+{
+    // the result is linear between the points of f and the departures that reach a point of g
+    std::vector<double> times;
+    for ( size_t i = 0; i < f.size(); i++ ) {
+        const TTFPoint& p = f.begin()[i];
+        times.push_back( p.time );
+        const double t1 = i + 1 < f.size() ? f.begin()[i + 1].time : f.begin()[0].time + ttf_period();
+        const double a0 = p.time + p.travel_time;
+        const double a1 = t1 + f.begin()[i + 1 < f.size() ? i + 1 : 0].travel_time;
+        if ( a1 <= a0 ) {
+            continue;
+        }
+        // points of g after a0, in order, until a1
+        double day = std::floor( a0 / ttf_period() ) * ttf_period();
+        size_t j = std::upper_bound( g.begin(), g.end(), a0 - day, []( double t, const TTFPoint& q ) { return t < q.time; } ) - g.begin();
+        for ( ;; j++ ) {
+            if ( j == g.size() ) {
+                j = 0;
+                day += ttf_period();
+            }
+            const double s = day + g.begin()[j].time;
+            if ( s >= a1 ) {
+                break;
+            }
+            if ( s > a0 ) {
+                times.push_back( p.time + ( s - a0 ) * ( t1 - p.time ) / ( a1 - a0 ) );
+            }
+        }
+    }
+    TTFCursor fc( f ), gc( g );
+    return sample( unique_times( std::move( times ) ), [&]( double t ) {
+            const double ft = fc.evaluate( t );
+            return std::make_pair( ft + gc.evaluate( t + ft ), middle );
+        });
+}
+
+TravelTimeFunction TravelTimeFunction::merge( const TTFView& f, const TTFView& g )
+{
+    std::vector<double> times;
+    for ( const TTFPoint& p : f ) {
+        times.push_back( p.time );
+    }
+    for ( const TTFPoint& p : g ) {
+        times.push_back( p.time );
+    }
+    times = unique_times( std::move( times ) );
+    // both functions are linear between these times, they may cross once
+    const size_t n = times.size();
+    std::vector<double> diff( n );
+    {
+        TTFCursor fc( f ), gc( g );
+        for ( size_t i = 0; i < n; i++ ) {
+            diff[i] = fc.evaluate( times[i] ) - gc.evaluate( times[i] );
+        }
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        const double t0 = times[i];
+        const double t1 = i + 1 < n ? times[i + 1] : times[0] + ttf_period();
+        const double d0 = diff[i];
+        const double d1 = diff[i + 1 < n ? i + 1 : 0];
+        if ( ( d0 < -ttf_epsilon && d1 > ttf_epsilon ) || ( d0 > ttf_epsilon && d1 < -ttf_epsilon ) ) {
+            times.push_back( t0 + ( t1 - t0 ) * d0 / ( d0 - d1 ) );
+        }
+    }
+    times = unique_times( std::move( times ) );
+
+    std::vector<TTFPoint> points;
+    points.reserve( times.size() );
+    TTFCursor fc( f ), gc( g ), fmid( f ), gmid( g );
+    for ( size_t i = 0; i < times.size(); i++ ) {
+        const double t0 = times[i];
+        const double t1 = i + 1 < times.size() ? times[i + 1] : times[0] + ttf_period();
+        // the fastest function on the whole piece
+        const double mid = ( t0 + t1 ) / 2;
+        const double f_mid = fmid.evaluate( mid );
+        const double g_mid = gmid.evaluate( mid );
+        const uint32_t middle = f_mid <= g_mid ? fmid.middle() : gmid.middle();
+        points.push_back( TTFPoint{ t0, std::min( fc.evaluate( t0 ), gc.evaluate( t0 ) ), middle } );
+    }
+    return simplified( points );
+}
+
+TDCHGraph::TDCHGraph( FlatArray<uint32_t>&& edge_index,
+                      FlatArray<TDCHEdge>&& edges,
+                      FlatArray<TTFPoint>&& points,
+                      FlatArray<uint32_t>&& down_index,
+                      FlatArray<TDCHDownEdge>&& down_edges )
+    : edge_index_( std::move( edge_index ) ),
+      edges_( std::move( edges ) ),
+      points_( std::move( points ) ),
+      down_index_( std::move( down_index ) ),
+      down_edges_( std::move( down_edges ) )
+{
+    if ( edge_index_.empty() || edge_index_[edge_index_.size() - 1] != edges_.size() ||
+         down_index_.size() != edge_index_.size() || down_index_[down_index_.size() - 1] != down_edges_.size() ) {
+        throw std::invalid_argument( "Inconsistent time-dependent CH graph" );
+    }
+    for ( size_t e = 0; e < edges_.size(); e++ ) {
+        const uint32_t end = e + 1 < edges_.size() ? edges_[e + 1].first_point : uint32_t( points_.size() );
+        if ( edges_[e].first_point >= end || end > points_.size() || edges_[e].target >= num_vertices() ) {
+            throw std::invalid_argument( "Inconsistent time-dependent CH graph" );
+        }
+    }
+}
+
+std::pair<uint32_t, double> TDCHGraph::fastest_edge( uint32_t u, uint32_t v, double time ) const
+{
+    std::pair<uint32_t, double> fastest( uint32_t( num_edges() ), std::numeric_limits<double>::infinity() );
+    const TDCHEdge* first = edges_.begin() + edge_index_[u];
+    const TDCHEdge* last = edges_.begin() + edge_index_[u + 1];
+    for ( const TDCHEdge* it = std::lower_bound( first, last, v, []( const TDCHEdge& e, uint32_t t ) { return e.target < t; } );
+          it != last && it->target == v; it++ ) {
+        const uint32_t e = uint32_t( it - edges_.begin() );
+        const double travel_time = ttf( e ).evaluate( time );
+        if ( travel_time < fastest.second ) {
+            fastest = std::make_pair( e, travel_time );
+        }
+    }
+    return fastest;
+}
+
+namespace
+{
+struct TDWorkEdge
+{
+    uint32_t from;
+    uint32_t to;
+    TravelTimeFunction ttf;
+    db_id_t db_id;
+    bool shortcut;
+    // bounds of the travel time, for witness searches
+    double min_travel_time;
+    double max_travel_time;
+};
+}
+
+///
+/// Flat graph out of a list of edges
+static std::unique_ptr<TDCHGraph> build_td_graph( uint32_t n_vertices, std::vector<TDWorkEdge>& edges )
+{
+    std::sort( edges.begin(), edges.end(), []( const TDWorkEdge& a, const TDWorkEdge& b ) {
+            return std::tie( a.from, a.to ) < std::tie( b.from, b.to );
+        });
+    std::vector<uint32_t> edge_index( n_vertices + 1, 0 );
+    std::vector<TDCHEdge> flat_edges;
+    std::vector<TTFPoint> points;
+    std::vector<uint32_t> down_index( n_vertices + 1, 0 );
+    flat_edges.reserve( edges.size() );
+    for ( const TDWorkEdge& e : edges ) {
+        edge_index[e.from + 1]++;
+        if ( e.to < e.from ) {
+            down_index[e.to + 1]++;
+        }
+        // bounds rounded outwards
+        const double min_travel_time = e.ttf.view().min_travel_time();
+        const double max_travel_time = e.ttf.view().max_travel_time();
+        float min_f = float( min_travel_time );
+        float max_f = float( max_travel_time );
+        if ( min_f > min_travel_time ) {
+            min_f = std::nextafter( min_f, 0.0f );
+        }
+        if ( max_f < max_travel_time ) {
+            max_f = std::nextafter( max_f, std::numeric_limits<float>::infinity() );
+        }
+        flat_edges.push_back( TDCHEdge{ e.to, uint32_t( points.size() ), e.shortcut ? 0 : e.db_id, min_f, max_f } );
+        points.insert( points.end(), e.ttf.points().begin(), e.ttf.points().end() );
+    }
+    for ( uint32_t v = 0; v < n_vertices; v++ ) {
+        edge_index[v + 1] += edge_index[v];
+        down_index[v + 1] += down_index[v];
+    }
+    std::vector<TDCHDownEdge> down_edges( down_index.back() );
+    std::vector<uint32_t> next_down( down_index.begin(), down_index.end() - 1 );
+    for ( uint32_t i = 0; i < edges.size(); i++ ) {
+        if ( edges[i].to < edges[i].from ) {
+            down_edges[next_down[edges[i].to]++] = TDCHDownEdge{ edges[i].from, i };
+        }
+    }
+    return std::unique_ptr<TDCHGraph>( new TDCHGraph( FlatArray<uint32_t>( std::move( edge_index ) ),
+                                                      FlatArray<TDCHEdge>( std::move( flat_edges ) ),
+                                                      FlatArray<TTFPoint>( std::move( points ) ),
+                                                      FlatArray<uint32_t>( std::move( down_index ) ),
+                                                      FlatArray<TDCHDownEdge>( std::move( down_edges ) ) ) );
+}
+
+std::unique_ptr<TDCHGraph> TDCHGraph::renumbered( const std::vector<uint32_t>& new_number ) const
+{
+    if ( new_number.size() != num_vertices() ) {
+        throw std::invalid_argument( "renumbered: one number per vertex is expected" );
+    }
+    std::vector<TDWorkEdge> edges;
+    edges.reserve( num_edges() );
+    for ( uint32_t u = 0; u < num_vertices(); u++ ) {
+        for ( uint32_t e = out_edges( u ).first; e != out_edges( u ).second; e++ ) {
+            const uint32_t v = edges_[e].target;
+            if ( ( new_number[u] < new_number[v] ) != ( u < v ) ) {
+                throw std::invalid_argument( (boost::format( "The new numbering inverts the edge %1% -> %2%" ) % u % v).str() );
+            }
+            std::vector<TTFPoint> points( ttf( e ).begin(), ttf( e ).end() );
+            for ( TTFPoint& p : points ) {
+                if ( p.middle != TTFPoint::no_middle() ) {
+                    p.middle = new_number[p.middle];
+                }
+            }
+            edges.push_back( TDWorkEdge{ new_number[u], new_number[v], TravelTimeFunction( std::move( points ) ), edges_[e].db_id, is_shortcut( e ), 0.0, 0.0 } );
+        }
+    }
+    return build_td_graph( uint32_t( num_vertices() ), edges );
+}
+
+///
+/// Upper bounds of the travel times from a vertex to the vertices not contracted yet,
+/// by a Dijkstra search on the upper bounds of the edges
+static std::unordered_map<uint32_t, double> witness_search( const std::vector<TDWorkEdge>& edges,
+                                                            const std::vector<std::vector<uint32_t>>& out,
+                                                            uint32_t origin,
+                                                            uint32_t contracted,
+                                                            double max_cost,
+                                                            size_t settled_limit )
+{
+    std::unordered_map<uint32_t, double> dist;
+    typedef std::pair<double, uint32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    dist[origin] = 0.0;
+    queue.push( Entry( 0.0, origin ) );
+    size_t settled = 0;
+    while ( !queue.empty() && settled < settled_limit ) {
+        const Entry top = queue.top();
+        queue.pop();
+        if ( top.first > dist[top.second] ) {
+            continue;
+        }
+        if ( top.first > max_cost ) {
+            break;
+        }
+        settled++;
+        for ( uint32_t e : out[top.second] ) {
+            const uint32_t w = edges[e].to;
+            if ( w <= contracted ) {
+                continue;
+            }
+            const double d = top.first + edges[e].max_travel_time;
+            auto it = dist.find( w );
+            if ( it == dist.end() || d < it->second ) {
+                dist[w] = d;
+                queue.push( Entry( d, w ) );
+            }
+        }
+    }
+    return dist;
+}
+
+///
+/// Whether f is never slower than g
+static bool dominates( const TTFView& f, const TTFView& g )
+{
+    // both functions are linear between their points
+    TTFCursor fc( f ), gc( g );
+    for ( const TTFPoint& p : f ) {
+        if ( p.travel_time > gc.evaluate( p.time ) + ttf_epsilon ) {
+            return false;
+        }
+    }
+    for ( const TTFPoint& p : g ) {
+        if ( fc.evaluate( p.time ) > p.travel_time + ttf_epsilon ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+/// Exact travel time functions from a vertex to the given targets, restricted to paths of at most hop_limit edges
+/// between vertices not contracted yet.
+/// Paths always slower than every target are not followed.
+static std::map<uint32_t, TravelTimeFunction> profile_witness( const std::vector<TDWorkEdge>& edges,
+                                                               const std::vector<std::vector<uint32_t>>& out,
+                                                               uint32_t origin,
+                                                               uint32_t contracted,
+                                                               const std::map<uint32_t, TravelTimeFunction>& targets,
+                                                               size_t hop_limit )
+{
+    // a witness is useless when it is always slower than the function of its target
+    std::map<uint32_t, double> target_max;
+    double bound = 0.0;
+    for ( const auto& t : targets ) {
+        target_max[t.first] = t.second.view().max_travel_time();
+        bound = std::max( bound, target_max[t.first] );
+    }
+    // whether a path reaching z with the given number of edges and lowest travel time may lead to a faster witness
+    auto useful = [&]( uint32_t z, size_t hops, double min_travel_time ) {
+        auto t = target_max.find( z );
+        if ( t != target_max.end() && min_travel_time < t->second ) {
+            return true;
+        }
+        if ( hops + 1 < hop_limit ) {
+            return min_travel_time < bound;
+        }
+        if ( hops + 1 == hop_limit ) {
+            for ( uint32_t e : out[z] ) {
+                auto next = target_max.find( edges[e].to );
+                if ( next != target_max.end() && min_travel_time + edges[e].min_travel_time < next->second ) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    std::map<uint32_t, TravelTimeFunction> labels;
+    std::vector<uint32_t> frontier( 1, origin );
+    for ( size_t hop = 0; hop < hop_limit && !frontier.empty(); hop++ ) {
+        std::vector<uint32_t> next;
+        for ( uint32_t y : frontier ) {
+            for ( uint32_t e : out[y] ) {
+                const uint32_t z = edges[e].to;
+                if ( z <= contracted || z == origin ) {
+                    continue;
+                }
+                const double y_min = y == origin ? 0.0 : labels[y].view().min_travel_time();
+                if ( !useful( z, hop + 1, y_min + edges[e].min_travel_time ) ) {
+                    continue;
+                }
+                TravelTimeFunction ttf = y == origin ? edges[e].ttf : TravelTimeFunction::link( labels[y].view(), edges[e].ttf.view(), y );
+                if ( !useful( z, hop + 1, ttf.view().min_travel_time() ) ) {
+                    continue;
+                }
+                auto it = labels.find( z );
+                if ( it == labels.end() ) {
+                    labels[z] = std::move( ttf );
+                }
+                else if ( dominates( it->second.view(), ttf.view() ) ) {
+                    continue;
+                }
+                else {
+                    it->second = TravelTimeFunction::merge( it->second.view(), ttf.view() );
+                }
+                next.push_back( z );
+            }
+        }
+        std::sort( next.begin(), next.end() );
+        next.erase( std::unique( next.begin(), next.end() ), next.end() );
+        frontier.swap( next );
+    }
+    return labels;
+}
+
+std::unique_ptr<TDCHGraph> td_contraction( uint32_t n_vertices, const std::vector<TDInputEdge>& input_edges, size_t witness_settled_limit, size_t witness_hop_limit )
+{
+    std::vector<TDWorkEdge> edges;
+    std::vector<std::vector<uint32_t>> out( n_vertices ), in( n_vertices );
+    // shortcut of each pair of vertices
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> shortcut_edges;
+    auto add_edge = [&]( uint32_t from, uint32_t to, TravelTimeFunction&& ttf, db_id_t db_id, bool shortcut ) {
+        const double min_travel_time = ttf.view().min_travel_time();
+        const double max_travel_time = ttf.view().max_travel_time();
+        if ( shortcut ) {
+            shortcut_edges[std::make_pair( from, to )] = uint32_t( edges.size() );
+        }
+        out[from].push_back( uint32_t( edges.size() ) );
+        in[to].push_back( uint32_t( edges.size() ) );
+        edges.push_back( TDWorkEdge{ from, to, std::move( ttf ), db_id, shortcut, min_travel_time, max_travel_time } );
+    };
+    for ( const TDInputEdge& e : input_edges ) {
+        if ( e.from >= n_vertices || e.to >= n_vertices ) {
+            throw std::invalid_argument( "td_contraction: edge out of the graph" );
+        }
+        if ( e.from != e.to ) {
+            add_edge( e.from, e.to, TravelTimeFunction( e.ttf ), e.db_id, false );
+        }
+    }
+
+    for ( uint32_t v = 0; v < n_vertices; v++ ) {
+        // neighbours not contracted yet, parallel edges merged
+        std::map<uint32_t, TravelTimeFunction> from_x, to_w;
+        auto add_neighbour = []( std::map<uint32_t, TravelTimeFunction>& neighbours, uint32_t x, const TravelTimeFunction& ttf ) {
+            auto it = neighbours.find( x );
+            if ( it == neighbours.end() ) {
+                neighbours[x] = ttf;
+            }
+            else {
+                it->second = TravelTimeFunction::merge( it->second.view(), ttf.view() );
+            }
+        };
+        for ( uint32_t e : in[v] ) {
+            if ( edges[e].from > v ) {
+                add_neighbour( from_x, edges[e].from, edges[e].ttf );
+            }
+        }
+        for ( uint32_t e : out[v] ) {
+            if ( edges[e].to > v ) {
+                add_neighbour( to_w, edges[e].to, edges[e].ttf );
+            }
+        }
+
+        std::map<uint32_t, double> to_w_min;
+        for ( const auto& w : to_w ) {
+            to_w_min[w.first] = w.second.view().min_travel_time();
+        }
+
+        for ( const auto& x : from_x ) {
+            const double x_min = x.second.view().min_travel_time();
+            // lower bound of each shortcut, before computing its function
+            double max_cost = 0.0;
+            for ( const auto& w : to_w_min ) {
+                if ( w.first != x.first ) {
+                    max_cost = std::max( max_cost, x_min + w.second );
+                }
+            }
+            std::unordered_map<uint32_t, double> witness = witness_search( edges, out, x.first, v, max_cost, witness_settled_limit );
+            std::map<uint32_t, TravelTimeFunction> shortcuts;
+            for ( const auto& w : to_w ) {
+                if ( w.first == x.first ) {
+                    continue;
+                }
+                auto it = witness.find( w.first );
+                if ( it != witness.end() && it->second <= x_min + to_w_min[w.first] ) {
+                    // always slower than the witness
+                    continue;
+                }
+                TravelTimeFunction h = TravelTimeFunction::link( x.second.view(), w.second.view(), v );
+                if ( it != witness.end() && it->second <= h.view().min_travel_time() ) {
+                    continue;
+                }
+                shortcuts[w.first] = std::move( h );
+            }
+            if ( shortcuts.empty() ) {
+                continue;
+            }
+            // short witness paths, compared on the whole day
+            const std::map<uint32_t, TravelTimeFunction> short_witness = profile_witness( edges, out, x.first, v, shortcuts, witness_hop_limit );
+            for ( auto& s : shortcuts ) {
+                auto sw = short_witness.find( s.first );
+                if ( sw != short_witness.end() && dominates( sw->second.view(), s.second.view() ) ) {
+                    continue;
+                }
+                // merged with the shortcut of other middle vertices, if any
+                auto existing = shortcut_edges.find( std::make_pair( x.first, s.first ) );
+                if ( existing != shortcut_edges.end() ) {
+                    TDWorkEdge& e = edges[existing->second];
+                    e.ttf = TravelTimeFunction::merge( e.ttf.view(), s.second.view() );
+                    e.min_travel_time = e.ttf.view().min_travel_time();
+                    e.max_travel_time = e.ttf.view().max_travel_time();
+                }
+                else {
+                    add_edge( x.first, s.first, std::move( s.second ), 0, true );
+                }
+            }
+        }
+    }
+    return build_td_graph( n_vertices, edges );
+}
+
+void td_unpack_path( const TDCHGraph& graph, const std::vector<std::pair<uint32_t, uint32_t>>& path, double departure, std::vector<TDPathEdge>& road_edges )
+{
+    double t = departure;
+    // edges to unpack with their source, the next one on top
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    for ( const auto& edge : path ) {
+        stack.push_back( edge );
+        while ( !stack.empty() ) {
+            const uint32_t u = stack.back().first;
+            const uint32_t e = stack.back().second;
+            stack.pop_back();
+            if ( !graph.is_shortcut( e ) ) {
+                const double travel_time = graph.ttf( e ).evaluate( t );
+                road_edges.push_back( TDPathEdge{ e, t, travel_time } );
+                t += travel_time;
+                continue;
+            }
+            // the second half is the fastest edge when the first one is left
+            const uint32_t middle = graph.ttf( e ).middle( t );
+            const std::pair<uint32_t, double> first = graph.fastest_edge( u, middle, t );
+            const std::pair<uint32_t, double> second = graph.fastest_edge( middle, graph.edge( e ).target, t + first.second );
+            if ( first.first == graph.num_edges() || second.first == graph.num_edges() ) {
+                throw std::runtime_error( "td_unpack_path: the edges of a shortcut are missing" );
+            }
+            stack.push_back( std::make_pair( middle, second.first ) );
+            stack.push_back( std::make_pair( u, first.first ) );
+        }
+    }
+}
+
+} // namespace Tempus
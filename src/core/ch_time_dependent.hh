@@ -0,0 +1,269 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_CH_TIME_DEPENDENT_HH
+#define TEMPUS_CH_TIME_DEPENDENT_HH
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include "base.hh"
+#include "flat_file.hh"
+
+namespace Tempus
+{
+
+//
+// Time-dependent contraction hierarchies.
+//
+// The travel time of an edge depends on the departure time. It is given by a travel time function (TTF):
+// a periodic piecewise-linear function of the time of the day, both in minutes.
+// Functions of road sections are derived from daily speed profiles. They have the FIFO property:
+// leaving later never means arriving earlier.
+//
+// Shortcuts carry the exact function of the paths they replace, built by linking the functions of their
+// two edges, and merged (minimum) with the shortcuts of the other middle vertices. Each piece of the
+// function of a shortcut records the middle vertex of its fastest path, so that paths can be unpacked
+// for a given departure time.
+//
+// Vertices are numbered in contraction order, like a CHQuery graph, so that a time-dependent hierarchy
+// can share the vertices of a static one.
+
+///
+/// Period of travel time functions: one day, in minutes
+inline double ttf_period() { return 1440.0; }
+
+///
+/// Point of a travel time function
+struct TTFPoint
+{
+    /// Value of middle for the functions of road sections
+    static uint32_t no_middle() { return 0xFFFFFFFF; }
+
+    /// Time of the day of the departure (minutes), in [0, ttf_period())
+    double time;
+    /// Travel time of this departure (minutes)
+    double travel_time;
+    /// Middle vertex of the fastest path of a shortcut, from this point to the next one
+    uint32_t middle;
+};
+
+///
+/// Read-only travel time function, points sorted by time.
+/// The function is linear between two consecutive points and between the last point and the first one of the next day.
+class TTFView
+{
+public:
+    TTFView( const TTFPoint* points, size_t size ) : points_( points ), size_( size ) {}
+
+    const TTFPoint* begin() const { return points_; }
+    const TTFPoint* end() const { return points_ + size_; }
+    size_t size() const { return size_; }
+
+    ///
+    /// Travel time of a departure at a given time, that may be out of [0, ttf_period())
+    double evaluate( double time ) const;
+
+    ///
+    /// Middle vertex of the fastest path departing at a given time, TTFPoint::no_middle() for a road section
+    uint32_t middle( double time ) const;
+
+    double min_travel_time() const;
+    double max_travel_time() const;
+
+private:
+    // index of the last point at or before the time of the day t, the last one of the previous day if none
+    size_t segment( double t ) const;
+
+    const TTFPoint* points_;
+    size_t size_;
+};
+
+///
+/// Travel time function with its own points
+class TravelTimeFunction
+{
+public:
+    TravelTimeFunction() {}
+
+    ///
+    /// Function of sorted points, throws std::invalid_argument if the points are not sorted
+    /// or are out of [0, ttf_period())
+    explicit TravelTimeFunction( std::vector<TTFPoint>&& points );
+
+    ///
+    /// Constant travel time
+    static TravelTimeFunction constant( double travel_time, uint32_t middle = TTFPoint::no_middle() );
+
+    ///
+    /// Travel time of a road section whose speed changes during the day.
+    /// Throws std::invalid_argument if a speed is not positive
+    /// \param length Length of the section (meters)
+    /// \param speeds Time of the day (minutes) and speed (km/h) of each change of speed, sorted by time.
+    /// The last speed holds until the first change of the next day.
+    static TravelTimeFunction from_speeds( double length, const std::vector<std::pair<double, double>>& speeds );
+
+    ///
+    /// Function of the path made of an edge of function f followed by an edge of function g:
+    /// h(t) = f(t) + g(t + f(t))
+    /// \param middle Middle vertex of every piece of the result
+    static TravelTimeFunction link( const TTFView& f, const TTFView& g, uint32_t middle );
+
+    ///
+    /// Pointwise minimum of two functions, each piece keeping the middle vertex of the fastest one
+    static TravelTimeFunction merge( const TTFView& f, const TTFView& g );
+
+    TTFView view() const { return TTFView( points_.data(), points_.size() ); }
+    const std::vector<TTFPoint>& points() const { return points_; }
+
+    double evaluate( double time ) const { return view().evaluate( time ); }
+
+private:
+    std::vector<TTFPoint> points_;
+};
+
+///
+/// Edge of a time-dependent CH graph
+struct TDCHEdge
+{
+    uint32_t target;
+    /// Index of the first point of the travel time function, that ends at the first point of the next edge
+    uint32_t first_point;
+    /// ID of the road section, 0 for a shortcut
+    db_id_t db_id;
+    /// Bounds of the travel time function, rounded outwards
+    float min_travel_time;
+    float max_travel_time;
+};
+
+///
+/// Downward edge, indexed by its target
+struct TDCHDownEdge
+{
+    uint32_t source;
+    /// Index of the edge in the graph
+    uint32_t edge;
+};
+
+///
+/// Time-dependent CH graph, with its arrays stored flat so that it can be mapped from a file.
+/// Each vertex has its outgoing edges, upward and downward, sorted by target.
+/// Downward edges are also indexed by target, for the backward part of queries.
+class TDCHGraph
+{
+public:
+    ///
+    /// Throws std::invalid_argument if the arrays are inconsistent
+    TDCHGraph( FlatArray<uint32_t>&& edge_index,
+               FlatArray<TDCHEdge>&& edges,
+               FlatArray<TTFPoint>&& points,
+               FlatArray<uint32_t>&& down_index,
+               FlatArray<TDCHDownEdge>&& down_edges );
+
+    size_t num_vertices() const { return edge_index_.size() - 1; }
+    size_t num_edges() const { return edges_.size(); }
+
+    ///
+    /// Outgoing edges of a vertex, from first to second excluded
+    std::pair<uint32_t, uint32_t> out_edges( uint32_t u ) const { return std::make_pair( edge_index_[u], edge_index_[u + 1] ); }
+
+    ///
+    /// Downward edges reaching a vertex, from first to second excluded in down_edge_array()
+    std::pair<uint32_t, uint32_t> down_edges( uint32_t v ) const { return std::make_pair( down_index_[v], down_index_[v + 1] ); }
+
+    const TDCHDownEdge& down_edge( uint32_t i ) const { return down_edges_[i]; }
+
+    const TDCHEdge& edge( uint32_t e ) const { return edges_[e]; }
+
+    ///
+    /// Travel time function of an edge
+    TTFView ttf( uint32_t e ) const
+    {
+        const uint32_t end = e + 1 < edges_.size() ? edges_[e + 1].first_point : uint32_t( points_.size() );
+        return TTFView( points_.data() + edges_[e].first_point, end - edges_[e].first_point );
+    }
+
+    bool is_shortcut( uint32_t e ) const { return points_[edges_[e].first_point].middle != TTFPoint::no_middle(); }
+
+    ///
+    /// Fastest of the edges from u to v for a departure at a given time
+    /// \returns the edge and its travel time, num_edges() as edge if there is none
+    std::pair<uint32_t, double> fastest_edge( uint32_t u, uint32_t v, double time ) const;
+
+    ///
+    /// Copy with renumbered vertices. Throws std::invalid_argument if an edge would not keep the direction
+    /// (upward or downward) it has
+    std::unique_ptr<TDCHGraph> renumbered( const std::vector<uint32_t>& new_number ) const;
+
+    const FlatArray<uint32_t>& edge_index_array() const { return edge_index_; }
+    const FlatArray<TDCHEdge>& edge_array() const { return edges_; }
+    const FlatArray<TTFPoint>& point_array() const { return points_; }
+    const FlatArray<uint32_t>& down_index_array() const { return down_index_; }
+    const FlatArray<TDCHDownEdge>& down_edge_array() const { return down_edges_; }
+
+private:
+    FlatArray<uint32_t> edge_index_;
+    FlatArray<TDCHEdge> edges_;
+    FlatArray<TTFPoint> points_;
+    FlatArray<uint32_t> down_index_;
+    FlatArray<TDCHDownEdge> down_edges_;
+};
+
+///
+/// Input edge of a time-dependent contraction
+struct TDInputEdge
+{
+    uint32_t from;
+    uint32_t to;
+    TravelTimeFunction ttf;
+    db_id_t db_id;
+};
+
+///
+/// Contract a time-dependent graph, each vertex being contracted in its numbering order.
+/// A shortcut is not added if a witness path is always faster. Witnesses are first looked for on the upper bounds
+/// of travel times, then by comparing the exact functions of the paths of a few edges.
+/// \param n_vertices Number of vertices, numbered in contraction order
+/// \param edges Road sections, parallel edges are allowed
+/// \param witness_settled_limit Maximum number of vertices settled by a witness search on upper bounds
+/// \param witness_hop_limit Maximum number of edges of the witnesses compared by their functions
+std::unique_ptr<TDCHGraph> td_contraction( uint32_t n_vertices, const std::vector<TDInputEdge>& edges,
+                                           size_t witness_settled_limit = 500, size_t witness_hop_limit = 2 );
+
+///
+/// Edge of the path found by a time-dependent query
+struct TDPathEdge
+{
+    /// Index of the road section in the TDCHGraph
+    uint32_t edge;
+    /// Departure time on the road section (minutes since the beginning of the day of the query)
+    double departure;
+    double travel_time;
+};
+
+///
+/// Unpack a path of the TDCHGraph into road sections, shortcuts being unpacked for the departure time they are reached at
+/// \param graph The graph
+/// \param path Edges of the path, each one with its source vertex
+/// \param departure Departure time at the beginning of the path
+/// \param[out] road_edges Road sections are appended to it
+void td_unpack_path( const TDCHGraph& graph, const std::vector<std::pair<uint32_t, uint32_t>>& path, double departure, std::vector<TDPathEdge>& road_edges );
+
+} // namespace Tempus
+
+#endif
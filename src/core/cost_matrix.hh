@@ -0,0 +1,83 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_COST_MATRIX_HH
+#define TEMPUS_COST_MATRIX_HH
+
+#include <vector>
+#include <limits>
+
+#include "common.hh"
+#include "property.hh"
+
+namespace Tempus
+{
+
+/**
+   A CostMatrixRequest asks for the cost of every (origin, destination) pair.
+   Origins and destinations are road vertex IDs.
+*/
+class CostMatrixRequest
+{
+public:
+    DECLARE_RW_PROPERTY( origins, std::vector<db_id_t> );
+    DECLARE_RW_PROPERTY( destinations, std::vector<db_id_t> );
+
+    ///
+    /// Allowed transport modes (their ID)
+    DECLARE_RW_PROPERTY( allowed_modes, std::vector<db_id_t> );
+};
+
+/**
+   Dense matrix of costs between origins (rows) and destinations (columns).
+   Unreachable destinations have an infinite cost.
+*/
+class CostMatrix
+{
+public:
+    CostMatrix( const std::vector<db_id_t>& origins, const std::vector<db_id_t>& destinations )
+        : origins_( origins ), destinations_( destinations ),
+          costs_( origins.size() * destinations.size(), infinity() )
+    {}
+
+    static float infinity() { return std::numeric_limits<float>::infinity(); }
+
+    DECLARE_RO_PROPERTY( origins, std::vector<db_id_t> );
+    DECLARE_RO_PROPERTY( destinations, std::vector<db_id_t> );
+
+    float cost( size_t origin_idx, size_t destination_idx ) const
+    {
+        return costs_[origin_idx * destinations_.size() + destination_idx];
+    }
+
+    void set_cost( size_t origin_idx, size_t destination_idx, float c )
+    {
+        costs_[origin_idx * destinations_.size() + destination_idx] = c;
+    }
+
+    bool is_reachable( size_t origin_idx, size_t destination_idx ) const
+    {
+        return cost( origin_idx, destination_idx ) != infinity();
+    }
+
+private:
+    // row-major storage
+    std::vector<float> costs_;
+};
+
+} // namespace Tempus
+
+#endif
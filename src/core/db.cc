@@ -16,6 +16,8 @@
  */
 
 #include <iostream>
+#include <cstring>
+#include <cstdio>
 
 #include "db.hh"
 
@@ -54,6 +56,20 @@ long long Value::as<long long>() const
     return v;
 }
 template <>
+unsigned long long Value::as<unsigned long long>() const
+{
+    unsigned long long v;
+    sscanf( value_, "%llu", &v );
+    return v;
+}
+template <>
+unsigned int Value::as<unsigned int>() const
+{
+    unsigned int v;
+    sscanf( value_, "%u", &v );
+    return v;
+}
+template <>
 int Value::as<int>() const
 {
     int v;
@@ -246,11 +262,385 @@ ResultIterator Connection::exec_it( const std::string& query ) throw (std::runti
     return ResultIterator( conn_ );
 }
 
+namespace {
+// data are sent by chunks of this size
+const size_t copy_chunk_size = 1 << 16;
+
+// header of the binary format: signature, flags and length of the header extension
+const char copy_binary_header[] = "PGCOPY\n\377\r\n\0\0\0\0\0\0\0\0\0";
+const size_t copy_binary_header_size = 19;
+
+// integers are sent in network byte order
+template <typename T>
+void append_big_endian( std::string& buf, T v )
+{
+    for ( int i = sizeof( T ) - 1; i >= 0; i-- ) {
+        buf.push_back( char( ( uint64_t( v ) >> ( i * 8 ) ) & 0xFF ) );
+    }
+}
+}
+
+CopyWriter::CopyWriter( pg_conn* conn, Format format )
+    : conn_( conn ), format_( format ), n_fields_( 0 ), rows_( 0 ), finished_( false )
+{
+    buffer_.reserve( copy_chunk_size + 1024 );
+    if ( format_ == BinaryFormat ) {
+        buffer_.append( copy_binary_header, copy_binary_header_size );
+    }
+}
+
+CopyWriter::CopyWriter( CopyWriter&& other )
+    : conn_( other.conn_ ), format_( other.format_ ), buffer_( std::move( other.buffer_ ) ), row_( std::move( other.row_ ) ),
+      n_fields_( other.n_fields_ ), rows_( other.rows_ ), finished_( other.finished_ )
+{
+    other.finished_ = true;
+}
+
+CopyWriter::~CopyWriter()
+{
+    if ( !finished_ ) {
+        // cancel the copy
+        PQputCopyEnd( conn_, "copy not finished" );
+        while ( pg_result* res = PQgetResult( conn_ ) ) {
+            PQclear( res );
+        }
+    }
+}
+
+void CopyWriter::add_binary_field( const char* data, int32_t len )
+{
+    append_big_endian( row_, len );
+    if ( len > 0 ) {
+        row_.append( data, len );
+    }
+    n_fields_++;
+}
+
+void CopyWriter::add_text_field( const std::string& v )
+{
+    if ( n_fields_ > 0 ) {
+        row_.push_back( '\t' );
+    }
+    row_.append( v );
+    n_fields_++;
+}
+
+CopyWriter& CopyWriter::add( int32_t v )
+{
+    if ( format_ == BinaryFormat ) {
+        append_big_endian( row_, int32_t( 4 ) );
+        append_big_endian( row_, uint32_t( v ) );
+        n_fields_++;
+    }
+    else {
+        add_text_field( std::to_string( v ) );
+    }
+    return *this;
+}
+
+CopyWriter& CopyWriter::add( int64_t v )
+{
+    if ( format_ == BinaryFormat ) {
+        append_big_endian( row_, int32_t( 8 ) );
+        append_big_endian( row_, uint64_t( v ) );
+        n_fields_++;
+    }
+    else {
+        add_text_field( std::to_string( v ) );
+    }
+    return *this;
+}
+
+CopyWriter& CopyWriter::add( float v )
+{
+    if ( format_ == BinaryFormat ) {
+        uint32_t bits;
+        memcpy( &bits, &v, sizeof( bits ) );
+        append_big_endian( row_, int32_t( 4 ) );
+        append_big_endian( row_, bits );
+        n_fields_++;
+    }
+    else {
+        char str[32];
+        snprintf( str, sizeof( str ), "%.9g", v );
+        add_text_field( str );
+    }
+    return *this;
+}
+
+CopyWriter& CopyWriter::add( double v )
+{
+    if ( format_ == BinaryFormat ) {
+        uint64_t bits;
+        memcpy( &bits, &v, sizeof( bits ) );
+        append_big_endian( row_, int32_t( 8 ) );
+        append_big_endian( row_, bits );
+        n_fields_++;
+    }
+    else {
+        char str[32];
+        snprintf( str, sizeof( str ), "%.17g", v );
+        add_text_field( str );
+    }
+    return *this;
+}
+
+CopyWriter& CopyWriter::add( const std::string& v )
+{
+    if ( format_ == BinaryFormat ) {
+        add_binary_field( v.data(), int32_t( v.size() ) );
+        return *this;
+    }
+    std::string escaped;
+    escaped.reserve( v.size() );
+    for ( char c : v ) {
+        switch ( c ) {
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        case '\r':
+            escaped += "\\r";
+            break;
+        case '\t':
+            escaped += "\\t";
+            break;
+        default:
+            escaped.push_back( c );
+        }
+    }
+    add_text_field( escaped );
+    return *this;
+}
+
+CopyWriter& CopyWriter::add_null()
+{
+    if ( format_ == BinaryFormat ) {
+        add_binary_field( 0, -1 );
+    }
+    else {
+        add_text_field( "\\N" );
+    }
+    return *this;
+}
+
+void CopyWriter::end_row()
+{
+    if ( format_ == BinaryFormat ) {
+        append_big_endian( buffer_, n_fields_ );
+        buffer_.append( row_ );
+    }
+    else {
+        buffer_.append( row_ );
+        buffer_.push_back( '\n' );
+    }
+    row_.clear();
+    n_fields_ = 0;
+    rows_++;
+    if ( buffer_.size() >= copy_chunk_size ) {
+        flush();
+    }
+}
+
+void CopyWriter::flush()
+{
+    if ( buffer_.empty() ) {
+        return;
+    }
+    if ( PQputCopyData( conn_, buffer_.data(), int( buffer_.size() ) ) != 1 ) {
+        throw std::runtime_error( std::string( "Problem on copy: " ) + PQerrorMessage( conn_ ) );
+    }
+    buffer_.clear();
+}
+
+void CopyWriter::finish()
+{
+    if ( finished_ ) {
+        return;
+    }
+    if ( format_ == BinaryFormat ) {
+        // file trailer
+        append_big_endian( buffer_, int16_t( -1 ) );
+    }
+    flush();
+    finished_ = true;
+    if ( PQputCopyEnd( conn_, NULL ) != 1 ) {
+        throw std::runtime_error( std::string( "Problem on copy: " ) + PQerrorMessage( conn_ ) );
+    }
+    std::string msg;
+    while ( pg_result* res = PQgetResult( conn_ ) ) {
+        if ( PQresultStatus( res ) != PGRES_COMMAND_OK ) {
+            msg = std::string( "Problem on copy: " ) + PQresultErrorMessage( res );
+        }
+        PQclear( res );
+    }
+    if ( !msg.empty() ) {
+        throw std::runtime_error( msg );
+    }
+}
+
+CopyReader::CopyReader( pg_conn* conn ) : conn_( conn ), line_( 0 ), done_( false )
+{
+}
+
+CopyReader::CopyReader( CopyReader&& other )
+    : conn_( other.conn_ ), line_( other.line_ ), fields_( std::move( other.fields_ ) ), done_( other.done_ )
+{
+    other.line_ = 0;
+    other.done_ = true;
+}
+
+CopyReader::~CopyReader()
+{
+    if ( line_ ) {
+        PQfreemem( line_ );
+    }
+    if ( !done_ ) {
+        // consume the remaining data, the connection could not be used otherwise
+        char* buf;
+        while ( PQgetCopyData( conn_, &buf, 0 ) > 0 ) {
+            PQfreemem( buf );
+        }
+        while ( pg_result* res = PQgetResult( conn_ ) ) {
+            PQclear( res );
+        }
+    }
+}
+
+bool CopyReader::next()
+{
+    if ( line_ ) {
+        PQfreemem( line_ );
+        line_ = 0;
+    }
+    fields_.clear();
+    if ( done_ ) {
+        return false;
+    }
+
+    int len = PQgetCopyData( conn_, &line_, 0 );
+    if ( len < 0 ) {
+        // end of data or error
+        done_ = true;
+        std::string msg;
+        if ( len == -2 ) {
+            msg = std::string( "Problem on copy: " ) + PQerrorMessage( conn_ );
+        }
+        while ( pg_result* res = PQgetResult( conn_ ) ) {
+            if ( msg.empty() && PQresultStatus( res ) != PGRES_COMMAND_OK ) {
+                msg = std::string( "Problem on copy: " ) + PQresultErrorMessage( res );
+            }
+            PQclear( res );
+        }
+        if ( !msg.empty() ) {
+            throw std::runtime_error( msg );
+        }
+        return false;
+    }
+
+    // split on tabulations and unescape in place, each field is null-terminated
+    char* end = line_ + len;
+    if ( len > 0 && *( end - 1 ) == '\n' ) {
+        end--;
+    }
+    char* p = line_;
+    while ( true ) {
+        Field f;
+        char* start = p;
+        if ( p + 1 < end && p[0] == '\\' && p[1] == 'N' && ( p + 2 == end || p[2] == '\t' ) ) {
+            // null value
+            p += 2;
+            f.value = "";
+            f.len = 0;
+            f.isnull = true;
+        }
+        else {
+            char* out = p;
+            while ( p < end && *p != '\t' ) {
+                if ( *p == '\\' && p + 1 < end ) {
+                    p++;
+                    switch ( *p ) {
+                    case 'b': *out = '\b'; break;
+                    case 'f': *out = '\f'; break;
+                    case 'n': *out = '\n'; break;
+                    case 'r': *out = '\r'; break;
+                    case 't': *out = '\t'; break;
+                    case 'v': *out = '\v'; break;
+                    default: *out = *p;
+                    }
+                }
+                else {
+                    *out = *p;
+                }
+                out++;
+                p++;
+            }
+            f.value = start;
+            f.len = out - start;
+            f.isnull = false;
+            // the separator, or the end of line, is replaced
+            *out = 0;
+        }
+        bool at_end = p >= end;
+        if ( !at_end ) {
+            *p = 0;
+        }
+        fields_.push_back( f );
+        if ( at_end ) {
+            break;
+        }
+        p++;
+    }
+    return true;
+}
+
+Value CopyReader::operator [] ( size_t fn ) const
+{
+    BOOST_ASSERT( fn < fields_.size() );
+    const Field& f = fields_[fn];
+    return Value( f.value, f.len, f.isnull );
+}
+
 Connection::Connection()
     : conn_( 0 )
 {
 }
 
+CopyWriter Connection::copy_in( const std::string& table, CopyWriter::Format format ) throw ( std::runtime_error )
+{
+    std::string query = "COPY " + table + " FROM STDIN";
+    if ( format == CopyWriter::BinaryFormat ) {
+        query += " WITH (FORMAT binary)";
+    }
+    pg_result* res = PQexec( conn_, query.c_str() );
+    ExecStatusType ret = PQresultStatus( res );
+    if ( ret != PGRES_COPY_IN ) {
+        std::string msg = "Problem on database copy: ";
+        msg += PQresultErrorMessage( res );
+        PQclear( res );
+        throw std::runtime_error( msg.c_str() );
+    }
+    PQclear( res );
+    return CopyWriter( conn_, format );
+}
+
+CopyReader Connection::copy_out( const std::string& query ) throw ( std::runtime_error )
+{
+    std::string copy_query = "COPY (" + query + ") TO STDOUT";
+    pg_result* res = PQexec( conn_, copy_query.c_str() );
+    ExecStatusType ret = PQresultStatus( res );
+    if ( ret != PGRES_COPY_OUT ) {
+        std::string msg = "Problem on database copy: ";
+        msg += PQresultErrorMessage( res );
+        PQclear( res );
+        throw std::runtime_error( msg.c_str() );
+    }
+    PQclear( res );
+    return CopyReader( conn_ );
+}
+
 Connection::Connection( const std::string& db_options )
     : conn_( 0 )
 {
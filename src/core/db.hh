@@ -24,11 +24,14 @@
    * A Db::Result objet represents result of a query. It is a lightweighted objet that is reference-counted and thus can be copied safely.
    * A Db::RowValue object represents a row of a result and is obtained by Db::Result::operator[]
    * A Db::Value object represent a basic value. It is obtained by Db::RowValue::operator[]. It has templated conversion operators for common data types.
+   * A Db::CopyWriter object sends rows to a table by means of the COPY protocol, in text or binary format. It is obtained by Db::Connection::copy_in
+   * A Db::CopyReader object reads rows of a query by means of the COPY protocol. It is obtained by Db::Connection::copy_out
 
    These classes throw std::runtime_error on problem.
  */
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 
 #ifdef _WIN32
@@ -108,6 +111,10 @@ Tempus::Time Value::as<Tempus::Time>() const;
 template <>
 long long Value::as<long long>() const;
 template <>
+unsigned long long Value::as<unsigned long long>() const;
+template <>
+unsigned int Value::as<unsigned int>() const;
+template <>
 int Value::as<int>() const;
 template <>
 float Value::as<float>() const;
@@ -188,6 +195,108 @@ private:
     pg_result* res_;
 };
 
+///
+/// Class used to send rows to a table with a COPY ... FROM STDIN.
+/// Values of a row are added in the order of the columns given to Connection::copy_in, then the row is ended by end_row().
+/// Rows are buffered and sent by chunks.
+/// finish() ends the copy and reports errors. A writer destroyed before finish() cancels the copy.
+///
+/// In binary format, the C++ type of a value must match the type of its column:
+/// int32_t for INT, int64_t for BIGINT, float for REAL, double for DOUBLE PRECISION, std::string for text types
+class CopyWriter {
+public:
+    enum Format
+    {
+        TextFormat,
+        BinaryFormat
+    };
+
+    CopyWriter( pg_conn* conn, Format format );
+    ~CopyWriter();
+
+    // a copy writer is moveable
+    CopyWriter( CopyWriter&& other );
+
+    CopyWriter& add( int32_t v );
+    CopyWriter& add( int64_t v );
+    CopyWriter& add( float v );
+    CopyWriter& add( double v );
+    CopyWriter& add( const std::string& v );
+    CopyWriter& add_null();
+
+    ///
+    /// End of the current row
+    void end_row();
+
+    ///
+    /// End of the copy. Throws a std::runtime_error on problem
+    void finish();
+
+    ///
+    /// Number of rows ended so far
+    size_t rows() const { return rows_; }
+
+private:
+    // non copyable
+    CopyWriter( const CopyWriter& other );
+    CopyWriter& operator=( const CopyWriter& other );
+
+    void add_binary_field( const char* data, int32_t len );
+    void add_text_field( const std::string& v );
+    void flush();
+
+    pg_conn* conn_;
+    Format format_;
+    // data not yet sent
+    std::string buffer_;
+    // current row, in binary format its number of fields is needed first
+    std::string row_;
+    int16_t n_fields_;
+    size_t rows_;
+    bool finished_;
+};
+
+///
+/// Class used to read the result of a query with a COPY ( query ) TO STDOUT, in text format.
+/// Its rows are much faster to get than with a ResultIterator. A row is valid until the next call to next().
+class CopyReader {
+public:
+    CopyReader( pg_conn* conn );
+    ~CopyReader();
+
+    // a copy reader is moveable
+    CopyReader( CopyReader&& other );
+
+    ///
+    /// Read the next row. Returns false at the end of the data. Throws a std::runtime_error on problem
+    bool next();
+
+    ///
+    /// Number of columns of the current row
+    size_t columns() const { return fields_.size(); }
+
+    ///
+    /// Access to a value of the current row, by column number
+    Value operator [] ( size_t fn ) const;
+
+private:
+    // non copyable
+    CopyReader( const CopyReader& other );
+    CopyReader& operator=( const CopyReader& other );
+
+    pg_conn* conn_;
+    // current line, fields are unescaped in place
+    char* line_;
+    struct Field
+    {
+        const char* value;
+        size_t len;
+        bool isnull;
+    };
+    std::vector<Field> fields_;
+    bool done_;
+};
+
 ///
 /// Class representing connection to a database.
 class Connection: boost::noncopyable {
@@ -206,6 +315,16 @@ public:
     /// Query execution using a cursor
     ResultIterator exec_it( const std::string& query ) throw ( std::runtime_error );
 
+    ///
+    /// Bulk loading of rows by means of COPY ... FROM STDIN
+    /// @param table The table, possibly followed by a list of columns, e.g. "schema.table (col1, col2)"
+    /// @param format Text or binary format
+    CopyWriter copy_in( const std::string& table, CopyWriter::Format format = CopyWriter::TextFormat ) throw ( std::runtime_error );
+
+    ///
+    /// Query execution by means of COPY ( query ) TO STDOUT
+    CopyReader copy_out( const std::string& query ) throw ( std::runtime_error );
+
 protected:
     pg_conn* conn_;
     static boost::mutex mutex;
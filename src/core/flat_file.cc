@@ -0,0 +1,165 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "flat_file.hh"
+
+#include <cstring>
+#include <ostream>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace Tempus
+{
+
+static uint64_t align_offset( uint64_t offset )
+{
+    const uint64_t a = FlatFileHeader::alignment();
+    return ( offset + a - 1 ) / a * a;
+}
+
+void FlatFileWriter::add_raw( const std::string& name, const void* data, size_t count, size_t element_size )
+{
+    if ( name.size() > FlatFileSection::max_name_size() ) {
+        throw std::invalid_argument( "Flat file section name too long: " + name );
+    }
+    for ( const Section& s : sections_ ) {
+        if ( s.name == name ) {
+            throw std::invalid_argument( "Duplicate flat file section " + name );
+        }
+    }
+    sections_.push_back( Section{ name, data, count, element_size } );
+}
+
+void FlatFileWriter::write( std::ostream& ostr, size_t prefix_size ) const
+{
+    FlatFileHeader header;
+    std::memset( &header, 0, sizeof( header ) );
+    std::memcpy( header.magic, FlatFileHeader::magic_string(), sizeof( header.magic ) );
+    header.byte_order = FlatFileHeader::byte_order_mark();
+    header.n_sections = sections_.size();
+
+    // table of sections
+    std::vector<FlatFileSection> table( sections_.size() );
+    uint64_t offset = prefix_size + sizeof( FlatFileHeader ) + sections_.size() * sizeof( FlatFileSection );
+    for ( size_t i = 0; i < sections_.size(); i++ ) {
+        std::memset( &table[i], 0, sizeof( FlatFileSection ) );
+        std::strncpy( table[i].name, sections_[i].name.c_str(), FlatFileSection::max_name_size() );
+        offset = align_offset( offset );
+        table[i].offset = offset;
+        table[i].count = sections_[i].count;
+        table[i].element_size = sections_[i].element_size;
+        offset += sections_[i].count * sections_[i].element_size;
+    }
+
+    ostr.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+    ostr.write( reinterpret_cast<const char*>( table.data() ), table.size() * sizeof( FlatFileSection ) );
+
+    uint64_t pos = prefix_size + sizeof( FlatFileHeader ) + sections_.size() * sizeof( FlatFileSection );
+    const char padding[64] = {0};
+    for ( size_t i = 0; i < sections_.size(); i++ ) {
+        ostr.write( padding, table[i].offset - pos );
+        size_t size = sections_[i].count * sections_[i].element_size;
+        ostr.write( static_cast<const char*>( sections_[i].data ), size );
+        pos = table[i].offset + size;
+    }
+    // so that the last array can be mapped by whole alignment blocks
+    ostr.write( padding, align_offset( pos ) - pos );
+
+    if ( ostr.fail() ) {
+        throw std::runtime_error( "Problem writing the flat file" );
+    }
+}
+
+struct FlatFileReader::Mapping
+{
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+};
+
+FlatFileReader::FlatFileReader( const std::string& filename, size_t prefix_size ) :
+    mapping_( new Mapping )
+{
+    try {
+        mapping_->file = boost::interprocess::file_mapping( filename.c_str(), boost::interprocess::read_only );
+        mapping_->region = boost::interprocess::mapped_region( mapping_->file, boost::interprocess::read_only );
+    }
+    catch ( boost::interprocess::interprocess_exception& e ) {
+        throw std::runtime_error( "Cannot map " + filename + ": " + e.what() );
+    }
+    base_ = static_cast<const char*>( mapping_->region.get_address() );
+    const size_t file_size = mapping_->region.get_size();
+
+    if ( file_size < prefix_size + sizeof( FlatFileHeader ) ) {
+        throw std::runtime_error( "Truncated flat file " + filename );
+    }
+    const FlatFileHeader* header = reinterpret_cast<const FlatFileHeader*>( base_ + prefix_size );
+    if ( std::memcmp( header->magic, FlatFileHeader::magic_string(), sizeof( header->magic ) ) != 0 ) {
+        throw std::runtime_error( "Unrecognized flat file header in " + filename );
+    }
+    if ( header->byte_order != FlatFileHeader::byte_order_mark() ) {
+        throw std::runtime_error( "The flat file " + filename + " has been written with another byte order" );
+    }
+    n_sections_ = header->n_sections;
+    sections_ = reinterpret_cast<const FlatFileSection*>( header + 1 );
+    if ( file_size < prefix_size + sizeof( FlatFileHeader ) + n_sections_ * sizeof( FlatFileSection ) ) {
+        throw std::runtime_error( "Truncated flat file " + filename );
+    }
+    for ( uint32_t i = 0; i < n_sections_; i++ ) {
+        if ( sections_[i].offset + sections_[i].count * sections_[i].element_size > file_size ) {
+            throw std::runtime_error( "Truncated flat file " + filename );
+        }
+    }
+}
+
+FlatFileReader::~FlatFileReader()
+{
+}
+
+bool FlatFileReader::has_section( const std::string& name ) const
+{
+    for ( uint32_t i = 0; i < n_sections_; i++ ) {
+        if ( name == sections_[i].name ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> FlatFileReader::section_names() const
+{
+    std::vector<std::string> names;
+    for ( uint32_t i = 0; i < n_sections_; i++ ) {
+        names.push_back( sections_[i].name );
+    }
+    return names;
+}
+
+const void* FlatFileReader::section_raw( const std::string& name, size_t element_size, size_t& count ) const
+{
+    for ( uint32_t i = 0; i < n_sections_; i++ ) {
+        if ( name == sections_[i].name ) {
+            if ( sections_[i].element_size != element_size ) {
+                throw std::runtime_error( "Flat file section " + name + " does not have the expected layout" );
+            }
+            count = sections_[i].count;
+            return base_ + sections_[i].offset;
+        }
+    }
+    throw std::runtime_error( "No flat file section " + name );
+}
+
+} // namespace Tempus
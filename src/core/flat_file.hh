@@ -0,0 +1,201 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_FLAT_FILE_HH
+#define TEMPUS_FLAT_FILE_HH
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace Tempus
+{
+
+//
+// Flat files are made of arrays of plain data that can be used in place once the file is mapped in memory:
+// loading is then almost instantaneous and read-only pages are shared by every process that maps the file.
+//
+// Layout, after an optional prefix (e.g. the header of a routing data dump):
+// - a FlatFileHeader;
+// - a table of FlatFileSection, giving the name, offset and size of each array;
+// - the arrays, each one aligned on FlatFileHeader::alignment() bytes.
+//
+// Arrays are stored in the byte order of the machine that wrote the file, which is checked when reading.
+
+///
+/// An array either owned (built in memory) or viewing memory owned by someone else (e.g. a mapped file)
+template <typename T>
+class FlatArray
+{
+public:
+    FlatArray() : data_( nullptr ), size_( 0 ) {}
+
+    /// Take ownership of a vector
+    explicit FlatArray( std::vector<T>&& v ) : owned_( std::move( v ) ), data_( owned_.data() ), size_( owned_.size() ) {}
+
+    /// View an array, that must outlive this object
+    FlatArray( const T* data, size_t size ) : data_( data ), size_( size ) {}
+
+    FlatArray( const FlatArray& other ) : owned_( other.owned_ ), data_( other.is_view() ? other.data_ : owned_.data() ), size_( other.size_ ) {}
+
+    FlatArray( FlatArray&& other ) : data_( other.data_ ), size_( other.size_ )
+    {
+        // the buffer of a moved vector does not change
+        owned_.swap( other.owned_ );
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    FlatArray& operator=( FlatArray other )
+    {
+        owned_.swap( other.owned_ );
+        std::swap( data_, other.data_ );
+        std::swap( size_, other.size_ );
+        return *this;
+    }
+
+    /// Whether the array views memory it does not own
+    bool is_view() const { return data_ != owned_.data(); }
+
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T& operator[]( size_t i ) const { return data_[i]; }
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+private:
+    std::vector<T> owned_;
+    const T* data_;
+    size_t size_;
+};
+
+///
+/// Header of a flat file
+struct FlatFileHeader
+{
+    static const char* magic_string() { return "TFLAT\0\0"; }
+    static uint32_t byte_order_mark() { return 0x01020304; }
+    static uint32_t alignment() { return 64; }
+
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t n_sections;
+};
+
+///
+/// Entry of the section table of a flat file
+struct FlatFileSection
+{
+    static size_t max_name_size() { return 55; }
+
+    char name[56];
+    /// Offset of the array, from the beginning of the file
+    uint64_t offset;
+    /// Number of elements
+    uint64_t count;
+    /// Size of an element, checked when reading
+    uint64_t element_size;
+};
+
+///
+/// Writing of a flat file.
+/// Arrays are registered with add(), they must stay alive until write() is called
+class FlatFileWriter
+{
+public:
+    template <typename T>
+    void add( const std::string& name, const T* data, size_t count )
+    {
+        static_assert( std::is_trivially_copyable<T>::value, "Only plain data can be written to a flat file" );
+        add_raw( name, data, count, sizeof( T ) );
+    }
+
+    template <typename T>
+    void add( const std::string& name, const FlatArray<T>& array )
+    {
+        add( name, array.data(), array.size() );
+    }
+
+    ///
+    /// Write the header, the section table and the arrays
+    /// \param ostr The output stream, offsets are computed from its current position
+    /// \param prefix_size Size of what has already been written to the file, i.e. position of the flat header in the file
+    void write( std::ostream& ostr, size_t prefix_size ) const;
+
+private:
+    void add_raw( const std::string& name, const void* data, size_t count, size_t element_size );
+
+    struct Section
+    {
+        std::string name;
+        const void* data;
+        size_t count;
+        size_t element_size;
+    };
+    std::vector<Section> sections_;
+};
+
+///
+/// Read-only mapping of a flat file.
+/// Arrays returned by section() are views of the mapping, they are valid as long as the reader is alive
+class FlatFileReader
+{
+public:
+    ///
+    /// Map a file. Throws std::runtime_error if the file cannot be mapped or is not a flat file
+    /// \param filename The file
+    /// \param prefix_size Position of the flat header in the file
+    FlatFileReader( const std::string& filename, size_t prefix_size );
+
+    ~FlatFileReader();
+
+    bool has_section( const std::string& name ) const;
+
+    ///
+    /// Names of the sections
+    std::vector<std::string> section_names() const;
+
+    ///
+    /// View of an array. Throws std::runtime_error if the section does not exist
+    /// or if its elements are not of the expected size
+    template <typename T>
+    FlatArray<T> section( const std::string& name ) const
+    {
+        size_t count = 0;
+        const void* data = section_raw( name, sizeof( T ), count );
+        return FlatArray<T>( static_cast<const T*>( data ), count );
+    }
+
+private:
+    const void* section_raw( const std::string& name, size_t element_size, size_t& count ) const;
+
+    struct Mapping;
+    std::unique_ptr<Mapping> mapping_;
+
+    const char* base_;
+    const FlatFileSection* sections_;
+    uint32_t n_sections_;
+};
+
+} // namespace Tempus
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/format.hpp>
+
+#include "multimodal_compiled_graph.hh"
+
+namespace Tempus {
+
+namespace Multimodal {
+
+CompiledGraph::CompiledGraph( const Graph& graph ) : graph_( graph ), index_( get( boost::vertex_index, graph ) )
+{
+    const size_t n = num_vertices( graph );
+    vertices_.resize( n );
+    VertexIterator vi, vi_end;
+    for ( boost::tie( vi, vi_end ) = vertices( graph ); vi != vi_end; vi++ ) {
+        vertices_[index_[*vi]] = *vi;
+    }
+
+    out_offsets_.reserve( n + 1 );
+    out_offsets_.push_back( 0 );
+    for ( size_t i = 0; i < n; i++ ) {
+        OutEdgeIterator ei, ei_end;
+        for ( boost::tie( ei, ei_end ) = out_edges( vertices_[i], graph ); ei != ei_end; ei++ ) {
+            const Edge& e = *ei;
+            out_edges_.push_back( e );
+            out_targets_.push_back( uint32_t( index_[e.target()] ) );
+            out_connections_.push_back( uint8_t( e.connection_type() ) );
+            out_pt_edges_.push_back( public_transport_edge( e ).first );
+        }
+        if ( out_edges_.size() > std::numeric_limits<uint32_t>::max() ) {
+            throw std::runtime_error( ( boost::format( "Too many edges in the multimodal graph: %1%" ) % out_edges_.size() ).str() );
+        }
+        out_offsets_.push_back( uint32_t( out_edges_.size() ) );
+    }
+
+    // in edges, by a counting sort of the out edges on their target
+    in_offsets_.assign( n + 1, 0 );
+    for ( uint32_t t : out_targets_ ) {
+        in_offsets_[t + 1]++;
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+        in_offsets_[i + 1] += in_offsets_[i];
+    }
+    std::vector<uint32_t> next( in_offsets_.begin(), in_offsets_.end() - 1 );
+    in_edges_.resize( out_edges_.size() );
+    for ( size_t a = 0; a < out_edges_.size(); a++ ) {
+        in_edges_[next[out_targets_[a]]++] = out_edges_[a];
+    }
+}
+
+std::pair< Edge, bool > edge( const Vertex& u, const Vertex& v, const CompiledGraph& graph )
+{
+    const size_t i = graph.index( u );
+    const size_t j = graph.index( v );
+    for ( size_t a = graph.out_arc_begin( i ); a != graph.out_arc_end( i ); a++ ) {
+        if ( graph.arc_target( a ) == j ) {
+            return std::make_pair( graph.arc_edge( a ), true );
+        }
+    }
+    return std::make_pair( Edge(), false );
+}
+
+}
+}
@@ -0,0 +1,247 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_MULTIMODAL_COMPILED_GRAPH_HH
+#define TEMPUS_MULTIMODAL_COMPILED_GRAPH_HH
+
+#include "multimodal_graph.hh"
+
+namespace Tempus {
+
+namespace Multimodal {
+
+///
+/// Read only snapshot of a Multimodal::Graph, for searches.
+///
+/// Vertices are numbered as by the VertexIndexProperty of the graph. Out edges and in edges are stored as compressed
+/// sparse rows of prebuilt Multimodal::Edge: the arcs of the vertex of index i are in [offsets[i], offsets[i+1]).
+/// Out edges are in the order of the OutEdgeIterator of the graph, in edges by source index. Each out arc, identified
+/// by its position in the rows, also has the index of its target, its connection type and its public transport edge, if any.
+///
+/// Vertex and edge descriptors are the ones of the graph, so that visitors, heuristics and cost calculators work with both.
+/// Cost calculators also take arc indices, to read the connection type and the public transport edge of an arc
+/// rather than computing them from its edge.
+/// The snapshot is built from a loaded graph and references it. It is not updated when the graph, its public transport
+/// selection or its POIs are changed.
+class CompiledGraph: boost::noncopyable {
+public:
+    // declaration for boost::graph
+    typedef Tempus::Multimodal::Vertex          vertex_descriptor;
+    typedef Tempus::Multimodal::Edge            edge_descriptor;
+    typedef const Edge*                         out_edge_iterator;
+    typedef const Edge*                         in_edge_iterator;
+    typedef std::vector<Vertex>::const_iterator vertex_iterator;
+    typedef const Edge*                         edge_iterator;
+
+    typedef boost::bidirectional_tag            directed_category;
+
+    typedef boost::disallow_parallel_edge_tag   edge_parallel_category;
+    typedef boost::bidirectional_graph_tag      traversal_category;
+
+    typedef size_t vertices_size_type;
+    typedef size_t edges_size_type;
+    typedef size_t degree_size_type;
+
+    // unused types (here to please boost::graph_traits<>)
+    typedef void adjacency_iterator;
+
+    static inline vertex_descriptor null_vertex() {
+        return vertex_descriptor();   // depending on boost version, this can be useless
+    }
+
+    ///
+    /// Build the snapshot of the current state of a graph. O(V + E)
+    explicit CompiledGraph( const Multimodal::Graph& graph );
+
+    /// Access to the underlying graph
+    const Graph& graph() const { return graph_; }
+
+    ///
+    /// The road graph
+    const Road::Graph& road() const { return graph_.road(); }
+
+    /// Access to a particular graph
+    const PublicTransport::Graph& public_transport( PublicTransportGraphIndex idx ) const { return graph_.public_transport( idx ); }
+
+    /// Transport modes
+    const RoutingData::TransportModes& transport_modes() const { return graph_.transport_modes(); }
+
+    /// access to a transportmode, given its id
+    boost::optional<TransportMode> transport_mode( db_id_t id ) const { return graph_.transport_mode( id ); }
+
+    /// access to a transportmode, given its name
+    boost::optional<TransportMode> transport_mode( const std::string& name ) const { return graph_.transport_mode( name ); }
+
+    ///
+    /// @return a Road::Vertex from it's database id in O(1)
+    boost::optional<Road::Vertex> road_vertex_from_id( db_id_t id ) const { return graph_.road_vertex_from_id( id ); }
+
+    ///
+    /// Index of a vertex, the one of the VertexIndexProperty of the graph
+    size_t index( const Vertex& v ) const { return index_[v]; }
+    /// Vertex of an index
+    const Vertex& vertex( size_t i ) const { return vertices_[i]; }
+
+    size_t vertex_count() const { return vertices_.size(); }
+    size_t edge_count() const { return out_edges_.size(); }
+
+    ///
+    /// Out arcs of the vertex of index i, as a range of arc indices
+    size_t out_arc_begin( size_t i ) const { return out_offsets_[i]; }
+    size_t out_arc_end( size_t i ) const { return out_offsets_[i + 1]; }
+
+    ///
+    /// Out arcs of a vertex
+    std::pair<out_edge_iterator, out_edge_iterator> out_arcs( const Vertex& v ) const
+    {
+        const size_t i = index_[v];
+        return std::make_pair( out_edges_.data() + out_offsets_[i], out_edges_.data() + out_offsets_[i + 1] );
+    }
+    ///
+    /// In arcs of a vertex
+    std::pair<in_edge_iterator, in_edge_iterator> in_arcs( const Vertex& v ) const
+    {
+        const size_t i = index_[v];
+        return std::make_pair( in_edges_.data() + in_offsets_[i], in_edges_.data() + in_offsets_[i + 1] );
+    }
+    ///
+    /// All the arcs, by source index
+    std::pair<edge_iterator, edge_iterator> arcs() const
+    {
+        return std::make_pair( out_edges_.data(), out_edges_.data() + out_edges_.size() );
+    }
+
+    ///
+    /// Arc index of an out edge iterator, or of an edge iterator
+    size_t arc( out_edge_iterator it ) const { return size_t( it - out_edges_.data() ); }
+
+    /// Edge of an arc
+    const Edge& arc_edge( size_t a ) const { return out_edges_[a]; }
+    /// Index of the target of an arc
+    size_t arc_target( size_t a ) const { return out_targets_[a]; }
+    /// Connection type of an arc
+    Edge::ConnectionType arc_connection( size_t a ) const { return Edge::ConnectionType( out_connections_[a] ); }
+    ///
+    /// Public transport edge of an arc, if it is a Transport2Transport one, in constant time
+    std::pair<PublicTransport::Edge, bool> arc_public_transport_edge( size_t a ) const
+    {
+        if ( arc_connection( a ) != Edge::Transport2Transport ) {
+            return std::make_pair( PublicTransport::Edge(), false );
+        }
+        return std::make_pair( out_pt_edges_[a], true );
+    }
+
+    size_t out_degree( const Vertex& v ) const
+    {
+        const size_t i = index_[v];
+        return out_offsets_[i + 1] - out_offsets_[i];
+    }
+    size_t in_degree( const Vertex& v ) const
+    {
+        const size_t i = index_[v];
+        return in_offsets_[i + 1] - in_offsets_[i];
+    }
+
+    std::pair<vertex_iterator, vertex_iterator> vertex_range() const
+    {
+        return std::make_pair( vertices_.begin(), vertices_.end() );
+    }
+
+private:
+    const Graph& graph_;
+    VertexIndexProperty index_;
+
+    /// Vertices, by index
+    std::vector<Vertex> vertices_;
+
+    std::vector<uint32_t> out_offsets_;
+    std::vector<Edge> out_edges_;
+    std::vector<uint32_t> out_targets_;
+    std::vector<uint8_t> out_connections_;
+    /// Public transport edges of the Transport2Transport arcs, default ones for the others
+    std::vector<PublicTransport::Edge> out_pt_edges_;
+
+    std::vector<uint32_t> in_offsets_;
+    std::vector<Edge> in_edges_;
+};
+
+//
+// Boost graph functions
+// A Multimodal::CompiledGraph is a BidirectionalGraph and a VertexAndEdgeListGraph
+
+///
+/// Number of vertices. Constant time
+inline size_t num_vertices( const CompiledGraph& graph ) { return graph.vertex_count(); }
+///
+/// Number of edges. Constant time
+inline size_t num_edges( const CompiledGraph& graph ) { return graph.edge_count(); }
+///
+/// Returns source vertex from an edge. Constant time
+inline Vertex source( const Edge& e, const CompiledGraph& ) { return e.source(); }
+///
+/// Returns target vertex from an edge. Constant time
+inline Vertex target( const Edge& e, const CompiledGraph& ) { return e.target(); }
+
+///
+/// Returns the range of vertices, by index. Constant time
+inline std::pair<CompiledGraph::vertex_iterator, CompiledGraph::vertex_iterator> vertices( const CompiledGraph& graph )
+{
+    return graph.vertex_range();
+}
+///
+/// Returns the range of edges, by source index. Constant time
+inline std::pair<CompiledGraph::edge_iterator, CompiledGraph::edge_iterator> edges( const CompiledGraph& graph )
+{
+    return graph.arcs();
+}
+///
+/// Returns the range of out edges of a vertex. Constant time
+inline std::pair<CompiledGraph::out_edge_iterator, CompiledGraph::out_edge_iterator> out_edges( const Vertex& v, const CompiledGraph& graph )
+{
+    return graph.out_arcs( v );
+}
+///
+/// Returns the range of in edges of a vertex. Constant time
+inline std::pair<CompiledGraph::in_edge_iterator, CompiledGraph::in_edge_iterator> in_edges( const Vertex& v, const CompiledGraph& graph )
+{
+    return graph.in_arcs( v );
+}
+///
+/// Number of out edges for a vertex. Constant time
+inline size_t out_degree( const Vertex& v, const CompiledGraph& graph ) { return graph.out_degree( v ); }
+///
+/// Number of in edges for a vertex. Constant time
+inline size_t in_degree( const Vertex& v, const CompiledGraph& graph ) { return graph.in_degree( v ); }
+///
+/// Number of out and in edges for a vertex. Constant time
+inline size_t degree( const Vertex& v, const CompiledGraph& graph ) { return graph.out_degree( v ) + graph.in_degree( v ); }
+
+///
+/// Find an edge, based on a source and target vertex. Linear in the out degree of u
+std::pair< Edge, bool > edge( const Vertex& u, const Vertex& v, const CompiledGraph& graph );
+
+///
+/// Overloading of get()
+inline VertexIndexProperty get( boost::vertex_index_t t, const CompiledGraph& graph )
+{
+    return get( t, graph.graph() );
+}
+
+} // multimodal
+
+}
+
+#endif
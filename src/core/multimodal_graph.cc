@@ -870,70 +870,6 @@ size_t get( const VertexIndexProperty& p, const Multimodal::Vertex& v )
     return p.get_index( v );
 }
 
-size_t VertexIndexProperty::get_index( const Vertex& v ) const
-{
-    // Maps a vertex to an integer in (0, num_vertices-1).
-    //
-    // If the vertex is a road vertex, maps it to its vertex_index in the road graph
-    // If it is a public transport vertex, maps it to its vertex_index in the pt graph
-    // and adds the number of vertices of the road graph and all the preceding public transport
-    // graphs.
-    // If it is a poi, maps it to its vertex index + the sum of num_vertices for all previous graphs.
-    //
-    // The complexity is then not constant (linear in terms of number of public transports graphs and pois).
-
-
-    switch (v.type()) {
-    case Vertex::Null:
-        return 0;
-    case Vertex::Road: {
-        return boost::get( boost::get( boost::vertex_index, graph_.road() ), v.road_vertex() );
-    }
-
-    case Vertex::PublicTransport: {
-        size_t n = num_vertices( graph_.road() );
-
-        for ( auto it : graph_.public_transports() ) {
-            if ( it.second != v.pt_graph() ) {
-                n += num_vertices( *it.second );
-            }
-            else {
-                n += boost::get( boost::get( boost::vertex_index, *v.pt_graph() ), v.pt_vertex() );
-                break;
-            }
-        }
-        return n;
-    }
-
-    case Vertex::Poi: {
-        size_t n = num_vertices( graph_.road() );
-
-        for ( auto it : graph_.public_transports() ) {
-            n += num_vertices( *it.second );
-        }
-
-        n += v.poi_idx();
-        return n;
-    }
-    }
-
-    return 0;
-}
-
-size_t num_vertices( const Graph& graph )
-{
-    //
-    // The number of vertices of a Multimodal::Graph is :
-    // num_vertices of the road graph
-    // + num_vertices of each pt graph
-    // + the number of pois
-    size_t n = 0;
-    for ( auto it : graph.public_transports() ) {
-        n += num_vertices( *it.second );
-    }
-
-    return n + num_vertices( graph.road() ) + graph.pois().size();
-}
 size_t num_edges( const Graph& graph )
 {
     size_t n = 0;
@@ -981,19 +917,23 @@ pair<InEdgeIterator, InEdgeIterator> in_edges( const Vertex& v, const Graph& gra
 size_t out_degree( const Vertex& v, const Graph& graph )
 {
     if ( v.type() == Vertex::Road ) {
-        size_t sum = 0;
-        Road::OutEdgeIterator ei, ei_end;
-
         //
         // For each out edge of the vertex, we have access to
         // N stops (given by stops.size())
         // M POis (given by pois.size())
         // the out edge (+1)
-        for ( boost::tie( ei, ei_end ) = out_edges( v.road_vertex(), graph.road() ); ei != ei_end; ei++ ) {
-            sum += graph.edge_stops( *ei ).size() + graph.edge_pois( *ei ).size() + 1;
+        // Out edges of a road vertex have consecutive indices, their stops and POIs are consecutive too
+        Road::OutEdgeIterator ei, ei_end;
+        boost::tie( ei, ei_end ) = out_edges( v.road_vertex(), graph.road() );
+        if ( ei == ei_end ) {
+            return 0;
         }
-
-        return sum;
+        const size_t degree = out_degree( v.road_vertex(), graph.road() );
+        const Graph::EdgeStops first_stops = graph.edge_stops( *ei );
+        const Graph::EdgePois first_pois = graph.edge_pois( *ei );
+        Road::Edge last = *ei;
+        last.idx += uint32_t( degree - 1 );
+        return degree + size_t( graph.edge_stops( last ).end() - first_stops.begin() ) + size_t( graph.edge_pois( last ).end() - first_pois.begin() );
     }
     else if ( v.type() == Vertex::PublicTransport ) {
         //
@@ -1090,6 +1030,13 @@ void Graph::set_road( std::unique_ptr<Road::Graph> r )
 
     road_vertex_map_.clear();
     road_edge_map_.clear();
+    update_index_offsets_();
+    // nothing attached to the edges of the new road graph
+    const size_t n_edges = road_ ? num_edges( *road_ ) : 0;
+    edge_stop_offsets_.assign( n_edges + 1, 0 );
+    edge_stop_values_.clear();
+    edge_poi_offsets_.assign( n_edges + 1, 0 );
+    edge_poi_values_.clear();
     if ( road_ ) {
         // update vertex and edge map
         for ( auto it = vertices( *road_ ).first; it != vertices( *road_ ).second; it++ ) {
@@ -1145,11 +1092,36 @@ void Graph::set_public_transports( std::map<db_id_t, std::unique_ptr<PublicTrans
         selected_transport_graphs_.insert( it->first );
         i++;
     }
+    update_index_offsets_();
 }
 
 void Graph::select_public_transports( const std::set<db_id_t> & s )
 {
     selected_transport_graphs_ = s;
+    update_index_offsets_();
+}
+
+void Graph::update_index_offsets_()
+{
+    // selected graphs, in the order of public_transports()
+    size_t n = road_ ? num_vertices( *road_ ) : 0;
+    pt_index_offsets_.assign( public_transport_graphs_.size(), 0 );
+    std::vector<bool> selected( public_transport_graphs_.size(), false );
+    for ( db_id_t id : selected_transport_graphs_ ) {
+        auto it = public_transport_graph_idx_map_.find( id );
+        if ( it == public_transport_graph_idx_map_.end() ) {
+            continue;
+        }
+        pt_index_offsets_[it->second] = n;
+        selected[it->second] = true;
+        n += num_vertices( *public_transport_graphs_[it->second] );
+    }
+    for ( size_t i = 0; i < selected.size(); i++ ) {
+        if ( !selected[i] ) {
+            pt_index_offsets_[i] = n;
+        }
+    }
+    poi_index_offset_ = n;
 }
 
 std::set<db_id_t> Graph::public_transport_selection() const
@@ -1172,19 +1144,6 @@ void Graph::set_pois( std::vector<POI>&& v )
     }
 }
 
-void Graph::add_poi_ref( const Road::Edge& e, POIIndex idx )
-{
-    auto it = road_edge_pois_.find(e);
-    if ( it == road_edge_pois_.end() ) {
-        std::vector<POIIndex> v(1);
-        v[0] = idx;
-        road_edge_pois_.insert( std::make_pair(e, v) );
-    }
-    else {
-        it->second.push_back( idx );
-    }
-}
-
 boost::optional<POIIndex> Graph::poi_index( db_id_t id ) const
 {
     auto it = poi_index_map_.find(id);
@@ -1204,35 +1163,36 @@ POI& Graph::poi( POIIndex idx )
     return pois_[idx];
 }
 
-const Graph::EdgePois& Graph::edge_pois( const Road::Edge& e ) const
+namespace
+{
+// Compressed sparse rows of (road edge, value) pairs, by a stable counting sort on the edge index
+template <typename T>
+void build_edge_rows( size_t n_edges, const std::vector<std::pair<Road::Edge, T>>& pairs, std::vector<uint32_t>& offsets, std::vector<T>& values )
 {
-    auto it = road_edge_pois_.find(e);
-    if ( it == road_edge_pois_.end() ) {
-        return empty_edge_pois_;
+    offsets.assign( n_edges + 1, 0 );
+    for ( const auto& p : pairs ) {
+        BOOST_ASSERT( p.first.idx < n_edges );
+        offsets[p.first.idx + 1]++;
+    }
+    for ( size_t i = 0; i < n_edges; i++ ) {
+        offsets[i + 1] += offsets[i];
     }
-    return it->second;
+    values.resize( pairs.size() );
+    std::vector<uint32_t> fill( offsets.begin(), offsets.end() - 1 );
+    for ( const auto& p : pairs ) {
+        values[fill[p.first.idx]++] = p.second;
+    }
+}
 }
 
-void Graph::add_stop_ref( const Road::Edge& e, const PublicTransportGraphIndex& idx, const PublicTransport::Vertex& vertex )
+void Graph::set_edge_pois( const std::vector<std::pair<Road::Edge, POIIndex>>& pairs )
 {
-    auto it = road_edge_stops_.find(e);
-    if ( it == road_edge_stops_.end() ) {
-        EdgeStops v;
-        v.push_back( StopIndex( idx, vertex ) );
-        road_edge_stops_.insert( std::make_pair(e, v) );
-    }
-    else {
-        it->second.push_back( StopIndex( idx, vertex ) );
-    }
+    build_edge_rows( num_edges( road() ), pairs, edge_poi_offsets_, edge_poi_values_ );
 }
 
-const Graph::EdgeStops& Graph::edge_stops( const Road::Edge& e ) const
+void Graph::set_edge_stops( const std::vector<std::pair<Road::Edge, StopIndex>>& pairs )
 {
-    auto it = road_edge_stops_.find(e);
-    if ( it == road_edge_stops_.end() ) {
-        return empty_edge_stops_;
-    }
-    return it->second;
+    build_edge_rows( num_edges( road() ), pairs, edge_stop_offsets_, edge_stop_values_ );
 }
 
 boost::optional<Road::Vertex> Graph::road_vertex_from_id( db_id_t id ) const
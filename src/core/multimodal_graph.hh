@@ -22,6 +22,7 @@
 
 #include <boost/variant.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
+#include <boost/range/iterator_range.hpp>
 
 #include "common.hh"
 #include "road_graph.hh"
@@ -411,6 +412,24 @@ public:
     /// Current public transport selection
     std::set<db_id_t> public_transport_selection() const;
 
+    ///
+    /// Offsets of the vertex numbering of VertexIndexProperty: road vertices, then the vertices of each selected
+    /// public transport graph, then the POIs. Tables are refreshed when the road graph, the public transport graphs,
+    /// their selection or the POIs are changed.
+    /// First index of the vertices of a public transport graph, the first POI index if it is not selected
+    size_t pt_index_offset( PublicTransportGraphIndex idx ) const { return pt_index_offsets_[idx]; }
+    /// First index of the POIs
+    size_t poi_index_offset() const { return poi_index_offset_; }
+    /// Number of vertices, POIs included
+    size_t vertex_count() const { return poi_index_offset_ + pois_.size(); }
+
+private:
+    void update_index_offsets_();
+
+    std::vector<size_t> pt_index_offsets_;
+    size_t poi_index_offset_;
+public:
+
     ///
     /// Point of interests
     typedef std::vector<POI> POIList;
@@ -429,12 +448,17 @@ public:
 
     POIList pois() const { return pois_; }
 
-    void add_poi_ref( const Road::Edge& e, POIIndex );
-
-    typedef std::vector<POIIndex> EdgePois;
-    const EdgePois& edge_pois( const Road::Edge& e ) const;
+    ///
+    /// POIs attached to a road edge
+    typedef boost::iterator_range<const POIIndex*> EdgePois;
+    EdgePois edge_pois( const Road::Edge& e ) const
+    {
+        return EdgePois( edge_poi_values_.data() + edge_poi_offsets_[e.idx], edge_poi_values_.data() + edge_poi_offsets_[e.idx + 1] );
+    }
 
-    void add_stop_ref( const Road::Edge& e, const PublicTransportGraphIndex&, const PublicTransport::Vertex& );
+    ///
+    /// Attach POIs to road edges, given as (road edge, POI) pairs. POIs of an edge keep their order
+    void set_edge_pois( const std::vector<std::pair<Road::Edge, POIIndex>>& );
 
     struct StopIndex
     {
@@ -444,19 +468,26 @@ public:
         DECLARE_RO_PROPERTY( graph, PublicTransportGraphIndex );
         DECLARE_RO_PROPERTY( vertex, PublicTransport::Vertex );
     };
-    typedef std::vector<StopIndex> EdgeStops;
-    const EdgeStops& edge_stops( const Road::Edge& ) const;
 
-private:
-    typedef std::map<Road::Edge, EdgeStops> RoadEdgeStops;
-    RoadEdgeStops road_edge_stops_;
-    // just to be able to return a reference to empty
-    EdgeStops empty_edge_stops_;
+    ///
+    /// Public transport stops attached to a road edge
+    typedef boost::iterator_range<const StopIndex*> EdgeStops;
+    EdgeStops edge_stops( const Road::Edge& e ) const
+    {
+        return EdgeStops( edge_stop_values_.data() + edge_stop_offsets_[e.idx], edge_stop_values_.data() + edge_stop_offsets_[e.idx + 1] );
+    }
+
+    ///
+    /// Attach stops to road edges, given as (road edge, stop) pairs. Stops of an edge keep their order
+    void set_edge_stops( const std::vector<std::pair<Road::Edge, StopIndex>>& );
 
-    typedef std::map<Road::Edge, EdgePois> RoadEdgePOIs;
-    RoadEdgePOIs road_edge_pois_;
-    // just to be able to return a reference to empty
-    EdgePois empty_edge_pois_;
+private:
+    // Stops and POIs of each road edge, as compressed sparse rows indexed by the road edge index:
+    // values of the edge i are in [offsets[i], offsets[i+1]). Resetted when the road graph is changed
+    std::vector<uint32_t> edge_stop_offsets_;
+    std::vector<StopIndex> edge_stop_values_;
+    std::vector<uint32_t> edge_poi_offsets_;
+    std::vector<POIIndex> edge_poi_values_;
 
     friend void Tempus::serialize( std::ostream& ostr, const Graph& graph, binary_serialization_t );
     friend void Tempus::unserialize( std::istream& istr, Graph& graph, binary_serialization_t );
@@ -685,7 +716,29 @@ public:
     typedef boost::vertex_property_tag category;
 
     VertexIndexProperty( const Graph& graph ) : graph_( graph ) {}
-    size_t get_index( const Vertex& v ) const;
+
+    ///
+    /// Maps a vertex to an integer in (0, num_vertices-1), in constant time.
+    ///
+    /// A road vertex is mapped to its vertex_index in the road graph.
+    /// A public transport vertex is mapped to its vertex_index in its pt graph, plus the number of vertices of the road graph
+    /// and of all the preceding selected public transport graphs.
+    /// A POI is mapped to its index plus the number of vertices of all the graphs.
+    size_t get_index( const Vertex& v ) const
+    {
+        // road and public transport vertices are their own vertex_index (CSR and vecS graphs)
+        switch ( v.type_ ) {
+        case Vertex::Null:
+            return 0;
+        case Vertex::Road:
+            return v.data_.vertex;
+        case Vertex::PublicTransport:
+            return graph_.pt_index_offset( v.data_.pt.index ) + v.data_.pt.vertex;
+        case Vertex::Poi:
+            return graph_.poi_index_offset() + v.data_.poi;
+        }
+        return 0;
+    }
 
     size_t operator[] ( const Vertex& v ) const {
         return get_index( v );
@@ -700,7 +753,7 @@ protected:
 
 ///
 /// Number of vertices. Constant time
-size_t num_vertices( const Graph& graph );
+inline size_t num_vertices( const Graph& graph ) { return graph.vertex_count(); }
 ///
 /// Number of edges. O(n) for n number of PT and POI edges
 size_t num_edges( const Graph& graph );
@@ -7,6 +7,7 @@
 #include "serializers.hh"
 #include "db.hh"
 #include "multimodal_graph.hh"
+#include "utils/hilbert.hh"
 
 namespace Tempus
 {
@@ -155,13 +156,29 @@ std::unique_ptr<Road::Graph> import_road_graph_( Db::Connection& connection, Pro
             p.set_z( res_i[4] );
             node.set_coordinates(p);
 
-            road_nodes_map[ node.db_id() ] = nodes.size();
             nodes.push_back( node );
 
             //progression( static_cast<float>( ( i + 0. ) / res.size() / 4.0 ) );
         }
     }
 
+    // Vertices are numbered along a Hilbert curve rather than in database order,
+    // so that vertices close to each other, that are explored together, are also close in memory
+    {
+        std::vector<Point3D> coordinates;
+        coordinates.reserve( nodes.size() );
+        for ( const Road::Node& node : nodes ) {
+            coordinates.push_back( node.coordinates() );
+        }
+        std::vector<Road::Node> ordered_nodes;
+        ordered_nodes.reserve( nodes.size() );
+        for ( size_t i : hilbert_order( coordinates ) ) {
+            road_nodes_map[ nodes[i].db_id() ] = ordered_nodes.size();
+            ordered_nodes.push_back( nodes[i] );
+        }
+        nodes.swap( ordered_nodes );
+    }
+
     //------------------
     //   Road sections
     //------------------
@@ -434,6 +451,7 @@ std::unique_ptr<Multimodal::Graph> import_graph( Db::Connection& connection, Pro
 
     //
     // For all public transport nodes, add a reference to the attached road section
+    std::vector<std::pair<Road::Edge, Multimodal::Graph::StopIndex>> edge_stops;
     size_t gidx = 0;
     for ( auto it = pt_graphs.begin(); it != pt_graphs.end(); it++, gidx++ ) {
         PublicTransport::Graph& g = *it->second;
@@ -441,14 +459,15 @@ std::unique_ptr<Multimodal::Graph> import_graph( Db::Connection& connection, Pro
 
         for ( boost::tie( vi, vi_end ) = boost::vertices( g ); vi != vi_end; vi++ ) {
             Road::Edge rs = g[ *vi ].road_edge();
-            graph->add_stop_ref( rs, gidx, *vi );
+            edge_stops.push_back( std::make_pair( rs, Multimodal::Graph::StopIndex( gidx, *vi ) ) );
             // add a ref to the opposite road edge, if any
             if (g[*vi].opposite_road_edge()) {
                 rs = g[*vi].opposite_road_edge().get();
-                graph->add_stop_ref( rs, gidx, *vi );
+                edge_stops.push_back( std::make_pair( rs, Multimodal::Graph::StopIndex( gidx, *vi ) ) );
             }
         }
     }
+    graph->set_edge_stops( edge_stops );
 
     {
         Db::ResultIterator res_it( connection.exec_it( (boost::format("SELECT network_id, stop_from, stop_to FROM %1%.pt_section ORDER BY network_id") % schema_name).str() ) );
@@ -502,6 +521,7 @@ std::unique_ptr<Multimodal::Graph> import_graph( Db::Connection& connection, Pro
     //    POI
     //-------------
     std::vector<POI> pois;
+    std::vector<std::pair<Road::Edge, POIIndex>> edge_pois;
     {
         Db::Result res = connection.exec( (boost::format("SELECT COUNT(*) FROM %1%.poi") % schema_name).str() );
         size_t count = 0;
@@ -536,7 +556,7 @@ std::unique_ptr<Multimodal::Graph> import_graph( Db::Connection& connection, Pro
 
             Road::Edge re = road_sections_map[ road_section_id ];
             poi.set_road_edge( re );
-            graph->add_poi_ref( re, pidx );
+            edge_pois.push_back( std::make_pair( re, POIIndex( pidx ) ) );
             // look for an opposite road edge
             {
                 Road::Edge opposite_edge;
@@ -546,7 +566,7 @@ std::unique_ptr<Multimodal::Graph> import_graph( Db::Connection& connection, Pro
                                                            *road_graph );
                 if ( found && (graph->road()[poi.road_edge()].db_id() == graph->road()[opposite_edge].db_id()) ) {
                     poi.set_opposite_road_edge( opposite_edge );
-                    graph->add_poi_ref( opposite_edge, pidx );
+                    edge_pois.push_back( std::make_pair( opposite_edge, POIIndex( pidx ) ) );
                 }
             }
 
@@ -566,6 +586,7 @@ std::unique_ptr<Multimodal::Graph> import_graph( Db::Connection& connection, Pro
     graph->set_network_map( networks );
     graph->set_public_transports( std::move(pt_graphs) );
     graph->set_pois( std::move(pois) );
+    graph->set_edge_pois( edge_pois );
 
     progression( 1.0, /* finished = */ true );
 
@@ -55,6 +55,11 @@ std::unique_ptr<Result> PluginRequest::process( const Request& /*request*/ )
     return std::unique_ptr<Result>( new Result );
 }
 
+std::unique_ptr<CostMatrix> PluginRequest::process_matrix( const CostMatrixRequest& /*request*/ )
+{
+    throw std::invalid_argument( "Cost matrices are not supported by the plugin " + plugin_->name() );
+}
+
 PluginRequest::PluginRequest( const Plugin* plugin, const VariantMap& options ) :
     plugin_(plugin), options_( options )
 {
@@ -31,7 +31,9 @@
 #endif
 
 #include "multimodal_graph.hh"
+#include "multimodal_compiled_graph.hh"
 #include "request.hh"
+#include "cost_matrix.hh"
 #include "roadmap.hh"
 #include "db.hh"
 #include "application.hh"
@@ -120,6 +122,13 @@ public:
     /// \return a result, set of paths
     virtual std::unique_ptr<Result> process( const Request& request );
 
+    ///
+    /// Compute the costs between each origin and each destination of a cost matrix request.
+    /// \param[in] request The cost matrix request.
+    /// \throw std::invalid_argument Throws an instance of std::invalid_argument if the plugin does not support cost matrices.
+    /// \return a dense cost matrix
+    virtual std::unique_ptr<CostMatrix> process_matrix( const CostMatrixRequest& request );
+
 protected:
     /// The parent plugin
     const Plugin* plugin_;
@@ -351,6 +360,7 @@ protected:
 typedef PluginGraphVisitorHelper< Road::Graph, &PluginRequest::road_vertex_accessor, &PluginRequest::road_edge_accessor > PluginRoadGraphVisitor;
 typedef PluginGraphVisitorHelper< PublicTransport::Graph, &PluginRequest::pt_vertex_accessor, &PluginRequest::pt_edge_accessor > PluginPtGraphVisitor;
 typedef PluginGraphVisitorHelper< Multimodal::Graph, &PluginRequest::vertex_accessor, &PluginRequest::edge_accessor > PluginGraphVisitor;
+typedef PluginGraphVisitorHelper< Multimodal::CompiledGraph, &PluginRequest::vertex_accessor, &PluginRequest::edge_accessor > PluginCompiledGraphVisitor;
 
 }
 
@@ -20,6 +20,7 @@
 
 #include <boost/optional.hpp>
 #include "common.hh"
+#include "point.hh"
 #include "road_graph.hh"
 
 #include <list>
@@ -55,13 +56,17 @@ public:
     struct Step {
         DECLARE_RW_PROPERTY( location, db_id_t );
         ///
+        /// Coordinates the location has been found from, if any.
+        /// Plugins may use them to start or end along a road section rather than at the location
+        DECLARE_RW_PROPERTY( coordinates, boost::optional<Point2D> );
+        ///
         /// Time constraint.
         /// @warning Should be ignored for the first step (origin)
         DECLARE_RW_PROPERTY( constraint, TimeConstraint );
         ///
         /// Whether the private vehicule must reach the destination
         DECLARE_RW_PROPERTY( private_vehicule_at_destination, bool );
-        Step() : private_vehicule_at_destination_( true ) {}
+        Step() : location_( 0 ), private_vehicule_at_destination_( true ) {}
     };
     typedef std::vector<Step> StepList;
 
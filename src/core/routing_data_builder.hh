@@ -48,8 +48,9 @@ public:
 
     /** Read a serialization header from the given input stream.
      * Will throw on errors
+     * @returns the version of the dump file format
      */
-    void read_header( std::istream& istr ) const;
+    uint32_t read_header( std::istream& istr ) const;
 
 private:
     const std::string name_;
@@ -419,10 +419,19 @@ void serialize( std::ostream& ostr, const Multimodal::Graph& graph, binary_seria
     }
     // pt graph selection
     serialize( ostr, graph.public_transport_selection(), t );
-    // edge_pois
-    serialize( ostr, graph.road_edge_pois_, t );
-    // edge stops
-    serialize( ostr, graph.road_edge_stops_, t );
+    // edge_pois and edge stops, written as maps of the edges that have some
+    std::map<Road::Edge, std::vector<POIIndex>> edge_pois;
+    std::map<Road::Edge, std::vector<Multimodal::Graph::StopIndex>> edge_stops;
+    for ( auto it = edges( graph.road() ).first; it != edges( graph.road() ).second; it++ ) {
+        if ( !graph.edge_pois( *it ).empty() ) {
+            edge_pois[*it].assign( graph.edge_pois( *it ).begin(), graph.edge_pois( *it ).end() );
+        }
+        if ( !graph.edge_stops( *it ).empty() ) {
+            edge_stops[*it].assign( graph.edge_stops( *it ).begin(), graph.edge_stops( *it ).end() );
+        }
+    }
+    serialize( ostr, edge_pois, t );
+    serialize( ostr, edge_stops, t );
 }
 
 void unserialize( std::istream& istr, Multimodal::Graph& graph, binary_serialization_t t )
@@ -454,11 +463,29 @@ void unserialize( std::istream& istr, Multimodal::Graph& graph, binary_serializa
     }
     graph.set_public_transports( std::move(pt_graphs) );
     // pt graph selection
-    unserialize( istr, graph.selected_transport_graphs_, t );
+    std::set<db_id_t> selection;
+    unserialize( istr, selection, t );
+    graph.select_public_transports( selection );
     // edge_pois
-    unserialize( istr, graph.road_edge_pois_, t );
+    std::map<Road::Edge, std::vector<POIIndex>> edge_pois;
+    unserialize( istr, edge_pois, t );
+    std::vector<std::pair<Road::Edge, POIIndex>> poi_pairs;
+    for ( const auto& p : edge_pois ) {
+        for ( POIIndex poi : p.second ) {
+            poi_pairs.push_back( std::make_pair( p.first, poi ) );
+        }
+    }
+    graph.set_edge_pois( poi_pairs );
     // edge stops
-    unserialize( istr, graph.road_edge_stops_, t );
+    std::map<Road::Edge, std::vector<Multimodal::Graph::StopIndex>> edge_stops;
+    unserialize( istr, edge_stops, t );
+    std::vector<std::pair<Road::Edge, Multimodal::Graph::StopIndex>> stop_pairs;
+    for ( const auto& p : edge_stops ) {
+        for ( const Multimodal::Graph::StopIndex& stop : p.second ) {
+            stop_pairs.push_back( std::make_pair( p.first, stop ) );
+        }
+    }
+    graph.set_edge_stops( stop_pairs );
 }
 
 }
@@ -60,6 +60,8 @@ void unserialize( std::istream& istr, Multimodal::Graph& g, binary_serialization
 
 void serialize( std::ostream& ostr, const char* ptr, size_t s, binary_serialization_t );
 void unserialize( std::istream& istr, char* ptr, size_t s, binary_serialization_t );
+void serialize( std::ostream& ostr, const std::string& t, binary_serialization_t );
+void unserialize( std::istream& istr, std::string& t, binary_serialization_t );
 
 template <typename T>
 typename std::enable_if<std::is_integral<T>::value, void>::type
@@ -0,0 +1,90 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_UTILS_HILBERT_HH
+#define TEMPUS_UTILS_HILBERT_HH
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <utility>
+
+namespace Tempus
+{
+
+///
+/// Position of a cell along a Hilbert curve filling a 2^bits x 2^bits grid.
+/// Cells that are consecutive on the curve are neighbours on the grid, so that sorting
+/// objects by the index of their cell keeps objects that are close together.
+/// \param x Column of the cell, lower than 2^bits
+/// \param y Row of the cell, lower than 2^bits
+/// \param bits Number of bits of each coordinate, at most 32
+inline uint64_t hilbert_index( uint32_t x, uint32_t y, unsigned bits = 32 )
+{
+    const uint64_t n_max = ( bits == 32 ) ? 0xFFFFFFFFULL : ( ( uint64_t( 1 ) << bits ) - 1 );
+    uint64_t d = 0;
+    for ( uint64_t s = ( n_max + 1 ) / 2; s > 0; s /= 2 ) {
+        const uint64_t rx = ( x & s ) > 0;
+        const uint64_t ry = ( y & s ) > 0;
+        d += s * s * ( ( 3 * rx ) ^ ry );
+        // rotate the quadrant so that the curve is continuous
+        if ( ry == 0 ) {
+            if ( rx == 1 ) {
+                x = uint32_t( n_max - x );
+                y = uint32_t( n_max - y );
+            }
+            std::swap( x, y );
+        }
+    }
+    return d;
+}
+
+///
+/// Order of points along a Hilbert curve over their bounding box
+/// \param points Coordinates of each point (x(), y())
+/// \returns indexes of the points, in the order of the curve. Ties are kept in their original order
+template <typename Point>
+std::vector<size_t> hilbert_order( const std::vector<Point>& points )
+{
+    std::vector<size_t> order( points.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    if ( points.empty() ) {
+        return order;
+    }
+
+    double min_x = points[0].x(), max_x = min_x, min_y = points[0].y(), max_y = min_y;
+    for ( const Point& p : points ) {
+        min_x = std::min( min_x, double( p.x() ) );
+        max_x = std::max( max_x, double( p.x() ) );
+        min_y = std::min( min_y, double( p.y() ) );
+        max_y = std::max( max_y, double( p.y() ) );
+    }
+    // cells of a 2^16 x 2^16 grid, that is much finer than the density of a road network
+    const unsigned bits = 16;
+    const double cells = double( ( 1 << bits ) - 1 );
+    const double scale = cells / std::max( std::max( max_x - min_x, max_y - min_y ), 1e-9 );
+    std::vector<uint64_t> index( points.size() );
+    for ( size_t i = 0; i < points.size(); i++ ) {
+        index[i] = hilbert_index( uint32_t( ( points[i].x() - min_x ) * scale ), uint32_t( ( points[i].y() - min_y ) * scale ), bits );
+    }
+    std::stable_sort( order.begin(), order.end(), [&index]( size_t a, size_t b ) { return index[a] < index[b]; } );
+    return order;
+}
+
+} // namespace Tempus
+
+#endif
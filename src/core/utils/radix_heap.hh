@@ -0,0 +1,153 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEMPUS_UTILS_RADIX_HEAP_HH
+#define TEMPUS_UTILS_RADIX_HEAP_HH
+
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+
+#include <boost/assert.hpp>
+
+namespace Tempus
+{
+
+//
+// Monotone priority queue on unsigned integer keys.
+//
+// Elements are stored in buckets given by the highest bit that differs between their key
+// and the last extracted minimum. Since keys pushed are never lower than the last minimum
+// (which is the case of Dijkstra-like algorithms with non-negative costs),
+// each element is moved at most once per bit of its key.
+//
+// Duplicated values are allowed, outdated entries must be filtered by the caller.
+template <typename Key, typename Value>
+class RadixHeap
+{
+    static_assert( std::is_unsigned<Key>::value, "RadixHeap needs unsigned integer keys" );
+public:
+    RadixHeap() : last_( 0 ), size_( 0 ) {}
+
+    void push( Key k, const Value& v )
+    {
+        BOOST_ASSERT( k >= last_ );
+        buckets_[bucket_index( k )].emplace_back( k, v );
+        size_++;
+    }
+
+    bool empty() const { return size_ == 0; }
+
+    size_t size() const { return size_; }
+
+    ///
+    /// The current minimum is in the first bucket.
+    /// Buckets are only redistributed when the minimum is requested, so that
+    /// keys pushed after a pop() can still be equal to the popped key.
+    Key top_key()
+    {
+        BOOST_ASSERT( !empty() );
+        if ( buckets_[0].empty() ) {
+            refill_();
+        }
+        return buckets_[0].back().first;
+    }
+
+    const Value& top_value()
+    {
+        BOOST_ASSERT( !empty() );
+        if ( buckets_[0].empty() ) {
+            refill_();
+        }
+        return buckets_[0].back().second;
+    }
+
+    void pop()
+    {
+        BOOST_ASSERT( !empty() );
+        if ( buckets_[0].empty() ) {
+            refill_();
+        }
+        buckets_[0].pop_back();
+        size_--;
+    }
+
+    ///
+    /// Remove all elements, memory of the buckets is kept.
+    /// Keys pushed after a clear() can start from zero again
+    void clear()
+    {
+        for ( auto& b : buckets_ ) {
+            b.clear();
+        }
+        size_ = 0;
+        last_ = 0;
+    }
+
+private:
+    static const int num_bits = sizeof( Key ) * 8;
+
+    static int bit_width_( uint64_t x )
+    {
+#if defined(__GNUC__)
+        return x == 0 ? 0 : 64 - __builtin_clzll( x );
+#else
+        int n = 0;
+        while ( x ) {
+            x >>= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+
+    size_t bucket_index( Key k ) const
+    {
+        return bit_width_( uint64_t( k ^ last_ ) );
+    }
+
+    // Find the first non-empty bucket, take its minimum as the new reference
+    // and redistribute its elements in lower buckets
+    void refill_()
+    {
+        size_t i = 1;
+        while ( buckets_[i].empty() ) {
+            i++;
+        }
+        Key m = buckets_[i][0].first;
+        for ( const auto& e : buckets_[i] ) {
+            if ( e.first < m ) {
+                m = e.first;
+            }
+        }
+        last_ = m;
+        for ( const auto& e : buckets_[i] ) {
+            size_t j = bucket_index( e.first );
+            BOOST_ASSERT( j < i );
+            buckets_[j].push_back( e );
+        }
+        buckets_[i].clear();
+    }
+
+    std::vector<std::pair<Key, Value>> buckets_[num_bits + 1];
+    Key last_;
+    size_t size_;
+};
+
+} // namespace Tempus
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *   Copyright (C) 2015 Mappy <dt.lbs.route@mappy.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "ch_hub_labels.hh"
+#include "ch_routing_data.hh"
+#include "routing_data.hh"
+#include "utils/timer.hh"
+
+#include <string>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+using namespace Tempus;
+
+//
+// Computation of the hub labels of a metric of a CH, to be loaded by the ch_plugin with its ch/hub_labels option
+int main( int argc, char *argv[] )
+{
+    using namespace std;
+
+    std::string db_options = "dbname=tempus_test_db";
+    std::string in_schema = "ch";
+    std::string in_file;
+    std::string metric;
+    std::string out_file;
+    std::string checkpoint_file;
+    double checkpoint_interval = 300.0;
+
+    namespace po = boost::program_options;
+    po::options_description desc( "Allowed options" );
+    desc.add_options()
+        ( "help", "produce help message" )
+        ( "db,d", po::value<string>(&db_options), "set database connection options" )
+        ( "in_schema,s", po::value<string>(&in_schema), "set database schema of the contraction" )
+        ( "in_file,L", po::value<string>(&in_file), "set the name of the ch_graph dump file where the contraction is located" )
+        ( "metric,m", po::value<string>(&metric), "metric to compute the labels of, the default one if not set" )
+        ( "out-file,o", po::value<string>(&out_file), "write the hub labels to this file" )
+        ( "checkpoint", po::value<string>(&checkpoint_file), "save the labels computed so far to this file, and start again from it if it exists" )
+        ( "checkpoint-interval", po::value<double>(&checkpoint_interval), "minimum time between two checkpoints, in seconds (300 by default)" )
+        ;
+
+    po::variables_map vm;
+    po::store( po::parse_command_line( argc, argv, desc ), vm );
+    po::notify( vm );
+
+    if ( vm.count( "help" ) ) {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+    if ( out_file.empty() ) {
+        std::cerr << "An output file is needed (--out-file)" << std::endl;
+        return 1;
+    }
+
+    TextProgression progression;
+    VariantMap options;
+    options["db/options"] = Variant::from_string( db_options );
+    options["db/schema"] = Variant::from_string( in_schema );
+    if ( !in_file.empty() ) {
+        options["from_file"] = Variant::from_string( in_file );
+    }
+
+    try {
+        std::cout << "* Loading the contraction" << std::endl;
+        const CHRoutingData* rd = dynamic_cast<const CHRoutingData*>( load_routing_data( "ch_graph", progression, options ) );
+        if ( rd == nullptr ) {
+            std::cerr << "Problem loading the CH routing data" << std::endl;
+            return 1;
+        }
+
+        std::cout << "* Computing hub labels" << std::endl;
+        CHHubLabelStatistics stats;
+        std::unique_ptr<CHHubLabels> labels = build_ch_hub_labels( rd->ch_query( metric ), metric, stats, checkpoint_file, checkpoint_interval, progression );
+        const double n = double( labels->num_vertices() );
+        std::cout << "Hub labels computed in " << stats.build_time << "s, " << stats.levels << " levels";
+        if ( stats.resumed_levels ) {
+            std::cout << " (" << stats.resumed_levels << " from the checkpoint)";
+        }
+        std::cout << ", " << stats.forward_entries / n << " forward and " << stats.backward_entries / n << " backward entries per vertex, "
+                  << stats.pruned_entries << " pruned entries" << std::endl;
+
+        Timer timer;
+        labels->save( out_file );
+        std::cout << "Hub labels written to " << out_file << " in " << timer.elapsed() << "s" << std::endl;
+    }
+    catch ( std::exception& e ) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
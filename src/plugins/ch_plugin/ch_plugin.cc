@@ -24,8 +24,6 @@
 #ifdef _WIN32
 #pragma warning(push, 0)
 #endif
-#include <queue>
-#include <boost/pending/indirect_cmp.hpp>
 #include <boost/graph/visitors.hpp>
 #include <boost/graph/dijkstra_shortest_paths_no_color_map.hpp>
 #include <boost/property_map/function_property_map.hpp>
@@ -34,22 +32,47 @@
 #pragma warning(pop)
 #endif
 
-#include "utils/associative_property_map_default_value.hh"
+#include <fstream>
+#include <limits>
+#include <cmath>
+#include <chrono>
+
 #include "utils/timer.hh"
 
 #include "utils/graph_db_link.hh"
+#include "ch_search.hh"
 
 namespace Tempus {
 
 const Plugin::OptionDescriptionList CHPlugin::option_descriptions()
 {
     Plugin::OptionDescriptionList odl;
+    odl.declare_option( "CH/stall_on_demand", "Prune the search with stall-on-demand", Variant::from_bool( false ) );
+    odl.declare_option( "CH/priority_queue", "Priority queue used by the search (binary or radix)", Variant::from_string( "binary" ) );
+    odl.declare_option( "CH/max_cost", "Maximum cost of one-to-all queries, 0 for no limit", Variant::from_float( 0.0 ) );
+    odl.declare_option( "CH/time_dependent", "Route cars departing after a given time with the time-dependent hierarchy, if any, "
+                        "unless the costs of the car metric have been changed", Variant::from_bool( true ) );
+    odl.declare_option( "CH/metric", "Metric to use (see ch/metrics), empty for the one of the transport mode of the request", Variant::from_string( "" ) );
+    odl.declare_option( "CH/turn_restrictions", "Route with the edge-based hierarchy, if any. The request fails if it has not been built for the metric "
+                        "of the request. It takes precedence over the time-dependent hierarchy", Variant::from_bool( true ) );
+    odl.declare_option( "CH/phantom_nodes", "Start and end along the road sections nearest to the coordinates of the request, if any, "
+                        "rather than at its road nodes. It takes precedence over the edge-based and time-dependent hierarchies", Variant::from_bool( true ) );
+    odl.declare_option( "CH/snap_max_distance", "Maximum distance between coordinates and their road section, in the unit of the coordinates",
+                        Variant::from_float( 200.0 ) );
+    odl.declare_option( "CH/use_hub_labels", "Compute cost matrices with targets from the hub labels of the metric, if they have been loaded (ch/hub_labels plugin option)", Variant::from_bool( true ) );
+    odl.declare_option( "CH/alternatives", "Maximum number of alternative routes, besides the shortest one, each one in its own roadmap. "
+                        "Not used with the edge-based and time-dependent hierarchies", Variant::from_int( 0 ) );
+    odl.declare_option( "CH/alternative_max_stretch", "Maximum extra cost of an alternative route, as a fraction of the shortest one", Variant::from_float( 0.25 ) );
+    odl.declare_option( "CH/alternative_max_sharing", "Maximum cost an alternative route shares with the previous ones, as a fraction of the shortest one", Variant::from_float( 0.8 ) );
+    odl.declare_option( "CH/alternative_local_optimality", "Cost around the via vertex of an alternative route that must be a shortest path, "
+                        "as a fraction of the shortest one", Variant::from_float( 0.25 ) );
     return odl;
 }
 
 const Plugin::Capabilities CHPlugin::plugin_capabilities()
 {
     Plugin::Capabilities caps;
+    caps.optimization_criteria().push_back( CostId::CostDistance );
     caps.optimization_criteria().push_back( CostId::CostDuration );
     return caps;
 }
@@ -62,284 +85,835 @@ CHPlugin::CHPlugin( ProgressionCallback& progression, const VariantMap& options
     if ( rd_ == nullptr ) {
         throw std::runtime_error( "Problem loading the CH routing data" );
     }
-}
+    workspace_pool_.reset( new CHQueryWorkspacePool( num_vertices( rd_->ch_query() ) ) );
+    radix_workspace_pool_.reset( new CHQueryRadixWorkspacePool( num_vertices( rd_->ch_query() ) ) );
+    td_workspace_pool_.reset( new TDCHQueryWorkspacePool( num_vertices( rd_->ch_query() ) ) );
+    if ( rd_->turn_graph() ) {
+        turn_workspace_pool_.reset( new CHQueryWorkspacePool( num_vertices( rd_->turn_graph()->query_graph() ) ) );
+        turn_radix_workspace_pool_.reset( new CHQueryRadixWorkspacePool( num_vertices( rd_->turn_graph()->query_graph() ) ) );
+    }
 
+    // cache of unpacked shortcuts, one per metric, of ch/unpack_cache_size road edges each
+    size_t unpack_cache_size = 0;
+    auto cache_it = options.find( "ch/unpack_cache_size" );
+    if ( cache_it != options.end() && cache_it->second.as<int64_t>() > 0 ) {
+        unpack_cache_size = size_t( cache_it->second.as<int64_t>() );
+    }
+    versions_.reset( new CHGraphVersions( *rd_, unpack_cache_size ) );
+
+    // hub labels of a metric, computed by ch_hub_labels from the same graph
+    auto labels_it = options.find( "ch/hub_labels" );
+    if ( labels_it != options.end() && !labels_it->second.str().empty() ) {
+        const std::string filename = labels_it->second.str();
+        std::shared_ptr<const CHHubLabels> labels( CHHubLabels::load( filename ).release() );
+        try {
+            versions_->set_hub_labels( labels );
+        }
+        catch ( std::runtime_error& e ) {
+            throw std::runtime_error( filename + ": " + e.what() );
+        }
+    }
 
+    // cost changes of a metric (ch/cost_changes_metric, the default one if not set), applied again when the file is modified
+    auto changes_it = options.find( "ch/cost_changes" );
+    if ( changes_it != options.end() && !changes_it->second.str().empty() ) {
+        auto changes_metric_it = options.find( "ch/cost_changes_metric" );
+        const std::string metric = changes_metric_it != options.end() ? changes_metric_it->second.str() : std::string();
+        cost_changes_.reset( new CHCostChangesFile( changes_it->second.str(), versions_->metric_key( metric ) ) );
+        reload_cost_changes();
+        // polled every ch/cost_changes_interval seconds, out of the requests
+        double interval = 1.0;
+        auto interval_it = options.find( "ch/cost_changes_interval" );
+        if ( interval_it != options.end() && interval_it->second.as<double>() > 0 ) {
+            interval = interval_it->second.as<double>();
+        }
+        cost_changes_thread_ = std::thread( &CHPlugin::watch_cost_changes_, this, interval );
+    }
+}
 
-template <typename OutIterator>
-void unpack_edge( CHVertex v1, CHVertex v2, const MiddleNodeMap& middle_node, OutIterator out_it )
+CHPlugin::~CHPlugin()
 {
-    auto it = middle_node.find( std::make_pair(v1,v2) );
-    if ( it != middle_node.end() ) {
-        unpack_edge( v1, it->second, middle_node, out_it );
-        unpack_edge( it->second, v2, middle_node, out_it );
+    if ( cost_changes_thread_.joinable() ) {
+        {
+            std::lock_guard<std::mutex> lock( cost_changes_mutex_ );
+            stopping_ = true;
+        }
+        cost_changes_stop_.notify_one();
+        cost_changes_thread_.join();
     }
-    else {
-        *out_it = v1;
-        out_it++;
+}
+
+void CHPlugin::watch_cost_changes_( double interval )
+{
+    const std::chrono::milliseconds period( int64_t( interval * 1000 ) );
+    std::string last_error;
+    std::unique_lock<std::mutex> lock( cost_changes_mutex_ );
+    while ( !cost_changes_stop_.wait_for( lock, period, [this]() { return stopping_; } ) ) {
+        // if the file cannot be read, e.g. while it is written, requests go on with the previous costs
+        try {
+            reload_cost_changes();
+            last_error.clear();
+        }
+        catch ( std::runtime_error& e ) {
+            if ( e.what() != last_error ) {
+                CERR << e.what() << std::endl;
+                last_error = e.what();
+            }
+        }
     }
 }
 
-template <typename InIterator, typename OutIterator>
-void unpack_path( InIterator it_begin, InIterator it_end, const MiddleNodeMap& middle_node, OutIterator out_it )
+bool CHPlugin::reload_cost_changes() const
 {
-    if ( it_begin == it_end )
-        return;
-    auto it = it_begin;
-    auto it2 = it_begin;
-    it2++;
-    for ( ; it2 != it_end; it++, it2++ ) {
-        unpack_edge( *it, *it2, middle_node, out_it );
-    }
-    *out_it = *it;
-    out_it++;
+    if ( !cost_changes_ ) {
+        return false;
+    }
+    Timer timer;
+    CHCustomizationStatistics stats;
+    if ( !cost_changes_->update_if_modified( *versions_, stats ) ) {
+        return false;
+    }
+    COUT << "Cost changes of " << cost_changes_->filename() << " applied in " << timer.elapsed() << "s: " << stats.changed_edges << " changed edges, "
+         << stats.unknown_sections << " unknown sections, " << stats.updated_edges << " updated edges" << std::endl;
+    return true;
 }
 
+CHCustomizationStatistics CHPlugin::update_costs_from_file( const std::string& metric, const std::string& filename )
+{
+    std::ifstream file( filename );
+    if ( !file ) {
+        throw std::runtime_error( "Cannot open " + filename );
+    }
+    return update_costs( metric, read_ch_cost_changes( file ) );
+}
 
-template <typename CostType, typename WeightMap>
-std::list<CHVertex> bidirectional_ch_dijkstra( const CHRoutingData& rd, CHVertex origin, CHVertex destination, WeightMap weight_map, CostType& ret_cost )
+///
+/// Point-to-point query.
+/// The original edges of the path are appended to road_edges, by their index in the graph
+/// \returns the cost of the path, in the integer unit of the graph, none if there is no path
+template <typename Workspace>
+boost::optional<float> ch_query( const CHQuery& graph, CHVertex ch_origin, CHVertex ch_destination, Workspace& ws, bool stall_on_demand, CHUnpackCache* cache, CHQueryStatistics& stats, std::vector<uint32_t>& road_edges )
 {
-    const CHQuery& graph = rd.ch_query();
+    // integer costs of the CH graph
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    uint32_t ret_cost = 0;
+    if ( !bidirectional_ch_dijkstra( graph, ch_origin, ch_destination, weight_map, ws, stall_on_demand, ret_cost, stats ) ) {
+        return boost::optional<float>();
+    }
 
-    std::map<CHVertex, CostType> costs;
-    std::list<CHVertex> returned_path;
+    unpack_ch_path( graph, ws.path_edges(), road_edges, ws.unpack_stack(), cache );
+    return float(ret_cost);
+}
 
-    const CostType infinity = std::numeric_limits<CostType>::max();
+///
+/// Point-to-point query on an edge-based hierarchy, from the sections leaving the origin to the sections reaching the destination.
+/// \param[out] first_section Turn vertex of the first section of the path
+/// \param[out] turns Turns of the path, by their index in the graph. Each turn leads to the next section of the path
+/// \returns the cost of the path, in the integer unit of the graph, none if there is no path
+template <typename Workspace>
+boost::optional<float> turn_ch_query( const CHTurnGraph& turn_graph, CHVertex ch_origin, CHVertex ch_destination, Workspace& ws, bool stall_on_demand,
+                                      CHQueryStatistics& stats, CHVertex& first_section, std::vector<uint32_t>& turns )
+{
+    const CHQuery& graph = turn_graph.query_graph();
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
 
-    typedef std::vector<CostType> PotentialMap;
-    size_t n = num_vertices( graph );
-    PotentialMap potential[2] = { PotentialMap( n, infinity ),
-                                  PotentialMap( n, infinity ) };
-    typedef CostType* PotentialPMap;
-    PotentialPMap potential_map[2] = { &potential[0][0], &potential[1][0] };
+    // a path starts with the cost of its first section, turns give the cost of the next ones
+    std::vector<std::pair<CHVertex, uint32_t>> sources, targets;
+    for ( const uint32_t* it = turn_graph.out_vertices( ch_origin ).first; it != turn_graph.out_vertices( ch_origin ).second; it++ ) {
+        sources.push_back( std::make_pair( *it, turn_graph.turn_vertex( *it ).cost ) );
+    }
+    for ( const uint32_t* it = turn_graph.in_vertices( ch_destination ).first; it != turn_graph.in_vertices( ch_destination ).second; it++ ) {
+        targets.push_back( std::make_pair( *it, uint32_t( 0 ) ) );
+    }
+    uint32_t ret_cost = 0;
+    CHVertex last_section = 0;
+    if ( !bidirectional_ch_dijkstra( graph, sources.begin(), sources.end(), targets.begin(), targets.end(), weight_map, ws, stall_on_demand, ret_cost, first_section, last_section, stats ) ) {
+        return boost::optional<float>();
+    }
 
-    typedef boost::indirect_cmp<PotentialPMap, std::greater<CostType>> Cmp;
+    unpack_ch_path( graph, ws.path_edges(), turns, ws.unpack_stack() );
+    return float(ret_cost);
+}
 
-    // FIXME is the heap needed ? since the graph is partitioned in two acyclic graphs with a topological order on nodes
-    // There may be a way to be faster: loop over each node in order and relax out edges
-    //typedef boost::heap::d_ary_heap< CHVertex, boost::heap::arity<4>, boost::heap::compare< Cmp >, boost::heap::mutable_<true> > VertexQueue;
-    typedef std::priority_queue<CHVertex, std::vector<CHVertex>, Cmp> VertexQueue;
-    Cmp cmp_fw( potential_map[0] );
-    Cmp cmp_bw( potential_map[1] );
-    VertexQueue vertex_queue[2] = { VertexQueue( cmp_fw ), VertexQueue( cmp_bw ) };
+///
+/// Cost of a section in one direction in a version of a graph, none if the section cannot be traveled in this direction.
+/// The costs of the section are the ones stored with the section index, if any: its original edge may not be in the graph
+/// (see CHSectionCosts). Otherwise it is the cost of this edge, if it can be found
+static boost::optional<uint32_t> section_cost( const CHGraphVersion& version, const CHSection& section, const CHSectionCosts* costs, bool forward )
+{
+    uint32_t cost = CHSectionCosts::no_cost();
+    if ( costs ) {
+        cost = forward ? costs->forward : costs->backward;
+    }
+    else {
+        CHEdge e;
+        bool found = false;
+        std::tie( e, found ) = forward ? edge( section.from, section.to, *version.graph ) : edge( section.to, section.from, *version.graph );
+        if ( found && !e.property().b.is_shortcut && version.graph->edge_details( version.graph->edge_index( e ) ).db_id == section.db_id ) {
+            cost = uint32_t( e.property().b.cost );
+        }
+    }
+    if ( cost == CHSectionCosts::no_cost() ) {
+        return boost::none;
+    }
+    // a changed cost applies to both directions, unless the section is closed
+    auto it = version.changed_costs.find( section.db_id );
+    if ( it != version.changed_costs.end() ) {
+        cost = it->second;
+    }
+    if ( cost == CCHMetric::infinity() ) {
+        return boost::none;
+    }
+    return cost;
+}
 
-    std::map<CHVertex, CHVertex> predecessor[2];
+///
+/// Vertices a query can start from (or end at) on a phantom node, with the cost of the part of the section
+/// between the phantom node and each of them, a fraction of the cost of the section in this direction
+static std::vector<std::pair<CHVertex, uint32_t>> phantom_endpoints( const CHGraphVersion& version, const CHSection& section, const CHSectionCosts* costs,
+                                                                     float ratio, bool is_origin )
+{
+    std::vector<std::pair<CHVertex, uint32_t>> endpoints;
+    // along the section, an origin goes to its to vertex and a destination is reached from its from vertex
+    if ( boost::optional<uint32_t> c = section_cost( version, section, costs, true ) ) {
+        endpoints.push_back( is_origin ? std::make_pair( section.to, uint32_t( c.get() * ( 1.0f - ratio ) + 0.5f ) )
+                                       : std::make_pair( section.from, uint32_t( c.get() * ratio + 0.5f ) ) );
+    }
+    if ( boost::optional<uint32_t> c = section_cost( version, section, costs, false ) ) {
+        endpoints.push_back( is_origin ? std::make_pair( section.from, uint32_t( c.get() * ratio + 0.5f ) )
+                                       : std::make_pair( section.to, uint32_t( c.get() * ( 1.0f - ratio ) + 0.5f ) ) );
+    }
+    return endpoints;
+}
 
-    vertex_queue[0].push( origin );
-    put( potential_map[0], origin, 0.0 );
-    vertex_queue[1].push( destination );
-    put( potential_map[1], destination, 0.0 );
+///
+/// Query between two sets of vertices with initial costs, e.g. the ends of the sections of phantom nodes.
+/// The original edges of the path are appended to road_edges, by their index in the graph
+/// \param[out] path_source, path_target First and last vertices of the path
+/// \returns the cost of the path, initial costs included, none if there is no path
+template <typename Workspace>
+boost::optional<float> multi_endpoint_ch_query( const CHQuery& graph,
+                                                const std::vector<std::pair<CHVertex, uint32_t>>& sources,
+                                                const std::vector<std::pair<CHVertex, uint32_t>>& targets,
+                                                Workspace& ws, bool stall_on_demand, CHUnpackCache* cache, CHQueryStatistics& stats,
+                                                CHVertex& path_source, CHVertex& path_target, std::vector<uint32_t>& road_edges )
+{
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    uint32_t ret_cost = 0;
+    if ( !bidirectional_ch_dijkstra( graph, sources.begin(), sources.end(), targets.begin(), targets.end(), weight_map, ws, stall_on_demand,
+                                     ret_cost, path_source, path_target, stats ) ) {
+        return boost::optional<float>();
+    }
 
-    // direction : 0 = forward, 1 = backward
-    int dir = 1;
+    unpack_ch_path( graph, ws.path_edges(), road_edges, ws.unpack_stack(), cache );
+    return float(ret_cost);
+}
 
-    CHVertex top_node = 0;
-    CostType total_cost = infinity;
-    bool path_found = false;
+class CHPluginRequest : public PluginRequest
+{
+private:
+    const CHRoutingData& rd_;
+    const CHPlugin* parent_;
+    // graph of the metric used by the request, see select_graph()
+    std::string metric_;
+    std::shared_ptr<const CHGraphVersion> version_;
+    const CHQuery* graph_;
+    // node ordering of the graph, null if its vertices are the ones of the CH graph
+    const CHMetricRanks* ranks_;
+    CHUnpackCache* unpack_cache_;
+    // costs of the sections of the index in the metric, null if unknown
+    const FlatArray<CHSectionCosts>* section_costs_;
+    db_id_t mode_;
+    // criterion of the costs of the graph and factor from integer costs to its unit
+    CostId cost_id_;
+    double cost_factor_;
+public:
+    CHPluginRequest( const CHPlugin* parent, const VariantMap& options, const CHRoutingData& rd )
+        : PluginRequest( parent, options), rd_(rd), parent_(parent),
+          graph_( nullptr ), ranks_( nullptr ), unpack_cache_( nullptr ), section_costs_( nullptr ), mode_( TransportModeWalking ),
+          cost_id_( CostId::CostDistance ), cost_factor_( 0.01 )
+    {}
 
-    auto get_min_pi = [&vertex_queue,&potential_map]( int ldir ) {
-        if ( !vertex_queue[ldir].empty() ) {
-            return get( potential_map[ldir], vertex_queue[ldir].top() );
+    ///
+    /// Select the hierarchy of the CH/metric option if set, the one of the transport mode otherwise.
+    /// Pedestrian costs are hundredths of meters, bicycle and car costs are hundredths of seconds.
+    void select_graph( const std::vector<db_id_t>& allowed_modes )
+    {
+        if ( allowed_modes.size() > 1 ) {
+            throw std::runtime_error( "This is a monomodal plugin" );
         }
-        return std::numeric_limits<CostType>::max();
-    };
+        mode_ = allowed_modes.empty() ? db_id_t( TransportModeWalking ) : allowed_modes[0];
+        metric_ = get_string_option( "CH/metric" );
+        if ( metric_.empty() ) {
+            metric_ = rd_.transport_mode_metric( mode_ );
+        }
+        version_ = parent_->graph_version( metric_ );
+        graph_ = version_->graph.get();
+        ranks_ = rd_.metric_ranks( metric_ );
+        unpack_cache_ = version_->unpack_cache.get();
+        section_costs_ = rd_.section_costs( metric_ );
+        if ( metric_ == "bicycle" || metric_ == "car" ) {
+            cost_id_ = CostId::CostDuration;
+            cost_factor_ = 1.0 / 6000.0;
+        }
+        else {
+            cost_id_ = CostId::CostDistance;
+            cost_factor_ = 0.01;
+        }
+    }
 
-    while ( !vertex_queue[0].empty() || !vertex_queue[1].empty() ) {
+    ///
+    /// Vertex of the graph of the request out of a vertex of the CH graph, see CHMetricRanks
+    CHVertex graph_vertex( CHVertex v ) const
+    {
+        return ranks_ ? ranks_->rank[v] : v;
+    }
 
-        if ( std::min( get_min_pi(dir), get_min_pi(1-dir) ) > total_cost ) {
-            // we've reached the best path
-            break;
+    ///
+    /// Vertex of the CH graph out of a vertex of the graph of the request
+    CHVertex ch_vertex( CHVertex v ) const
+    {
+        return ranks_ ? ranks_->vertex[v] : v;
+    }
+
+    ///
+    /// Whether the costs of the hierarchy of a transport mode have been changed (see CHPlugin::update_costs()).
+    /// The time-dependent hierarchy cannot be customized: while car costs are changed, car requests are routed on the
+    /// static hierarchy, whose customized costs take closures into account
+    bool has_cost_changes( db_id_t mode ) const
+    {
+        std::string metric;
+        try {
+            metric = rd_.transport_mode_metric( mode );
+        }
+        catch ( std::runtime_error& ) {
+            return false;
         }
+        return !parent_->graph_version( metric )->changed_costs.empty();
+    }
 
-        // interleave directions
-        dir = 1 - dir;
+    std::unique_ptr<Result> process( const Request& request ) override
+    {
+        Timer timer;
 
-        if ( vertex_queue[dir].empty() )
-            dir = 1 - dir;
+        boost::optional<CHVertex> origin = rd_.vertex_from_id( request.origin() );
+        boost::optional<CHVertex> destination = rd_.vertex_from_id( request.destination() );
 
-        CHVertex min_v = vertex_queue[dir].top();
-        vertex_queue[dir].pop();
-        CostType min_pi = get( potential_map[dir], min_v );
+        if ( rd_.section_index() && get_bool_option( "CH/phantom_nodes" ) && get_int_option( "CH/alternatives" ) == 0 &&
+             ( request.steps().front().coordinates() || request.steps().back().coordinates() ) ) {
+            select_graph( request.allowed_modes() );
+            return process_phantom_nodes( request, origin, destination );
+        }
 
-        {
-            CostType min_pi2 = get( potential_map[1-dir], min_v );
-            // if min_pi2 is not infinity, it means this node has already been seen
-            // in the other direction
-            // so it is a candidate top node
-            if ( min_pi + min_pi2 < total_cost ) {
-                top_node = min_v;
-                total_cost = min_pi + min_pi2;
-                path_found = true;
+        if ( !origin ) {
+            throw std::runtime_error( (boost::format("Can't find vertex of ID %1%") % request.origin()).str() );
+        }
+        if ( !destination ) {
+            throw std::runtime_error( (boost::format("Can't find vertex of ID %1%") % request.destination()).str() );
+        }
+        std::cout << "From " << request.origin() << " to " << request.destination() << std::endl;
+        if ( rd_.turn_graph() && get_bool_option( "CH/turn_restrictions" ) ) {
+            select_graph( request.allowed_modes() );
+            // a route of the node-based hierarchy may take forbidden turns
+            if ( metric_ != rd_.turn_graph_metric() ) {
+                throw std::runtime_error( (boost::format( "No edge-based hierarchy for the %1% metric, it has been built for %2%. "
+                                                          "Set CH/turn_restrictions to false to route without turn restrictions" )
+                                           % metric_ % rd_.turn_graph_metric()).str() );
             }
+            return process_turn_restrictions( request, origin.get(), destination.get() );
         }
-
-        if ( dir == 0 ) {
-            for ( auto oei = out_edges( min_v, graph ).first;
-                  oei != out_edges( min_v, graph ).second;
-                  oei++ ) {
-                CHVertex vv = target( *oei, graph );
-
-                CostType new_pi = get( potential_map[dir], vv );
-                CostType cost = get( weight_map, *oei );
-                if ( min_pi + cost < new_pi ) {
-                    // relax edge
-                    put( potential_map[dir], vv, min_pi + cost );
-                    vertex_queue[dir].push( vv );
-                    predecessor[dir][vv] = min_v;
-                }
+        if ( rd_.td_graph() && get_bool_option( "CH/time_dependent" ) && get_string_option( "CH/metric" ).empty() &&
+             request.allowed_modes().size() == 1 && request.allowed_modes()[0] == TransportModePrivateCar &&
+             request.steps()[1].constraint().type() == Request::TimeConstraint::ConstraintAfter &&
+             !has_cost_changes( TransportModePrivateCar ) ) {
+            return process_time_dependent( request, origin.get(), destination.get() );
+        }
+        select_graph( request.allowed_modes() );
+        const CHVertex graph_origin = graph_vertex( origin.get() );
+        const CHVertex graph_destination = graph_vertex( destination.get() );
+
+        bool stall_on_demand = get_bool_option( "CH/stall_on_demand" );
+        std::string queue = get_string_option( "CH/priority_queue" );
+
+        CHQueryStatistics stats;
+        // original edges of the shortest path, then of the alternatives
+        std::vector<std::vector<uint32_t>> paths;
+        const int64_t alternatives = get_int_option( "CH/alternatives" );
+        if ( alternatives > 0 ) {
+            CHAlternativeParameters params;
+            params.max_routes = size_t( alternatives ) + 1;
+            params.max_stretch = get_float_option( "CH/alternative_max_stretch" );
+            params.max_sharing = get_float_option( "CH/alternative_max_sharing" );
+            params.local_optimality = get_float_option( "CH/alternative_local_optimality" );
+            std::vector<CHRoute> routes;
+            if ( queue == "radix" ) {
+                CHQueryRadixWorkspacePool::Handle ws = parent_->radix_workspace_pool().borrow();
+                routes = ch_alternative_routes( *graph_, graph_origin, graph_destination, *ws, stall_on_demand, params, stats );
+            }
+            else if ( queue == "binary" ) {
+                CHQueryWorkspacePool::Handle ws = parent_->workspace_pool().borrow();
+                routes = ch_alternative_routes( *graph_, graph_origin, graph_destination, *ws, stall_on_demand, params, stats );
+            }
+            else {
+                throw std::invalid_argument( "Unknown priority queue " + queue );
+            }
+            for ( CHRoute& route : routes ) {
+                paths.push_back( std::move( route.edges ) );
             }
         }
         else {
-            for ( auto iei = in_edges( min_v, graph ).first;
-                  iei != in_edges( min_v, graph ).second;
-                  iei++ ) {
-                CHVertex vv = source( *iei, graph );
-
-                CostType new_pi = get( potential_map[dir], vv );
-                CostType cost = get( weight_map, *iei );
-                if ( min_pi + cost < new_pi ) {
-                    // relax edge
-                    put( potential_map[dir], vv, min_pi + cost );
-                    vertex_queue[dir].push( vv );
-                    predecessor[dir][vv] = min_v;
-                }
+            boost::optional<float> cost;
+            std::vector<uint32_t> path;
+            if ( queue == "radix" ) {
+                CHQueryRadixWorkspacePool::Handle ws = parent_->radix_workspace_pool().borrow();
+                cost = ch_query( *graph_, graph_origin, graph_destination, *ws, stall_on_demand, unpack_cache_, stats, path );
+            }
+            else if ( queue == "binary" ) {
+                CHQueryWorkspacePool::Handle ws = parent_->workspace_pool().borrow();
+                cost = ch_query( *graph_, graph_origin, graph_destination, *ws, stall_on_demand, unpack_cache_, stats, path );
+            }
+            else {
+                throw std::invalid_argument( "Unknown priority queue " + queue );
+            }
+            if ( cost ) {
+                paths.push_back( std::move( path ) );
             }
         }
-    }
 
-    if ( !path_found ) {
-        //std::cout << "NO PATH FOUND" << std::endl;
-        return returned_path;
-    }
-    //std::cout << "PATH FOUND" << std::endl;
+        if ( paths.empty() ) {
+            throw std::runtime_error( "No path found !" );
+        }
+
+        metrics_[ "time_s" ] = Variant::from_float( timer.elapsed() );
+        metrics_[ "settled_nodes" ] = Variant::from_int( stats.settled_nodes );
+        metrics_[ "stalled_nodes" ] = Variant::from_int( stats.stalled_nodes );
+
+        std::unique_ptr<Result> result( new Result() );
+        Db::Connection connection( plugin_->db_options() );
+        for ( const std::vector<uint32_t>& path : paths ) {
+            result->push_back( Roadmap() );
+            Roadmap& roadmap = result->back();
+
+            roadmap.set_starting_date_time( request.steps()[1].constraint().date_time() );
 
-    // path from origin (s) to top node (x)
-    // s = p[p[p[p[p[...[x]]]]]] , ..., p[x], x
-    //std::cout << "top node " << node_id[top_node] << std::endl;
+            std::auto_ptr<Roadmap::Step> step;
 
-    std::list<CHVertex> path;
-    CHVertex x = top_node;
-    while (x != origin)
+            for ( uint32_t e : path ) {
+                step.reset( new Roadmap::RoadStep() );
+                step->set_cost( cost_id_, graph_->edge_property( e ).b.cost * cost_factor_ );
+                step->set_transport_mode( mode_ );
+                Roadmap::RoadStep* rstep = static_cast<Roadmap::RoadStep*>(step.get());
+                rstep->set_road_edge_id( graph_->edge_details( e ).db_id );
+                roadmap.add_step( step );
+            }
+
+            fill_roadmap_from_db( roadmap.begin(), roadmap.end(), connection );
+        }
+        return std::move( result );
+    }
+
+    std::unique_ptr<CostMatrix> process_matrix( const CostMatrixRequest& request ) override
     {
-        returned_path.push_front( x );
-        auto it = predecessor[0].find( x );
-        BOOST_ASSERT_MSG( it != predecessor[0].end(), "Can't find upward predecessor" );
-        x = it->second;
+        Timer timer;
+        select_graph( request.allowed_modes() );
+
+        auto to_ch_vertices = [this]( const std::vector<db_id_t>& ids ) {
+            std::vector<CHVertex> vertices;
+            vertices.reserve( ids.size() );
+            for ( db_id_t id : ids ) {
+                boost::optional<CHVertex> v = rd_.vertex_from_id( id );
+                if ( !v ) {
+                    throw std::runtime_error( (boost::format("Can't find vertex of ID %1%") % id).str() );
+                }
+                vertices.push_back( graph_vertex( v.get() ) );
+            }
+            return vertices;
+        };
+        std::vector<CHVertex> sources = to_ch_vertices( request.origins() );
+        std::vector<CHVertex> targets = to_ch_vertices( request.destinations() );
+
+        std::string queue = get_string_option( "CH/priority_queue" );
+        CHQueryStatistics stats;
+        std::unique_ptr<CostMatrix> matrix;
+        const CHHubLabels* labels = version_->hub_labels.get();
+        if ( labels && !targets.empty() && get_bool_option( "CH/use_hub_labels" ) ) {
+            matrix = hub_label_matrix( request, sources, targets, *labels );
+        }
+        else if ( queue == "radix" ) {
+            matrix = compute_matrix( request, sources, targets, parent_->radix_workspace_pool(), stats );
+        }
+        else if ( queue == "binary" ) {
+            matrix = compute_matrix( request, sources, targets, parent_->workspace_pool(), stats );
+        }
+        else {
+            throw std::invalid_argument( "Unknown priority queue " + queue );
+        }
+
+        metrics_[ "time_s" ] = Variant::from_float( timer.elapsed() );
+        metrics_[ "settled_nodes" ] = Variant::from_int( stats.settled_nodes );
+        metrics_[ "stalled_nodes" ] = Variant::from_int( stats.stalled_nodes );
+
+        return matrix;
     }
-    returned_path.push_front( origin );
 
-    // path from destination (t) to top node (x)
-    // t = p[p[p[p[p[...[x]]]]]] , ..., p[x], x
-    CHVertex t = top_node;
-    while ( t != destination )
+private:
+    ///
+    /// Cost matrix between sources and targets from the hub labels of the graph, without any search
+    std::unique_ptr<CostMatrix> hub_label_matrix( const CostMatrixRequest& request,
+                                                  const std::vector<CHVertex>& sources,
+                                                  const std::vector<CHVertex>& targets,
+                                                  const CHHubLabels& labels )
     {
-        auto it = predecessor[1].find( t );
-        BOOST_ASSERT_MSG( it != predecessor[0].end(), "Can't find downward predecessor" );
-        t = it->second;
-        returned_path.push_back( t );
+        std::vector<uint32_t> costs( sources.size() * targets.size() );
+        #pragma omp parallel for schedule(dynamic, 1) if ( sources.size() * targets.size() > 1024 )
+        for ( int i = 0; i < int( sources.size() ); i++ ) {
+            for ( size_t j = 0; j < targets.size(); j++ ) {
+                costs[i * targets.size() + j] = labels.distance( sources[i], targets[j] );
+            }
+        }
+
+        std::unique_ptr<CostMatrix> matrix( new CostMatrix( request.origins(), request.destinations() ) );
+        for ( size_t i = 0; i < sources.size(); i++ ) {
+            for ( size_t j = 0; j < targets.size(); j++ ) {
+                uint32_t c = costs[i * targets.size() + j];
+                if ( c != CHHubLabels::infinity() ) {
+                    matrix->set_cost( i, j, float(c * cost_factor_) );
+                }
+            }
+        }
+        metrics_[ "hub_label_queries" ] = Variant::from_int( int64_t( costs.size() ) );
+        return matrix;
     }
 
-    ret_cost = total_cost;
-    return returned_path;
-}
+    ///
+    /// Route on the edge-based hierarchy, that takes turn restrictions into account
+    std::unique_ptr<Result> process_turn_restrictions( const Request& request, CHVertex origin, CHVertex destination )
+    {
+        Timer timer;
+        const CHTurnGraph& turn_graph = *rd_.turn_graph();
+        bool stall_on_demand = get_bool_option( "CH/stall_on_demand" );
+        std::string queue = get_string_option( "CH/priority_queue" );
+
+        CHQueryStatistics stats;
+        boost::optional<float> cost;
+        CHVertex first_section = 0;
+        std::vector<uint32_t> turns;
+        if ( origin == destination ) {
+            cost = 0.0f;
+        }
+        else if ( queue == "radix" ) {
+            CHQueryRadixWorkspacePool::Handle ws = parent_->turn_radix_workspace_pool()->borrow();
+            cost = turn_ch_query( turn_graph, origin, destination, *ws, stall_on_demand, stats, first_section, turns );
+        }
+        else if ( queue == "binary" ) {
+            CHQueryWorkspacePool::Handle ws = parent_->turn_workspace_pool()->borrow();
+            cost = turn_ch_query( turn_graph, origin, destination, *ws, stall_on_demand, stats, first_section, turns );
+        }
+        else {
+            throw std::invalid_argument( "Unknown priority queue " + queue );
+        }
 
-std::pair<std::list<CHVertex>, float> ch_query( const CHRoutingData& rd, CHVertex ch_origin, CHVertex ch_destination )
-{
-    std::pair<std::list<CHVertex>, float> ret;
+        if ( !cost ) {
+            throw std::runtime_error( "No path found !" );
+        }
 
-    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
-        return float(e.property().b.cost / 100.0);
-    };
-    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, float, decltype(weight_map_fn)>( weight_map_fn );
-    float ret_cost = std::numeric_limits<float>::max();
-    auto path = bidirectional_ch_dijkstra( rd, ch_origin, ch_destination, weight_map, ret_cost );
+        metrics_[ "time_s" ] = Variant::from_float( timer.elapsed() );
+        metrics_[ "settled_nodes" ] = Variant::from_int( stats.settled_nodes );
+        metrics_[ "stalled_nodes" ] = Variant::from_int( stats.stalled_nodes );
 
-    auto& ret_path = ret.first;
-    unpack_path( path.begin(), path.end(), rd.middle_node(), std::back_inserter( ret_path ) );
-    ret.second = ret_cost;
+        std::unique_ptr<Result> result( new Result() );
+        result->push_back( Roadmap() );
+        Roadmap& roadmap = result->back();
+        roadmap.set_starting_date_time( request.steps()[1].constraint().date_time() );
 
-    return ret;
-}
+        // the first section, then the section each turn leads to, with the penalty of the turn
+        auto add_step = [&]( uint32_t step_cost, db_id_t section ) {
+            std::auto_ptr<Roadmap::Step> step( new Roadmap::RoadStep() );
+            step->set_cost( cost_id_, step_cost * cost_factor_ );
+            step->set_transport_mode( mode_ );
+            static_cast<Roadmap::RoadStep*>(step.get())->set_road_edge_id( section );
+            roadmap.add_step( step );
+        };
+        if ( origin != destination ) {
+            add_step( turn_graph.turn_vertex( first_section ).cost, turn_graph.turn_vertex( first_section ).db_id );
+        }
+        for ( uint32_t e : turns ) {
+            add_step( turn_graph.query_graph().edge_property( e ).b.cost, turn_graph.query_graph().edge_details( e ).db_id );
+        }
 
-class CHPluginRequest : public PluginRequest
-{
-private:
-    const CHRoutingData& rd_;
-public:
-    CHPluginRequest( const CHPlugin* parent, const VariantMap& options, const CHRoutingData& rd )
-        : PluginRequest( parent, options), rd_(rd)
-    {}
+        Db::Connection connection( plugin_->db_options() );
+        fill_roadmap_from_db( roadmap.begin(), roadmap.end(), connection );
+        return result;
+    }
 
-    std::unique_ptr<Result> process( const Request& request ) override
+    ///
+    /// Costs of a section of the index in the metric of the request, null if unknown
+    const CHSectionCosts* section_costs( uint32_t section ) const
     {
-        Timer timer;
+        return section_costs_ ? &( *section_costs_ )[section] : nullptr;
+    }
 
-        boost::optional<CHVertex> origin = rd_.vertex_from_id( request.origin() );
-        boost::optional<CHVertex> destination = rd_.vertex_from_id( request.destination() );
+    ///
+    /// Section of the index, between vertices of the graph of the request
+    CHSection graph_section( const CHSectionIndex& index, uint32_t section ) const
+    {
+        CHSection s = index.section( section );
+        s.from = graph_vertex( s.from );
+        s.to = graph_vertex( s.to );
+        return s;
+    }
 
-        if ( !origin ) {
-            throw std::runtime_error( (boost::format("Can't find vertex of ID %1%") % request.origin()).str() );
+    ///
+    /// Cost from an origin to a destination along their section, none if they are not on the same section
+    /// or if the section cannot be traveled from the origin to the destination
+    boost::optional<uint32_t> direct_phantom_cost( const CHSectionIndex& index,
+                                                   const boost::optional<CHPhantomNode>& origin,
+                                                   const boost::optional<CHPhantomNode>& destination ) const
+    {
+        if ( !origin || !destination || origin->section != destination->section ) {
+            return boost::none;
         }
-        if ( !destination ) {
-            throw std::runtime_error( (boost::format("Can't find vertex of ID %1%") % request.destination()).str() );
+        const float delta = destination->ratio - origin->ratio;
+        const boost::optional<uint32_t> c = section_cost( *version_, graph_section( index, origin->section ), section_costs( origin->section ), delta >= 0 );
+        if ( !c ) {
+            return boost::none;
         }
-        std::cout << "From " << request.origin() << " to " << request.destination() << std::endl;
-
-        auto ch_ret = ch_query( rd_, origin.get(), destination.get() );
-        auto& ch_graph = rd_.ch_query();
+        return uint32_t( c.get() * std::abs( delta ) + 0.5f );
+    }
 
-        auto& path = ch_ret.first;
+    ///
+    /// Route between the road sections nearest to the coordinates of the request, starting and ending part-way along them.
+    /// A step without coordinates, or too far from any section, is its road node
+    std::unique_ptr<Result> process_phantom_nodes( const Request& request, boost::optional<CHVertex> origin, boost::optional<CHVertex> destination )
+    {
+        Timer timer;
+        const CHSectionIndex& index = *rd_.section_index();
+        const float max_distance = float( get_float_option( "CH/snap_max_distance" ) );
+        bool stall_on_demand = get_bool_option( "CH/stall_on_demand" );
+        std::string queue = get_string_option( "CH/priority_queue" );
+
+        auto endpoints = [&]( const Request::Step& step, boost::optional<CHVertex> vertex, bool is_origin, boost::optional<CHPhantomNode>& phantom ) {
+            std::vector<std::pair<CHVertex, uint32_t>> e;
+            if ( step.coordinates() ) {
+                phantom = index.nearest( step.coordinates()->x(), step.coordinates()->y(), max_distance );
+            }
+            if ( phantom ) {
+                e = phantom_endpoints( *version_, graph_section( index, phantom->section ), section_costs( phantom->section ), phantom->ratio, is_origin );
+            }
+            if ( e.empty() ) {
+                // no section nearby, or it cannot be traveled
+                phantom.reset();
+                if ( !vertex ) {
+                    throw std::runtime_error( (boost::format("Can't find vertex of ID %1%") % step.location()).str() );
+                }
+                e.push_back( std::make_pair( graph_vertex( vertex.get() ), uint32_t( 0 ) ) );
+            }
+            return e;
+        };
+        boost::optional<CHPhantomNode> origin_phantom, destination_phantom;
+        const std::vector<std::pair<CHVertex, uint32_t>> sources = endpoints( request.steps().front(), origin, true, origin_phantom );
+        const std::vector<std::pair<CHVertex, uint32_t>> targets = endpoints( request.steps().back(), destination, false, destination_phantom );
+
+        CHQueryStatistics stats;
+        boost::optional<float> cost;
+        CHVertex path_source = 0, path_target = 0;
+        std::vector<uint32_t> path;
+        if ( queue == "radix" ) {
+            CHQueryRadixWorkspacePool::Handle ws = parent_->radix_workspace_pool().borrow();
+            cost = multi_endpoint_ch_query( *graph_, sources, targets, *ws, stall_on_demand, unpack_cache_, stats, path_source, path_target, path );
+        }
+        else if ( queue == "binary" ) {
+            CHQueryWorkspacePool::Handle ws = parent_->workspace_pool().borrow();
+            cost = multi_endpoint_ch_query( *graph_, sources, targets, *ws, stall_on_demand, unpack_cache_, stats, path_source, path_target, path );
+        }
+        else {
+            throw std::invalid_argument( "Unknown priority queue " + queue );
+        }
 
-        if ( path.empty() ) {
+        // both ends on the same section, the destination being ahead of the origin
+        const boost::optional<uint32_t> direct_cost = direct_phantom_cost( index, origin_phantom, destination_phantom );
+        if ( !cost && !direct_cost ) {
             throw std::runtime_error( "No path found !" );
         }
 
         metrics_[ "time_s" ] = Variant::from_float( timer.elapsed() );
+        metrics_[ "settled_nodes" ] = Variant::from_int( stats.settled_nodes );
+        metrics_[ "stalled_nodes" ] = Variant::from_int( stats.stalled_nodes );
 
         std::unique_ptr<Result> result( new Result() );
         result->push_back( Roadmap() );
         Roadmap& roadmap = result->back();
-
         roadmap.set_starting_date_time( request.steps()[1].constraint().date_time() );
 
-        std::auto_ptr<Roadmap::Step> step;
-
-        Road::Edge current_road;
-        auto prev = path.begin();
-        auto it = prev;
-        it++;
+        auto add_step = [&]( uint32_t step_cost, db_id_t section ) {
+            std::auto_ptr<Roadmap::Step> step( new Roadmap::RoadStep() );
+            step->set_cost( cost_id_, step_cost * cost_factor_ );
+            step->set_transport_mode( mode_ );
+            static_cast<Roadmap::RoadStep*>(step.get())->set_road_edge_id( section );
+            roadmap.add_step( step );
+        };
+        // initial cost of the end of a path
+        auto endpoint_cost = []( const std::vector<std::pair<CHVertex, uint32_t>>& e, CHVertex v ) {
+            uint32_t c = std::numeric_limits<uint32_t>::max();
+            for ( const auto& p : e ) {
+                if ( p.first == v ) {
+                    c = std::min( c, p.second );
+                }
+            }
+            return c;
+        };
+        if ( direct_cost && ( !cost || direct_cost.get() <= cost.get() ) ) {
+            add_step( direct_cost.get(), index.section( origin_phantom->section ).db_id );
+        }
+        else {
+            if ( origin_phantom ) {
+                add_step( endpoint_cost( sources, path_source ), index.section( origin_phantom->section ).db_id );
+            }
+            for ( uint32_t e : path ) {
+                add_step( graph_->edge_property( e ).b.cost, graph_->edge_details( e ).db_id );
+            }
+            if ( destination_phantom ) {
+                add_step( endpoint_cost( targets, path_target ), index.section( destination_phantom->section ).db_id );
+            }
+        }
 
-        for ( ; it != path.end(); ++it, ++prev) {
-            CHVertex v = *it;
-            CHVertex previous = *prev;
+        Db::Connection connection( plugin_->db_options() );
+        fill_roadmap_from_db( roadmap.begin(), roadmap.end(), connection );
+        return result;
+    }
 
-            // Find an edge, based on a source and destination vertex
-            CHEdge e;
-            bool found = false;
-            boost::tie( e, found ) = edge( previous, v, ch_graph );
+    ///
+    /// Car route departing after the time of the request, on the time-dependent hierarchy.
+    /// Its travel time functions are the ones of the preprocessing, cost changes are not applied (see has_cost_changes())
+    std::unique_ptr<Result> process_time_dependent( const Request& request, CHVertex origin, CHVertex destination )
+    {
+        Timer timer;
+        const TDCHGraph& graph = *rd_.td_graph();
+        // vertices of the time-dependent graph are the ones of the metric whose node ordering it has been contracted in
+        const CHMetricRanks* td_ranks = rd_.metric_ranks( rd_.td_graph_metric() );
+        if ( td_ranks ) {
+            origin = td_ranks->rank[origin];
+            destination = td_ranks->rank[destination];
+        }
+        const DateTime departure_date_time = request.steps()[1].constraint().date_time();
+        const double departure = departure_date_time.time_of_day().total_seconds() / 60.0;
 
-            if ( !found ) {
-                std::cout << "Cannot find edge (" << rd_.vertex_id( previous ) << "->" << rd_.vertex_id( v ) << ")" << std::endl;
+        CHQueryStatistics stats;
+        std::vector<std::pair<uint32_t, uint32_t>> path;
+        std::vector<TDPathEdge> road_edges;
+        {
+            TDCHQueryWorkspacePool::Handle ws = parent_->td_workspace_pool().borrow();
+            if ( !td_ch_query( graph, origin, destination, departure, *ws, stats, path ) ) {
+                throw std::runtime_error( "No path found !" );
             }
-            BOOST_ASSERT( found );
+        }
+        td_unpack_path( graph, path, departure, road_edges );
 
+        metrics_[ "time_s" ] = Variant::from_float( timer.elapsed() );
+        metrics_[ "settled_nodes" ] = Variant::from_int( stats.settled_nodes );
+        metrics_[ "stalled_nodes" ] = Variant::from_int( 0 );
+
+        std::unique_ptr<Result> result( new Result() );
+        result->push_back( Roadmap() );
+        Roadmap& roadmap = result->back();
+        roadmap.set_starting_date_time( departure_date_time );
+
+        std::auto_ptr<Roadmap::Step> step;
+        for ( const TDPathEdge& e : road_edges ) {
             step.reset( new Roadmap::RoadStep() );
-            step->set_cost( CostId::CostDistance, e.property().b.cost / 100.0 );
-            step->set_transport_mode(1);
+            step->set_cost( CostId::CostDuration, e.travel_time );
+            step->set_transport_mode( TransportModePrivateCar );
             Roadmap::RoadStep* rstep = static_cast<Roadmap::RoadStep*>(step.get());
-            rstep->set_road_edge_id( e.property().db_id );
+            rstep->set_road_edge_id( graph.edge( e.edge ).db_id );
             roadmap.add_step( step );
         }
 
         Db::Connection connection( plugin_->db_options() );
         fill_roadmap_from_db( roadmap.begin(), roadmap.end(), connection );
-        return std::move( result );
+        return result;
+    }
+
+    ///
+    /// Cost matrix between sources and targets.
+    /// Without target, costs to every vertex are computed by means of PHAST (one-to-all)
+    /// and columns are vertices reached by at least one source, within the maximum cost if any (isochrone).
+    template <typename Workspace>
+    std::unique_ptr<CostMatrix> compute_matrix( const CostMatrixRequest& request,
+                                                const std::vector<CHVertex>& sources,
+                                                const std::vector<CHVertex>& targets,
+                                                CHSearchWorkspacePool<Workspace>& pool,
+                                                CHQueryStatistics& stats )
+    {
+        bool stall_on_demand = get_bool_option( "CH/stall_on_demand" );
+
+        // integer costs of the CH graph
+        auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+            return uint32_t(e.property().b.cost);
+        };
+        auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+        if ( !targets.empty() ) {
+            std::vector<uint32_t> costs = ch_many_to_many( *graph_, sources, targets, weight_map, pool, stall_on_demand, stats );
+
+            std::unique_ptr<CostMatrix> matrix( new CostMatrix( request.origins(), request.destinations() ) );
+            for ( size_t i = 0; i < sources.size(); i++ ) {
+                for ( size_t j = 0; j < targets.size(); j++ ) {
+                    uint32_t c = costs[i * targets.size() + j];
+                    if ( c != Workspace::infinity() ) {
+                        matrix->set_cost( i, j, float(c * cost_factor_) );
+                    }
+                }
+            }
+            return matrix;
+        }
+
+        const size_t n = num_vertices( *graph_ );
+        // several sources are swept at once by the multi-source version
+        std::vector<uint32_t> costs = sources.size() > 1
+            ? ch_one_to_all_batch<16>( *graph_, sources, weight_map, pool, stall_on_demand, stats )
+            : ch_one_to_all( *graph_, sources, weight_map, pool, stall_on_demand, stats );
+
+        double max_cost = get_float_option( "CH/max_cost" );
+        uint32_t limit = max_cost > 0 ? uint32_t( max_cost / cost_factor_ ) : Workspace::infinity() - 1;
+
+        std::vector<CHVertex> columns;
+        std::vector<db_id_t> destinations;
+        for ( size_t v = 0; v < n; v++ ) {
+            for ( size_t i = 0; i < sources.size(); i++ ) {
+                if ( costs[i * n + v] <= limit ) {
+                    columns.push_back( CHVertex(v) );
+                    destinations.push_back( rd_.vertex_id( ch_vertex( CHVertex(v) ) ) );
+                    break;
+                }
+            }
+        }
+
+        std::unique_ptr<CostMatrix> matrix( new CostMatrix( request.origins(), destinations ) );
+        for ( size_t i = 0; i < sources.size(); i++ ) {
+            for ( size_t j = 0; j < columns.size(); j++ ) {
+                uint32_t c = costs[i * n + columns[j]];
+                if ( c <= limit ) {
+                    matrix->set_cost( i, j, float(c * cost_factor_) );
+                }
+            }
+        }
+        return matrix;
     }
 };
 
 
 std::unique_ptr<PluginRequest> CHPlugin::request( const VariantMap& options ) const
 {
+    // a request uses the graph versions that are current when it starts, cost changes are reloaded by watch_cost_changes_()
     return std::unique_ptr<PluginRequest>( new CHPluginRequest( this, options, *rd_ ) );
 }
 
@@ -17,12 +17,29 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
 #include "plugin.hh"
 #include "ch_routing_data.hh"
+#include "ch_customizer.hh"
+#include "ch_hub_labels.hh"
+#include "ch_search_workspace.hh"
+#include "utils/radix_heap.hh"
 
 namespace Tempus
 {
 
+using CHQueryWorkspace = CHSearchWorkspace<uint32_t, CHVertex>;
+using CHQueryWorkspacePool = CHSearchWorkspacePool<CHQueryWorkspace>;
+using CHQueryRadixWorkspace = CHSearchWorkspace<uint32_t, CHVertex, RadixHeap<uint32_t, CHVertex>>;
+using CHQueryRadixWorkspacePool = CHSearchWorkspacePool<CHQueryRadixWorkspace>;
+// costs of time-dependent queries are arrival times (minutes)
+using TDCHQueryWorkspace = CHSearchWorkspace<double, CHVertex>;
+using TDCHQueryWorkspacePool = CHSearchWorkspacePool<TDCHQueryWorkspace>;
+
 class CHPlugin : public Plugin
 {
 public:
@@ -32,12 +49,64 @@ public:
 
     CHPlugin( ProgressionCallback& progression, const VariantMap& options );
 
+    ///
+    /// Stop the thread that reloads the cost changes
+    virtual ~CHPlugin();
+
     const RoutingData* routing_data() const override { return rd_; }
 
     std::unique_ptr<PluginRequest> request( const VariantMap& options = VariantMap() ) const override;
 
+    ///
+    /// Search workspaces, borrowed by each request
+    CHQueryWorkspacePool& workspace_pool() const { return *workspace_pool_; }
+    CHQueryRadixWorkspacePool& radix_workspace_pool() const { return *radix_workspace_pool_; }
+    TDCHQueryWorkspacePool& td_workspace_pool() const { return *td_workspace_pool_; }
+    /// On the edge-based hierarchy, null if none
+    CHQueryWorkspacePool* turn_workspace_pool() const { return turn_workspace_pool_.get(); }
+    CHQueryRadixWorkspacePool* turn_radix_workspace_pool() const { return turn_radix_workspace_pool_.get(); }
+
+    ///
+    /// Current version of the graph of a metric, the default one if the name is empty or is the default metric name.
+    /// Its unpack cache is null if the ch/unpack_cache_size option is not set, its hub labels if the ch/hub_labels option is not set.
+    /// Throws std::invalid_argument on an unknown metric
+    std::shared_ptr<const CHGraphVersion> graph_version( const std::string& metric ) const { return versions_->current( metric ); }
+
+    ///
+    /// Update the costs of road sections of a metric (see CHCustomizer), then publish the new version of its graph.
+    /// Running requests go on with the version they have started with. Concurrent updates are serialized.
+    /// Throws std::invalid_argument on an unknown metric
+    CHCustomizationStatistics update_costs( const std::string& metric, const std::vector<CHCostChange>& changes ) { return versions_->update_costs( metric, changes ); }
+
+    ///
+    /// Same with the changes of a file (see read_ch_cost_changes()).
+    /// Throws std::runtime_error if the file cannot be read
+    CHCustomizationStatistics update_costs_from_file( const std::string& metric, const std::string& filename );
+
+    ///
+    /// Apply the changes of the ch/cost_changes file if it has been modified since they have last been applied.
+    /// Called by a background thread every ch/cost_changes_interval seconds, requests only read the current graph versions.
+    /// \returns whether the changes have been applied
+    /// Throws std::runtime_error if the file cannot be read
+    bool reload_cost_changes() const;
+
 private:
     const CHRoutingData* rd_;
+    std::unique_ptr<CHQueryWorkspacePool> workspace_pool_;
+    std::unique_ptr<CHQueryRadixWorkspacePool> radix_workspace_pool_;
+    std::unique_ptr<TDCHQueryWorkspacePool> td_workspace_pool_;
+    std::unique_ptr<CHQueryWorkspacePool> turn_workspace_pool_;
+    std::unique_ptr<CHQueryRadixWorkspacePool> turn_radix_workspace_pool_;
+    std::unique_ptr<CHGraphVersions> versions_;
+    // file of the ch/cost_changes option, null if none
+    std::unique_ptr<CHCostChangesFile> cost_changes_;
+
+    // reloads the cost changes until the plugin is destroyed
+    void watch_cost_changes_( double interval );
+    std::thread cost_changes_thread_;
+    std::mutex cost_changes_mutex_;
+    std::condition_variable cost_changes_stop_;
+    bool stopping_ = false;
 };
 
 } // namespace Tempus
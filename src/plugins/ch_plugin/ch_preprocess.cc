@@ -22,16 +22,20 @@
 #include "utils/timer.hh"
 
 #include <chrono>
-#include <unordered_set>
-#include <queue>
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+#include <boost/heap/d_ary_heap.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace Tempus;
 using namespace std;
 
-using TTargetSet = std::set<CHVertex>;
-
 using TNodeContractionCost = int;
-using TRemainingNodeSet = std::unordered_set<CHVertex>;
 
 struct TEdge
 {
@@ -57,19 +61,143 @@ void add_edge_or_update( CHGraph& graph, CHVertex u, CHVertex v, TCost cost )
 // Actually reducing the graph seems a bit faster
 #define REDUCE_GRAPH 1
 
-map<CHVertex, TCost> witness_search(const CHGraph& graph, CHVertex contracted_node, CHVertex source, const TTargetSet& targets, TCost cutoff, int& search_space)
+///
+/// Witness search engine.
+///
+/// Dijkstra from one source to multiple targets, ignoring the node being contracted.
+/// All the storage is allocated once for the whole graph and reused between searches:
+/// a cost is only valid if its stamp equals the stamp of the current search, and targets
+/// are marked in a bitset that is cleared at the end of each search.
+/// An engine is used by one thread at a time.
+class WitnessSearch
 {
+public:
+    WitnessSearch( size_t n_vertices, const WitnessSearchLimits& limits )
+        : cost_( n_vertices ), stamp_( n_vertices, 0 ), target_bits_( (n_vertices + 63) / 64, 0 ),
+          current_stamp_( 0 ), limits_( limits )
+    {}
+
+    ///
+    /// Run a search from source
+    /// \param[in] contracted_node The node to ignore
+    /// \param[in] targets The targets. The search stops when all of them are settled
+    /// \param[in] cutoff Do not search beyond this cost, if not null
+    /// \param[out] search_space Maximum number of nodes of a relaxed path, source included (used for node ordering)
+    void run( const CHGraph& graph, CHVertex contracted_node, CHVertex source, const vector<CHVertex>& targets, TCost cutoff, int& search_space )
+    {
+        REQUIRE(!targets.empty());
+
+        new_search_();
+        heap_.clear();
+
+        size_t remaining_targets = 0;
+        for ( CHVertex t : targets ) {
+            if ( !is_target_( t ) ) {
+                set_target_( t, true );
+                remaining_targets++;
+            }
+        }
+
+        set_cost_( source, 0 );
+        search_space = 1;
+        int order = 0;
+        int settled = 0;
+        heap_.push_back( {source, 0, 0, order++} );
+
+        while ( !heap_.empty() )
+        {
+            pop_heap( heap_.begin(), heap_.end(), CompareNode() );
+            DijkstraNode top = heap_.back();
+            heap_.pop_back();
+
+            if ( top.cost > cost( top.node ) ) {
+                // outdated entry
+                continue;
+            }
+
+            if ( is_target_( top.node ) ) {
+                // found one of the targets, unmark it so that it is counted once
+                set_target_( top.node, false );
+                if ( --remaining_targets == 0 ) {
+                    break;
+                }
+            }
+
+            if ( limits_.max_settled && ++settled >= limits_.max_settled ) {
+                break;
+            }
+            if ( limits_.max_hops && top.hops >= limits_.max_hops ) {
+                // do not go further from this node
+                continue;
+            }
+
+            for ( auto succ : pair_range( out_edges( top.node, graph ) ) )
+            {
+                CHVertex successor_node = target( succ, graph );
+#if REDUCE_GRAPH
+                if( successor_node == contracted_node ) // ignore contracted node
+                    continue;
+#else
+                if( successor_node <= contracted_node ) // ignore contracted node and lower nodes
+                    continue;
+#endif
+
+                TCost vu_cost = top.cost + graph[succ].weight;
+                if(cutoff && vu_cost > cutoff) // do not search beyond 'cutoff'
+                {
+                    continue;
+                }
+
+                if( vu_cost < cost( successor_node ) )
+                {
+                    set_cost_( successor_node, vu_cost );
+                    heap_.push_back( {successor_node, vu_cost, top.hops + 1, order++} );
+                    push_heap( heap_.begin(), heap_.end(), CompareNode() );
+
+                    // a path of n edges has n + 1 nodes
+                    if(top.hops + 2 > search_space)
+                        search_space = top.hops + 2;
+                }
+            }
+        }
+
+        // clear targets not found
+        if ( remaining_targets ) {
+            for ( CHVertex t : targets ) {
+                set_target_( t, false );
+            }
+        }
+    }
+
+    ///
+    /// Cost of the best path found from the source during the last search.
+    /// When a search is stopped by limits, it is the cost of a path, but not necessarily the shortest one.
+    /// Returns max TCost if the node has not been reached
+    TCost cost( CHVertex v ) const
+    {
+        return stamp_[v] == current_stamp_ ? cost_[v] : std::numeric_limits<TCost>::max();
+    }
+
+    ///
+    /// Scratch storage of targets, for the caller
+    vector<CHVertex>& targets_buffer() { return targets_buffer_; }
+
+    ///
+    /// Scratch storage of shortcuts, for the caller
+    vector<TEdge>& shortcuts_buffer() { return shortcuts_buffer_; }
+
+private:
     struct DijkstraNode
     {
         CHVertex node;
         TCost cost;
+        /// Number of edges from the source
         int hops;
         int order;
     };
 
-    class CompareNode
+    struct CompareNode
     {
-    public:
         bool operator()(const DijkstraNode& node1, const DijkstraNode& node2) const
         {
             // node2 has higher priority if it has a smaller cost
@@ -78,86 +206,89 @@ map<CHVertex, TCost> witness_search(const CHGraph& graph, CHVertex contracted_no
         }
     };
 
-    // Dijkstra from one source to multiple targets.
-    REQUIRE(!targets.empty());
-
-    TTargetSet found; // targets found
-    map<CHVertex, TCost> relaxed; // minimal costs of relaxed nodes (from 'source')
-    relaxed[source] = 0; // the cost from 'source' to 'source' is 0
-    search_space = 1; // search-space of Dijkstra (used for node-ordering)
-
-    int order = 0;
-#if 1
-    priority_queue<DijkstraNode, vector<DijkstraNode>, CompareNode> heap; // priority queue
-#else
-    CompareNode cmp;
-    boost::heap::d_ary_heap< DijkstraNode, boost::heap::arity<2>, boost::heap::compare< CompareNode >, boost::heap::mutable_<true> > heap( cmp );
-#endif
-    heap.push( {source, 0, 1, order++} );
+    void new_search_()
+    {
+        current_stamp_++;
+        if ( current_stamp_ == 0 ) {
+            // wrap around
+            std::fill( stamp_.begin(), stamp_.end(), 0 );
+            current_stamp_ = 1;
+        }
+    }
 
-    while( !heap.empty() )
+    void set_cost_( CHVertex v, TCost c )
     {
-        // Get less costly node in priority queue:
-        const DijkstraNode& top = heap.top();
-        CHVertex node = top.node;
-        TCost cost = top.cost;
-        int num_hops = top.hops;
-        heap.pop();
-
-        if( targets.find( node ) != targets.end() ) // found one of the targets
-        {
-            found.emplace( node );
+        cost_[v] = c;
+        stamp_[v] = current_stamp_;
+    }
 
-            if( found == targets ) // all targets have been found
-            {
-                break;
-            }
-        }
+    bool is_target_( CHVertex v ) const
+    {
+        return ( target_bits_[v / 64] >> ( v % 64 ) ) & 1;
+    }
 
-        for ( auto succ : pair_range( out_edges( node, graph ) ) )
-        {
-            CHVertex successor_node = target( succ, graph );
-#if REDUCE_GRAPH
-            if( successor_node == contracted_node ) // ignore contracted node
-                continue;
-#else
-            if( successor_node <= contracted_node ) // ignore contracted node and lower nodes
-                continue;
-#endif
+    void set_target_( CHVertex v, bool b )
+    {
+        if ( b )
+            target_bits_[v / 64] |= uint64_t(1) << ( v % 64 );
+        else
+            target_bits_[v / 64] &= ~( uint64_t(1) << ( v % 64 ) );
+    }
 
-            TCost vu_cost = cost + graph[succ].weight;
-            if(cutoff && vu_cost > cutoff) // do not search beyond 'cutoff'
-            {
-                continue;
-            }
+    vector<TCost> cost_;
+    vector<uint32_t> stamp_;
+    vector<uint64_t> target_bits_;
+    vector<DijkstraNode> heap_;
+    uint32_t current_stamp_;
+    WitnessSearchLimits limits_;
 
-            auto iter = relaxed.find( successor_node );
-            if( iter == relaxed.end() || vu_cost < iter->second )
-            {
-                // Add node to priority queue:
-                heap.push( {successor_node, vu_cost, num_hops + 1, order++} );
-                relaxed[successor_node] = vu_cost;
+    vector<CHVertex> targets_buffer_;
+    vector<TEdge> shortcuts_buffer_;
+};
 
-                if(num_hops + 1 > search_space)
-                    search_space = num_hops + 1;
-            }
+///
+/// One witness search engine per thread
+class WitnessSearchPool
+{
+public:
+    WitnessSearchPool( size_t n_vertices, const WitnessSearchLimits& limits )
+    {
+        int num_threads = 1;
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#endif
+        for ( int i = 0; i < num_threads; i++ ) {
+            engines_.emplace_back( new WitnessSearch( n_vertices, limits ) );
         }
     }
 
-    map<CHVertex, TCost> target_costs;
-    for(CHVertex t : found)
-        target_costs.emplace( t, relaxed[t] );
-    return target_costs;
-}
+    ///
+    /// Engine of the calling thread
+    WitnessSearch& local()
+    {
+        int thread_id = 0;
+#ifdef _OPENMP
+        thread_id = omp_get_thread_num();
+#endif
+        return *engines_[thread_id];
+    }
+
+private:
+    vector<std::unique_ptr<WitnessSearch>> engines_;
+};
 
-std::vector<TEdge> get_contraction_shortcuts( const CHGraph& graph, CHVertex v )
+///
+/// Shortcuts needed to contract a node, appended to 'shortcuts'
+/// \param[out] max_search_space Maximum search space of the witness searches
+void get_contraction_shortcuts( const CHGraph& graph, CHVertex v, WitnessSearch& witness, vector<TEdge>& shortcuts, int& max_search_space )
 {
     // Contraction of 'node'.
+    max_search_space = 0;
 
-    vector<TEdge> shortcuts;
+    vector<CHVertex>& targets = witness.targets_buffer();
     for ( auto uv : pair_range( in_edges( v, graph ) ) )
     {
-        TTargetSet targets;
+        targets.clear();
         TCost mx = 0;
         CHVertex u = source( uv, graph );
 
@@ -166,7 +297,6 @@ std::vector<TEdge> get_contraction_shortcuts( const CHGraph& graph, CHVertex v )
             continue;
 #endif
 
-        //std::cout << s << " " << node << std::endl;
         for ( auto vw : pair_range( out_edges( v, graph ) ) )
         {
             CHVertex w = target( vw, graph );
@@ -177,7 +307,7 @@ std::vector<TEdge> get_contraction_shortcuts( const CHGraph& graph, CHVertex v )
                 continue;
 #endif
 
-            targets.emplace( w );
+            targets.push_back( w );
 
             if ( graph[vw].weight > mx )
                 mx = graph[vw].weight;
@@ -190,8 +320,10 @@ std::vector<TEdge> get_contraction_shortcuts( const CHGraph& graph, CHVertex v )
         TCost cutoff = graph[uv].weight + mx;
 
         // Perform Dijkstra from 'predecessor' to all 'targets' while ignoring 'node'
-        int _ = 0; // not used
-        auto target_costs = witness_search( graph, v, u, targets, cutoff, _ );
+        int search_space = 0;
+        witness.run( graph, v, u, targets, cutoff, search_space );
+        if ( search_space > max_search_space )
+            max_search_space = search_space;
 
         for ( auto vw : pair_range( out_edges( v, graph ) ) )
         {
@@ -203,81 +335,28 @@ std::vector<TEdge> get_contraction_shortcuts( const CHGraph& graph, CHVertex v )
                 continue;
 #endif
 
-            auto iter_shortcut = target_costs.find( w );
             TCost uvw_cost = graph[uv].weight + graph[vw].weight;
-            if( iter_shortcut == target_costs.end() || iter_shortcut->second > uvw_cost )
+            if( witness.cost( w ) > uvw_cost )
             {
-                // If no shortest path was found from 'predecessor' to 'successor' during the Dijkstra
+                // If no shorter path was found from 'predecessor' to 'successor' during the Dijkstra
                 // propagation, then it means the shortest path from 'predecessor' to 'successor' is
                 // <predecessor, node, successor>, and a shortcut must be added.
                 shortcuts.push_back( {u, w, uvw_cost} );
             }
         }
     }
-
-    // cout << "Contracted " << node << "." << endl;
-    return shortcuts;
 }
 
-void get_node_edge_impact( const CHGraph& graph, CHVertex v, int& nb_added_edges, int& max_search_space )
+void get_node_edge_impact( const CHGraph& graph, CHVertex v, WitnessSearch& witness, int& nb_added_edges, int& max_search_space )
 {
-    // Contraction of 'node'.
-
-    nb_added_edges = 0;
-    max_search_space = 0;
-
-    for ( auto uv : pair_range( in_edges( v, graph ) ) )
-    {
-        TTargetSet targets;
-        TCost mx = 0;
-        CHVertex u = source( uv, graph );
-
-        //std::cout << s << " " << node << std::endl;
-        for ( auto vw : pair_range( out_edges( v, graph ) ) )
-        {
-            CHVertex w = target( vw, graph );
-            if ( w == u )
-                continue;
-
-            targets.emplace( w );
-
-            if ( graph[vw].weight > mx )
-                mx = graph[vw].weight;
-        }
-
-        if ( targets.empty() )
-            continue;
-
-        // It is not useful to search shortcuts beyond 'cutoff'
-        TCost cutoff = graph[uv].weight + mx;
-
-        // Perform Dijkstra from 'predecessor' to all 'targets' while ignoring 'node'
-        int search_space = 0;
-        auto target_costs = witness_search( graph, v, u, targets, cutoff, search_space );
-
-        if ( search_space > max_search_space )
-            max_search_space = search_space;
-
-        for ( auto vw : pair_range( out_edges( v, graph ) ) )
-        {
-            CHVertex w = target( vw, graph );
-            if ( w == u )
-                continue;
-
-            auto iter_shortcut = target_costs.find( w );
-            TCost uvw_cost = graph[uv].weight + graph[vw].weight;
-            if( iter_shortcut == target_costs.end() || iter_shortcut->second > uvw_cost )
-            {
-                // If no shortest path was found from 'predecessor' to 'successor' during the Dijkstra
-                // propagation, then it means the shortest path from 'predecessor' to 'successor' is
-                // <predecessor, node, successor>, and a shortcut must be added.
-                nb_added_edges++;
-            }
-        }
-    }
+    vector<TEdge>& shortcuts = witness.shortcuts_buffer();
+    shortcuts.clear();
+    get_contraction_shortcuts( graph, v, witness, shortcuts, max_search_space );
+    nb_added_edges = int( shortcuts.size() );
 }
 
 TNodeContractionCost get_node_cost( const CHGraph& graph,
+                                    WitnessSearch& witness,
                                     CHVertex node,
                                     const vector<int>& hierarchyDepths,
                                     db_id_t nodeId64)
@@ -288,12 +367,12 @@ TNodeContractionCost get_node_cost( const CHGraph& graph,
 
     nbRemovedEdges = in_degree( node, graph ) + out_degree( node, graph );
 
-    get_node_edge_impact(graph, node, nbAddedEdges, maxSearchSpace);
+    get_node_edge_impact(graph, node, witness, nbAddedEdges, maxSearchSpace);
 
     // The "edge difference" is the number of shortcuts created
     // when contracting 'node' minus the number of edges removed.
-    int edgeDiff = nbAddedEdges - nbRemovedEdges;
-    REQUIRE(abs(edgeDiff) <= 2000); // 32-bit limit
+    // Clamped to the 32-bit limit, it may be reached on dense graphs when witness searches are limited.
+    int edgeDiff = std::max( -2000, std::min( 2000, nbAddedEdges - nbRemovedEdges ) );
 
     int depth = hierarchyDepths[node];
 
@@ -302,58 +381,6 @@ TNodeContractionCost get_node_cost( const CHGraph& graph,
 }
 
 
-inline bool is_node_independent(const CHGraph& graph,
-                                CHVertex node,
-                                const vector<TNodeContractionCost>& nodeCosts,
-                                TNodeContractionCost nodeCost)
-{
-    // A node is 'independent' if all its neighbors, and the neighbors
-    // of its neighbors have a higher cost.
-
-    for ( const auto& pred : pair_range( in_edges( node, graph ) ) )
-    {
-        CHVertex u = source( pred, graph );
-        if ( nodeCosts[u] < nodeCost )
-            return false;
-
-        for ( const auto& pred2 : pair_range( in_edges( u, graph ) ) )
-        {
-            CHVertex v = source( pred2, graph );
-            if ( nodeCosts[v] < nodeCost )
-                return false;
-        }
-        for ( const auto& succ2 : pair_range( out_edges( u, graph ) ) )
-        {
-            CHVertex v = target( succ2, graph );
-            if ( nodeCosts[v] < nodeCost )
-                return false;
-        }
-    }
-
-    for ( const auto& succ : pair_range( out_edges( node, graph ) ) )
-    {
-        CHVertex u = target( succ, graph );
-        if ( nodeCosts[u] < nodeCost )
-            return false;
-
-        for ( const auto& pred2 : pair_range( in_edges( u, graph ) ) )
-        {
-            CHVertex v = source( pred2, graph );
-            if ( nodeCosts[v] < nodeCost )
-                return false;
-        }
-        for ( const auto& succ2 : pair_range( out_edges( u, graph ) ) )
-        {
-            CHVertex v = target( succ2, graph );
-            if ( nodeCosts[v] < nodeCost )
-                return false;
-        }
-    }
-
-    return true;
-}
-
-
 template <typename Foo>
 void apply_on_1_neighbourhood( const CHGraph& graph, CHVertex node, Foo foo )
 {
@@ -408,37 +435,56 @@ void apply_on_2_neighbourhood( const CHGraph& graph, CHVertex node, Foo foo )
     }
 }
 
+///
+/// Contraction priority of a node: its cost, with the node index to break ties.
+/// Two different nodes never have the same priority.
+inline bool has_lower_priority( const vector<TNodeContractionCost>& nodeCosts, CHVertex a, CHVertex b )
+{
+    return nodeCosts[a] < nodeCosts[b] || ( nodeCosts[a] == nodeCosts[b] && a < b );
+}
+
+inline bool is_node_independent(const CHGraph& graph,
+                                CHVertex node,
+                                const vector<TNodeContractionCost>& nodeCosts)
+{
+    // A node is 'independent' if all its neighbors, and the neighbors
+    // of its neighbors have a higher priority.
+    // Since priorities are all different, two independent nodes
+    // cannot be in the 2-neighbourhood of each other.
+
+    bool independent = true;
+    apply_on_2_neighbourhood( graph, node, [&]( CHVertex u ) {
+            if ( u != node && has_lower_priority( nodeCosts, u, node ) )
+                independent = false;
+        });
+    return independent;
+}
+
+
 vector<CHVertex> get_independent_node_set( const CHGraph& graph,
                                            vector<CHVertex>::const_iterator nodeBeginIt,
                                            int numNodes,
                                            const vector<TNodeContractionCost>& nodeCosts )
 {
     // Get all independent nodes from the sequence [nodeBeginIt : NodeBeginIt+numNodes]
+    // Nodes are tested independently of each other, in parallel
 
     REQUIRE(!nodeCosts.empty());
     REQUIRE(numNodes > 0);
 
-    vector<CHVertex> returnValue;
-    unordered_set<CHVertex> excluded;
-    auto nodeEndIt = nodeBeginIt + numNodes;
-    for (auto nodeIt=nodeBeginIt; nodeIt!=nodeEndIt; ++nodeIt)
+    vector<char> independent( numNodes );
+    #pragma omp parallel for schedule(dynamic, 64)
+    for ( int i = 0; i < numNodes; i++ )
     {
-        CHVertex nodeID = *nodeIt;
-        if (excluded.find(nodeID) != excluded.end())
-            continue;
-        REQUIRE(nodeID < nodeCosts.size());
-        TNodeContractionCost nodeCost = nodeCosts[nodeID];
-
-        if ( !is_node_independent( graph, nodeID, nodeCosts, nodeCost ) )
-            continue;
-
-        apply_on_2_neighbourhood( graph, nodeID, [&excluded]( CHVertex u ) {
-                excluded.emplace( u );
-            });
-
-        returnValue.push_back(nodeID);
+        independent[i] = is_node_independent( graph, *(nodeBeginIt + i), nodeCosts );
     }
 
+    vector<CHVertex> returnValue;
+    for ( int i = 0; i < numNodes; i++ )
+    {
+        if ( independent[i] )
+            returnValue.push_back( *(nodeBeginIt + i) );
+    }
     return returnValue;
 }
 
@@ -446,8 +492,11 @@ vector<CHVertex> get_independent_node_set( const CHGraph& graph,
 namespace Tempus
 {
 
-vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> node_id )
+///
+/// Node ordering by rounds of independent node sets
+static vector<CHVertex> order_graph_independent_sets( CHGraph& graph, std::function<db_id_t(CHVertex)> node_id, const WitnessSearchLimits& limits )
 {
+    WitnessSearchPool witness_pool( num_vertices( graph ), limits );
     std::vector<CHVertex> processed_nodes;
     std::vector<TNodeContractionCost> node_costs;
 
@@ -461,7 +510,7 @@ vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> n
     cout << "Processing initial contraction costs..." << endl;
 
     // nodes not contracted yet
-    TRemainingNodeSet remaining_nodes;
+    vector<CHVertex> remaining_nodes;
 
     // Parallel processing of node costs:
     #pragma omp parallel
@@ -470,84 +519,111 @@ vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> n
         for ( int node_i = 0; node_i < int(num_vertices( graph )); node_i++ )
         {
             CHVertex node = CHVertex( node_i );
-            node_costs[node] = get_node_cost( graph, node, hierarchy_depths, node_id(node) );
+            node_costs[node] = get_node_cost( graph, witness_pool.local(), node, hierarchy_depths, node_id(node) );
         }
     }
 
+    remaining_nodes.reserve( num_vertices( graph ) );
     for ( CHVertex node=0; node < num_vertices( graph ); ++node )
     {
-        remaining_nodes.insert( node );
+        remaining_nodes.push_back( node );
     }
 
+    vector<char> contracted( num_vertices( graph ), 0 );
+
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    // shortcuts and impacted neighbors, buffered per thread
+    vector<vector<TEdge>> thread_shortcuts( num_threads );
+    vector<vector<CHVertex>> thread_neighbors( num_threads );
+
+    auto lower_priority = [&node_costs](CHVertex a, CHVertex b) { return has_lower_priority( node_costs, a, b ); };
+
     int num_shortcuts = 0;
     while ( !remaining_nodes.empty() )
     {
         cout << "--------" << endl;
-        cout << "Sorting nodes... [processed=" << processed_nodes.size()
+        cout << "Selecting nodes... [processed=" << processed_nodes.size()
              << ", remaining=" << remaining_nodes.size()
              << ", shortcuts=" << num_shortcuts
              << ", elapsed=" << t.elapsed_ms() << "ms]"
              << endl;
 
-        // Sort all remaining nodes by cost
-        vector<CHVertex> sorted_nodes(remaining_nodes.begin(), remaining_nodes.end());
-        sort(sorted_nodes.begin(), sorted_nodes.end(), [&node_costs](CHVertex a, CHVertex b) { return node_costs[a] < node_costs[b]; });
-
         // Only contract among the best 20% of remaining nodes during this iteration.
-        int step = max(static_cast<size_t>(1), sorted_nodes.size()/5);
-        REQUIRE(step <= int(sorted_nodes.size()));
+        // Their order does not matter for the independent set, a partition is enough
+        int step = max(static_cast<size_t>(1), remaining_nodes.size()/5);
+        REQUIRE(step <= int(remaining_nodes.size()));
+        nth_element( remaining_nodes.begin(), remaining_nodes.begin() + (step - 1), remaining_nodes.end(), lower_priority );
 
         // Independent node set
-        vector<CHVertex> next_nodes = get_independent_node_set(graph, sorted_nodes.cbegin(), step, node_costs );
+        vector<CHVertex> next_nodes = get_independent_node_set(graph, remaining_nodes.cbegin(), step, node_costs );
         REQUIRE(!next_nodes.empty());
+        sort( next_nodes.begin(), next_nodes.end(), lower_priority );
 
         cout << "Contracting " << next_nodes.size()
              << " nodes... [elapsed=" << t.elapsed_ms() << "ms]" << endl;
 
-        // Parallel contractions of selected nodes:
-        vector<vector<TEdge>> node_shortcuts(next_nodes.size());
+        // Parallel contractions of selected nodes.
+        // Nodes of an independent set have no common neighbor, so that
+        // each neighbor is updated by only one thread
         #pragma omp parallel
         {
+            int thread_id = 0;
+#ifdef _OPENMP
+            thread_id = omp_get_thread_num();
+#endif
+            vector<TEdge>& shortcuts = thread_shortcuts[thread_id];
+            vector<CHVertex>& neighbors = thread_neighbors[thread_id];
+            shortcuts.clear();
+            neighbors.clear();
+
             #pragma omp for schedule(dynamic)
             for (int i=0; i<int(next_nodes.size()); ++i)
             {
-                node_shortcuts[i] = get_contraction_shortcuts( graph, next_nodes[i] );
+                CHVertex nodeID = next_nodes[i];
+                int search_space = 0;
+                get_contraction_shortcuts( graph, nodeID, witness_pool.local(), shortcuts, search_space );
+
+                apply_on_1_neighbourhood( graph, nodeID, [&neighbors, &hierarchy_depths, &nodeID] ( CHVertex node ) {
+                        neighbors.push_back( node );
+                        hierarchy_depths[node] = max(hierarchy_depths[nodeID]+1, hierarchy_depths[node]);
+                    });
             }
         }
 
-        // Update graph after contractions:
-        set<CHVertex> impacted_neighbors;
-        for (int i=0; i<int(next_nodes.size()); ++i)
+        // Merge: update the graph after contractions
+        for ( CHVertex nodeID : next_nodes )
         {
-            CHVertex nodeID = next_nodes[i];
-
-            apply_on_1_neighbourhood( graph, nodeID, [&impacted_neighbors, &hierarchy_depths, &nodeID] ( CHVertex node ) {
-                impacted_neighbors.emplace( node );
-                hierarchy_depths[node] = max(hierarchy_depths[nodeID]+1, hierarchy_depths[node]);
-                });
-
-            num_shortcuts += static_cast<int>(node_shortcuts[i].size());
-            remaining_nodes.erase(nodeID);
-
-            for (const TEdge& shortcut : node_shortcuts[i])
-                add_edge_or_update( graph, shortcut.from, shortcut.to, shortcut.cost );
-
-            //graph.removeNode(nodeID);
+            contracted[nodeID] = 1;
             clear_vertex( nodeID, graph );
         }
+        vector<CHVertex> impacted_neighbors;
+        for ( int th = 0; th < num_threads; th++ )
+        {
+            num_shortcuts += static_cast<int>(thread_shortcuts[th].size());
+            for (const TEdge& shortcut : thread_shortcuts[th])
+                add_edge_or_update( graph, shortcut.from, shortcut.to, shortcut.cost );
+            impacted_neighbors.insert( impacted_neighbors.end(), thread_neighbors[th].begin(), thread_neighbors[th].end() );
+        }
+        // a neighbor is seen twice if it is linked by in and out edges
+        sort( impacted_neighbors.begin(), impacted_neighbors.end() );
+        impacted_neighbors.erase( unique( impacted_neighbors.begin(), impacted_neighbors.end() ), impacted_neighbors.end() );
+        remaining_nodes.erase( remove_if( remaining_nodes.begin(), remaining_nodes.end(), [&contracted]( CHVertex v ) { return contracted[v] != 0; } ),
+                               remaining_nodes.end() );
 
         cout << "Updating " << impacted_neighbors.size()
              << " impacted neighbors. [elapsed=" << t.elapsed_ms() << "ms]" << endl;
 
         // Parallel update of node costs:
-        vector<CHVertex> impacted_neighbors1(impacted_neighbors.begin(), impacted_neighbors.end());
         #pragma omp parallel
         {
             #pragma omp for schedule(dynamic)
-            for (int i=0; i<int(impacted_neighbors1.size()); ++i)
+            for (int i=0; i<int(impacted_neighbors.size()); ++i)
             {
-                CHVertex update_node = impacted_neighbors1[i];
-                node_costs[update_node] = get_node_cost(graph, update_node, hierarchy_depths, node_id( update_node ));
+                CHVertex update_node = impacted_neighbors[i];
+                node_costs[update_node] = get_node_cost(graph, witness_pool.local(), update_node, hierarchy_depths, node_id( update_node ));
             }
         }
 
@@ -556,6 +632,7 @@ vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> n
     }
 
     cout << "Shortcuts: " << num_shortcuts << endl;
+    cout << "Ordered " << processed_nodes.size() << " nodes with " << num_threads << " threads in " << t.elapsed_ms() << "ms" << endl;
     REQUIRE(processed_nodes.size() == num_vertices( graph ));
     REQUIRE(node_costs.size() == num_vertices( graph ));
 
@@ -565,8 +642,162 @@ vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> n
     return processed_nodes;
 }
 
-vector<Shortcut> contract_graph( CHGraph& graph )
+///
+/// Node ordering by means of a mutable priority queue.
+/// Nodes are contracted one at a time. After a contraction, neighbors of the contracted node
+/// have their cost updated, and their own neighbors are marked as stale: the cost of a stale node
+/// is re-evaluated when it reaches the top of the queue (lazy update).
+/// Costs are only estimated, with witness searches limited to WitnessSearchLimits::estimate_max_settled settled nodes.
+static vector<CHVertex> order_graph_lazy_updates( CHGraph& graph, std::function<db_id_t(CHVertex)> node_id, const WitnessSearchLimits& limits )
 {
+    // costs are estimated with small witness searches, contractions use the requested limits
+    WitnessSearchLimits estimate_limits = limits;
+    if ( limits.estimate_max_settled && ( !limits.max_settled || limits.max_settled > limits.estimate_max_settled ) ) {
+        estimate_limits.max_settled = limits.estimate_max_settled;
+    }
+    WitnessSearchPool witness_pool( num_vertices( graph ), estimate_limits );
+    WitnessSearch contraction_witness( num_vertices( graph ), limits );
+    std::vector<CHVertex> processed_nodes;
+    std::vector<TNodeContractionCost> node_costs;
+
+    Timer t;
+
+    processed_nodes.reserve( num_vertices( graph ) );
+    node_costs.resize( num_vertices( graph ) );
+
+    vector<int> hierarchy_depths( num_vertices( graph ) );
+
+    cout << "Processing initial contraction costs..." << endl;
+
+    // Parallel processing of node costs:
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(dynamic)
+        for ( int node_i = 0; node_i < int(num_vertices( graph )); node_i++ )
+        {
+            CHVertex node = CHVertex( node_i );
+            node_costs[node] = get_node_cost( graph, witness_pool.local(), node, hierarchy_depths, node_id(node) );
+        }
+    }
+
+    struct QueueNode
+    {
+        TNodeContractionCost cost;
+        CHVertex node;
+    };
+    struct CompareQueueNode
+    {
+        // the top of a boost heap is its greatest element
+        bool operator()( const QueueNode& a, const QueueNode& b ) const
+        {
+            return a.cost > b.cost || ( a.cost == b.cost && a.node > b.node );
+        }
+    };
+    typedef boost::heap::d_ary_heap<QueueNode, boost::heap::arity<4>, boost::heap::compare<CompareQueueNode>, boost::heap::mutable_<true>> Queue;
+
+    Queue queue;
+    vector<Queue::handle_type> handles( num_vertices( graph ) );
+    for ( CHVertex node=0; node < num_vertices( graph ); ++node )
+    {
+        handles[node] = queue.push( {node_costs[node], node} );
+    }
+
+    // nodes whose cost must be re-evaluated before their contraction
+    vector<char> stale( num_vertices( graph ), 0 );
+
+    WitnessSearch& witness = witness_pool.local();
+    vector<TEdge> shortcuts;
+    vector<CHVertex> neighbors;
+    int num_shortcuts = 0;
+    int num_reevaluations = 0;
+    while ( !queue.empty() )
+    {
+        CHVertex node = queue.top().node;
+
+        // Lazy update: the graph may have changed around the node since its cost has been computed
+        if ( stale[node] )
+        {
+            stale[node] = 0;
+            TNodeContractionCost cost = get_node_cost( graph, witness, node, hierarchy_depths, node_id( node ) );
+            if ( cost != node_costs[node] )
+            {
+                node_costs[node] = cost;
+                queue.update( handles[node], {cost, node} );
+                if ( queue.top().node != node )
+                {
+                    num_reevaluations++;
+                    continue;
+                }
+            }
+        }
+        queue.pop();
+
+        if ( processed_nodes.size() % 10000 == 0 )
+        {
+            cout << "Contracting nodes... [processed=" << processed_nodes.size()
+                 << ", remaining=" << queue.size() + 1
+                 << ", shortcuts=" << num_shortcuts
+                 << ", elapsed=" << t.elapsed_ms() << "ms]"
+                 << endl;
+        }
+
+        // Contraction
+        shortcuts.clear();
+        int search_space = 0;
+        get_contraction_shortcuts( graph, node, contraction_witness, shortcuts, search_space );
+
+        neighbors.clear();
+        apply_on_1_neighbourhood( graph, node, [&neighbors, &hierarchy_depths, &node] ( CHVertex u ) {
+                neighbors.push_back( u );
+                hierarchy_depths[u] = max(hierarchy_depths[node]+1, hierarchy_depths[u]);
+            });
+
+        clear_vertex( node, graph );
+        for (const TEdge& shortcut : shortcuts)
+            add_edge_or_update( graph, shortcut.from, shortcut.to, shortcut.cost );
+        num_shortcuts += static_cast<int>(shortcuts.size());
+        processed_nodes.push_back( node );
+
+        // Update of neighbor costs only
+        // a neighbor is seen twice if it is linked by in and out edges
+        sort( neighbors.begin(), neighbors.end() );
+        neighbors.erase( unique( neighbors.begin(), neighbors.end() ), neighbors.end() );
+        for ( CHVertex u : neighbors )
+        {
+            node_costs[u] = get_node_cost( graph, witness, u, hierarchy_depths, node_id( u ) );
+            queue.update( handles[u], {node_costs[u], u} );
+            stale[u] = 0;
+        }
+        // The shortcuts may give witnesses to the neighbors of neighbors:
+        // their costs are re-evaluated if they reach the top of the queue
+        for ( CHVertex u : neighbors )
+        {
+            apply_on_1_neighbourhood( graph, u, [&stale, &neighbors] ( CHVertex x ) {
+                    if ( !binary_search( neighbors.begin(), neighbors.end(), x ) )
+                        stale[x] = 1;
+                });
+        }
+    }
+
+    cout << "Shortcuts: " << num_shortcuts << endl;
+    cout << "Ordered " << processed_nodes.size() << " nodes with " << num_reevaluations << " lazy re-evaluations in " << t.elapsed_ms() << "ms" << endl;
+    REQUIRE(processed_nodes.size() == num_vertices( graph ));
+
+    return processed_nodes;
+}
+
+vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> node_id, const WitnessSearchLimits& limits, CHOrderingMode mode )
+{
+    if ( mode == CHOrderingLazyUpdates ) {
+        return order_graph_lazy_updates( graph, node_id, limits );
+    }
+    return order_graph_independent_sets( graph, node_id, limits );
+}
+
+vector<Shortcut> contract_graph( CHGraph& graph, const WitnessSearchLimits& limits )
+{
+    WitnessSearch witness( num_vertices( graph ), limits );
+    vector<TEdge> shortcuts;
     vector<Shortcut> r;
     Timer t;
 
@@ -576,7 +807,9 @@ vector<Shortcut> contract_graph( CHGraph& graph )
             cout << "Contracting nodes " << node << "... [elapsed=" << t.elapsed_ms() << "ms]" << endl;
 
         // Single node contraction:
-        vector<TEdge> shortcuts = get_contraction_shortcuts( graph, node );
+        shortcuts.clear();
+        int search_space = 0;
+        get_contraction_shortcuts( graph, node, witness, shortcuts, search_space );
 
         // Update graph after contraction:
         for(const TEdge& edge : shortcuts)
@@ -56,12 +56,46 @@ typedef boost::adjacency_list<boost::vecS,
 typedef typename boost::graph_traits<CHGraph>::vertex_descriptor CHVertex;
 typedef typename boost::graph_traits<CHGraph>::edge_descriptor CHEdge;
 
+///
+/// Limits of the witness searches, 0 for no limit.
+/// A witness search stopped by a limit may miss a witness path and add a useless shortcut:
+/// lower limits give a faster preprocessing, but more shortcuts.
+struct WitnessSearchLimits
+{
+    WitnessSearchLimits() : max_hops( 0 ), max_settled( 0 ), estimate_max_settled( 30 ) {}
+
+    /// Maximum number of edges of a witness path
+    int max_hops;
+    /// Maximum number of nodes settled by a search
+    int max_settled;
+    /// Maximum number of nodes settled by the searches that estimate contraction costs in the lazy update ordering,
+    /// never more than max_settled, 0 for max_settled. Contractions themselves use max_settled.
+    /// Small estimates are much cheaper, and on grids they even give fewer shortcuts than exact costs
+    int estimate_max_settled;
+};
+
+///
+/// How nodes are ordered
+enum CHOrderingMode
+{
+    /// Rounds of parallel contractions of independent node sets, among the 20% best remaining nodes
+    CHOrderingIndependentSets,
+    /// Nodes are contracted one by one, by means of a priority queue with lazy updates.
+    /// Gives fewer shortcuts, but the contraction is sequential
+    CHOrderingLazyUpdates
+};
+
 ///
 /// The node ordering processing
 /// \param[inout] graph The input graph that will be contracted
 /// \param[in] node_id A function that maps a vertex to its id
+/// \param[in] limits Limits of the witness searches
+/// \param[in] mode Ordering algorithm
 /// \returns the ordered nodes
-std::vector<CHVertex> order_graph( CHGraph& graph, std::function<db_id_t(CHVertex)> node_id );
+std::vector<CHVertex> order_graph( CHGraph& graph,
+                                   std::function<db_id_t(CHVertex)> node_id,
+                                   const WitnessSearchLimits& limits = WitnessSearchLimits(),
+                                   CHOrderingMode mode = CHOrderingIndependentSets );
 
 struct Shortcut
 {
@@ -74,8 +108,9 @@ struct Shortcut
 ///
 /// The graph contraction processing
 /// \param[inout] graph The input graph that will be contracted
+/// \param[in] limits Limits of the witness searches
 /// \returns the shortcuts created
-std::vector<Shortcut> contract_graph( CHGraph& graph );
+std::vector<Shortcut> contract_graph( CHGraph& graph, const WitnessSearchLimits& limits = WitnessSearchLimits() );
 
 }
 
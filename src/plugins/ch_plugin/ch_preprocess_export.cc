@@ -0,0 +1,196 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *   Copyright (C) 2015 Mappy <dt.lbs.route@mappy.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+// Kept apart from ch_preprocess.cc since the query graph and the graph used for the contraction
+// both define CHVertex and CHEdge
+#include "ch_preprocess_export.hh"
+#include "ch_routing_data.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+#include <boost/format.hpp>
+
+namespace Tempus
+{
+
+///
+/// Query graph out of contracted edges, sorted in place
+static std::unique_ptr<CHQuery> contracted_query_graph( size_t n_vertices, std::vector<ContractedEdge>& edges, MiddleNodeMap& middle_node )
+{
+    // An edge u->v is stored at the lowest vertex, upward edges first.
+    // This is the order of the query graph constructor
+    auto arc = []( const ContractedEdge& e ) {
+        return std::make_tuple( std::min( e.from, e.to ), e.from > e.to, std::max( e.from, e.to ) );
+    };
+    std::sort( edges.begin(), edges.end(), [&arc]( const ContractedEdge& a, const ContractedEdge& b ) {
+            return arc( a ) < arc( b ) || ( arc( a ) == arc( b ) && a.cost < b.cost );
+        });
+
+    std::vector<std::pair<uint32_t, uint32_t>> targets;
+    std::vector<CHEdgeProperty> properties;
+    std::vector<uint32_t> up_degrees( n_vertices, 0 );
+    targets.reserve( edges.size() );
+    properties.reserve( edges.size() );
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        const ContractedEdge& e = edges[i];
+        if ( i > 0 && arc( e ) == arc( edges[i-1] ) ) {
+            // parallel edge with a higher cost
+            continue;
+        }
+        CHEdgeProperty p;
+        p.b.cost = e.cost;
+        p.b.is_shortcut = e.middle != ContractedEdge::no_middle();
+        p.db_id = p.b.is_shortcut ? 0 : e.db_id;
+        if ( p.b.is_shortcut ) {
+            middle_node[std::make_pair( e.from, e.to )] = e.middle;
+        }
+        if ( e.from < e.to ) {
+            up_degrees[e.from]++;
+        }
+        targets.push_back( std::make_pair( std::min( e.from, e.to ), std::max( e.from, e.to ) ) );
+        properties.push_back( p );
+    }
+
+    return std::unique_ptr<CHQuery>( new CHQuery( targets.begin(), targets.end(), n_vertices, up_degrees.begin(), properties.begin() ) );
+}
+
+///
+/// Spatial index of the sections, if any, with their costs in each metric
+static void set_section_index( CHRoutingData& rd, const std::vector<ContractedSection>& sections, const std::vector<std::string>& metrics )
+{
+    if ( sections.empty() ) {
+        return;
+    }
+    std::vector<CHSection> ch_sections;
+    ch_sections.reserve( sections.size() );
+    for ( const ContractedSection& s : sections ) {
+        if ( s.costs.size() != metrics.size() ) {
+            throw std::invalid_argument( (boost::format( "The section %1% does not have a cost per metric" ) % s.db_id).str() );
+        }
+        ch_sections.push_back( CHSection{ s.db_id, s.from, s.to, s.x1, s.y1, s.x2, s.y2 } );
+    }
+    rd.set_section_index( std::unique_ptr<CHSectionIndex>( new CHSectionIndex( std::move( ch_sections ) ) ) );
+    for ( size_t i = 0; i < metrics.size(); i++ ) {
+        std::vector<CHSectionCosts> costs;
+        costs.reserve( sections.size() );
+        for ( const ContractedSection& s : sections ) {
+            costs.push_back( CHSectionCosts{ s.costs[i].first, s.costs[i].second } );
+        }
+        rd.set_section_costs( metrics[i], FlatArray<CHSectionCosts>( std::move( costs ) ) );
+    }
+}
+
+void export_ch_graph( const std::string& filename,
+                      const std::vector<db_id_t>& node_id,
+                      std::vector<ContractedHierarchy>& graphs,
+                      std::unique_ptr<TDCHGraph> td_graph,
+                      const std::string& td_graph_metric,
+                      ContractedTurnGraph* turn_graph,
+                      const std::vector<ContractedSection>& sections,
+                      ProgressionCallback& progression )
+{
+    if ( graphs.empty() ) {
+        throw std::invalid_argument( "export_ch_graph: no graph" );
+    }
+
+    if ( !graphs[0].rank.empty() ) {
+        throw std::invalid_argument( "export_ch_graph: the first graph numbers the vertices" );
+    }
+
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> ch_query = contracted_query_graph( node_id.size(), graphs[0].edges, middle_node );
+    std::vector<db_id_t> ids( node_id );
+    CHRoutingData rd( std::move( ch_query ), std::move( middle_node ), std::move( ids ) );
+    rd.set_default_metric_name( graphs[0].metric );
+    for ( size_t i = 1; i < graphs.size(); i++ ) {
+        MiddleNodeMap metric_middle_node;
+        std::unique_ptr<CHQuery> metric_query = contracted_query_graph( node_id.size(), graphs[i].edges, metric_middle_node );
+        rd.add_metric( graphs[i].metric, std::move( metric_query ), std::move( metric_middle_node ), std::vector<CHVertex>( graphs[i].rank ) );
+    }
+    rd.set_td_graph( std::move( td_graph ), td_graph_metric );
+    if ( turn_graph ) {
+        MiddleNodeMap turn_middle_node;
+        std::unique_ptr<CHQuery> turn_query = contracted_query_graph( turn_graph->vertices.size(), turn_graph->edges, turn_middle_node );
+        std::vector<CHTurnVertex> vertices;
+        vertices.reserve( turn_graph->vertices.size() );
+        for ( const ContractedTurnVertex& v : turn_graph->vertices ) {
+            vertices.push_back( CHTurnVertex{ v.db_id, v.from, v.to, v.cost } );
+        }
+        std::unique_ptr<CHQuery> linked( new CHQuery( link_ch_shortcuts( *turn_query, turn_middle_node ) ) );
+        rd.set_turn_graph( turn_graph->metric, std::unique_ptr<CHTurnGraph>( new CHTurnGraph( std::move( linked ), std::move( vertices ), node_id.size() ) ) );
+    }
+
+    std::vector<std::string> metrics;
+    for ( const auto& g : graphs ) {
+        metrics.push_back( g.metric );
+    }
+    set_section_index( rd, sections, metrics );
+
+    std::cout << "* Renumbering vertices" << std::endl;
+    rd.renumber_vertices( rd.locality_order() );
+    // hierarchies contracted in their own order are renumbered on their own
+    for ( const std::string& metric : rd.metric_names() ) {
+        if ( rd.metric_ranks( metric ) ) {
+            rd.renumber_metric_vertices( metric, rd.locality_order( metric ) );
+        }
+    }
+
+    std::cout << "* Writing the CH graph to " << filename << std::endl;
+    CHRoutingDataBuilder().file_export( &rd, filename, progression );
+}
+
+void export_cch_graph( const std::string& filename,
+                       const std::vector<db_id_t>& node_id,
+                       const CCHTopology& topology,
+                       const std::vector<std::pair<std::string, CCHMetric>>& metrics,
+                       const std::vector<db_id_t>& edge_db_id,
+                       const std::vector<ContractedSection>& sections,
+                       ProgressionCallback& progression )
+{
+    if ( metrics.empty() ) {
+        throw std::invalid_argument( "export_cch_graph: no metric" );
+    }
+
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> ch_query = cch_query_graph( topology, metrics[0].second, edge_db_id, middle_node );
+    std::vector<db_id_t> ids( node_id );
+    CHRoutingData rd( std::move( ch_query ), std::move( middle_node ), std::move( ids ) );
+    rd.set_default_metric_name( metrics[0].first );
+    for ( size_t i = 1; i < metrics.size(); i++ ) {
+        MiddleNodeMap metric_middle_node;
+        std::unique_ptr<CHQuery> metric_query = cch_query_graph( topology, metrics[i].second, edge_db_id, metric_middle_node );
+        rd.add_metric( metrics[i].first, std::move( metric_query ), std::move( metric_middle_node ) );
+    }
+
+    std::vector<std::string> metric_names;
+    for ( const auto& m : metrics ) {
+        metric_names.push_back( m.first );
+    }
+    set_section_index( rd, sections, metric_names );
+
+    std::cout << "* Renumbering vertices" << std::endl;
+    rd.renumber_vertices( rd.locality_order() );
+
+    std::cout << "* Writing the CCH graph to " << filename << std::endl;
+    CHRoutingDataBuilder().file_export( &rd, filename, progression );
+}
+
+} // namespace Tempus
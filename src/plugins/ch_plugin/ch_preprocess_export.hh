@@ -0,0 +1,150 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *   Copyright (C) 2015 Mappy <dt.lbs.route@mappy.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef TEMPUS_CH_PREPROCESS_EXPORT_HH
+#define TEMPUS_CH_PREPROCESS_EXPORT_HH
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "base.hh"
+#include "cch.hh"
+#include "ch_time_dependent.hh"
+
+namespace Tempus
+{
+
+class ProgressionCallback;
+
+///
+/// Edge of a contracted graph, vertices are numbered by rank
+struct ContractedEdge
+{
+    uint32_t from;
+    uint32_t to;
+    uint32_t cost;
+    /// Middle vertex of a shortcut, no_middle() for an edge of the original graph
+    uint32_t middle;
+    /// ID of the road section of an original edge
+    db_id_t db_id;
+
+    static uint32_t no_middle() { return 0xFFFFFFFF; }
+};
+
+///
+/// Hierarchy of a metric, e.g. of a transport mode
+struct ContractedHierarchy
+{
+    /// Name of the metric
+    std::string metric;
+    /// Original edges and shortcuts, vertices are numbered by rank in this hierarchy
+    std::vector<ContractedEdge> edges;
+    /// Rank in this hierarchy of each vertex of the first exported one, by rank in the first one.
+    /// Empty if both have been contracted in the same order
+    std::vector<uint32_t> rank;
+};
+
+///
+/// Road section in one direction, vertex of an edge-based hierarchy
+struct ContractedTurnVertex
+{
+    /// Vertices the section goes from and to, by rank
+    uint32_t from;
+    uint32_t to;
+    /// Cost of the section
+    uint32_t cost;
+    /// ID of the road section
+    db_id_t db_id;
+};
+
+///
+/// Edge-based hierarchy (see CHTurnGraph): vertices are road sections in one direction, numbered by rank in this hierarchy,
+/// and edges are turns between them
+struct ContractedTurnGraph
+{
+    /// Name of the metric, e.g. the transport mode it has been built for
+    std::string metric;
+    std::vector<ContractedTurnVertex> vertices;
+    std::vector<ContractedEdge> edges;
+};
+
+///
+/// Road section between two vertices, for the spatial index of a dump file (see CHSectionIndex)
+struct ContractedSection
+{
+    /// ID of the road section
+    db_id_t db_id;
+    /// Vertices of the section, by rank
+    uint32_t from;
+    uint32_t to;
+    /// Coordinates of the from and to nodes
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+    /// Costs of the section from its from vertex to its to vertex and back, in each exported graph or metric in their order.
+    /// no_cost() for a direction the section cannot be traveled in (see CHSectionCosts)
+    std::vector<std::pair<uint32_t, uint32_t>> costs;
+
+    static uint32_t no_cost() { return 0xFFFFFFFF; }
+};
+
+///
+/// Write contracted graphs to a ch_graph dump file, without going through the database.
+/// Graphs share their vertices, e.g. one hierarchy per transport mode, each one contracted in its own order.
+/// The first graph is the default one and numbers the vertices, the other ones are metrics (see CHRoutingData::add_metric()).
+/// Vertices of the file are renumbered for locality (see CHRoutingData::locality_order())
+/// \param filename The dump file
+/// \param node_id ID of each vertex, by rank in the first graph
+/// \param graphs Each hierarchy. Edges are sorted in place. Among parallel edges, only the one with the lowest cost is kept
+/// \param td_graph Time-dependent hierarchy, may be null
+/// \param td_graph_metric Metric of the graph whose node ordering the time-dependent hierarchy has been contracted in
+/// \param turn_graph Edge-based hierarchy whose sections are between these vertices, may be null. Its edges are sorted in place
+/// \param sections Road sections between these vertices, with a cost per graph, for the spatial index of the file (see CHSectionIndex). May be empty
+void export_ch_graph( const std::string& filename,
+                      const std::vector<db_id_t>& node_id,
+                      std::vector<ContractedHierarchy>& graphs,
+                      std::unique_ptr<TDCHGraph> td_graph,
+                      const std::string& td_graph_metric,
+                      ContractedTurnGraph* turn_graph,
+                      const std::vector<ContractedSection>& sections,
+                      ProgressionCallback& progression );
+
+///
+/// Write customized metrics of a CCH to a ch_graph dump file, the first metric is the default one.
+/// Vertices of the file are renumbered for locality, the same way for every metric
+/// \param filename The dump file
+/// \param node_id ID of each vertex, by rank
+/// \param topology The CCH
+/// \param metrics Name and arc costs of each metric
+/// \param edge_db_id ID of the road section of each input edge of the CCH
+/// \param sections Road sections between the vertices, with a cost per metric, for the spatial index of the file (see CHSectionIndex). May be empty
+void export_cch_graph( const std::string& filename,
+                       const std::vector<db_id_t>& node_id,
+                       const CCHTopology& topology,
+                       const std::vector<std::pair<std::string, CCHMetric>>& metrics,
+                       const std::vector<db_id_t>& edge_db_id,
+                       const std::vector<ContractedSection>& sections,
+                       ProgressionCallback& progression );
+
+} // namespace Tempus
+
+#endif
@@ -18,16 +18,507 @@
  */
 
 #include "ch_preprocess.hh"
+#include "ch_preprocess_export.hh"
+#include "cch.hh"
 #include "routing_data.hh"
 #include "multimodal_graph.hh"
+#include "multimodal_graph_builder.hh"
 #include "db.hh"
+#include "utils/timer.hh"
+#include "cost_lib/speed_profile.hh"
+#include "cost_lib/road_section_cost.hh"
 
 #include <string>
+#include <algorithm>
+#include <set>
+#include <cmath>
 #include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+using namespace Tempus;
+
+///
+/// Transport mode of a metric of a CCH or of a hierarchy of a CH
+struct MetricMode
+{
+    /// Name of the metric: pedestrian, bicycle or car
+    std::string name;
+    TransportMode mode;
+    /// Average cycling speed (km/h)
+    double cycling_speed;
+};
+
+///
+/// Cost of a road section for the transport mode of a metric, CCHMetric::infinity() if the section is forbidden (see road_section_cost())
+static uint32_t mode_cost( const MetricMode& metric, const Road::Section& section )
+{
+    return road_section_cost( section, metric.mode, metric.cycling_speed );
+}
+
+///
+/// Road sections of the graph, once each, between their vertices by rank and with the coordinates of their nodes.
+/// Costs are the ones of each metric, given by the edges of the section in each direction
+static std::vector<ContractedSection> road_sections( const Road::Graph& road_graph, const std::map<db_id_t, uint32_t>& id_order_map,
+                                                     const std::vector<MetricMode>& metrics )
+{
+    std::vector<ContractedSection> sections;
+    std::map<db_id_t, size_t> section_index;
+    for ( Road::Edge e : pair_range( edges( road_graph ) ) ) {
+        const Road::Node& from = road_graph[source( e, road_graph )];
+        const Road::Node& to = road_graph[target( e, road_graph )];
+        auto it = section_index.find( road_graph[e].db_id() );
+        if ( it == section_index.end() ) {
+            it = section_index.insert( std::make_pair( road_graph[e].db_id(), sections.size() ) ).first;
+            sections.push_back( ContractedSection{ road_graph[e].db_id(), id_order_map.at( from.db_id() ), id_order_map.at( to.db_id() ),
+                                                   from.coordinates().x(), from.coordinates().y(), to.coordinates().x(), to.coordinates().y(),
+                                                   std::vector<std::pair<uint32_t, uint32_t>>( metrics.size(), std::make_pair( ContractedSection::no_cost(), ContractedSection::no_cost() ) ) } );
+        }
+        ContractedSection& section = sections[it->second];
+        const bool forward = id_order_map.at( from.db_id() ) == section.from;
+        for ( size_t i = 0; i < metrics.size(); i++ ) {
+            const uint32_t cost = mode_cost( metrics[i], road_graph[e] );
+            uint32_t& c = forward ? section.costs[i].first : section.costs[i].second;
+            if ( cost != CCHMetric::infinity() ) {
+                c = std::min( c, cost );
+            }
+        }
+    }
+    return sections;
+}
+
+///
+/// Contraction of a CCH, then customization of each metric.
+/// The first metric is saved in the query_graph table, the other ones in query_graph_<metric> tables.
+/// Metrics are also written to out_file if not empty
+static void cch_contraction( const Road::Graph& road_graph,
+                             const std::vector<db_id_t>& order_id,
+                             const std::map<db_id_t, uint32_t>& id_order_map,
+                             const std::vector<MetricMode>& metrics,
+                             Db::Connection* conn,
+                             Db::CopyWriter::Format copy_format,
+                             const std::string& schema,
+                             const std::string& out_file,
+                             ProgressionCallback& progression )
+{
+    // every road section, whatever the metric
+    std::vector<std::pair<uint32_t, uint32_t>> cch_edges;
+    std::vector<Road::Edge> road_edges;
+    std::vector<db_id_t> edge_db_id;
+    for ( Road::Edge e : pair_range( edges( road_graph ) ) ) {
+        cch_edges.push_back( std::make_pair( id_order_map.at( road_graph[source( e, road_graph )].db_id() ),
+                                             id_order_map.at( road_graph[target( e, road_graph )].db_id() ) ) );
+        road_edges.push_back( e );
+        edge_db_id.push_back( road_graph[e].db_id() );
+    }
+
+    Timer timer;
+    CCHTopology topology( uint32_t( order_id.size() ), cch_edges );
+    std::cout << "CCH of " << topology.num_arcs() << " arcs and " << topology.num_levels() << " levels built in " << timer.elapsed_ms() << "ms" << std::endl;
+
+    if ( conn ) {
+        conn->exec( "CREATE SCHEMA IF NOT EXISTS " + schema );
+    }
+
+    std::vector<std::pair<std::string, CCHMetric>> customized;
+    for ( size_t i = 0; i < metrics.size(); i++ ) {
+        std::vector<uint32_t> weights( road_edges.size() );
+        for ( size_t j = 0; j < road_edges.size(); j++ ) {
+            weights[j] = mode_cost( metrics[i], road_graph[road_edges[j]] );
+        }
+
+        Timer customization_timer;
+        customized.push_back( std::make_pair( metrics[i].name, topology.customize( weights ) ) );
+        const CCHMetric& metric = customized.back().second;
+        std::cout << "Metric " << metrics[i].name << " customized in " << customization_timer.elapsed_ms() << "ms" << std::endl;
+
+        if ( !conn ) {
+            continue;
+        }
+        std::string table = schema + ".query_graph" + ( i == 0 ? std::string() : "_" + metrics[i].name );
+        std::cout << "* Saving metric " << metrics[i].name << " to " << table << std::endl;
+        conn->exec( "DROP TABLE IF EXISTS " + table + " CASCADE" );
+        conn->exec( "CREATE TABLE " + table + " (id SERIAL PRIMARY KEY, node_inf BIGINT NOT NULL, node_sup BIGINT NOT NULL, contracted_id BIGINT, weight INT NOT NULL, constraints INT NOT NULL)" );
+
+        Db::CopyWriter writer = conn->copy_in( table + " (node_inf, node_sup, contracted_id, weight, constraints)", copy_format );
+        for ( uint32_t a = 0; a < topology.num_arcs(); a++ ) {
+            db_id_t node_inf = order_id[topology.arc_tail( a )];
+            db_id_t node_sup = order_id[topology.arc_head( a )];
+            // upward cost (node_inf -> node_sup), then downward cost
+            uint32_t costs[2] = { metric.up_cost[a], metric.down_cost[a] };
+            uint32_t middles[2] = { metric.up_middle[a], metric.down_middle[a] };
+            for ( int dir = 0; dir < 2; dir++ ) {
+                if ( costs[dir] == CCHMetric::infinity() ) {
+                    continue;
+                }
+                writer.add( int64_t( node_inf ) ).add( int64_t( node_sup ) );
+                if ( middles[dir] != CCHMetric::no_middle() ) {
+                    writer.add( int64_t( order_id[middles[dir]] ) );
+                }
+                else {
+                    writer.add_null();
+                }
+                writer.add( int32_t( costs[dir] ) ).add( int32_t( dir + 1 ) );
+                writer.end_row();
+            }
+        }
+        writer.finish();
+    }
+
+    if ( !out_file.empty() ) {
+        export_cch_graph( out_file, order_id, topology, customized, edge_db_id, road_sections( road_graph, id_order_map, metrics ), progression );
+    }
+}
+
+///
+/// Node ordering of the road sections allowed to a transport mode
+/// \returns the vertices of the road graph, by rank
+static std::vector<CHVertex> mode_ordering( const Road::Graph& road_graph,
+                                            const MetricMode& mode,
+                                            const WitnessSearchLimits& witness_limits,
+                                            CHOrderingMode ordering_mode )
+{
+    std::cout << "* Computing node ordering for " << mode.name << std::endl;
+    CHGraph ch_graph;
+    for ( Road::Vertex v : pair_range( vertices( road_graph ) ) ) {
+        CHVertex new_v = add_vertex( ch_graph );
+        ch_graph[new_v].id = road_graph[v].db_id();
+    }
+    for ( Road::Edge e : pair_range( edges( road_graph ) ) ) {
+        uint32_t cost = mode_cost( mode, road_graph[e] );
+        if ( cost == CCHMetric::infinity() ) {
+            continue;
+        }
+
+        CHVertex v1 = source( e, road_graph );
+        CHVertex v2 = target( e, road_graph );
+        bool added = false;
+        CHEdge new_e;
+        boost::tie( new_e, added ) = add_edge( v1, v2, ch_graph );
+
+        BOOST_ASSERT( added );
+        ch_graph[new_e].weight = int( cost );
+    }
+
+    return order_graph( ch_graph, [&ch_graph](CHVertex v){ return ch_graph[v].id; }, witness_limits, ordering_mode );
+}
+
+///
+/// Table of the node ordering of the i-th transport mode: ordered_nodes for the first one, that numbers the vertices, ordered_nodes_<mode> for the other ones
+static std::string ordering_table( const std::string& schema, const std::vector<std::string>& modes, size_t i )
+{
+    return schema + ".ordered_nodes" + ( i == 0 ? std::string() : "_" + modes[i] );
+}
+
+///
+/// Contraction of the road sections allowed to a transport mode, vertices are contracted in the given order.
+/// The query graph is saved in the table if conn is not null
+/// \returns the edges of the query graph if with_edges is set, to be written to a file
+static std::vector<ContractedEdge> ch_contraction( const Road::Graph& road_graph,
+                                                   const std::vector<db_id_t>& order_id,
+                                                   const std::map<db_id_t, uint32_t>& id_order_map,
+                                                   const MetricMode& mode,
+                                                   const WitnessSearchLimits& witness_limits,
+                                                   Db::Connection* conn,
+                                                   Db::CopyWriter::Format copy_format,
+                                                   const std::string& table,
+                                                   bool with_edges )
+{
+    std::cout << "* Contraction for " << mode.name << std::endl;
+    CHGraph ch_graph;
+    std::map<db_id_t, Road::Vertex> id_vertex_map; // id -> vertex
+    for ( auto it = vertices( road_graph ).first; it != vertices( road_graph ).second; it++ ) {
+        add_vertex( ch_graph );
+        id_vertex_map[road_graph[*it].db_id()] = *it;
+    }
+    for ( CHVertex i = 0; i < order_id.size(); i++ ) {
+        db_id_t id = order_id[i];
+        ch_graph[i].id = id;
+    }
+
+    if ( conn ) {
+        conn->exec( "DROP TABLE IF EXISTS " + table + " CASCADE" );
+        conn->exec( "CREATE TABLE " + table + " (id SERIAL PRIMARY KEY, node_inf BIGINT NOT NULL, node_sup BIGINT NOT NULL, contracted_id BIGINT, weight INT NOT NULL, constraints INT NOT NULL)" );
+    }
+    // edges of the query graph, to be written to a file
+    std::vector<ContractedEdge> contracted_edges;
+    std::unique_ptr<Db::CopyWriter> edge_writer;
+    if ( conn ) {
+        edge_writer.reset( new Db::CopyWriter( conn->copy_in( table + " (node_inf, node_sup, weight, constraints)", copy_format ) ) );
+    }
+
+    for ( uint32_t order = 0; order < order_id.size(); order++ ) {
+        Road::Vertex v = id_vertex_map[order_id[order]];
+        BOOST_ASSERT( ch_graph[order].id == order_id[order] );
+        for ( auto it = out_edges( v, road_graph ).first; it != out_edges( v, road_graph ).second; it++ ) {
+            uint32_t cost = mode_cost( mode, road_graph[*it] );
+            if ( cost == CCHMetric::infinity() ) {
+                continue;
+            }
+            Road::Vertex s = target( *it, road_graph );
+            db_id_t id = road_graph[s].db_id();
+            const uint32_t s_order = id_order_map.at( id );
+            bool added = false;
+            CHEdge e;
+            boost::tie( e, added ) = add_edge( order, s_order, ch_graph );
+            BOOST_ASSERT( added );
+            ch_graph[e].weight = int( cost );
+            if ( with_edges ) {
+                contracted_edges.push_back( { order, s_order, cost, ContractedEdge::no_middle(), road_graph[*it].db_id() } );
+            }
+            if ( edge_writer ) {
+                if ( order < s_order ) {
+                    edge_writer->add( int64_t( order_id[order] ) ).add( int64_t( id ) ).add( int32_t( ch_graph[e].weight ) ).add( int32_t( 1 ) );
+                } else {
+                    edge_writer->add( int64_t( id ) ).add( int64_t( order_id[order] ) ).add( int32_t( ch_graph[e].weight ) ).add( int32_t( 2 ) );
+                }
+                edge_writer->end_row();
+            }
+        }
+    }
+    if ( edge_writer ) {
+        edge_writer->finish();
+    }
+
+    std::vector<Shortcut> shortcuts = contract_graph( ch_graph, witness_limits );
+
+    if ( conn ) {
+        std::cout << "* Saving contraction to " << table << std::endl;
+        // write shortcuts
+        Db::CopyWriter writer = conn->copy_in( table + " (node_inf, node_sup, contracted_id, weight, constraints)", copy_format );
+        for ( const Shortcut& s : shortcuts )
+        {
+            if ( s.from < s.to ) {
+                writer.add( int64_t( ch_graph[s.from].id ) ).add( int64_t( ch_graph[s.to].id ) );
+            } else {
+                writer.add( int64_t( ch_graph[s.to].id ) ).add( int64_t( ch_graph[s.from].id ) );
+            }
+            writer.add( int64_t( ch_graph[s.contracted].id ) ).add( int32_t( s.cost ) ).add( int32_t( s.from < s.to ? 1 : 2 ) );
+            writer.end_row();
+        }
+        writer.finish();
+    }
+
+    if ( with_edges ) {
+        for ( const Shortcut& s : shortcuts ) {
+            contracted_edges.push_back( { uint32_t( s.from ), uint32_t( s.to ), uint32_t( s.cost ), uint32_t( s.contracted ), 0 } );
+        }
+    }
+    return contracted_edges;
+}
+
+///
+/// Cost of a turn restriction for a transport mode, in the unit of mode_cost(): CCHMetric::infinity() if the turn is forbidden,
+/// 0 if the restriction does not apply to the mode.
+/// Time penalties (minutes) only apply to durations, costs of the pedestrian speed rule are distances
+static uint32_t turn_penalty( const MetricMode& mode, const Road::Restriction::CostPerTransport& costs )
+{
+    for ( const auto& p : costs ) {
+        // the key of a cost is a combination of traffic rules
+        if ( ( p.first & mode.mode.traffic_rules() ) == 0 ) {
+            continue;
+        }
+        if ( std::isinf( p.second ) ) {
+            return CCHMetric::infinity();
+        }
+        return mode.mode.speed_rule() == SpeedRulePedestrian ? 0 : uint32_t( std::max( p.second, 0.0 ) * 6000.0 );
+    }
+    return 0;
+}
+
+///
+/// Edge-based contraction of the road sections allowed to a transport mode, with its turn restrictions (see CHTurnGraph).
+/// Only restrictions of two sections, i.e. turns, can be represented: longer sequences are ignored.
+/// \param id_order_map Rank of each node in the node-based hierarchy
+static ContractedTurnGraph turn_contraction( const Road::Graph& road_graph,
+                                             const Road::Restrictions& restrictions,
+                                             const std::map<db_id_t, uint32_t>& id_order_map,
+                                             const MetricMode& mode,
+                                             const WitnessSearchLimits& witness_limits,
+                                             CHOrderingMode ordering_mode )
+{
+    std::cout << "* Edge-based contraction for " << mode.name << std::endl;
+    const uint32_t no_vertex = 0xFFFFFFFF;
+
+    // turn vertices: road sections allowed to the mode, in each of their directions
+    std::vector<uint32_t> edge_vertex( num_edges( road_graph ), no_vertex );
+    std::vector<Road::Edge> vertex_edge;
+    std::vector<uint32_t> vertex_cost;
+    for ( Road::Edge e : pair_range( edges( road_graph ) ) ) {
+        const uint32_t cost = mode_cost( mode, road_graph[e] );
+        if ( cost != CCHMetric::infinity() ) {
+            edge_vertex[get( boost::edge_index, road_graph, e )] = uint32_t( vertex_edge.size() );
+            vertex_edge.push_back( e );
+            vertex_cost.push_back( cost );
+        }
+    }
+
+    // penalty of each restricted turn, by pair of turn vertices
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> penalties;
+    size_t n_ignored = 0;
+    for ( const Road::Restriction& r : restrictions.restrictions() ) {
+        const uint32_t penalty = turn_penalty( mode, r.cost_per_transport() );
+        if ( penalty == 0 ) {
+            continue;
+        }
+        if ( r.road_edges().size() != 2 ) {
+            n_ignored++;
+            continue;
+        }
+        const uint32_t x = edge_vertex[get( boost::edge_index, road_graph, r.road_edges()[0] )];
+        const uint32_t y = edge_vertex[get( boost::edge_index, road_graph, r.road_edges()[1] )];
+        if ( x != no_vertex && y != no_vertex ) {
+            uint32_t& p = penalties[std::make_pair( x, y )];
+            p = std::max( p, penalty );
+        }
+    }
+    std::cout << penalties.size() << " restricted turns";
+    if ( n_ignored ) {
+        std::cout << ", " << n_ignored << " restrictions of more than two sections ignored";
+    }
+    std::cout << std::endl;
+
+    // turns x -> y, of the cost of y plus the penalty
+    struct Turn
+    {
+        uint32_t from;
+        uint32_t to;
+        uint32_t cost;
+    };
+    std::vector<Turn> turns;
+    for ( uint32_t x = 0; x < vertex_edge.size(); x++ ) {
+        const Road::Vertex v = target( vertex_edge[x], road_graph );
+        for ( Road::Edge e : pair_range( out_edges( v, road_graph ) ) ) {
+            const uint32_t y = edge_vertex[get( boost::edge_index, road_graph, e )];
+            if ( y == no_vertex || y == x ) {
+                continue;
+            }
+            uint32_t penalty = 0;
+            auto it = penalties.find( std::make_pair( x, y ) );
+            if ( it != penalties.end() ) {
+                if ( it->second == CCHMetric::infinity() ) {
+                    continue;
+                }
+                penalty = it->second;
+            }
+            turns.push_back( Turn{ x, y, vertex_cost[y] + penalty } );
+        }
+    }
+    std::cout << vertex_edge.size() << " turn vertices, " << turns.size() << " turns" << std::endl;
+
+    // node ordering, then contraction in this order
+    std::vector<CHVertex> ordered;
+    {
+        CHGraph graph;
+        for ( uint32_t x = 0; x < vertex_edge.size(); x++ ) {
+            add_vertex( graph );
+            graph[x].id = x;
+        }
+        for ( const Turn& t : turns ) {
+            graph[add_edge( t.from, t.to, graph ).first].weight = TCost( t.cost );
+        }
+        ordered = order_graph( graph, [&graph]( CHVertex v ) { return graph[v].id; }, witness_limits, ordering_mode );
+    }
+    std::vector<uint32_t> rank( vertex_edge.size() );
+    for ( uint32_t i = 0; i < ordered.size(); i++ ) {
+        rank[ordered[i]] = i;
+    }
+
+    ContractedTurnGraph turn_graph;
+    turn_graph.metric = mode.name;
+    turn_graph.vertices.resize( vertex_edge.size() );
+    for ( uint32_t x = 0; x < vertex_edge.size(); x++ ) {
+        const Road::Edge e = vertex_edge[x];
+        turn_graph.vertices[rank[x]] = ContractedTurnVertex{ id_order_map.at( road_graph[source( e, road_graph )].db_id() ),
+                                                             id_order_map.at( road_graph[target( e, road_graph )].db_id() ),
+                                                             vertex_cost[x],
+                                                             road_graph[e].db_id() };
+    }
+
+    CHGraph graph;
+    for ( uint32_t x = 0; x < vertex_edge.size(); x++ ) {
+        add_vertex( graph );
+        graph[x].id = x;
+    }
+    for ( const Turn& t : turns ) {
+        const uint32_t u = rank[t.from];
+        const uint32_t v = rank[t.to];
+        graph[add_edge( u, v, graph ).first].weight = TCost( t.cost );
+        // the section of the turn is the one it leads to
+        turn_graph.edges.push_back( { u, v, uint32_t( t.cost ), ContractedEdge::no_middle(), turn_graph.vertices[v].db_id } );
+    }
+    for ( const Shortcut& s : contract_graph( graph, witness_limits ) ) {
+        turn_graph.edges.push_back( { uint32_t( s.from ), uint32_t( s.to ), uint32_t( s.cost ), uint32_t( s.contracted ), 0 } );
+    }
+    std::cout << "Edge-based hierarchy of " << turn_graph.edges.size() << " edges" << std::endl;
+    return turn_graph;
+}
+
+///
+/// Load the daily speed profiles of cars
+static void load_car_speed_profiles( Db::Connection& conn, RoadEdgeSpeedProfile& profile )
+{
+    Db::Result res( conn.exec( (boost::format( "SELECT road_section_id, begin_time, end_time, average_speed FROM\n"
+                                               "tempus.road_section_speed as ss,\n"
+                                               "tempus.road_daily_profile as p\n"
+                                               "WHERE\n"
+                                               "p.profile_id = ss.profile_id AND ss.speed_rule = %1%" ) % int( SpeedRuleCar )).str() ) );
+    for ( size_t i = 0; i < res.size(); i++ ) {
+        double begin_time = res[i][1].as<double>();
+        double end_time = res[i][2].as<double>();
+        profile.add_period( res[i][0].as<db_id_t>(), SpeedRuleCar, begin_time, end_time - begin_time, res[i][3].as<double>() );
+    }
+}
+
+///
+/// Time-dependent hierarchy of cars, vertices are contracted in the given order.
+/// Travel times of road sections are derived from their speed profile, from the speed limit for sections without profile.
+static std::unique_ptr<TDCHGraph> td_car_contraction( const Road::Graph& road_graph,
+                                                      const std::map<db_id_t, uint32_t>& id_order_map,
+                                                      const RoadEdgeSpeedProfile& profile )
+{
+    std::cout << "* Time-dependent contraction for car" << std::endl;
+    std::vector<TDInputEdge> td_edges;
+    size_t n_profiles = 0;
+    for ( Road::Edge e : pair_range( edges( road_graph ) ) ) {
+        const Road::Section& section = road_graph[e];
+        if ( ( section.traffic_rules() & TrafficRuleCar ) == 0 ) {
+            continue;
+        }
+        // time of the day (minutes) and speed of each period, periods without speed are ignored
+        std::vector<std::pair<double, double>> speeds;
+        const std::map<double, SpeedTimePeriod>* periods = profile.periods( section.db_id(), SpeedRuleCar );
+        if ( periods ) {
+            for ( const auto& p : *periods ) {
+                if ( p.first >= 0 && p.first < ttf_period() && p.second.speed > 0 ) {
+                    speeds.push_back( std::make_pair( p.first, p.second.speed ) );
+                }
+            }
+        }
+        if ( !speeds.empty() ) {
+            n_profiles++;
+        }
+        else if ( section.car_speed_limit() > 0 ) {
+            speeds.push_back( std::make_pair( 0.0, double( section.car_speed_limit() ) ) );
+        }
+        else {
+            continue;
+        }
+        const uint32_t from = id_order_map.at( road_graph[source( e, road_graph )].db_id() );
+        const uint32_t to = id_order_map.at( road_graph[target( e, road_graph )].db_id() );
+        td_edges.push_back( TDInputEdge{ from, to, TravelTimeFunction::from_speeds( section.length(), speeds ), section.db_id() } );
+    }
+    std::cout << td_edges.size() << " road sections, " << n_profiles << " with a speed profile" << std::endl;
+
+    Timer timer;
+    std::unique_ptr<TDCHGraph> td_graph = td_contraction( uint32_t( num_vertices( road_graph ) ), td_edges );
+    std::cout << "Time-dependent contraction: " << td_graph->num_edges() << " edges, "
+              << td_graph->point_array().size() << " points in " << timer.elapsed_ms() << "ms" << std::endl;
+    return td_graph;
+}
 
 int main( int argc, char *argv[] )
 {
-    using namespace Tempus;
     using namespace std;
 
     bool compute_node_ordering = true;
@@ -42,6 +533,14 @@ int main( int argc, char *argv[] )
     std::string ordering_out_schema = "ch";
     std::string ordering_in_schema = "ch";
     std::string contraction_out_schema = "ch";
+    WitnessSearchLimits witness_limits;
+    std::string ordering_mode = "independent-sets";
+    std::string cch_metrics = "pedestrian";
+    std::string ch_modes = "pedestrian";
+    double cycling_speed = DEFAULT_ROAD_CYCLING_SPEED;
+    std::string copy_format_str = "binary";
+    std::string out_file;
+    std::string turn_restriction_mode;
 
     namespace po = boost::program_options;
     po::options_description desc( "Allowed options" );
@@ -57,6 +556,18 @@ int main( int argc, char *argv[] )
         ( "ordering-in-schema", po::value<string>(&ordering_in_schema), "set database schema used for reading the node ordering" )
         ( "contraction-out-schema", po::value<string>(&contraction_out_schema), "set database schema used for writing the contraction" )
         ( "no-db-saving", "do not save to db" )
+        ( "out-file,o", po::value<string>(&out_file), "write the contracted graph to a ch_graph dump file, to be loaded with the from_file option of the CH plugin" )
+        ( "witness-hop-limit", po::value<int>(&witness_limits.max_hops), "maximum number of edges of witness paths, 0 for no limit (lower values: faster preprocessing, more shortcuts)" )
+        ( "witness-settle-limit", po::value<int>(&witness_limits.max_settled), "maximum number of nodes settled by a witness search, 0 for no limit" )
+        ( "witness-estimate-settle-limit", po::value<int>(&witness_limits.estimate_max_settled), "maximum number of nodes settled by the witness searches that estimate contraction costs in the lazy ordering mode, at most the one of --witness-settle-limit, 0 for the same limit (default: 30)" )
+        ( "ordering-mode", po::value<string>(&ordering_mode), "node ordering algorithm: 'independent-sets' (parallel contraction of independent nodes, default) or 'lazy' (priority queue with lazy updates, fewer shortcuts, sequential)" )
+        ( "copy-format", po::value<string>(&copy_format_str), "format of the bulk copy to the database: 'binary' (default) or 'text'" )
+        ( "cch", "build a customizable CH: metric-independent ordering by nested dissection, then customization of each metric of --cch-metrics" )
+        ( "modes", po::value<string>(&ch_modes), "comma-separated list of transport modes (pedestrian, bicycle, car) to build a hierarchy for, each one with its own node ordering. The first one is saved in the query_graph and ordered_nodes tables, the other ones in query_graph_<mode> and ordered_nodes_<mode> tables" )
+        ( "time-dependent", "also build a time-dependent hierarchy of cars from the speed profiles of road sections, with the node ordering of the car transport mode, that must be one of --modes. It is only written to the dump file (--out-file)" )
+        ( "turn-restrictions", po::value<string>(&turn_restriction_mode), "also build an edge-based hierarchy of this transport mode of --modes (e.g. car), that takes the turns of the road_restriction table into account. It is only written to the dump file (--out-file)" )
+        ( "cch-metrics", po::value<string>(&cch_metrics), "comma-separated list of metrics to customize (pedestrian, bicycle, car), the first one is the default metric (query_graph table), the other ones are saved in query_graph_<metric> tables" )
+        ( "cycling-speed", po::value<double>(&cycling_speed), "average cycling speed (km/h) of the bicycle metric (default: 12, as the Time/cycling_speed option of plugins)" )
         ;
 
     po::variables_map vm;
@@ -81,6 +592,66 @@ int main( int argc, char *argv[] )
     if ( vm.count( "ordering-loading" ) ) {
         load_ordering_from_db = true;
     }
+    Db::CopyWriter::Format copy_format;
+    if ( copy_format_str == "binary" ) {
+        copy_format = Db::CopyWriter::BinaryFormat;
+    }
+    else if ( copy_format_str == "text" ) {
+        copy_format = Db::CopyWriter::TextFormat;
+    }
+    else {
+        std::cerr << "Unknown copy format " << copy_format_str << std::endl;
+        return 1;
+    }
+
+    bool use_cch = vm.count( "cch" ) > 0;
+    bool time_dependent = vm.count( "time-dependent" ) > 0;
+    if ( time_dependent && ( use_cch || out_file.empty() ) ) {
+        std::cerr << "A time-dependent hierarchy needs a standard contraction written to a dump file" << std::endl;
+        return 1;
+    }
+    bool turn_restrictions = vm.count( "turn-restrictions" ) > 0;
+    if ( turn_restrictions && ( use_cch || out_file.empty() ) ) {
+        std::cerr << "An edge-based hierarchy needs a standard contraction written to a dump file" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> metrics;
+    boost::split( metrics, cch_metrics, boost::is_any_of( "," ), boost::token_compress_on );
+    std::vector<std::string> modes;
+    boost::split( modes, ch_modes, boost::is_any_of( "," ), boost::token_compress_on );
+    for ( const std::string& mode : use_cch ? metrics : modes ) {
+        if ( mode != "pedestrian" && mode != "bicycle" && mode != "car" ) {
+            std::cerr << "Unknown transport mode " << mode << std::endl;
+            return 1;
+        }
+    }
+    // index in --modes of the car transport mode, whose node ordering the time-dependent hierarchy is contracted in
+    const size_t car_index = std::find( modes.begin(), modes.end(), "car" ) - modes.begin();
+    if ( time_dependent && car_index == modes.size() ) {
+        std::cerr << "A time-dependent hierarchy needs the car transport mode in --modes" << std::endl;
+        return 1;
+    }
+    // index in --modes of the transport mode of the edge-based hierarchy
+    size_t turn_restriction_index = 0;
+    if ( turn_restrictions ) {
+        turn_restriction_index = std::find( modes.begin(), modes.end(), turn_restriction_mode ) - modes.begin();
+        if ( turn_restriction_index == modes.size() ) {
+            std::cerr << "The transport mode of --turn-restrictions must be one of --modes" << std::endl;
+            return 1;
+        }
+    }
+
+    CHOrderingMode ch_ordering_mode;
+    if ( ordering_mode == "independent-sets" ) {
+        ch_ordering_mode = CHOrderingIndependentSets;
+    }
+    else if ( ordering_mode == "lazy" ) {
+        ch_ordering_mode = CHOrderingLazyUpdates;
+    }
+    else {
+        std::cerr << "Unknown ordering mode " << ordering_mode << std::endl;
+        return 1;
+    }
 
     TextProgression progression;
     VariantMap options;
@@ -95,53 +666,63 @@ int main( int argc, char *argv[] )
 
     const Road::Graph& road_graph = graph.road();
 
-    std::vector<CHVertex> ordered_nodes;
+    // transport modes of the metrics of a CCH, or of the hierarchies of a CH
+    std::vector<MetricMode> metric_modes;
+    for ( const std::string& name : use_cch ? metrics : modes ) {
+        const db_id_t id = name == "pedestrian" ? TransportModeWalking : ( name == "bicycle" ? TransportModePrivateBicycle : TransportModePrivateCar );
+        boost::optional<TransportMode> mode = graph.transport_mode( id );
+        if ( !mode ) {
+            std::cerr << "No transport mode of ID " << id << " for the " << name << " metric" << std::endl;
+            return 1;
+        }
+        metric_modes.push_back( MetricMode{ name, mode.get(), cycling_speed } );
+    }
+
+    // one node ordering per transport mode, a single metric-independent one for a CCH
+    const size_t n_orderings = use_cch ? 1 : modes.size();
+    std::vector<std::vector<CHVertex>> ordered_nodes( n_orderings );
     //
     // Node ordering
     //
-    CHGraph ch_graph;
     if ( compute_node_ordering ) {
-        std::cout << "* Computing node ordering" << std::endl;
-        // copy to ch_graph
-        for ( Road::Vertex v : pair_range( vertices( road_graph ) ) ) {
-            CHVertex new_v = add_vertex( ch_graph );
-            ch_graph[new_v].id = road_graph[v].db_id();
+        if ( use_cch ) {
+            std::cout << "* Computing node ordering" << std::endl;
+            // metric-independent ordering: every road section is taken into account
+            std::vector<std::pair<uint32_t, uint32_t>> cch_edges;
+            for ( Road::Edge e : pair_range( edges( road_graph )) ) {
+                cch_edges.push_back( std::make_pair( uint32_t( source( e, road_graph ) ), uint32_t( target( e, road_graph ) ) ) );
+            }
+            Timer timer;
+            std::vector<uint32_t> order = cch_nested_dissection_order( uint32_t( num_vertices( road_graph ) ), cch_edges );
+            ordered_nodes[0].assign( order.begin(), order.end() );
+            std::cout << "Nested dissection ordering computed in " << timer.elapsed_ms() << "ms" << std::endl;
         }
-
-        for ( Road::Edge e : pair_range( edges( road_graph )) ) {
-            if ( (road_graph[e].traffic_rules() & TrafficRulePedestrian) == 0 ) {
-                continue;
+        else {
+            // each transport mode is contracted in its own order, the first one numbers the vertices
+            for ( size_t i = 0; i < modes.size(); i++ ) {
+                ordered_nodes[i] = mode_ordering( road_graph, metric_modes[i], witness_limits, ch_ordering_mode );
             }
-
-            CHVertex v1 = source( e, road_graph );
-            CHVertex v2 = target( e, road_graph );
-            bool added = false;
-            CHEdge new_e;
-            boost::tie( new_e, added ) = add_edge( v1, v2, ch_graph );
-
-            BOOST_ASSERT( added );
-            ch_graph[new_e].weight = int(road_graph[e].length() * 100.0);
         }
 
-        ordered_nodes = order_graph( ch_graph, [&ch_graph](CHVertex v){ return ch_graph[v].id; } );
-
         if ( save_to_db ) {
-            std::cout << "* Saving node ordering to schema " << ordering_out_schema << std::endl;
             Db::Connection conn( db_options );
             conn.exec( "CREATE SCHEMA IF NOT EXISTS " + ordering_out_schema );
-            conn.exec( "DROP TABLE IF EXISTS " + ordering_out_schema + ".ordered_nodes CASCADE" );
-            conn.exec( "CREATE TABLE " + ordering_out_schema + ".ordered_nodes (id SERIAL PRIMARY KEY, node_id BIGINT NOT NULL, sort_order INT NOT NULL)" );
-
-            conn.exec( "BEGIN" );
-            uint32_t i = 0;
-            for ( CHVertex v : ordered_nodes )
-            {
-                std::ostringstream ostr;
-                ostr << "INSERT INTO " << ordering_out_schema << ".ordered_nodes (node_id, sort_order) VALUES (" << ch_graph[v].id << "," << i << ")";
-                conn.exec( ostr.str() );
-                i++;
+            for ( size_t i = 0; i < n_orderings; i++ ) {
+                const std::string table = ordering_table( ordering_out_schema, modes, i );
+                std::cout << "* Saving node ordering to " << table << std::endl;
+                conn.exec( "DROP TABLE IF EXISTS " + table + " CASCADE" );
+                conn.exec( "CREATE TABLE " + table + " (id SERIAL PRIMARY KEY, node_id BIGINT NOT NULL, sort_order INT NOT NULL)" );
+
+                Db::CopyWriter writer = conn.copy_in( table + " (node_id, sort_order)", copy_format );
+                int32_t r = 0;
+                for ( CHVertex v : ordered_nodes[i] )
+                {
+                    writer.add( int64_t( road_graph[v].db_id() ) ).add( r );
+                    writer.end_row();
+                    r++;
+                }
+                writer.finish();
             }
-            conn.exec( "COMMIT" );
         }
     }
 
@@ -150,98 +731,100 @@ int main( int argc, char *argv[] )
     //
     if ( compute_contraction ) {
         std::cout << "* Compute graph contraction" << std::endl;
-        // get nodes, ordered
-        std::vector<db_id_t> order_id; // order -> id
-        std::map<db_id_t, uint32_t> id_order_map; // id -> order
-        Db::Connection conn( db_options );
-        if ( load_ordering_from_db ) {
-            std::cout << "* Loading node ordering from schema " << ordering_in_schema << std::endl;
-            Db::ResultIterator res_it = conn.exec_it( "select node_id from " + ordering_in_schema + ".ordered_nodes order by id asc" );
-            Db::ResultIterator it_end;
-
-            CHVertex i = 0;
-            for ( ; res_it != it_end; res_it++, i++ ) {
-                Db::RowValue res_i = *res_it;
-                db_id_t db_id = res_i[0];
-                order_id.push_back( db_id );
-                //std::cout << i << " -> " << db_id << std::endl;
-                id_order_map[db_id] = i;
-            }
-        }
-        else {
-            for ( uint32_t i = 0; i < ordered_nodes.size(); i++ ) {
-                db_id_t id = ch_graph[ordered_nodes[i]].id;
-                order_id.push_back( id );
-                id_order_map[id] = i;
-            }
+        // get nodes, ordered, for each ordering
+        std::vector<std::vector<db_id_t>> order_ids( n_orderings ); // order -> id
+        std::vector<std::map<db_id_t, uint32_t>> id_order_maps( n_orderings ); // id -> order
+        // the database is only needed to read the ordering or to save the contraction
+        std::unique_ptr<Db::Connection> conn;
+        if ( load_ordering_from_db || save_to_db ) {
+            conn.reset( new Db::Connection( db_options ) );
         }
-        // clear the graph from the ordering step
-        ch_graph.clear();
+        for ( size_t i = 0; i < n_orderings; i++ ) {
+            std::vector<db_id_t>& order_id = order_ids[i];
+            std::map<db_id_t, uint32_t>& id_order_map = id_order_maps[i];
+            if ( load_ordering_from_db ) {
+                const std::string table = ordering_table( ordering_in_schema, modes, i );
+                if ( i > 0 ) {
+                    bool has_table = false;
+                    {
+                        Db::Result r( conn->exec( "select * from information_schema.tables where table_name='ordered_nodes_" + modes[i] + "' and table_schema='" + ordering_in_schema + "'" ) );
+                        has_table = r.size() == 1;
+                    }
+                    if ( !has_table ) {
+                        // orderings saved when every mode was contracted in the order of the first one
+                        std::cout << "* No table " << table << ", " << modes[i] << " is contracted in the order of " << modes[0] << std::endl;
+                        order_id = order_ids[0];
+                        id_order_map = id_order_maps[0];
+                        continue;
+                    }
+                }
+                std::cout << "* Loading node ordering from " << table << std::endl;
+                Db::ResultIterator res_it = conn->exec_it( "select node_id from " + table + " order by id asc" );
+                Db::ResultIterator it_end;
 
-        std::map<db_id_t, Road::Vertex> id_vertex_map; // id -> vertex
-        for ( auto it = vertices( road_graph ).first; it != vertices( road_graph ).second; it++ ) {
-            add_vertex( ch_graph );
-            id_vertex_map[road_graph[*it].db_id()] = *it;
+                uint32_t r = 0;
+                for ( ; res_it != it_end; res_it++, r++ ) {
+                    Db::RowValue res_i = *res_it;
+                    db_id_t db_id = res_i[0];
+                    order_id.push_back( db_id );
+                    id_order_map[db_id] = r;
+                }
+            }
+            else {
+                for ( uint32_t r = 0; r < ordered_nodes[i].size(); r++ ) {
+                    db_id_t id = road_graph[ordered_nodes[i][r]].db_id();
+                    order_id.push_back( id );
+                    id_order_map[id] = r;
+                }
+            }
         }
-        for ( CHVertex i = 0; i < order_id.size(); i++ ) {
-            db_id_t id = order_id[i];
-            ch_graph[i].id = id;
+        // vertices are numbered by the first ordering
+        const std::vector<db_id_t>& order_id = order_ids[0];
+        const std::map<db_id_t, uint32_t>& id_order_map = id_order_maps[0];
+        if ( use_cch ) {
+            cch_contraction( road_graph, order_id, id_order_map, metric_modes, save_to_db ? conn.get() : nullptr, copy_format, contraction_out_schema, out_file, progression );
+            return 0;
         }
 
         if ( save_to_db ) {
-            conn.exec( "CREATE SCHEMA IF NOT EXISTS " + contraction_out_schema );
-            conn.exec( "DROP TABLE IF EXISTS " + contraction_out_schema + ".query_graph CASCADE" );
-            conn.exec( "CREATE TABLE " + contraction_out_schema + ".query_graph (id SERIAL PRIMARY KEY, node_inf BIGINT NOT NULL, node_sup BIGINT NOT NULL, contracted_id BIGINT, weight INT NOT NULL, constraints INT NOT NULL)" );
-
-            conn.exec( "BEGIN" );
+            conn->exec( "CREATE SCHEMA IF NOT EXISTS " + contraction_out_schema );
         }
-
-        for ( uint32_t order = 0; order < order_id.size(); order++ ) {
-            Road::Vertex v = id_vertex_map[order_id[order]];
-            BOOST_ASSERT( ch_graph[order].id == order_id[order] );
-            for ( auto it = out_edges( v, road_graph ).first; it != out_edges( v, road_graph ).second; it++ ) {
-                if ( (road_graph[*it].traffic_rules() & TrafficRulePedestrian) == 0 ) {
-                    continue;
-                }
-                Road::Vertex s = target( *it, road_graph );
-                db_id_t id = road_graph[s].db_id();
-                bool added = false;
-                CHEdge e;
-                boost::tie( e, added ) = add_edge( order, id_order_map[id], ch_graph );
-                BOOST_ASSERT( added );
-                ch_graph[e].weight = std::max(int(road_graph[*it].length()*100.0),1);
-                if ( save_to_db ) {
-                    std::ostringstream ss;
-                    if ( order < id_order_map[id] ) {
-                        ss << "(" << order_id[order] << "," << id << "," << ch_graph[e].weight << ",1)";
-                    } else {
-                        ss << "(" << id << "," << order_id[order] << "," << ch_graph[e].weight << ",2)";
-                    }
-                    conn.exec( "INSERT INTO " + contraction_out_schema + ".query_graph (node_inf, node_sup, weight, constraints) VALUES " + ss.str() );
+        // one hierarchy per transport mode, each one in its own node ordering
+        std::vector<ContractedHierarchy> graphs;
+        for ( size_t i = 0; i < modes.size(); i++ ) {
+            std::string table = contraction_out_schema + ".query_graph" + ( i == 0 ? std::string() : "_" + modes[i] );
+            ContractedHierarchy hierarchy;
+            hierarchy.metric = modes[i];
+            hierarchy.edges = ch_contraction( road_graph, order_ids[i], id_order_maps[i], metric_modes[i], witness_limits,
+                                              save_to_db ? conn.get() : nullptr, copy_format, table, !out_file.empty() );
+            if ( i > 0 && order_ids[i] != order_id ) {
+                // rank in this hierarchy of each vertex of the first one
+                hierarchy.rank.resize( order_id.size() );
+                for ( uint32_t v = 0; v < order_id.size(); v++ ) {
+                    hierarchy.rank[v] = id_order_maps[i].at( order_id[v] );
                 }
             }
+            graphs.push_back( std::move( hierarchy ) );
         }
-        if ( save_to_db ) {
-            conn.exec( "COMMIT" );
+
+        std::unique_ptr<TDCHGraph> td_graph;
+        if ( time_dependent ) {
+            RoadEdgeSpeedProfile profile;
+            Db::Connection profile_conn( db_options );
+            load_car_speed_profiles( profile_conn, profile );
+            td_graph = td_car_contraction( road_graph, id_order_maps[car_index], profile );
         }
 
-        std::vector<Shortcut> shortcuts = contract_graph( ch_graph );
+        std::unique_ptr<ContractedTurnGraph> turn_graph;
+        if ( turn_restrictions ) {
+            Db::Connection restriction_conn( db_options );
+            Road::Restrictions restrictions = import_turn_restrictions( restriction_conn, road_graph, in_schema );
+            turn_graph.reset( new ContractedTurnGraph( turn_contraction( road_graph, restrictions, id_order_map, metric_modes[turn_restriction_index],
+                                                                      witness_limits, ch_ordering_mode ) ) );
+        }
 
-        if ( save_to_db ) {
-            std::cout << "* Saving contraction to schema " << contraction_out_schema << std::endl;
-            // write shortcuts
-            conn.exec( "BEGIN" );
-            for ( const Shortcut& s : shortcuts )
-            {
-                std::ostringstream ss;
-                if ( s.from < s.to ) {
-                    ss << "(" << ch_graph[s.from].id << "," << ch_graph[s.to].id << "," << ch_graph[s.contracted].id << "," << s.cost << ",1)";
-                } else {
-                    ss << "(" << ch_graph[s.to].id << "," << ch_graph[s.from].id << "," << ch_graph[s.contracted].id << "," << s.cost << ",2)";
-                }
-                conn.exec( "INSERT INTO " + contraction_out_schema + ".query_graph (node_inf, node_sup, contracted_id, weight, constraints) VALUES " + ss.str() );
-            }
-            conn.exec( "COMMIT" );
+        if ( !out_file.empty() ) {
+            export_ch_graph( out_file, order_id, graphs, std::move( td_graph ), modes[car_index], turn_graph.get(), road_sections( road_graph, id_order_map, metric_modes ), progression );
         }
     }
 }
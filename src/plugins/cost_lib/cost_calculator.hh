@@ -21,6 +21,7 @@
 #define AUTOMATION_LIB_COST_CALCULATOR_HH
 
 #include "reverse_multimodal_graph.hh"
+#include "multimodal_compiled_graph.hh"
 #include "speed_profile.hh"
 
 namespace Tempus {
@@ -129,6 +130,23 @@ public:
     // Multimodal travel time function
     template <class Graph>
     double travel_time( const Graph& graph, const Multimodal::Edge& e, db_id_t mode_id, double initial_time, double initial_shift_time, double& final_shift_time, db_id_t initial_trip_id, db_id_t& final_trip_id, double& wait_time ) const
+    {
+        return travel_time_( graph, e, e.connection_type(), nullptr, mode_id, initial_time, initial_shift_time, final_shift_time, initial_trip_id, final_trip_id, wait_time );
+    }
+
+    // Travel time of an arc of a compiled graph, whose connection type and public transport edge are read from the arc
+    double travel_time( const Multimodal::CompiledGraph& graph, size_t arc, db_id_t mode_id, double initial_time, double initial_shift_time, double& final_shift_time, db_id_t initial_trip_id, db_id_t& final_trip_id, double& wait_time ) const
+    {
+        const std::pair<PublicTransport::Edge, bool> pt_e = graph.arc_public_transport_edge( arc );
+        return travel_time_( graph, graph.arc_edge( arc ), graph.arc_connection( arc ), pt_e.second ? &pt_e.first : nullptr,
+                             mode_id, initial_time, initial_shift_time, final_shift_time, initial_trip_id, final_trip_id, wait_time );
+    }
+
+protected:
+    // Travel time of an edge of a given connection type. Its public transport edge is looked up in the graph when pt_edge is null
+    template <class Graph>
+    double travel_time_( const Graph& graph, const Multimodal::Edge& e, Multimodal::Edge::ConnectionType connection, const PublicTransport::Edge* pt_edge,
+                         db_id_t mode_id, double initial_time, double initial_shift_time, double& final_shift_time, db_id_t initial_trip_id, db_id_t& final_trip_id, double& wait_time ) const
     {
         // default (for non-PT edges)
         final_trip_id = 0;
@@ -139,7 +157,7 @@ public:
         const TransportMode& mode = graph.transport_modes().find( mode_id )->second;
         if ( std::find(allowed_transport_modes_.begin(), allowed_transport_modes_.end(), mode_id) != allowed_transport_modes_.end() ) 
         {
-            switch ( e.connection_type() ) {  
+            switch ( connection ) {
             case Multimodal::Edge::Road2Road: {
                 double c = road_travel_time( graph.road(), e.road_edge(), graph.road()[ e.road_edge() ].length(), initial_time, mode,
                                              walking_speed_, cycling_speed_, speed_profile_ ); 
@@ -196,9 +214,14 @@ public:
 					
             case Multimodal::Edge::Transport2Transport: { 
                 PublicTransport::Edge pt_e;
-                bool found = false;
-                boost::tie( pt_e, found ) = public_transport_edge( e );
-                BOOST_ASSERT(found);
+                if ( pt_edge ) {
+                    pt_e = *pt_edge;
+                }
+                else {
+                    bool found = false;
+                    boost::tie( pt_e, found ) = public_transport_edge( e );
+                    BOOST_ASSERT(found);
+                }
 						
                 if ( ! is_graph_reversed<Graph>::value ) {
                     // Timetable travel time calculation
@@ -361,7 +384,8 @@ public:
         }
         return std::numeric_limits<double>::max(); 
     }
-		
+
+public:
     // Mode transfer time function : returns numeric_limits<double>::max() when the mode transfer is impossible
     template <class Graph>
     double transfer_time( const Graph& graph, const Multimodal::Edge& edge, const TransportMode& initial_mode, const TransportMode& final_mode ) const
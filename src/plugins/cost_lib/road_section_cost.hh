@@ -0,0 +1,70 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef TEMPUS_ROAD_SECTION_COST_HH
+#define TEMPUS_ROAD_SECTION_COST_HH
+
+#include <algorithm>
+
+#include "road_graph.hh"
+#include "transport_modes.hh"
+#include "cch.hh"
+
+namespace Tempus {
+
+// Average cycling speed in km/h, the default of the Time/cycling_speed option of plugins
+#define DEFAULT_ROAD_CYCLING_SPEED 12.0
+
+///
+/// Integer cost of a road section for a transport mode, e.g. the cost of an edge of a contraction hierarchy.
+/// Costs of the pedestrian speed rule are distances, in hundredths of meters.
+/// Other costs are durations, in hundredths of seconds: at the speed limit of the section for cars, at cycling_speed for bicycles.
+/// \param cycling_speed Average cycling speed (km/h)
+/// \returns CCHMetric::infinity() if the traffic rules of the section do not allow the mode, or if there is no speed for it
+inline uint32_t road_section_cost( const Road::Section& section, const TransportMode& mode, double cycling_speed = DEFAULT_ROAD_CYCLING_SPEED )
+{
+    if ( ( section.traffic_rules() & mode.traffic_rules() ) == 0 ) {
+        return CCHMetric::infinity();
+    }
+    double cost = 0.0;
+    switch ( mode.speed_rule() ) {
+    case SpeedRulePedestrian:
+        cost = section.length() * 100.0;
+        break;
+    case SpeedRuleBicycle:
+        if ( cycling_speed <= 0 ) {
+            return CCHMetric::infinity();
+        }
+        cost = section.length() / ( cycling_speed / 3.6 ) * 100.0;
+        break;
+    case SpeedRuleCar:
+        if ( section.car_speed_limit() <= 0 ) {
+            return CCHMetric::infinity();
+        }
+        cost = section.length() / ( section.car_speed_limit() / 3.6 ) * 100.0;
+        break;
+    default:
+        return CCHMetric::infinity();
+    }
+    // a section is never free, nor as expensive as a forbidden one
+    return std::min( std::max( uint32_t( cost ), uint32_t( 1 ) ), CCHMetric::infinity() - 1 );
+}
+
+} // namespace Tempus
+
+#endif
@@ -52,4 +52,14 @@ std::pair<RoadEdgeSpeedProfile::PeriodIterator, RoadEdgeSpeedProfile::PeriodIter
     return std::make_pair( PeriodIterator(), PeriodIterator() );
 }
 
+const std::map<double, SpeedTimePeriod>* RoadEdgeSpeedProfile::periods( db_id_t section_id, TransportModeSpeedRule speed_rule ) const
+{
+    RoadEdgeSpeedProfileMap::const_iterator sit = speed_profile_.find( section_id );
+    if ( sit == speed_profile_.end() ) {
+        return 0;
+    }
+    SpeedProfile::const_iterator it = sit->second.find( speed_rule );
+    return it == sit->second.end() ? 0 : &it->second;
+}
+
 }
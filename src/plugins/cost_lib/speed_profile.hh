@@ -47,6 +47,9 @@ public:
 
     std::pair<PeriodIterator, PeriodIterator> periods_after( db_id_t section_id, TransportModeSpeedRule speed_rule, double begin_time, bool& found ) const;
 
+    // all the periods of a section for a speed rule, null if the section has no profile
+    const std::map<double, SpeedTimePeriod>* periods( db_id_t section_id, TransportModeSpeedRule speed_rule ) const;
+
     void add_period( db_id_t section_id, TransportModeSpeedRule speed_rule, double begin_time, double length, double speed );
 private:
     RoadEdgeSpeedProfileMap speed_profile_;
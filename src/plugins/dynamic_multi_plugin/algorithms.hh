@@ -32,9 +32,23 @@
 #include <type_traits>
 
 #include "reverse_multimodal_graph.hh"
+#include "multimodal_compiled_graph.hh"
 
 namespace Tempus {
 
+// Out edge as given to the travel time of a cost calculator: the edge itself, or its arc on a compiled graph
+// so that the connection type and the public transport edge stored with the arc are used
+template <class Graph>
+typename boost::graph_traits<Graph>::edge_descriptor out_edge_key( const Graph&, typename boost::graph_traits<Graph>::out_edge_iterator it )
+{
+    return *it;
+}
+
+inline size_t out_edge_key( const Multimodal::CompiledGraph& graph, Multimodal::CompiledGraph::out_edge_iterator it )
+{
+    return graph.arc( it );
+}
+
 template <class Object, class VertexDataMap, class Heuristic >
 struct HeuristicCompare
 {
@@ -98,7 +112,9 @@ struct HeuristicCompare
 			
             const TransportMode& initial_mode = *graph.transport_mode( min_object.mode );
 
-            BGL_FORALL_OUTEDGES_T( min_object.vertex, current_edge, graph, NetworkGraph ) {
+            typename boost::graph_traits<NetworkGraph>::out_edge_iterator ei, ei_end;
+            for ( boost::tie( ei, ei_end ) = out_edges( min_object.vertex, graph ); ei != ei_end; ei++ ) {
+                const typename boost::graph_traits<NetworkGraph>::edge_descriptor current_edge = *ei;
                 vis.examine_edge( current_edge, graph );
 
                 typename Automaton::State s;
@@ -139,7 +155,7 @@ struct HeuristicCompare
                         initial_shift_time = min_vd.shift_time();
                         // will update final_trip_id and wait_time
                         double travel_time = cost_calculator.travel_time( graph,
-                                                                          current_edge,
+                                                                          out_edge_key( graph, ei ),
                                                                           mode.db_id(),
                                                                           min_pi,
                                                                           initial_shift_time,
@@ -290,6 +290,7 @@ DynamicMultiPlugin::DynamicMultiPlugin( ProgressionCallback& progression, const
     if ( graph_ == nullptr ) {
         throw std::runtime_error( "Problem loading the multimodal graph" );
     }
+    compiled_graph_.reset( new Multimodal::CompiledGraph( *graph_ ) );
 
     const Road::Graph& road_graph = graph_->road();
 
@@ -315,11 +316,12 @@ DynamicMultiPlugin::DynamicMultiPlugin( ProgressionCallback& progression, const
 
 std::unique_ptr<PluginRequest> DynamicMultiPlugin::request( const VariantMap& options ) const
 {
-    return std::unique_ptr<PluginRequest>( new DynamicMultiPluginRequest( this, options, graph_ ) );
+    return std::unique_ptr<PluginRequest>( new DynamicMultiPluginRequest( this, options, graph_, compiled_graph_.get() ) );
 }
 
-DynamicMultiPluginRequest::DynamicMultiPluginRequest( const DynamicMultiPlugin* plugin, const VariantMap& options, const Multimodal::Graph* graph )
-    : PluginRequest( plugin, options ), graph_(graph)
+DynamicMultiPluginRequest::DynamicMultiPluginRequest( const DynamicMultiPlugin* plugin, const VariantMap& options, const Multimodal::Graph* graph,
+                                                      const Multimodal::CompiledGraph* compiled_graph )
+    : PluginRequest( plugin, options ), graph_(graph), compiled_graph_(compiled_graph)
 {
 }
 
@@ -648,7 +650,7 @@ std::unique_ptr<Result> DynamicMultiPluginRequest::process( const Request& reque
     }
 
     // we cannot use the regular visitor here, since we examine tuples instead of vertices
-    DestinationDetectorVisitor<Multimodal::Graph> vis( *graph_, destinations, request.steps().back().private_vehicule_at_destination(), verbose_algo_, iterations_ );
+    DestinationDetectorVisitor<Multimodal::CompiledGraph> vis( *compiled_graph_, destinations, request.steps().back().private_vehicule_at_destination(), verbose_algo_, iterations_ );
 
     bool path_found = false;
     try {
@@ -663,8 +665,8 @@ std::unique_ptr<Result> DynamicMultiPluginRequest::process( const Request& reque
                 combined_ls_algorithm_no_init( rgraph, automaton_, destination_o, vertex_data_pmap, cost_calculator, request.allowed_modes(), rvis, heuristic );
             }
             else {
-                EuclidianHeuristic<Multimodal::Graph> heuristic( *graph_, request.destination(), h_speed_max );
-                combined_ls_algorithm_no_init( *graph_, automaton_, origin_o, vertex_data_pmap, cost_calculator, request.allowed_modes(), vis, heuristic );
+                EuclidianHeuristic<Multimodal::CompiledGraph> heuristic( *compiled_graph_, request.destination(), h_speed_max );
+                combined_ls_algorithm_no_init( *compiled_graph_, automaton_, origin_o, vertex_data_pmap, cost_calculator, request.allowed_modes(), vis, heuristic );
             }
         }
         else {
@@ -674,7 +676,7 @@ std::unique_ptr<Result> DynamicMultiPluginRequest::process( const Request& reque
                 combined_ls_algorithm_no_init( rgraph, automaton_, destination_o, vertex_data_pmap, cost_calculator, request.allowed_modes(), rvis, NullHeuristic() );
             }
             else {
-                combined_ls_algorithm_no_init( *graph_, automaton_, origin_o, vertex_data_pmap, cost_calculator, request.allowed_modes(), vis, NullHeuristic() );
+                combined_ls_algorithm_no_init( *compiled_graph_, automaton_, origin_o, vertex_data_pmap, cost_calculator, request.allowed_modes(), vis, NullHeuristic() );
             }
         }
     }
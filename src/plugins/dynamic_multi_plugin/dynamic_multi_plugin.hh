@@ -21,6 +21,7 @@
 #include <boost/tuple/tuple_comparison.hpp>
 
 #include "plugin.hh"
+#include "multimodal_compiled_graph.hh"
 #include "automaton_lib/automaton.hh"
 #include "cost_lib/cost_calculator.hh"
 
@@ -99,13 +100,15 @@ public:
 
 private:
     const Multimodal::Graph* graph_;
+    /// Snapshot of the graph for forward searches
+    std::unique_ptr<Multimodal::CompiledGraph> compiled_graph_;
     Automaton<Road::Edge> automaton_;
 };
 
 class DynamicMultiPluginRequest : public PluginRequest
 {
 public:
-    DynamicMultiPluginRequest( const DynamicMultiPlugin* plugin, const VariantMap& options, const Multimodal::Graph* );
+    DynamicMultiPluginRequest( const DynamicMultiPlugin* plugin, const VariantMap& options, const Multimodal::Graph*, const Multimodal::CompiledGraph* );
 
     virtual std::unique_ptr<Result> process( const Request& request );
 
@@ -120,6 +123,7 @@ private:
     bool enable_trace_;
 
     const Multimodal::Graph* graph_;
+    const Multimodal::CompiledGraph* compiled_graph_;
 
     bool verbose_;
 };
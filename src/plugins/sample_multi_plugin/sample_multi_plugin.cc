@@ -78,6 +78,7 @@ public:
         if ( graph_ == nullptr ) {
             throw std::runtime_error( "Problem loading the multimodal graph" );
         }
+        compiled_graph_.reset( new Multimodal::CompiledGraph( *graph_ ) );
 
         ///
         /// In the post_build, we pre-compute a table of distances for each edge
@@ -103,12 +104,14 @@ public:
 
         REQUIRE( pt_lengths.size() == res.size() );
 
-        Multimodal::EdgeIterator ei, ei_end;
+        Multimodal::CompiledGraph::edge_iterator ei, ei_end;
 
         const Road::Graph& road_graph = graph_->road();
 
-        for ( boost::tie( ei, ei_end ) = edges( *graph_ ); ei != ei_end; ei++ ) {
-            switch ( ei->connection_type() ) {
+        // arcs of the snapshot have their connection type and public transport edge
+        for ( boost::tie( ei, ei_end ) = edges( *compiled_graph_ ); ei != ei_end; ei++ ) {
+            const size_t arc = compiled_graph_->arc( ei );
+            switch ( compiled_graph_->arc_connection( arc ) ) {
             case Multimodal::Edge::Road2Road: {
                 Road::Edge e = ei->road_edge();
                 distances[*ei] = road_graph[e].length();
@@ -121,7 +124,7 @@ public:
                 PublicTransport::Edge e;
                 const PublicTransport::Graph& pt_graph = *( ei->source().pt_graph() );
                 bool found;
-                boost::tie( e, found ) = public_transport_edge( *ei );
+                boost::tie( e, found ) = compiled_graph_->arc_public_transport_edge( arc );
 
                 if ( !found ) {
                     CERR << "Can't find pt edge" << *ei << std::endl;
@@ -191,15 +194,19 @@ public:
 
 private:
     const Multimodal::Graph* graph_;
+    /// Snapshot of the graph, for the searches
+    std::unique_ptr<Multimodal::CompiledGraph> compiled_graph_;
 };
 
 class MultiPluginRequest : public PluginRequest
 {
 private:
     const Multimodal::Graph* graph_;
+    const Multimodal::CompiledGraph* compiled_graph_;
 
 public:
-    MultiPluginRequest( const MultiPlugin* parent, const VariantMap& options, const Multimodal::Graph* graph ) : PluginRequest( parent, options ), graph_(graph)
+    MultiPluginRequest( const MultiPlugin* parent, const VariantMap& options, const Multimodal::Graph* graph, const Multimodal::CompiledGraph* compiled_graph ) :
+        PluginRequest( parent, options ), graph_(graph), compiled_graph_(compiled_graph)
     {
     }
 
@@ -297,13 +304,13 @@ public:
         // distance map (in number of nodes)
         std::vector<double> node_distance_map( n );
 
-        Multimodal::VertexIndexProperty vertex_index = get( boost::vertex_index, *graph_ );
+        Multimodal::VertexIndexProperty vertex_index = get( boost::vertex_index, *compiled_graph_ );
 
-        Tempus::PluginGraphVisitor vis( this );
+        Tempus::PluginCompiledGraphVisitor vis( this );
         destination_ = destination;
         try {
             if ( optimizing_criterion == CostId::CostDistance ) {
-                boost::dijkstra_shortest_paths_no_color_map( *graph_,
+                boost::dijkstra_shortest_paths_no_color_map( *compiled_graph_,
                                                              origin,
                                                              boost::make_iterator_property_map( pred_map.begin(), vertex_index ),
                                                              boost::make_iterator_property_map( node_distance_map.begin(), vertex_index ),
@@ -317,7 +324,7 @@ public:
                                                              );
             }
             else if ( optimizing_criterion == CostId::CostDuration ) {
-                boost::dijkstra_shortest_paths_no_color_map( *graph_,
+                boost::dijkstra_shortest_paths_no_color_map( *compiled_graph_,
                                                              origin,
                                                              boost::make_iterator_property_map( pred_map.begin(), vertex_index ),
                                                              boost::make_iterator_property_map( node_distance_map.begin(), vertex_index ),
@@ -424,7 +431,7 @@ public:
 
 std::unique_ptr<PluginRequest> MultiPlugin::request( const VariantMap& options ) const
 {
-    return std::unique_ptr<PluginRequest>( new MultiPluginRequest( this, options, graph_ ) );
+    return std::unique_ptr<PluginRequest>( new MultiPluginRequest( this, options, graph_, compiled_graph_.get() ) );
 }
 
 
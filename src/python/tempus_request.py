@@ -524,6 +524,43 @@ def parse_plugin_options(xml):
     return options
 
 
+def options_to_pson(plugin_options):
+    opt_r = []
+    plugin_options = plugin_options or {}
+    for k, v in plugin_options.iteritems():
+        tag_name = ''
+        value = str(v)
+        if isinstance(v, bool):
+            tag_name = "bool_value"
+            value = "true" if v else "false"
+        elif isinstance(v, int):
+            tag_name = "int_value"
+        elif isinstance(v, float):
+            tag_name = "float_value"
+        elif isinstance(v, str):
+            tag_name = "string_value"
+        elif isinstance(v, unicode):
+            tag_name = "string_value"
+        else:
+            raise RuntimeError("Unknown value type " + value)
+
+        opt_r.append(['option', {'name': k}, [tag_name, {'value': value}]])
+    opt_r.insert(0, 'options')
+    return opt_r
+
+
+def parse_cost_matrix(matrix):
+    """Returns destination vertex ids and the matrix as a list of rows, None for unreachable destinations"""
+    destinations = [int(d.attrib['vertex']) for d in matrix.findall('destination')]
+    rows = []
+    for row in matrix.findall('row'):
+        r = []
+        for c in (row.text or '').split():
+            r.append(None if c == 'INF' else float(c))
+        rows.append(r)
+    return (destinations, rows)
+
+
 class TempusRequest:
 
     def __init__(self, wps_url="http://127.0.0.1/wps"):
@@ -599,29 +636,7 @@ class TempusRequest:
         for mode in allowed_transport_modes:
             args['request'].append(['allowed_mode', mode])
 
-        # options
-        opt_r = []
-        plugin_options = plugin_options or {}
-        for k, v in plugin_options.iteritems():
-            tag_name = ''
-            value = str(v)
-            if isinstance(v, bool):
-                tag_name = "bool_value"
-                value = "true" if v else "false"
-            elif isinstance(v, int):
-                tag_name = "int_value"
-            elif isinstance(v, float):
-                tag_name = "float_value"
-            elif isinstance(v, str):
-                tag_name = "string_value"
-            elif isinstance(v, unicode):
-                tag_name = "string_value"
-            else:
-                raise RuntimeError("Unknown value type " + value)
-
-            opt_r.append(['option', {'name': k}, [tag_name, {'value': value}]])
-        opt_r.insert(0, 'options')
-        args['options'] = opt_r
+        args['options'] = options_to_pson(plugin_options)
 
         outputs = self.wps.execute('select', args)
         for k, v in outputs.iteritems():
@@ -634,6 +649,38 @@ class TempusRequest:
         r = "<select>\n" + r + "</select>\n"
         return r
 
+    def cost_matrix(
+        self,
+        plugin_name='ch_plugin',
+        plugin_options=None,
+        origins=None,
+        destinations=None,
+        allowed_transport_modes=None
+    ):
+        """Costs between each origin and each destination (lists of Point)
+        Without destination, costs to every reachable vertex are returned (one-to-all)"""
+        origins = origins or []
+        destinations = destinations or []
+        allowed_transport_modes = allowed_transport_modes or [1]
+        args = {
+            'plugin': ['plugin', {'name': plugin_name}],
+            'request': ['request']
+        }
+        for origin in origins:
+            args['request'].append(origin.to_pson('origin'))
+        for destination in destinations:
+            args['request'].append(destination.to_pson('destination'))
+        for mode in allowed_transport_modes:
+            args['request'].append(['allowed_mode', mode])
+        args['options'] = options_to_pson(plugin_options)
+
+        outputs = self.wps.execute('cost_matrix', args)
+        for k, v in outputs.iteritems():
+            self.save[k] = v
+
+        self.metrics = parse_metrics(outputs['metrics'])
+        return parse_cost_matrix(outputs['matrix'])
+
     def server_state(self):
         """Retrieve current server state and return a XML string"""
         plugins = self.plugin_list()
@@ -357,6 +357,7 @@ int main( int argc, char* argv[] )
     // initialize WPS services
     WPS::PluginListService plugin_list_service;
     WPS::SelectService select_service;
+    WPS::CostMatrixService cost_matrix_service;
     WPS::ConstantListService constant_list_service;
 
     if ( chdir_str != "" ) {
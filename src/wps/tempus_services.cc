@@ -17,11 +17,13 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <boost/format.hpp>
 
 #include "wps_service.hh"
 #include "multimodal_graph.hh"
 #include "request.hh"
+#include "cost_matrix.hh"
 #include "roadmap.hh"
 #include "db.hh"
 #include "utils/graph_db_link.hh"
@@ -323,6 +325,14 @@ db_id_t get_vertex_id_from_point_and_modes( const xmlNode* node, Db::Connection&
     return id;
 }
 
+boost::optional<Point2D> get_point_coordinates( const xmlNode* node )
+{
+    if ( !XML::has_prop( node, "x" ) || !XML::has_prop( node, "y" ) ) {
+        return boost::optional<Point2D>();
+    }
+    return Point2D( lexical_cast<float>( XML::get_prop( node, "x" ) ), lexical_cast<float>( XML::get_prop( node, "y" ) ) );
+}
+
 db_id_t get_vertex_id_from_point_and_mode( const xmlNode* node, Db::Connection& db, db_id_t mode )
 {
     std::vector<db_id_t> modes;
@@ -330,6 +340,36 @@ db_id_t get_vertex_id_from_point_and_mode( const xmlNode* node, Db::Connection&
     return get_vertex_id_from_point_and_modes( node, db, modes );
 }
 
+void parse_options( const xmlNode* options_node, VariantMap& options )
+{
+    const xmlNode* field = XML::get_next_nontext( options_node->children );
+
+    while ( field && !xmlStrcmp( field->name, ( const xmlChar* )"option" ) ) {
+        std::string name = XML::get_prop( field, "name" );
+
+        const xmlNode* value_node = XML::get_next_nontext( field->children );
+        Tempus::VariantType t = Tempus::IntVariant;
+
+        if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"bool_value" ) ) {
+            t = Tempus::BoolVariant;
+        }
+        else if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"int_value" ) ) {
+            t = Tempus::IntVariant;
+        }
+        else if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"float_value" ) ) {
+            t = Tempus::FloatVariant;
+        }
+        else if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"string_value" ) ) {
+            t = Tempus::StringVariant;
+        }
+
+        const std::string value = XML::get_prop( value_node, "value" );
+        options[name] = Variant::from_string( value, t );
+
+        field = XML::get_next_nontext( field->next );
+    }
+}
+
 ///
 /// "result" service, get results from a path query.
 ///
@@ -362,37 +402,7 @@ Service::ParameterMap SelectService::execute( const ParameterMap& input_paramete
 
     // get options
     VariantMap options;
-    {
-        const xmlNode* options_node = input_parameter_map.find( "options" )->second;
-        const xmlNode* field = XML::get_next_nontext( options_node->children );
-
-        while ( field && !xmlStrcmp( field->name, ( const xmlChar* )"option" ) ) {
-            std::string name = XML::get_prop( field, "name" );
-
-            const xmlNode* value_node = XML::get_next_nontext( field->children );
-            Tempus::VariantType t = Tempus::IntVariant;
-
-            if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"bool_value" ) ) {
-                t = Tempus::BoolVariant;
-            }
-            else if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"int_value" ) ) {
-                t = Tempus::IntVariant;
-            }
-            else if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"float_value" ) ) {
-                t = Tempus::FloatVariant;
-            }
-            else if ( !xmlStrcmp( value_node->name, ( const xmlChar* )"string_value" ) ) {
-                t = Tempus::StringVariant;
-            }
-
-            const std::string value = XML::get_prop( value_node, "value" );
-
-                
-            options[name] = Variant::from_string( value, t );
-
-            field = XML::get_next_nontext( field->next );
-        }
-    }
+    parse_options( input_parameter_map.find( "options" )->second, options );
     std::unique_ptr<PluginRequest> plugin_request( plugin->request(options) );
     std::unique_ptr<Result> result;
 
@@ -435,6 +445,7 @@ Service::ParameterMap SelectService::execute( const ParameterMap& input_paramete
 
         Request::Step origin;
         origin.set_location( get_vertex_id_from_point_and_mode( field, db, request.allowed_modes()[0] ) );
+        origin.set_coordinates( get_point_coordinates( field ) );
             
         request.set_origin( origin );
 
@@ -463,6 +474,7 @@ Service::ParameterMap SelectService::execute( const ParameterMap& input_paramete
             // destination id
             subfield = XML::get_next_nontext( field->children );
             step.set_location( get_vertex_id_from_point_and_mode( subfield, db, request.allowed_modes()[0] ) );
+            step.set_coordinates( get_point_coordinates( subfield ) );
 
             // constraint
             subfield = XML::get_next_nontext( subfield->next );
@@ -726,4 +738,127 @@ Service::ParameterMap SelectService::execute( const ParameterMap& input_paramete
     return output_parameters;
 }
 
+
+///
+/// "cost_matrix" service, costs between each origin and each destination.
+///
+/// Output var: matrix, the list of origins and destinations, followed by
+/// one row of costs per origin. Unreachable destinations have an INF cost.
+/// Without destination in the request, destinations are chosen by the plugin (one-to-all queries).
+///
+CostMatrixService::CostMatrixService() : Service( "cost_matrix" ) {
+    add_input_parameter( "plugin" );
+    add_input_parameter( "request" );
+    add_input_parameter( "options" );
+    add_output_parameter( "matrix" );
+    add_output_parameter( "metrics" );
+}
+
+Service::ParameterMap CostMatrixService::execute( const ParameterMap& input_parameter_map ) const
+{
+    ParameterMap output_parameters;
+
+    // Ensure XML is OK
+    Service::check_parameters( input_parameter_map, input_parameter_schema_ );
+    const xmlNode* plugin_node = input_parameter_map.find( "plugin" )->second;
+    const std::string plugin_str = XML::get_prop( plugin_node, "name" );
+    Plugin* plugin = PluginFactory::instance()->plugin( plugin_str );
+
+    if ( plugin == nullptr ) {
+        throw std::invalid_argument( "Cannot find plugin " + plugin_str );
+    }
+
+    VariantMap options;
+    parse_options( input_parameter_map.find( "options" )->second, options );
+    std::unique_ptr<PluginRequest> plugin_request( plugin->request(options) );
+
+    Tempus::CostMatrixRequest request;
+    std::vector<const xmlNode*> origin_nodes, destination_nodes;
+    std::vector<db_id_t> modes;
+    {
+        const xmlNode* request_node = input_parameter_map.find( "request" )->second;
+        const xmlNode* field = XML::get_next_nontext( request_node->children );
+        while ( field ) {
+            if ( !xmlStrcmp( field->name, ( const xmlChar* )"origin" ) ) {
+                origin_nodes.push_back( field );
+            }
+            else if ( !xmlStrcmp( field->name, ( const xmlChar* )"destination" ) ) {
+                destination_nodes.push_back( field );
+            }
+            else if ( !xmlStrcmp( field->name, ( const xmlChar* )"allowed_mode" ) ) {
+                modes.push_back( lexical_cast<db_id_t>( field->children->content ) );
+            }
+            field = XML::get_next_nontext( field->next );
+        }
+    }
+    if ( modes.empty() ) {
+        modes.push_back( TransportModeWalking );
+    }
+    request.set_allowed_modes( modes );
+
+    std::unique_ptr<CostMatrix> matrix;
+    {
+        Db::Connection db( plugin->db_options() );
+
+        std::vector<db_id_t> origins, destinations;
+        for ( const xmlNode* n : origin_nodes ) {
+            origins.push_back( get_vertex_id_from_point_and_mode( n, db, modes[0] ) );
+        }
+        for ( const xmlNode* n : destination_nodes ) {
+            destinations.push_back( get_vertex_id_from_point_and_mode( n, db, modes[0] ) );
+        }
+        request.set_origins( origins );
+        request.set_destinations( destinations );
+
+        matrix = plugin_request->process_matrix( request );
+    }
+
+    // metrics
+    xmlNode* metrics_node = XML::new_node( "metrics" );
+
+    for ( auto metric : plugin_request->metrics() ) {
+        xmlNode* metric_node = XML::new_node( "metric" );
+        XML::new_prop( metric_node, "name", metric.first );
+        XML::new_prop( metric_node, "value",
+                       plugin_request->metric_to_string( metric.first ) );
+
+        XML::add_child( metrics_node, metric_node );
+    }
+
+    output_parameters[ "metrics" ] = metrics_node;
+
+    // matrix
+    xmlNode* root_node = XML::new_node( "matrix" );
+    for ( db_id_t id : matrix->origins() ) {
+        xmlNode* node = XML::new_node( "origin" );
+        XML::new_prop( node, "vertex", id );
+        XML::add_child( root_node, node );
+    }
+    for ( db_id_t id : matrix->destinations() ) {
+        xmlNode* node = XML::new_node( "destination" );
+        XML::new_prop( node, "vertex", id );
+        XML::add_child( root_node, node );
+    }
+    for ( size_t i = 0; i < matrix->origins().size(); i++ ) {
+        std::ostringstream row;
+        for ( size_t j = 0; j < matrix->destinations().size(); j++ ) {
+            if ( j > 0 ) {
+                row << " ";
+            }
+            if ( matrix->is_reachable( i, j ) ) {
+                row << matrix->cost( i, j );
+            }
+            else {
+                row << "INF";
+            }
+        }
+        xmlNode* row_node = XML::new_node( "row" );
+        XML::add_child( row_node, XML::new_text( row.str() ) );
+        XML::add_child( root_node, row_node );
+    }
+
+    output_parameters[ "matrix" ] = root_node;
+    return output_parameters;
+}
+
 } // WPS namespace
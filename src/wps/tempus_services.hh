@@ -38,6 +38,12 @@ public:
     Service::ParameterMap execute( const ParameterMap& input_parameter_map ) const;
 };
 
+class CostMatrixService : public Service {
+public:
+    CostMatrixService();
+    Service::ParameterMap execute( const ParameterMap& input_parameter_map ) const;
+};
+
 } // WPS namespace
 
 #endif
@@ -0,0 +1,173 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Query latency of a CH query graph depending on the layout of its edge properties (see CHEdgeLayout):
+// whole properties next to the targets (CHQueryAoS) or costs only, details in a parallel array (CHQuery).
+//
+// The graph is a grid with pseudo-random costs, ordered and contracted as a CCH.
+// Usage: ch_layout_benchmark [grid width] [number of queries] [number of rounds]
+// Figures are only meaningful with an optimized build (CMAKE_BUILD_TYPE=Release).
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include <boost/property_map/function_property_map.hpp>
+
+#include "ch_search.hh"
+
+using namespace Tempus;
+
+typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+
+struct QueryTimes
+{
+    double search_us;
+    double unpack_us;
+    uint64_t checksum;
+};
+
+template <typename Graph>
+QueryTimes run_queries( const Graph& graph, const std::vector<std::pair<CHVertex, CHVertex>>& queries, Workspace& ws )
+{
+    auto weight_map_fn = []( const typename Graph::edge_descriptor& e ) {
+        return uint32_t( e.property().b.cost );
+    };
+    auto weight_map = boost::make_function_property_map<typename Graph::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+    QueryTimes times = { 0.0, 0.0, 0 };
+    std::vector<uint32_t> road_edges;
+    CHQueryStatistics stats;
+    for ( const auto& q : queries ) {
+        ws.new_query();
+        uint32_t cost = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        bool found = bidirectional_ch_dijkstra( graph, q.first, q.second, weight_map, ws, true, cost, stats );
+        auto t1 = std::chrono::steady_clock::now();
+        road_edges.clear();
+        if ( found ) {
+            unpack_ch_path( graph, ws.path_edges(), road_edges, ws.unpack_stack() );
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        times.search_us += std::chrono::duration<double, std::micro>( t1 - t0 ).count();
+        times.unpack_us += std::chrono::duration<double, std::micro>( t2 - t1 ).count();
+
+        // roadmaps read the database ID of each original edge
+        times.checksum += cost;
+        for ( uint32_t e : road_edges ) {
+            times.checksum += graph.edge_details( e ).db_id;
+        }
+    }
+    times.search_us /= queries.size();
+    times.unpack_us /= queries.size();
+    return times;
+}
+
+int main( int argc, char** argv )
+{
+    const uint32_t w = argc > 1 ? atoi( argv[1] ) : 150;
+    const size_t n_queries = argc > 2 ? atoi( argv[2] ) : 2000;
+    const int n_rounds = argc > 3 ? atoi( argv[3] ) : 5;
+    const uint32_t n = w * w;
+
+    std::vector<std::pair<uint32_t, uint32_t>> input_edges;
+    for ( uint32_t v = 0; v < n; v++ ) {
+        if ( v % w + 1 < w ) {
+            input_edges.push_back( std::make_pair( v, v + 1 ) );
+            input_edges.push_back( std::make_pair( v + 1, v ) );
+        }
+        if ( v + w < n ) {
+            input_edges.push_back( std::make_pair( v, v + w ) );
+            input_edges.push_back( std::make_pair( v + w, v ) );
+        }
+    }
+    std::vector<uint32_t> order = cch_nested_dissection_order( n, input_edges );
+    std::vector<uint32_t> rank( n );
+    for ( uint32_t r = 0; r < n; r++ ) {
+        rank[order[r]] = r;
+    }
+    for ( auto& e : input_edges ) {
+        e = std::make_pair( rank[e.first], rank[e.second] );
+    }
+    CCHTopology topology( n, input_edges );
+    std::vector<db_id_t> edge_db_id( input_edges.size() );
+    std::vector<uint32_t> weights( input_edges.size() );
+    srand( 42 );
+    for ( size_t i = 0; i < input_edges.size(); i++ ) {
+        edge_db_id[i] = i + 1;
+        weights[i] = 100 + rand() % 1000;
+    }
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> built = cch_query_graph( topology, topology.customize( weights ), edge_db_id, middle_node );
+    const CHQuery split = link_ch_shortcuts( *built, middle_node );
+
+    // the same graph with the other layout, edges in the same order
+    std::vector<std::pair<CHVertex, CHVertex>> targets;
+    std::vector<uint32_t> up_degrees( n );
+    std::vector<CHEdgeProperty> properties;
+    auto add_edge = [&]( CHVertex u, CHVertex v, const CHEdge& e ) {
+        CHEdgeProperty p;
+        std::memset( &p, 0, sizeof( p ) );
+        p.data = e.property().data;
+        p.db_id = split.edge_details( e ).db_id;
+        targets.push_back( std::make_pair( u, v ) );
+        properties.push_back( p );
+    };
+    for ( CHVertex u = 0; u < n; u++ ) {
+        for ( auto oei = out_edges( u, split ).first; oei != out_edges( u, split ).second; oei++ ) {
+            add_edge( u, target( *oei, split ), *oei );
+            up_degrees[u]++;
+        }
+        for ( auto iei = in_edges( u, split ).first; iei != in_edges( u, split ).second; iei++ ) {
+            add_edge( u, source( *iei, split ), *iei );
+        }
+    }
+    const CHQueryAoS aos = link_ch_shortcuts( CHQueryAoS( targets.begin(), targets.end(), n, up_degrees.begin(), properties.begin() ), middle_node );
+
+    std::cout << n << " vertices, " << split.edge_array().size() << " edges" << std::endl;
+    std::cout << "bytes per edge: aos " << sizeof( CHQueryAoS::EdgeData )
+              << ", split " << sizeof( CHQuery::EdgeData ) << " + " << sizeof( CHEdgeDetails ) << std::endl;
+
+    std::vector<std::pair<CHVertex, CHVertex>> queries;
+    for ( size_t i = 0; i < n_queries; i++ ) {
+        queries.push_back( std::make_pair( rand() % n, rand() % n ) );
+    }
+
+    // rounds alternate layouts, the best one of each layout is kept
+    Workspace ws( n );
+    QueryTimes best_aos = { 1e30, 1e30, 0 }, best_split = { 1e30, 1e30, 0 };
+    for ( int r = 0; r < n_rounds; r++ ) {
+        QueryTimes t_aos = run_queries( aos, queries, ws );
+        QueryTimes t_split = run_queries( split, queries, ws );
+        if ( t_aos.checksum != t_split.checksum ) {
+            std::cerr << "Different paths with the two layouts" << std::endl;
+            return 1;
+        }
+        if ( t_aos.search_us + t_aos.unpack_us < best_aos.search_us + best_aos.unpack_us ) {
+            best_aos = t_aos;
+        }
+        if ( t_split.search_us + t_split.unpack_us < best_split.search_us + best_split.unpack_us ) {
+            best_split = t_split;
+        }
+    }
+
+    std::cout << "layout\tsearch (us)\tunpack (us)" << std::endl;
+    std::cout << "aos\t" << best_aos.search_us << "\t" << best_aos.unpack_us << std::endl;
+    std::cout << "split\t" << best_split.search_us << "\t" << best_split.unpack_us << std::endl;
+    return 0;
+}
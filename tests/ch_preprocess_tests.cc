@@ -0,0 +1,324 @@
+/**
+ *   Copyright (C) 2012-2013 IFSTTAR (http://www.ifsttar.fr)
+ *   Copyright (C) 2012-2013 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Kept apart from tests.cc since the graph used for the contraction and the query graph
+// both define CHVertex and CHEdge
+
+#ifdef _WIN32
+#pragma warning(push, 0)
+#endif
+#include <boost/graph/dijkstra_shortest_paths.hpp>
+#include <boost/test/unit_test.hpp>
+#ifdef _WIN32
+#pragma warning(pop)
+#endif
+
+#include "ch_preprocess.hh"
+#include "cost_lib/road_section_cost.hh"
+#include "grids.hh"
+
+#include <limits>
+#include <queue>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace boost::unit_test ;
+using namespace Tempus;
+
+BOOST_AUTO_TEST_SUITE( tempus_ch_preprocess )
+
+///
+/// Input graph of ch_preprocess out of weighted edges, vertex v having the database id grid_node_id( v )
+static CHGraph weighted_graph( uint32_t n, const GridEdges& edges, const std::vector<uint32_t>& weights )
+{
+    CHGraph graph;
+    for ( uint32_t v = 0; v < n; v++ ) {
+        graph[add_vertex( graph )].id = grid_node_id( v );
+    }
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        EdgeProperty p;
+        p.weight = TCost( weights[i] );
+        add_edge( edges[i].first, edges[i].second, p, graph );
+    }
+    return graph;
+}
+
+///
+/// Hierarchy computed the way ch_preprocess does: node ordering, then contraction of the graph with vertices numbered by rank
+struct ContractedGraph
+{
+    /// rank of each vertex
+    std::vector<uint32_t> rank;
+    /// upward edges (to a higher rank) of each rank, original edges and shortcuts
+    std::vector<std::vector<std::pair<uint32_t, TCost>>> up;
+    /// downward edges of each rank, reversed: from the lowest end to the highest one
+    std::vector<std::vector<std::pair<uint32_t, TCost>>> down;
+    size_t n_shortcuts;
+};
+
+static ContractedGraph contract( uint32_t n, const GridEdges& edges, const std::vector<uint32_t>& weights,
+                                 const WitnessSearchLimits& limits, CHOrderingMode mode )
+{
+    ContractedGraph ch;
+    CHGraph ordering_graph = weighted_graph( n, edges, weights );
+    std::vector<CHVertex> ordered = order_graph( ordering_graph, [&ordering_graph]( CHVertex v ) { return ordering_graph[v].id; }, limits, mode );
+    BOOST_REQUIRE_EQUAL( ordered.size(), n );
+    ch.rank.assign( n, n );
+    for ( uint32_t r = 0; r < n; r++ ) {
+        BOOST_REQUIRE_EQUAL( ch.rank[ordered[r]], n );
+        ch.rank[ordered[r]] = r;
+    }
+
+    GridEdges ranked_edges;
+    for ( const auto& e : edges ) {
+        ranked_edges.push_back( std::make_pair( ch.rank[e.first], ch.rank[e.second] ) );
+    }
+    CHGraph graph = weighted_graph( n, ranked_edges, weights );
+    ch.up.resize( n );
+    ch.down.resize( n );
+    auto add = [&ch]( uint32_t u, uint32_t v, TCost c ) {
+        if ( u < v ) {
+            ch.up[u].push_back( std::make_pair( v, c ) );
+        }
+        else {
+            ch.down[v].push_back( std::make_pair( u, c ) );
+        }
+    };
+    for ( size_t i = 0; i < ranked_edges.size(); i++ ) {
+        add( ranked_edges[i].first, ranked_edges[i].second, TCost( weights[i] ) );
+    }
+    std::vector<Shortcut> shortcuts = contract_graph( graph, limits );
+    for ( const Shortcut& s : shortcuts ) {
+        BOOST_CHECK_LT( s.contracted, std::min( s.from, s.to ) );
+        add( uint32_t( s.from ), uint32_t( s.to ), s.cost );
+    }
+    ch.n_shortcuts = shortcuts.size();
+    return ch;
+}
+
+///
+/// Costs of a Dijkstra from a rank over one direction of the hierarchy
+static std::vector<TCost> upward_costs( const std::vector<std::vector<std::pair<uint32_t, TCost>>>& adjacency, uint32_t source )
+{
+    std::vector<TCost> cost( adjacency.size(), std::numeric_limits<TCost>::max() );
+    typedef std::pair<TCost, uint32_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    cost[source] = 0;
+    queue.push( Entry( 0, source ) );
+    while ( !queue.empty() ) {
+        const Entry top = queue.top();
+        queue.pop();
+        if ( top.first > cost[top.second] ) {
+            continue;
+        }
+        for ( const auto& e : adjacency[top.second] ) {
+            if ( top.first + e.second < cost[e.first] ) {
+                cost[e.first] = top.first + e.second;
+                queue.push( Entry( cost[e.first], e.first ) );
+            }
+        }
+    }
+    return cost;
+}
+
+///
+/// Check that CH queries between every pair of vertices give the costs of Dijkstra on the input graph
+static void check_against_dijkstra( uint32_t n, const GridEdges& edges, const std::vector<uint32_t>& weights, const ContractedGraph& ch )
+{
+    CHGraph graph = weighted_graph( n, edges, weights );
+    std::vector<std::vector<TCost>> backward( n );
+    for ( uint32_t t = 0; t < n; t++ ) {
+        backward[t] = upward_costs( ch.down, ch.rank[t] );
+    }
+    size_t n_errors = 0;
+    for ( uint32_t s = 0; s < n; s++ ) {
+        std::vector<TCost> dijkstra( n );
+        boost::dijkstra_shortest_paths( graph, s, boost::weight_map( get( &EdgeProperty::weight, graph ) )
+                                        .distance_map( boost::make_iterator_property_map( dijkstra.begin(), get( boost::vertex_index, graph ) ) )
+                                        .distance_inf( std::numeric_limits<TCost>::max() ) );
+        const std::vector<TCost> forward = upward_costs( ch.up, ch.rank[s] );
+        for ( uint32_t t = 0; t < n; t++ ) {
+            // the highest vertex of the shortest path is settled by both searches
+            TCost best = std::numeric_limits<TCost>::max();
+            for ( uint32_t v = 0; v < n; v++ ) {
+                if ( forward[v] != std::numeric_limits<TCost>::max() && backward[t][v] != std::numeric_limits<TCost>::max() ) {
+                    best = std::min( best, forward[v] + backward[t][v] );
+                }
+            }
+            if ( best != dijkstra[t] ) {
+                n_errors++;
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL( n_errors, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( testWitnessSearchLimits )
+{
+    const uint32_t w = 12;
+    const GridEdges edges = grid_edges( w );
+    const std::vector<uint32_t> weights = cyclic_weights( edges.size(), 10, 37, 90 );
+
+    const ContractedGraph exact = contract( w * w, edges, weights, WitnessSearchLimits(), CHOrderingIndependentSets );
+    check_against_dijkstra( w * w, edges, weights, exact );
+
+    // searches stopped by limits miss witnesses: more shortcuts, but still shortest paths.
+    // A hop limit of 1 only finds direct edges, many searches are stopped by 5 settled nodes
+    for ( int hops : { 1, 3 } ) {
+        for ( int settled : { 0, 5 } ) {
+            WitnessSearchLimits limits;
+            limits.max_hops = hops;
+            limits.max_settled = settled;
+            const ContractedGraph limited = contract( w * w, edges, weights, limits, CHOrderingIndependentSets );
+            BOOST_TEST_MESSAGE( "hops " << hops << ", settled " << settled << ": " << limited.n_shortcuts << " shortcuts, " << exact.n_shortcuts << " without limits" );
+            BOOST_CHECK_GE( limited.n_shortcuts, exact.n_shortcuts );
+            check_against_dijkstra( w * w, edges, weights, limited );
+        }
+    }
+
+    // one-way streets: witnesses of a node are searched from each of its predecessors to several successors at once
+    const GridEdges one_way = grid_edges( w, []( const std::pair<uint32_t, uint32_t>& street ) { return ( street.first / 3 ) % 2 == 0; } );
+    const std::vector<uint32_t> one_way_weights = cyclic_weights( one_way.size(), 5, 13, 50 );
+    check_against_dijkstra( w * w, one_way, one_way_weights, contract( w * w, one_way, one_way_weights, WitnessSearchLimits(), CHOrderingIndependentSets ) );
+}
+
+BOOST_AUTO_TEST_CASE( testParallelContraction )
+{
+    const uint32_t w = 16;
+    const GridEdges edges = grid_edges( w );
+    const std::vector<uint32_t> weights = cyclic_weights( edges.size(), 10, 37, 90 );
+
+    const ContractedGraph sequential = contract( w * w, edges, weights, WitnessSearchLimits(), CHOrderingIndependentSets );
+#ifdef _OPENMP
+    const int max_threads = omp_get_max_threads();
+    // nodes of an independent set share no neighbour: buffering shortcuts per thread
+    // and merging them afterwards gives the ordering of a single thread
+    for ( int threads : { 2, 4 } ) {
+        omp_set_num_threads( threads );
+        const ContractedGraph parallel = contract( w * w, edges, weights, WitnessSearchLimits(), CHOrderingIndependentSets );
+        BOOST_CHECK( parallel.rank == sequential.rank );
+        BOOST_CHECK_EQUAL( parallel.n_shortcuts, sequential.n_shortcuts );
+        check_against_dijkstra( w * w, edges, weights, parallel );
+    }
+    omp_set_num_threads( max_threads );
+#else
+    check_against_dijkstra( w * w, edges, weights, sequential );
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( testLazyOrdering )
+{
+    const uint32_t w = 14;
+    const GridEdges edges = grid_edges( w );
+    const std::vector<uint32_t> weights = cyclic_weights( edges.size(), 10, 37, 90 );
+
+    // estimates by default, exact costs, tiny estimates, and estimates bounded by the settle limit of contractions
+    for ( int estimate : { 30, 0, 3 } ) {
+        for ( int settled : { 0, 10 } ) {
+            WitnessSearchLimits limits;
+            limits.max_settled = settled;
+            limits.estimate_max_settled = estimate;
+            const ContractedGraph lazy = contract( w * w, edges, weights, limits, CHOrderingLazyUpdates );
+            BOOST_TEST_MESSAGE( "estimate " << estimate << ", settled " << settled << ": " << lazy.n_shortcuts << " shortcuts" );
+            check_against_dijkstra( w * w, edges, weights, lazy );
+        }
+    }
+
+    const GridEdges one_way = grid_edges( w, []( const std::pair<uint32_t, uint32_t>& street ) { return ( street.first / 3 ) % 2 == 0; } );
+    const std::vector<uint32_t> one_way_weights = cyclic_weights( one_way.size(), 5, 13, 50 );
+    check_against_dijkstra( w * w, one_way, one_way_weights, contract( w * w, one_way, one_way_weights, WitnessSearchLimits(), CHOrderingLazyUpdates ) );
+}
+
+static TransportMode transport_mode( unsigned traffic_rules, TransportModeSpeedRule speed_rule )
+{
+    TransportMode mode;
+    mode.set_is_public_transport( false );
+    mode.set_traffic_rules( traffic_rules );
+    mode.set_speed_rule( speed_rule );
+    return mode;
+}
+
+BOOST_AUTO_TEST_CASE( testModeCosts )
+{
+    const TransportMode walking = transport_mode( TrafficRulePedestrian, SpeedRulePedestrian );
+    const TransportMode bicycle = transport_mode( TrafficRuleBicycle, SpeedRuleBicycle );
+    const TransportMode car = transport_mode( TrafficRuleCar, SpeedRuleCar );
+
+    Road::Section section;
+    section.set_length( 120.0 );
+    section.set_car_speed_limit( 36.0 );
+    section.set_traffic_rules( TrafficRulePedestrian | TrafficRuleCar );
+    // hundredths of meters, then hundredths of seconds
+    BOOST_CHECK_EQUAL( road_section_cost( section, walking ), 12000 );
+    BOOST_CHECK_EQUAL( road_section_cost( section, car ), 1200 );
+    // the traffic rules of the section do not allow bicycles
+    BOOST_CHECK_EQUAL( road_section_cost( section, bicycle ), CCHMetric::infinity() );
+
+    section.set_traffic_rules( TrafficRuleBicycle );
+    BOOST_CHECK_EQUAL( road_section_cost( section, walking ), CCHMetric::infinity() );
+    BOOST_CHECK_EQUAL( road_section_cost( section, car ), CCHMetric::infinity() );
+    // 12 km/h by default, as the Time/cycling_speed option of plugins
+    BOOST_CHECK_EQUAL( road_section_cost( section, bicycle ), 3600 );
+    BOOST_CHECK_EQUAL( road_section_cost( section, bicycle, 24.0 ), 1800 );
+
+    // a car needs a speed limit, a section is never free
+    section.set_traffic_rules( TrafficRuleCar | TrafficRulePedestrian );
+    section.set_car_speed_limit( 0.0 );
+    BOOST_CHECK_EQUAL( road_section_cost( section, car ), CCHMetric::infinity() );
+    section.set_length( 0.0 );
+    BOOST_CHECK_EQUAL( road_section_cost( section, walking ), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( testTransportModeHierarchies )
+{
+    // streets of a grid, some of them pedestrian or car only
+    const uint32_t w = 10;
+    const GridEdges streets = grid_streets( w );
+    std::vector<Road::Section> sections( streets.size() );
+    for ( size_t i = 0; i < streets.size(); i++ ) {
+        sections[i].set_length( float( 50 + ( i * 37 ) % 200 ) );
+        sections[i].set_car_speed_limit( float( 30 + ( i * 13 ) % 60 ) );
+        sections[i].set_traffic_rules( i % 5 == 0 ? TrafficRulePedestrian
+                                       : ( i % 7 == 0 ? TrafficRuleCar : TrafficRulePedestrian | TrafficRuleCar ) );
+    }
+
+    // each transport mode is contracted in its own order, on its own costs
+    std::vector<uint32_t> previous_rank;
+    for ( const TransportMode& mode : { transport_mode( TrafficRulePedestrian, SpeedRulePedestrian ), transport_mode( TrafficRuleCar, SpeedRuleCar ) } ) {
+        GridEdges edges;
+        std::vector<uint32_t> weights;
+        for ( size_t i = 0; i < streets.size(); i++ ) {
+            const uint32_t cost = road_section_cost( sections[i], mode );
+            if ( cost == CCHMetric::infinity() ) {
+                continue;
+            }
+            edges.push_back( streets[i] );
+            edges.push_back( std::make_pair( streets[i].second, streets[i].first ) );
+            weights.insert( weights.end(), 2, cost );
+        }
+        BOOST_CHECK_LT( edges.size(), 2 * streets.size() );
+
+        const ContractedGraph ch = contract( w * w, edges, weights, WitnessSearchLimits(), CHOrderingIndependentSets );
+        check_against_dijkstra( w * w, edges, weights, ch );
+        BOOST_CHECK( ch.rank != previous_rank );
+        previous_rank = ch.rank;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+/**
+ *   Copyright (C) 2012-2013 IFSTTAR (http://www.ifsttar.fr)
+ *   Copyright (C) 2012-2013 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Grids shared by the tests of contraction hierarchies
+
+#ifndef TEMPUS_TESTS_GRIDS_HH
+#define TEMPUS_TESTS_GRIDS_HH
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "base.hh"
+
+namespace Tempus
+{
+
+typedef std::vector<std::pair<uint32_t, uint32_t>> GridEdges;
+
+///
+/// Streets of a w x w grid: vertex v is at column v % w and row v / w,
+/// each vertex is linked to its right neighbour, then to its bottom neighbour
+inline GridEdges grid_streets( uint32_t w )
+{
+    GridEdges streets;
+    for ( uint32_t v = 0; v < w * w; v++ ) {
+        if ( v % w + 1 < w ) {
+            streets.push_back( std::make_pair( v, v + 1 ) );
+        }
+        if ( v + w < w * w ) {
+            streets.push_back( std::make_pair( v, v + w ) );
+        }
+    }
+    return streets;
+}
+
+///
+/// Edges of a w x w grid, in the order of grid_streets(): each street, then the opposite edge unless one_way( street ) is true
+inline GridEdges grid_edges( uint32_t w, bool (*one_way)( const std::pair<uint32_t, uint32_t>& ) = nullptr )
+{
+    GridEdges edges;
+    for ( const auto& street : grid_streets( w ) ) {
+        edges.push_back( street );
+        if ( !one_way || !one_way( street ) ) {
+            edges.push_back( std::make_pair( street.second, street.first ) );
+        }
+    }
+    return edges;
+}
+
+///
+/// Deterministic edge weights: base + ( i * factor ) % modulo
+inline std::vector<uint32_t> cyclic_weights( size_t n_edges, uint32_t base, uint32_t factor, uint32_t modulo )
+{
+    std::vector<uint32_t> weights( n_edges );
+    for ( size_t i = 0; i < n_edges; i++ ) {
+        weights[i] = uint32_t( base + ( i * factor ) % modulo );
+    }
+    return weights;
+}
+
+///
+/// Database id of a grid vertex, different from its index
+inline db_id_t grid_node_id( uint32_t v )
+{
+    return 1000 + v * 2;
+}
+
+inline std::vector<db_id_t> grid_node_ids( uint32_t n )
+{
+    std::vector<db_id_t> node_id( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        node_id[v] = grid_node_id( v );
+    }
+    return node_id;
+}
+
+} // namespace Tempus
+
+#endif
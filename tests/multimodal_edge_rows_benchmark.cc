@@ -0,0 +1,151 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Cost of the lookup of the stops and POIs attached to a road edge, done several times per road edge by the
+// out and in edge iterators of a Multimodal::Graph: edge-indexed rows of the graph against maps keyed by road edge.
+//
+// The graph is a road grid, a given percentage of its sections having a stop or a POI.
+// Usage: multimodal_edge_rows_benchmark [grid width] [percentage of sections with attachments] [number of rounds]
+// Figures are only meaningful with an optimized build (CMAKE_BUILD_TYPE=Release).
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+
+#include "multimodal_graph.hh"
+
+using namespace Tempus;
+
+template <typename F>
+double best_ns( int n_rounds, size_t n_calls, size_t& checksum, F f )
+{
+    double best = 1e30;
+    for ( int r = 0; r < n_rounds; r++ ) {
+        auto t0 = std::chrono::steady_clock::now();
+        checksum += f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min( best, std::chrono::duration<double, std::nano>( t1 - t0 ).count() / n_calls );
+    }
+    return best;
+}
+
+int main( int argc, char** argv )
+{
+    const uint32_t w = argc > 1 ? atoi( argv[1] ) : 700;
+    const uint32_t percent = argc > 2 ? atoi( argv[2] ) : 5;
+    const int n_rounds = argc > 3 ? atoi( argv[3] ) : 5;
+    const uint32_t n = w * w;
+
+    std::vector<std::pair<uint32_t, uint32_t>> road_edges;
+    for ( uint32_t v = 0; v < n; v++ ) {
+        if ( v % w + 1 < w ) {
+            road_edges.push_back( std::make_pair( v, v + 1 ) );
+            road_edges.push_back( std::make_pair( v + 1, v ) );
+        }
+        if ( v + w < n ) {
+            road_edges.push_back( std::make_pair( v, v + w ) );
+            road_edges.push_back( std::make_pair( v + w, v ) );
+        }
+    }
+    std::unique_ptr<Road::Graph> road( new Road::Graph( boost::edges_are_unsorted_multi_pass, road_edges.begin(), road_edges.end(), n ) );
+    std::vector<Road::Edge> sections;
+    for ( auto it = edges( *road ).first; it != edges( *road ).second; it++ ) {
+        sections.push_back( *it );
+    }
+    Multimodal::Graph graph( std::move( road ) );
+
+    // one network, one stop per attached section, and as many POIs
+    srand( 42 );
+    const size_t n_attached = sections.size() * percent / 100;
+    std::unique_ptr<PublicTransport::Graph> pt( new PublicTransport::Graph );
+    std::vector<POI> pois( n_attached );
+    for ( size_t i = 0; i < n_attached; i++ ) {
+        PublicTransport::Stop stop;
+        stop.set_road_edge( sections[rand() % sections.size()] );
+        boost::add_vertex( stop, *pt );
+        pois[i].set_road_edge( sections[rand() % sections.size()] );
+    }
+    std::map<db_id_t, std::unique_ptr<PublicTransport::Graph>> networks;
+    networks[1] = std::move( pt );
+    graph.set_public_transports( std::move( networks ) );
+
+    // the same attachments as rows of the graph and as maps
+    std::vector<std::pair<Road::Edge, Multimodal::Graph::StopIndex>> edge_stops;
+    std::vector<std::pair<Road::Edge, POIIndex>> edge_pois;
+    std::map<Road::Edge, std::vector<Multimodal::Graph::StopIndex>> stop_map;
+    std::map<Road::Edge, std::vector<POIIndex>> poi_map;
+    const PublicTransport::Graph& network = graph.public_transport( PublicTransportGraphIndex( 0 ) );
+    for ( PublicTransport::Vertex v = 0; v < num_vertices( network ); v++ ) {
+        edge_stops.push_back( std::make_pair( network[v].road_edge(), Multimodal::Graph::StopIndex( PublicTransportGraphIndex( 0 ), v ) ) );
+        stop_map[network[v].road_edge()].push_back( edge_stops.back().second );
+    }
+    for ( size_t i = 0; i < pois.size(); i++ ) {
+        edge_pois.push_back( std::make_pair( pois[i].road_edge(), POIIndex( i ) ) );
+        poi_map[pois[i].road_edge()].push_back( POIIndex( i ) );
+    }
+    graph.set_pois( std::move( pois ) );
+    graph.set_edge_stops( edge_stops );
+    graph.set_edge_pois( edge_pois );
+    std::cout << sections.size() << " road sections, " << stop_map.size() << " with stops, " << poi_map.size() << " with POIs" << std::endl;
+
+    // the number of attachments of a section, as the iterators compute it
+    auto map_count = [&]( const Road::Edge& e ) {
+        size_t c = 0;
+        auto sit = stop_map.find( e );
+        if ( sit != stop_map.end() ) {
+            c += sit->second.size();
+        }
+        auto pit = poi_map.find( e );
+        if ( pit != poi_map.end() ) {
+            c += pit->second.size();
+        }
+        return c;
+    };
+    auto row_count = [&]( const Road::Edge& e ) {
+        return size_t( graph.edge_stops( e ).size() + graph.edge_pois( e ).size() );
+    };
+
+    // both versions must agree
+    for ( const Road::Edge& e : sections ) {
+        if ( map_count( e ) != row_count( e ) ) {
+            std::cerr << "Different attachments for " << e << std::endl;
+            return 1;
+        }
+    }
+
+    size_t checksum = 0;
+    const double map_ns = best_ns( n_rounds, sections.size(), checksum, [&]() {
+        size_t s = 0;
+        for ( const Road::Edge& e : sections ) {
+            s += map_count( e );
+        }
+        return s;
+    } );
+    const double row_ns = best_ns( n_rounds, sections.size(), checksum, [&]() {
+        size_t s = 0;
+        for ( const Road::Edge& e : sections ) {
+            s += row_count( e );
+        }
+        return s;
+    } );
+
+    std::cout << "lookup\tmaps (ns)\trows (ns)" << std::endl;
+    std::cout << "stops and POIs of a section\t" << map_ns << "\t" << row_ns << std::endl;
+    std::cout << "checksum " << checksum << std::endl;
+    return 0;
+}
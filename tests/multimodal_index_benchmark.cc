@@ -0,0 +1,208 @@
+/**
+ *   Copyright (C) 2012-2015 Oslandia <infos@oslandia.com>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Library General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Library General Public License for more details.
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Cost of the vertex index and degree of a Multimodal::Graph, that are read at each relaxation of a multimodal search:
+// offset tables of the graph against sums over the public transport graphs and over the road out edges.
+//
+// The graph is a road grid with public transport networks, whose stops and POIs are attached to random road sections.
+// Usage: multimodal_index_benchmark [grid width] [number of networks] [stops per network] [number of rounds]
+// Figures are only meaningful with an optimized build (CMAKE_BUILD_TYPE=Release).
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+#include "multimodal_graph.hh"
+
+using namespace Tempus;
+
+// vertex index by summing the sizes of the preceding graphs
+size_t summed_index( const Multimodal::Graph& graph, const Multimodal::Vertex& v )
+{
+    switch ( v.type() ) {
+    case Multimodal::Vertex::Null:
+        return 0;
+    case Multimodal::Vertex::Road:
+        return v.road_vertex();
+    case Multimodal::Vertex::PublicTransport: {
+        size_t n = num_vertices( graph.road() );
+        for ( auto it : graph.public_transports() ) {
+            if ( it.second != v.pt_graph() ) {
+                n += num_vertices( *it.second );
+            }
+            else {
+                n += v.pt_vertex();
+                break;
+            }
+        }
+        return n;
+    }
+    case Multimodal::Vertex::Poi: {
+        size_t n = num_vertices( graph.road() );
+        for ( auto it : graph.public_transports() ) {
+            n += num_vertices( *it.second );
+        }
+        return n + v.poi_idx();
+    }
+    }
+    return 0;
+}
+
+// out degree of a road vertex by summing over its out edges
+size_t summed_out_degree( const Multimodal::Graph& graph, const Multimodal::Vertex& v )
+{
+    size_t sum = 0;
+    Road::OutEdgeIterator ei, ei_end;
+    for ( boost::tie( ei, ei_end ) = out_edges( v.road_vertex(), graph.road() ); ei != ei_end; ei++ ) {
+        sum += graph.edge_stops( *ei ).size() + graph.edge_pois( *ei ).size() + 1;
+    }
+    return sum;
+}
+
+template <typename F>
+double best_ns( int n_rounds, size_t n_calls, size_t& checksum, F f )
+{
+    double best = 1e30;
+    for ( int r = 0; r < n_rounds; r++ ) {
+        auto t0 = std::chrono::steady_clock::now();
+        checksum += f();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min( best, std::chrono::duration<double, std::nano>( t1 - t0 ).count() / n_calls );
+    }
+    return best;
+}
+
+int main( int argc, char** argv )
+{
+    const uint32_t w = argc > 1 ? atoi( argv[1] ) : 300;
+    const size_t n_networks = argc > 2 ? atoi( argv[2] ) : 8;
+    const size_t n_stops = argc > 3 ? atoi( argv[3] ) : 2000;
+    const int n_rounds = argc > 4 ? atoi( argv[4] ) : 5;
+    const uint32_t n = w * w;
+
+    std::vector<std::pair<uint32_t, uint32_t>> road_edges;
+    for ( uint32_t v = 0; v < n; v++ ) {
+        if ( v % w + 1 < w ) {
+            road_edges.push_back( std::make_pair( v, v + 1 ) );
+            road_edges.push_back( std::make_pair( v + 1, v ) );
+        }
+        if ( v + w < n ) {
+            road_edges.push_back( std::make_pair( v, v + w ) );
+            road_edges.push_back( std::make_pair( v + w, v ) );
+        }
+    }
+    std::unique_ptr<Road::Graph> road( new Road::Graph( boost::edges_are_unsorted_multi_pass, road_edges.begin(), road_edges.end(), n ) );
+    std::vector<Road::Edge> sections;
+    for ( auto it = edges( *road ).first; it != edges( *road ).second; it++ ) {
+        sections.push_back( *it );
+    }
+    Multimodal::Graph graph( std::move( road ) );
+
+    // networks of stops linked in a line
+    srand( 42 );
+    std::map<db_id_t, std::unique_ptr<PublicTransport::Graph>> networks;
+    for ( size_t k = 0; k < n_networks; k++ ) {
+        std::unique_ptr<PublicTransport::Graph> pt( new PublicTransport::Graph );
+        for ( size_t i = 0; i < n_stops; i++ ) {
+            PublicTransport::Stop stop;
+            stop.set_road_edge( sections[rand() % sections.size()] );
+            PublicTransport::Vertex v = boost::add_vertex( stop, *pt );
+            if ( i > 0 ) {
+                boost::add_edge( v - 1, v, *pt );
+            }
+        }
+        networks[db_id_t( k + 1 )] = std::move( pt );
+    }
+    graph.set_public_transports( std::move( networks ) );
+    std::vector<std::pair<Road::Edge, Multimodal::Graph::StopIndex>> edge_stops;
+    for ( size_t k = 0; k < n_networks; k++ ) {
+        const PublicTransport::Graph& pt = graph.public_transport( PublicTransportGraphIndex( k ) );
+        for ( PublicTransport::Vertex v = 0; v < num_vertices( pt ); v++ ) {
+            edge_stops.push_back( std::make_pair( pt[v].road_edge(), Multimodal::Graph::StopIndex( PublicTransportGraphIndex( k ), v ) ) );
+        }
+    }
+    graph.set_edge_stops( edge_stops );
+
+    std::vector<POI> pois( n / 20 );
+    std::vector<std::pair<Road::Edge, POIIndex>> edge_pois;
+    for ( size_t i = 0; i < pois.size(); i++ ) {
+        pois[i].set_road_edge( sections[rand() % sections.size()] );
+        edge_pois.push_back( std::make_pair( pois[i].road_edge(), POIIndex( i ) ) );
+    }
+    graph.set_pois( std::move( pois ) );
+    graph.set_edge_pois( edge_pois );
+
+    std::vector<Multimodal::Vertex> all_vertices, road_vertices;
+    for ( auto it = vertices( graph ).first; it != vertices( graph ).second; it++ ) {
+        all_vertices.push_back( *it );
+        if ( it->type() == Multimodal::Vertex::Road ) {
+            road_vertices.push_back( *it );
+        }
+    }
+    std::cout << num_vertices( graph ) << " vertices, " << n_networks << " public transport networks" << std::endl;
+
+    // both versions must agree
+    Multimodal::VertexIndexProperty index = get( boost::vertex_index, graph );
+    for ( const Multimodal::Vertex& v : all_vertices ) {
+        if ( index[v] != summed_index( graph, v ) ) {
+            std::cerr << "Different indices for " << v << std::endl;
+            return 1;
+        }
+    }
+    for ( const Multimodal::Vertex& v : road_vertices ) {
+        if ( out_degree( v, graph ) != summed_out_degree( graph, v ) ) {
+            std::cerr << "Different out degrees for " << v << std::endl;
+            return 1;
+        }
+    }
+
+    size_t checksum = 0;
+    const double index_summed = best_ns( n_rounds, all_vertices.size(), checksum, [&]() {
+        size_t s = 0;
+        for ( const Multimodal::Vertex& v : all_vertices ) {
+            s += summed_index( graph, v );
+        }
+        return s;
+    } );
+    const double index_offsets = best_ns( n_rounds, all_vertices.size(), checksum, [&]() {
+        size_t s = 0;
+        for ( const Multimodal::Vertex& v : all_vertices ) {
+            s += index[v];
+        }
+        return s;
+    } );
+    const double degree_summed = best_ns( n_rounds, road_vertices.size(), checksum, [&]() {
+        size_t s = 0;
+        for ( const Multimodal::Vertex& v : road_vertices ) {
+            s += summed_out_degree( graph, v );
+        }
+        return s;
+    } );
+    const double degree_offsets = best_ns( n_rounds, road_vertices.size(), checksum, [&]() {
+        size_t s = 0;
+        for ( const Multimodal::Vertex& v : road_vertices ) {
+            s += out_degree( v, graph );
+        }
+        return s;
+    } );
+
+    std::cout << "lookup\tsummed (ns)\toffsets (ns)" << std::endl;
+    std::cout << "vertex index\t" << index_summed << "\t" << index_offsets << std::endl;
+    std::cout << "road out degree\t" << degree_summed << "\t" << degree_offsets << std::endl;
+    std::cout << "checksum " << checksum << std::endl;
+    return 0;
+}
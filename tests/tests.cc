@@ -22,6 +22,7 @@
 #include <boost/graph/dijkstra_shortest_paths.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/format.hpp>
+#include <boost/property_map/function_property_map.hpp>
 #ifdef _WIN32
 #pragma warning(pop)
 #endif
@@ -29,12 +30,23 @@
 #include "db.hh"
 #include "multimodal_graph.hh"
 #include "reverse_multimodal_graph.hh"
+#include "multimodal_compiled_graph.hh"
 #include "utils/graph_db_link.hh"
 #include "multimodal_graph_builder.hh"
 #include "ch_routing_data.hh"
+#include "ch_search_workspace.hh"
+#include "ch_search.hh"
+#include "cch.hh"
+#include "ch_customizer.hh"
+#include "ch_hub_labels.hh"
+#include "utils/radix_heap.hh"
+#include "utils/hilbert.hh"
+#include "grids.hh"
 
 #include <iostream>
 #include <fstream>
+#include <set>
+#include <sstream>
 #include <string>
 
 static std::string g_db_options = getenv( "TEMPUS_DB_OPTIONS" ) ? getenv( "TEMPUS_DB_OPTIONS" ) : "";
@@ -113,6 +125,53 @@ BOOST_AUTO_TEST_CASE( testQueries )
     BOOST_CHECK_EQUAL( ( long )( 13 * 3600 + 52 * 60 + 45 ), t.n_secs );
 
 }
+
+BOOST_AUTO_TEST_CASE( testCopy )
+{
+    std::cout << "DbTest::testCopy()" << std::endl;
+    std::unique_ptr<Db::Connection> connection( new Db::Connection( g_db_options + " dbname = " + g_db_name ) );
+
+    for ( Db::CopyWriter::Format format : { Db::CopyWriter::TextFormat, Db::CopyWriter::BinaryFormat } ) {
+        connection->exec( "DROP TABLE IF EXISTS test_copy" );
+        connection->exec( "CREATE TABLE test_copy (id int, bigint_v bigint, float_v real, str_v varchar)" );
+
+        {
+            Db::CopyWriter writer = connection->copy_in( "test_copy (id, bigint_v, float_v, str_v)", format );
+            writer.add( int32_t( 1 ) ).add( int64_t( 10000000000LL ) ).add( 1.5f ).add( std::string( "Hello\tworld\n\\" ) );
+            writer.end_row();
+            writer.add( int32_t( -2 ) ).add_null().add_null().add( std::string( "\\N" ) );
+            writer.end_row();
+            BOOST_CHECK_EQUAL( writer.rows(), ( size_t )2 );
+            writer.finish();
+        }
+
+        // a writer not finished does not write anything
+        {
+            Db::CopyWriter writer = connection->copy_in( "test_copy (id)", format );
+            writer.add( int32_t( 3 ) );
+            writer.end_row();
+        }
+
+        Db::CopyReader reader = connection->copy_out( "SELECT id, bigint_v, float_v, str_v FROM test_copy ORDER BY id DESC" );
+        BOOST_REQUIRE( reader.next() );
+        BOOST_CHECK_EQUAL( reader.columns(), ( size_t )4 );
+        BOOST_CHECK_EQUAL( reader[0].as<int>(), 1 );
+        BOOST_CHECK_EQUAL( reader[1].as<long long>(), 10000000000LL );
+        BOOST_CHECK_EQUAL( reader[2].as<float>(), 1.5f );
+        BOOST_CHECK_EQUAL( reader[3].as<std::string>(), std::string( "Hello\tworld\n\\" ) );
+        BOOST_REQUIRE( reader.next() );
+        BOOST_CHECK_EQUAL( reader[0].as<int>(), -2 );
+        BOOST_CHECK( reader[1].is_null() );
+        BOOST_CHECK( reader[2].is_null() );
+        BOOST_CHECK( !reader[3].is_null() );
+        BOOST_CHECK_EQUAL( reader[3].as<std::string>(), std::string( "\\N" ) );
+        BOOST_CHECK( !reader.next() );
+    }
+
+    // the connection is still usable
+    Db::Result res( connection->exec( "SELECT count(*) FROM test_copy" ) );
+    BOOST_CHECK_EQUAL( res[0][0].as<int>(), 2 );
+}
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -778,6 +837,149 @@ BOOST_AUTO_TEST_CASE( testReverseMultimodal )
 }
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_SUITE( tempus_core_compiled_multimodal )
+
+BOOST_AUTO_TEST_CASE( testCompiledMultimodal )
+{
+    std::cout << "PgImporterTest::testCompiledMultimodal()" << std::endl;
+    TextProgression progression;
+    VariantMap options;
+    options["db/options"] = Variant::from_string(g_db_options + " dbname = " + g_db_name);
+    const Multimodal::Graph* graph( dynamic_cast<const Multimodal::Graph*>( load_routing_data( "multimodal_graph", progression, options ) ) );
+
+    Multimodal::CompiledGraph cgraph( *graph );
+    BOOST_CHECK_EQUAL( num_vertices( *graph ), num_vertices( cgraph ) );
+    BOOST_CHECK_EQUAL( num_edges( *graph ), num_edges( cgraph ) );
+
+    Multimodal::VertexIndexProperty index = get( boost::vertex_index, cgraph );
+    Multimodal::VertexIterator vi, vi_end;
+    for ( boost::tie( vi, vi_end ) = vertices( *graph ); vi != vi_end; vi++ ) {
+        BOOST_CHECK_EQUAL( cgraph.vertex( index[*vi] ), *vi );
+        BOOST_CHECK_EQUAL( out_degree( *vi, *graph ), out_degree( *vi, cgraph ) );
+        BOOST_CHECK_EQUAL( in_degree( *vi, *graph ), in_degree( *vi, cgraph ) );
+
+        // same out edges, in the same order
+        Multimodal::OutEdgeIterator oei, oei_end;
+        Multimodal::CompiledGraph::out_edge_iterator coei, coei_end;
+        boost::tie( oei, oei_end ) = out_edges( *vi, *graph );
+        boost::tie( coei, coei_end ) = out_edges( *vi, cgraph );
+        for ( ; oei != oei_end && coei != coei_end; oei++, coei++ ) {
+            BOOST_CHECK_EQUAL( *oei == *coei, true );
+            BOOST_CHECK_EQUAL( target( *coei, cgraph ), target( *oei, *graph ) );
+            const size_t a = cgraph.arc( coei );
+            BOOST_CHECK_EQUAL( cgraph.arc_target( a ), index[target( *oei, *graph )] );
+            BOOST_CHECK_EQUAL( cgraph.arc_connection( a ), oei->connection_type() );
+            std::pair<PublicTransport::Edge, bool> pte = public_transport_edge( *oei );
+            BOOST_CHECK_EQUAL( cgraph.arc_public_transport_edge( a ).second, pte.second );
+            if ( pte.second ) {
+                BOOST_CHECK_EQUAL( cgraph.arc_public_transport_edge( a ).first == pte.first, true );
+            }
+            BOOST_CHECK_EQUAL( edge( *vi, target( *oei, *graph ), cgraph ).second, true );
+        }
+        BOOST_CHECK( oei == oei_end && coei == coei_end );
+
+        // same in edges, in any order
+        std::vector<Multimodal::Edge> ie, cie;
+        Multimodal::InEdgeIterator iei, iei_end;
+        for ( boost::tie( iei, iei_end ) = in_edges( *vi, *graph ); iei != iei_end; iei++ ) {
+            ie.push_back( *iei );
+        }
+        Multimodal::CompiledGraph::in_edge_iterator ciei, ciei_end;
+        for ( boost::tie( ciei, ciei_end ) = in_edges( *vi, cgraph ); ciei != ciei_end; ciei++ ) {
+            cie.push_back( *ciei );
+        }
+        std::sort( ie.begin(), ie.end() );
+        std::sort( cie.begin(), cie.end() );
+        BOOST_CHECK( ie == cie );
+    }
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE( tempus_core_multimodal_serialization )
+
+BOOST_AUTO_TEST_CASE( testEdgeAttachmentsRoundTrip )
+{
+    // 5x5 grid of two-way streets, with stops of two networks and POIs attached to some of its sections
+    const uint32_t w = 5;
+    const uint32_t n = w * w;
+    std::vector<std::pair<uint32_t, uint32_t>> road_edges;
+    for ( uint32_t v = 0; v < n; v++ ) {
+        if ( v % w + 1 < w ) {
+            road_edges.push_back( std::make_pair( v, v + 1 ) );
+            road_edges.push_back( std::make_pair( v + 1, v ) );
+        }
+        if ( v + w < n ) {
+            road_edges.push_back( std::make_pair( v, v + w ) );
+            road_edges.push_back( std::make_pair( v + w, v ) );
+        }
+    }
+    std::unique_ptr<Road::Graph> road( new Road::Graph( boost::edges_are_unsorted_multi_pass, road_edges.begin(), road_edges.end(), n ) );
+    std::vector<Road::Edge> sections;
+    for ( auto it = edges( *road ).first; it != edges( *road ).second; it++ ) {
+        sections.push_back( *it );
+    }
+    Multimodal::Graph graph( std::move( road ) );
+
+    // several stops on the same section, of both networks, and sections without any
+    std::map<db_id_t, std::unique_ptr<PublicTransport::Graph>> networks;
+    for ( size_t k = 0; k < 2; k++ ) {
+        std::unique_ptr<PublicTransport::Graph> pt( new PublicTransport::Graph );
+        for ( size_t i = 0; i < 12; i++ ) {
+            PublicTransport::Stop stop;
+            stop.set_road_edge( sections[( i * 7 + k * 3 ) % 20] );
+            PublicTransport::Vertex v = boost::add_vertex( stop, *pt );
+            if ( i > 0 ) {
+                boost::add_edge( v - 1, v, *pt );
+            }
+        }
+        networks[db_id_t( k + 1 )] = std::move( pt );
+    }
+    graph.set_public_transports( std::move( networks ) );
+    std::vector<std::pair<Road::Edge, Multimodal::Graph::StopIndex>> edge_stops;
+    for ( size_t k = 0; k < 2; k++ ) {
+        const PublicTransport::Graph& pt = graph.public_transport( PublicTransportGraphIndex( k ) );
+        for ( PublicTransport::Vertex v = 0; v < num_vertices( pt ); v++ ) {
+            edge_stops.push_back( std::make_pair( pt[v].road_edge(), Multimodal::Graph::StopIndex( PublicTransportGraphIndex( k ), v ) ) );
+        }
+    }
+    graph.set_edge_stops( edge_stops );
+
+    std::vector<POI> pois( 9 );
+    std::vector<std::pair<Road::Edge, POIIndex>> edge_pois;
+    for ( size_t i = 0; i < pois.size(); i++ ) {
+        pois[i].set_road_edge( sections[( i * 5 ) % 30] );
+        edge_pois.push_back( std::make_pair( pois[i].road_edge(), POIIndex( i ) ) );
+    }
+    graph.set_pois( std::move( pois ) );
+    graph.set_edge_pois( edge_pois );
+
+    std::stringstream buffer;
+    serialize( buffer, graph, binary_serialization_t() );
+    Multimodal::Graph copy( std::unique_ptr<Road::Graph>( new Road::Graph() ) );
+    unserialize( buffer, copy, binary_serialization_t() );
+
+    // same attachments for every section, in the same order
+    BOOST_REQUIRE_EQUAL( num_edges( copy.road() ), sections.size() );
+    size_t n_stops = 0, n_pois = 0;
+    auto cit = edges( copy.road() ).first;
+    for ( const Road::Edge& e : sections ) {
+        const Multimodal::Graph::EdgeStops stops = graph.edge_stops( e ), copied_stops = copy.edge_stops( *cit );
+        BOOST_REQUIRE_EQUAL( stops.size(), copied_stops.size() );
+        for ( size_t i = 0; i < size_t( stops.size() ); i++ ) {
+            BOOST_CHECK_EQUAL( stops[i].graph(), copied_stops[i].graph() );
+            BOOST_CHECK_EQUAL( stops[i].vertex(), copied_stops[i].vertex() );
+        }
+        const Multimodal::Graph::EdgePois edge_poi = graph.edge_pois( e ), copied_pois = copy.edge_pois( *cit );
+        BOOST_CHECK( std::vector<POIIndex>( edge_poi.begin(), edge_poi.end() ) == std::vector<POIIndex>( copied_pois.begin(), copied_pois.end() ) );
+        n_stops += stops.size();
+        n_pois += edge_poi.size();
+        cit++;
+    }
+    BOOST_CHECK_EQUAL( n_stops, edge_stops.size() );
+    BOOST_CHECK_EQUAL( n_pois, edge_pois.size() );
+}
+BOOST_AUTO_TEST_SUITE_END()
+
 BOOST_AUTO_TEST_SUITE( tempus_road_restrictions )
 
 BOOST_AUTO_TEST_CASE( testRestrictions )
@@ -821,6 +1023,38 @@ BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE( tempus_ch_query )
 
+///
+/// A grid ordered by nested dissection, ready for a CCH
+struct GridCH
+{
+    uint32_t n;
+    /// rank of each grid vertex
+    std::vector<uint32_t> rank;
+    /// edges of grid_edges(), between ranks
+    GridEdges edges;
+    /// 1-based index of each edge
+    std::vector<db_id_t> edge_db_id;
+};
+
+static GridCH make_grid_ch( uint32_t w, bool (*one_way)( const std::pair<uint32_t, uint32_t>& ) = nullptr )
+{
+    GridCH grid;
+    grid.n = w * w;
+    grid.edges = grid_edges( w, one_way );
+    std::vector<uint32_t> order = cch_nested_dissection_order( grid.n, grid.edges );
+    grid.rank.resize( grid.n );
+    for ( uint32_t r = 0; r < grid.n; r++ ) {
+        grid.rank[order[r]] = r;
+    }
+    for ( auto& e : grid.edges ) {
+        e = std::make_pair( grid.rank[e.first], grid.rank[e.second] );
+    }
+    for ( size_t i = 0; i < grid.edges.size(); i++ ) {
+        grid.edge_db_id.push_back( i + 1 );
+    }
+    return grid;
+}
+
 void test_ch( const std::vector<std::pair<uint32_t, uint32_t>>& edges_, int n_vertices, int* degrees, int* costs )
 {
     std::vector<CHEdgeProperty> props;
@@ -918,5 +1152,1558 @@ BOOST_AUTO_TEST_CASE( testCHQuery )
     }
 }
 
+BOOST_AUTO_TEST_CASE( testCHSearchWorkspace )
+{
+    typedef CHSearchWorkspace<int> Workspace;
+    CHSearchWorkspacePool<Workspace> pool( 4 );
+
+    {
+        auto ws = pool.borrow();
+        BOOST_CHECK( !ws->reached( 0, 1 ) );
+        ws->set_label( 0, 1, 12, 0 );
+        ws->set_label( 1, 2, 5, 3 );
+        BOOST_CHECK_EQUAL( ws->cost( 0, 1 ), 12 );
+        BOOST_CHECK_EQUAL( ws->predecessor( 1, 2 ), 3u );
+        BOOST_CHECK_EQUAL( ws->cost( 1, 1 ), Workspace::infinity() );
+
+        ws->push( 0, 3, 8 );
+        ws->push( 0, 1, 2 );
+        ws->push( 0, 2, 5 );
+        BOOST_CHECK_EQUAL( ws->top_vertex( 0 ), 1u );
+        ws->pop( 0 );
+        BOOST_CHECK_EQUAL( ws->top_vertex( 0 ), 2u );
+        BOOST_CHECK_EQUAL( ws->top_cost( 0 ), 5 );
+    }
+    // the workspace is back in the pool
+    BOOST_CHECK_EQUAL( pool.size(), 1u );
+
+    {
+        // a borrowed workspace is reused and its labels are invalidated
+        auto ws = pool.borrow();
+        BOOST_CHECK_EQUAL( pool.size(), 0u );
+        BOOST_CHECK( !ws->reached( 0, 1 ) );
+        BOOST_CHECK( !ws->reached( 1, 2 ) );
+        BOOST_CHECK( ws->empty( 0 ) );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testRadixHeap )
+{
+    RadixHeap<uint32_t, int> heap;
+    BOOST_CHECK( heap.empty() );
+
+    // Dijkstra-like usage: pushed keys are never lower than the last extracted one
+    heap.push( 10, 0 );
+    heap.push( 3, 1 );
+    heap.push( 1000, 2 );
+    heap.push( 3, 3 );
+
+    std::vector<uint32_t> keys;
+    while ( !heap.empty() ) {
+        uint32_t k = heap.top_key();
+        keys.push_back( k );
+        if ( heap.top_value() == 1 ) {
+            heap.push( k + 4, 4 );
+            heap.push( k + 500, 5 );
+        }
+        heap.pop();
+    }
+    std::vector<uint32_t> expected = { 3, 3, 7, 10, 503, 1000 };
+    BOOST_CHECK_EQUAL_COLLECTIONS( keys.begin(), keys.end(), expected.begin(), expected.end() );
+
+    // a cleared heap can be reused from any key
+    heap.clear();
+    BOOST_CHECK( heap.empty() );
+    heap.push( 1, 0 );
+    BOOST_CHECK_EQUAL( heap.top_key(), 1u );
+}
+
+// small CH graph, vertices are numbered by CH order
+// 0 <-> 2 (10), 1 <-> 2 (20), 2 <-> 3 (5) and 0 -> 3 (100)
+// if islands is true, only 0 -> 2 is kept
+std::unique_ptr<CHQuery> small_ch_graph( bool islands = false )
+{
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.push_back( std::make_pair( (uint32_t)0, (uint32_t)(2) ) );
+    edges.push_back( std::make_pair( (uint32_t)0, (uint32_t)(3) ) );
+    edges.push_back( std::make_pair( (uint32_t)0, (uint32_t)(2) ) );
+    edges.push_back( std::make_pair( (uint32_t)1, (uint32_t)(2) ) );
+    edges.push_back( std::make_pair( (uint32_t)1, (uint32_t)(2) ) );
+    edges.push_back( std::make_pair( (uint32_t)2, (uint32_t)(3) ) );
+    edges.push_back( std::make_pair( (uint32_t)2, (uint32_t)(3) ) );
+    int degrees[] = { 2, 1, 1, 0 };
+    int islands_degrees[] = { 1, 0, 0, 0 };
+    int costs[] = { 10, 100, 10, 20, 20, 5, 5 };
+
+    std::vector<CHEdgeProperty> props;
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        CHEdgeProperty p;
+        p.b.cost = costs[i];
+        props.push_back( p );
+    }
+    if ( islands ) {
+        return std::unique_ptr<CHQuery>( new CHQuery( edges.begin(), edges.begin() + 1, 4, islands_degrees, &props[0] ) );
+    }
+    return std::unique_ptr<CHQuery>( new CHQuery( edges.begin(), edges.end(), 4, degrees, &props[0] ) );
+}
+
+BOOST_AUTO_TEST_CASE( testCHManyToMany )
+{
+    std::unique_ptr<CHQuery> graph = small_ch_graph();
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    CHSearchWorkspacePool<Workspace> pool( 4 );
+
+    std::vector<CHVertex> sources = { 0, 1 };
+    std::vector<CHVertex> targets = { 3, 0, 1 };
+    std::vector<uint32_t> expected = { 15, 0, 30, 25, 30, 0 };
+    for ( bool stall_on_demand : { false, true } ) {
+        CHQueryStatistics stats;
+        std::vector<uint32_t> matrix = ch_many_to_many( *graph, sources, targets, weight_map, pool, stall_on_demand, stats );
+        BOOST_CHECK_EQUAL_COLLECTIONS( matrix.begin(), matrix.end(), expected.begin(), expected.end() );
+    }
+
+    // unreachable targets
+    std::unique_ptr<CHQuery> islands = small_ch_graph( true );
+    CHQueryStatistics stats;
+    std::vector<uint32_t> matrix = ch_many_to_many( *islands, std::vector<CHVertex>( 1, 0 ), std::vector<CHVertex>( 1, 3 ), weight_map, pool, false, stats );
+    BOOST_CHECK_EQUAL( matrix[0], Workspace::infinity() );
+}
+
+BOOST_AUTO_TEST_CASE( testCHPhast )
+{
+    std::unique_ptr<CHQuery> graph = small_ch_graph();
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    CHSearchWorkspacePool<Workspace> pool( 4 );
+
+    for ( bool stall_on_demand : { false, true } ) {
+        CHQueryStatistics stats;
+        std::vector<uint32_t> costs;
+        {
+            auto ws = pool.borrow();
+            ch_phast( *graph, 0, weight_map, *ws, stall_on_demand, costs, stats );
+            std::vector<uint32_t> expected = { 0, 30, 10, 15 };
+            BOOST_CHECK_EQUAL_COLLECTIONS( costs.begin(), costs.end(), expected.begin(), expected.end() );
+        }
+
+        costs = ch_one_to_all( *graph, std::vector<CHVertex>( { 3, 1 } ), weight_map, pool, stall_on_demand, stats );
+        std::vector<uint32_t> expected = { 15, 25, 5, 0, 30, 0, 20, 25 };
+        BOOST_CHECK_EQUAL_COLLECTIONS( costs.begin(), costs.end(), expected.begin(), expected.end() );
+    }
+
+    // unreachable vertices
+    std::unique_ptr<CHQuery> islands = small_ch_graph( true );
+    CHQueryStatistics stats;
+    std::vector<uint32_t> costs = ch_one_to_all( *islands, std::vector<CHVertex>( 1, 0 ), weight_map, pool, false, stats );
+    std::vector<uint32_t> expected = { 0, Workspace::infinity(), 10, Workspace::infinity() };
+    BOOST_CHECK_EQUAL_COLLECTIONS( costs.begin(), costs.end(), expected.begin(), expected.end() );
+}
+
+BOOST_AUTO_TEST_CASE( testCHPhastMulti )
+{
+    std::unique_ptr<CHQuery> graph = small_ch_graph();
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    CHSearchWorkspacePool<Workspace> pool( 4 );
+
+    // 10 sources: a full group of 8 and a partial one
+    std::vector<CHVertex> sources = { 0, 1, 2, 3, 3, 2, 1, 0, 3, 1 };
+    CHQueryStatistics stats;
+    std::vector<uint32_t> expected = ch_one_to_all( *graph, sources, weight_map, pool, false, stats );
+    for ( bool stall_on_demand : { false, true } ) {
+        std::vector<uint32_t> costs = ch_one_to_all_batch<8>( *graph, sources, weight_map, pool, stall_on_demand, stats );
+        BOOST_CHECK_EQUAL_COLLECTIONS( costs.begin(), costs.end(), expected.begin(), expected.end() );
+        costs = ch_one_to_all_batch<16>( *graph, sources, weight_map, pool, stall_on_demand, stats );
+        BOOST_CHECK_EQUAL_COLLECTIONS( costs.begin(), costs.end(), expected.begin(), expected.end() );
+    }
+
+    // scalar and SIMD sweeps give the same labels, unused lanes are unreachable
+    std::vector<uint32_t> scalar_labels, labels;
+    auto ws = pool.borrow();
+    ch_phast_multi<8>( *graph, &sources[0], 3, weight_map, *ws, false, scalar_labels, stats, /* allow_simd */ false );
+    ch_phast_multi<8>( *graph, &sources[0], 3, weight_map, *ws, false, labels, stats );
+    BOOST_CHECK_EQUAL_COLLECTIONS( labels.begin(), labels.end(), scalar_labels.begin(), scalar_labels.end() );
+    BOOST_CHECK_EQUAL( labels[2 * 8 + 1], 20u );
+    BOOST_CHECK_EQUAL( labels[2 * 8 + 3], ch_multi_infinity );
+}
+
+BOOST_AUTO_TEST_CASE( testCCH )
+{
+    // 8x8 grid with some one-way streets
+    const uint32_t w = 8;
+    const uint32_t n = w * w;
+    const GridEdges edges = grid_edges( w, []( const std::pair<uint32_t, uint32_t>& street ) {
+            // horizontal street at column x and row y
+            return street.second == street.first + 1 && ( street.first % w + street.first / w ) % 3 == 0;
+        } );
+
+    // the ordering is a permutation, computed once for every metric
+    std::vector<uint32_t> order = cch_nested_dissection_order( n, edges );
+    std::vector<uint32_t> rank( n, n );
+    for ( uint32_t r = 0; r < n; r++ ) {
+        BOOST_REQUIRE( order[r] < n );
+        BOOST_CHECK_EQUAL( rank[order[r]], n );
+        rank[order[r]] = r;
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> ranked_edges;
+    for ( const auto& e : edges ) {
+        ranked_edges.push_back( std::make_pair( rank[e.first], rank[e.second] ) );
+    }
+    CCHTopology topology( n, ranked_edges );
+    std::vector<db_id_t> edge_db_id( edges.size() );
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        edge_db_id[i] = i + 1;
+    }
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    CHSearchWorkspacePool<Workspace> pool( n );
+
+    // two metrics, the second one forbids some edges
+    for ( int m = 0; m < 2; m++ ) {
+        std::vector<uint32_t> weights( edges.size() );
+        for ( size_t i = 0; i < edges.size(); i++ ) {
+            weights[i] = ( m == 1 && i % 7 == 0 ) ? CCHMetric::infinity() : uint32_t( 1 + ( i * 37 + m * 11 ) % 50 );
+        }
+        CCHMetric metric = topology.customize( weights );
+        MiddleNodeMap middle_node;
+        std::unique_ptr<CHQuery> graph = cch_query_graph( topology, metric, edge_db_id, middle_node );
+
+        // a shortcut is made of two edges of the query graph
+        for ( const auto& p : middle_node ) {
+            CHEdge e, e1, e2;
+            bool found, found1, found2;
+            std::tie( e, found ) = edge( p.first.first, p.first.second, *graph );
+            std::tie( e1, found1 ) = edge( p.first.first, p.second, *graph );
+            std::tie( e2, found2 ) = edge( p.second, p.first.second, *graph );
+            BOOST_REQUIRE( found && found1 && found2 );
+            BOOST_CHECK_EQUAL( e.property().b.cost, e1.property().b.cost + e2.property().b.cost );
+        }
+
+        // reference: Dijkstra on the input graph, in rank space
+        typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS, boost::no_property, boost::property<boost::edge_weight_t, uint32_t>> RefGraph;
+        RefGraph ref( n );
+        for ( size_t i = 0; i < edges.size(); i++ ) {
+            if ( weights[i] != CCHMetric::infinity() ) {
+                add_edge( ranked_edges[i].first, ranked_edges[i].second, weights[i], ref );
+            }
+        }
+        std::vector<CHVertex> sources = { 0, n / 2, n - 1, rank[0], rank[n - 1] };
+        CHQueryStatistics stats;
+        std::vector<uint32_t> costs = ch_one_to_all( *graph, sources, weight_map, pool, true, stats );
+        for ( size_t i = 0; i < sources.size(); i++ ) {
+            std::vector<uint32_t> dist( n );
+            boost::dijkstra_shortest_paths( ref, sources[i], boost::distance_map( &dist[0] ).distance_inf( Workspace::infinity() ) );
+            for ( uint32_t v = 0; v < n; v++ ) {
+                BOOST_CHECK_EQUAL( costs[i * n + v], dist[v] );
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testCHCustomizer )
+{
+    // 8x8 grid with some one-way streets, ordered by nested dissection
+    const GridCH grid = make_grid_ch( 8, []( const std::pair<uint32_t, uint32_t>& street ) {
+            return street.second == street.first + 1 && street.first % 3 == 0;
+        } );
+    const uint32_t n = grid.n;
+    const GridEdges& edges = grid.edges;
+    const std::vector<db_id_t>& edge_db_id = grid.edge_db_id;
+    CCHTopology topology( n, edges );
+    std::vector<uint32_t> weights = cyclic_weights( edges.size(), 10, 37, 50 );
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> unlinked = cch_query_graph( topology, topology.customize( weights ), edge_db_id, middle_node );
+    const CHQuery graph = link_ch_shortcuts( *unlinked, middle_node );
+
+    // sections that are original edges of the graph, the other ones cannot be updated
+    std::set<db_id_t> original;
+    for ( uint32_t i = 0; i < graph.edge_array().size(); i++ ) {
+        if ( !graph.edge_property( i ).b.is_shortcut ) {
+            original.insert( graph.edge_details( i ).db_id );
+        }
+    }
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    CHSearchWorkspacePool<Workspace> pool( n );
+    std::vector<CHVertex> sources;
+    for ( CHVertex v = 0; v < n; v += 5 ) {
+        sources.push_back( v );
+    }
+
+    // costs of the customized graph are the ones of a Dijkstra on the input graph, and shortcuts are consistent
+    auto check = [&]( const CHQuery& g, const std::vector<uint32_t>& input_weights ) {
+        for ( uint32_t i = 0; i < g.edge_array().size(); i++ ) {
+            if ( g.edge_property( i ).b.is_shortcut ) {
+                const CHEdgeDetails& d = g.edge_details( i );
+                BOOST_CHECK_EQUAL( g.edge_property( i ).b.cost, g.edge_property( d.unpack.first ).b.cost + g.edge_property( d.unpack.second ).b.cost );
+            }
+        }
+        typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS, boost::no_property, boost::property<boost::edge_weight_t, uint32_t>> RefGraph;
+        RefGraph ref( n );
+        for ( size_t i = 0; i < edges.size(); i++ ) {
+            if ( input_weights[i] != CCHMetric::infinity() ) {
+                add_edge( edges[i].first, edges[i].second, input_weights[i], ref );
+            }
+        }
+        CHQueryStatistics stats;
+        std::vector<uint32_t> costs = ch_one_to_all( g, sources, weight_map, pool, true, stats );
+        for ( size_t i = 0; i < sources.size(); i++ ) {
+            std::vector<uint32_t> dist( n );
+            boost::dijkstra_shortest_paths( ref, sources[i], boost::distance_map( &dist[0] ).distance_inf( Workspace::infinity() ) );
+            for ( uint32_t v = 0; v < n; v++ ) {
+                BOOST_CHECK_EQUAL( costs[i * n + v], dist[v] );
+            }
+        }
+    };
+
+    CHCustomizer customizer( graph );
+    check( *customizer.query_graph(), weights );
+
+    // slower, faster and closed sections
+    std::vector<CHCostChange> changes;
+    std::vector<uint32_t> new_weights = weights;
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        uint32_t c = weights[i];
+        if ( i % 5 == 0 ) {
+            c = weights[i] * 4;
+        }
+        else if ( i % 7 == 1 ) {
+            c = 1;
+        }
+        else if ( i % 11 == 2 ) {
+            c = CCHMetric::infinity();
+        }
+        else {
+            continue;
+        }
+        changes.push_back( CHCostChange{ edge_db_id[i], c } );
+        if ( original.count( edge_db_id[i] ) ) {
+            new_weights[i] = c;
+        }
+    }
+    changes.push_back( CHCostChange{ 100000, 1 } );
+    CHCustomizationStatistics stats = customizer.update( changes );
+    BOOST_CHECK_EQUAL( stats.unknown_sections + stats.changed_edges, changes.size() );
+    BOOST_CHECK( stats.customized_arcs < graph.edge_array().size() );
+    BOOST_CHECK( stats.updated_edges >= stats.changed_edges );
+    std::unique_ptr<CHQuery> updated = customizer.query_graph();
+    check( *updated, new_weights );
+    // the same as a customization from scratch
+    {
+        MiddleNodeMap m;
+        std::unique_ptr<CHQuery> full = cch_query_graph( topology, topology.customize( new_weights ), edge_db_id, m );
+        check( link_ch_shortcuts( *full, m ), new_weights );
+        BOOST_CHECK_EQUAL( full->edge_array().size(), updated->edge_array().size() );
+    }
+
+    // back to the initial costs, closed sections included
+    for ( CHCostChange& c : changes ) {
+        c.cost = c.db_id <= weights.size() ? weights[c.db_id - 1] : 1;
+    }
+    customizer.update( changes );
+    std::unique_ptr<CHQuery> restored = customizer.query_graph();
+    check( *restored, weights );
+    BOOST_CHECK_EQUAL( restored->edge_array().size(), graph.edge_array().size() );
+
+    // a complete set of changes: the sections changed before and not listed get back their base cost
+    customizer.update( changes );
+    std::vector<CHCostChange> first_changes( changes.begin(), changes.begin() + changes.size() / 2 );
+    for ( CHCostChange& c : first_changes ) {
+        c.cost = c.db_id <= weights.size() ? weights[c.db_id - 1] * 2 : 1;
+    }
+    std::vector<uint32_t> replaced_weights = weights;
+    for ( const CHCostChange& c : first_changes ) {
+        for ( size_t i = 0; i < edges.size(); i++ ) {
+            if ( edge_db_id[i] == c.db_id && original.count( c.db_id ) ) {
+                replaced_weights[i] = c.cost;
+            }
+        }
+    }
+    customizer.replace( first_changes );
+    check( *customizer.query_graph(), replaced_weights );
+    customizer.replace( {} );
+    check( *customizer.query_graph(), weights );
+
+    // cost change files
+    std::istringstream file( "# closures\n12 closed\n\n13 250\n" );
+    std::vector<CHCostChange> read = read_ch_cost_changes( file );
+    BOOST_REQUIRE_EQUAL( read.size(), 2 );
+    BOOST_CHECK_EQUAL( read[0].db_id, 12 );
+    BOOST_CHECK_EQUAL( read[0].cost, CCHMetric::infinity() );
+    BOOST_CHECK_EQUAL( read[1].db_id, 13 );
+    BOOST_CHECK_EQUAL( read[1].cost, 250 );
+    std::istringstream bad( "12 fast\n" );
+    BOOST_CHECK_THROW( read_ch_cost_changes( bad ), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( testCHGraphVersions )
+{
+    const GridCH grid = make_grid_ch( 8 );
+    const uint32_t n = grid.n;
+    CCHTopology topology( n, grid.edges );
+    std::vector<uint32_t> weights = cyclic_weights( grid.edges.size(), 10, 37, 50 );
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> query = cch_query_graph( topology, topology.customize( weights ), grid.edge_db_id, middle_node );
+    CHRoutingData rd( std::move( query ), std::move( middle_node ), grid_node_ids( n ) );
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    CHSearchWorkspacePool<CHSearchWorkspace<uint32_t, CHVertex>> pool( n );
+    const std::vector<CHVertex> sources = { 0, n / 2, n - 1 };
+    auto costs = [&]( const CHGraphVersion& version ) {
+        CHQueryStatistics stats;
+        return ch_one_to_all( *version.graph, sources, weight_map, pool, true, stats );
+    };
+    // every section of the grid with the given cost factor
+    auto changes = [&]( uint32_t factor ) {
+        std::vector<CHCostChange> r;
+        for ( size_t i = 0; i < weights.size(); i++ ) {
+            r.push_back( CHCostChange{ grid.edge_db_id[i], weights[i] * factor } );
+        }
+        return r;
+    };
+
+    CHGraphVersions versions( rd, 1000 );
+    BOOST_CHECK_THROW( versions.current( "unknown" ), std::invalid_argument );
+    std::shared_ptr<const CHGraphVersion> first = versions.current( "" );
+    BOOST_CHECK_EQUAL( first->graph.get(), &rd.ch_query() );
+    BOOST_CHECK( first->unpack_cache );
+    const std::vector<uint32_t> initial_costs = costs( *first );
+
+    // a request keeps the version it has started with, new requests get the updated costs
+    CHCustomizationStatistics stats = versions.update_costs( "", changes( 3 ) );
+    BOOST_CHECK_EQUAL( stats.unknown_sections, 0 );
+    std::shared_ptr<const CHGraphVersion> updated = versions.current( "" );
+    BOOST_CHECK( updated != first );
+    BOOST_CHECK( updated->unpack_cache && updated->unpack_cache != first->unpack_cache );
+    BOOST_CHECK( costs( *first ) == initial_costs );
+    const std::vector<uint32_t> updated_costs = costs( *updated );
+    for ( size_t i = 0; i < initial_costs.size(); i++ ) {
+        BOOST_CHECK_EQUAL( updated_costs[i], initial_costs[i] * 3 );
+    }
+    // changed costs of the sections, for phantom nodes along them
+    BOOST_CHECK( first->changed_costs.empty() );
+    BOOST_CHECK_EQUAL( updated->changed_costs.at( grid.edge_db_id[0] ), weights[0] * 3 );
+
+    // changes of a file are applied again when it is modified
+    const std::string filename = "ch_cost_changes.txt";
+    auto write_changes = [&]( const std::string& header, uint32_t factor ) {
+        std::ofstream file( filename );
+        file << header << "\n";
+        for ( const CHCostChange& c : changes( factor ) ) {
+            file << c.db_id << " " << c.cost << "\n";
+        }
+    };
+    write_changes( "# usual costs", 1 );
+    CHCostChangesFile changes_file( filename, "" );
+    BOOST_CHECK( changes_file.update_if_modified( versions, stats ) );
+    BOOST_CHECK( costs( *versions.current( "" ) ) == initial_costs );
+    std::shared_ptr<const CHGraphVersion> restored = versions.current( "" );
+    BOOST_CHECK( !changes_file.update_if_modified( versions, stats ) );
+    BOOST_CHECK_EQUAL( versions.current( "" ), restored );
+
+    write_changes( "# twice the usual costs", 2 );
+    BOOST_CHECK( changes_file.update_if_modified( versions, stats ) );
+    const std::vector<uint32_t> doubled_costs = costs( *versions.current( "" ) );
+    for ( size_t i = 0; i < initial_costs.size(); i++ ) {
+        BOOST_CHECK_EQUAL( doubled_costs[i], initial_costs[i] * 2 );
+    }
+    BOOST_CHECK( costs( *updated ) == updated_costs );
+    BOOST_CHECK_EQUAL( versions.current( "" )->changed_costs.size(), weights.size() );
+
+    // sections removed from the file get back their base cost
+    {
+        std::ofstream file( filename );
+        file << "# no change\n";
+    }
+    BOOST_CHECK( changes_file.update_if_modified( versions, stats ) );
+    BOOST_CHECK( costs( *versions.current( "" ) ) == initial_costs );
+    BOOST_CHECK( versions.current( "" )->changed_costs.empty() );
+
+    // rewritten within the same second with the same size, another section is closed
+    for ( size_t i : { 1, 2 } ) {
+        {
+            std::ofstream file( filename );
+            file << grid.edge_db_id[i] << " closed\n";
+        }
+        BOOST_CHECK( changes_file.update_if_modified( versions, stats ) );
+        BOOST_CHECK_EQUAL( versions.current( "" )->changed_costs.size(), 1 );
+        BOOST_CHECK_EQUAL( versions.current( "" )->changed_costs.count( grid.edge_db_id[i] ), 1 );
+    }
+
+    write_changes( "# twice the usual costs", 2 );
+    BOOST_CHECK( changes_file.update_if_modified( versions, stats ) );
+    BOOST_CHECK( costs( *versions.current( "" ) ) == doubled_costs );
+
+    std::remove( filename.c_str() );
+    BOOST_CHECK_THROW( changes_file.update_if_modified( versions, stats ), std::runtime_error );
+    BOOST_CHECK( costs( *versions.current( "" ) ) == doubled_costs );
+}
+
+BOOST_AUTO_TEST_CASE( testCHAlternatives )
+{
+    // 10x10 grid of two-way streets, ordered by nested dissection
+    const GridCH grid = make_grid_ch( 10 );
+    const uint32_t n = grid.n;
+    const std::vector<uint32_t>& rank = grid.rank;
+    const GridEdges& edges = grid.edges;
+    const std::vector<db_id_t>& edge_db_id = grid.edge_db_id;
+    CCHTopology topology( n, edges );
+    std::vector<uint32_t> weights = cyclic_weights( edges.size(), 20, 37, 11 );
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> unlinked = cch_query_graph( topology, topology.customize( weights ), edge_db_id, middle_node );
+    const CHQuery graph = link_ch_shortcuts( *unlinked, middle_node );
+
+    typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS, boost::no_property, boost::property<boost::edge_weight_t, uint32_t>> RefGraph;
+    RefGraph ref( n );
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        add_edge( edges[i].first, edges[i].second, weights[i], ref );
+    }
+    auto ref_cost = [&]( uint32_t from, uint32_t to ) {
+        std::vector<uint32_t> dist( n );
+        boost::dijkstra_shortest_paths( ref, from, boost::distance_map( &dist[0] ) );
+        return dist[to];
+    };
+
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    Workspace ws( n );
+    CHAlternativeParameters params;
+    params.max_routes = 4;
+    size_t n_alternatives = 0;
+    for ( uint32_t s = 0; s < n; s += 7 ) {
+        for ( uint32_t t = 3; t < n; t += 11 ) {
+            const CHVertex origin = rank[s], destination = rank[t];
+            CHQueryStatistics stats;
+            ws.new_query();
+            std::vector<CHRoute> routes = ch_alternative_routes( graph, origin, destination, ws, true, params, stats );
+            BOOST_REQUIRE( !routes.empty() );
+            BOOST_CHECK( routes.size() <= params.max_routes );
+            const uint32_t shortest = ref_cost( origin, destination );
+            BOOST_CHECK_EQUAL( routes[0].cost, shortest );
+            n_alternatives += routes.size() - 1;
+
+            std::set<uint32_t> previous_edges;
+            for ( const CHRoute& route : routes ) {
+                // a path of original edges from the origin to the destination, each vertex at most once
+                std::vector<uint32_t> vertices( 1, origin );
+                std::vector<uint32_t> prefix( 1, 0 );
+                uint32_t shared = 0;
+                for ( uint32_t e : route.edges ) {
+                    BOOST_REQUIRE( !graph.edge_property( e ).b.is_shortcut );
+                    const size_t i = graph.edge_details( e ).db_id - 1;
+                    BOOST_CHECK_EQUAL( edges[i].first, vertices.back() );
+                    vertices.push_back( edges[i].second );
+                    prefix.push_back( prefix.back() + weights[i] );
+                    if ( previous_edges.count( e ) ) {
+                        shared += weights[i];
+                    }
+                }
+                BOOST_CHECK_EQUAL( vertices.back(), destination );
+                BOOST_CHECK_EQUAL( prefix.back(), route.cost );
+                BOOST_CHECK_EQUAL( std::set<uint32_t>( vertices.begin(), vertices.end() ).size(), vertices.size() );
+                if ( &route == &routes[0] ) {
+                    previous_edges.insert( route.edges.begin(), route.edges.end() );
+                    continue;
+                }
+
+                // bounded stretch, limited sharing and local optimality around the via vertex
+                BOOST_CHECK( route.cost <= shortest * ( 1 + params.max_stretch ) );
+                BOOST_CHECK( shared <= shortest * params.max_sharing );
+                const size_t via = std::find( vertices.begin(), vertices.end(), route.via ) - vertices.begin();
+                BOOST_REQUIRE( via < vertices.size() );
+                const double t_cost = shortest * params.local_optimality;
+                size_t first = via, last = via;
+                while ( first > 0 && prefix[via] - prefix[first] < t_cost ) {
+                    first--;
+                }
+                while ( last + 1 < vertices.size() && prefix[last] - prefix[via] < t_cost ) {
+                    last++;
+                }
+                BOOST_CHECK_EQUAL( ref_cost( vertices[first], vertices[last] ), prefix[last] - prefix[first] );
+                previous_edges.insert( route.edges.begin(), route.edges.end() );
+            }
+        }
+    }
+    BOOST_CHECK( n_alternatives > 0 );
+
+    // no alternative without the stretch to afford it
+    params.max_stretch = 0;
+    ws.new_query();
+    CHQueryStatistics stats;
+    std::vector<CHRoute> routes = ch_alternative_routes( graph, rank[0], rank[n - 1], ws, true, params, stats );
+    BOOST_REQUIRE( !routes.empty() );
+    for ( const CHRoute& route : routes ) {
+        BOOST_CHECK_EQUAL( route.cost, routes[0].cost );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testCHHubLabels )
+{
+    // 10x10 grid, costs depend on the direction
+    const GridCH grid = make_grid_ch( 10 );
+    const uint32_t n = grid.n;
+    const GridEdges& edges = grid.edges;
+    const std::vector<db_id_t>& edge_db_id = grid.edge_db_id;
+    CCHTopology topology( n, edges );
+    std::vector<uint32_t> weights = cyclic_weights( edges.size(), 20, 37, 11 );
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> graph = cch_query_graph( topology, topology.customize( weights ), edge_db_id, middle_node );
+
+    typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS, boost::no_property, boost::property<boost::edge_weight_t, uint32_t>> RefGraph;
+    RefGraph ref( n );
+    for ( size_t i = 0; i < edges.size(); i++ ) {
+        add_edge( edges[i].first, edges[i].second, weights[i], ref );
+    }
+    std::vector<uint32_t> ref_dist( n * n );
+    for ( uint32_t s = 0; s < n; s++ ) {
+        boost::dijkstra_shortest_paths( ref, s, boost::distance_map( &ref_dist[s * n] ) );
+    }
+    auto check_labels = [&]( const CHHubLabels& labels ) {
+        BOOST_REQUIRE_EQUAL( labels.num_vertices(), n );
+        size_t errors = 0;
+        for ( uint32_t s = 0; s < n; s++ ) {
+            for ( uint32_t t = 0; t < n; t++ ) {
+                errors += labels.distance( s, t ) != ref_dist[s * n + t];
+            }
+        }
+        BOOST_CHECK_EQUAL( errors, 0 );
+    };
+
+    CHHubLabelStatistics stats;
+    std::unique_ptr<CHHubLabels> labels = build_ch_hub_labels( *graph, "pedestrian", stats );
+    check_labels( *labels );
+    BOOST_CHECK( stats.levels > 1 );
+    BOOST_CHECK( stats.pruned_entries > 0 );
+    BOOST_CHECK_EQUAL( stats.forward_entries, labels->forward_array().size() );
+    // each label has an entry of its own vertex, and less than the whole graph
+    BOOST_CHECK( stats.forward_entries >= n && stats.forward_entries < n * n / 2 );
+    BOOST_CHECK( labels->fingerprint() == ch_hub_label_fingerprint( *graph ) );
+
+    // mapped file
+    labels->save( "ch_hub_labels.bin" );
+    {
+        std::unique_ptr<CHHubLabels> loaded = CHHubLabels::load( "ch_hub_labels.bin" );
+        BOOST_CHECK_EQUAL( loaded->metric(), "pedestrian" );
+        BOOST_CHECK( loaded->fingerprint() == labels->fingerprint() );
+        check_labels( *loaded );
+    }
+
+    // interrupted computation, started again from its checkpoint
+    struct Interruption : public ProgressionCallback
+    {
+        size_t calls = 0;
+        void operator()( float, bool ) override
+        {
+            if ( ++calls == 3 ) {
+                throw std::runtime_error( "interrupted" );
+            }
+        }
+    };
+    Interruption interruption;
+    BOOST_CHECK_THROW( build_ch_hub_labels( *graph, "pedestrian", stats, "ch_hub_labels.ckpt", 0.0, interruption ), std::runtime_error );
+    BOOST_CHECK_THROW( CHHubLabels::load( "ch_hub_labels.ckpt" ), std::runtime_error );
+    CHHubLabelStatistics resumed_stats;
+    std::unique_ptr<CHHubLabels> resumed = build_ch_hub_labels( *graph, "pedestrian", resumed_stats, "ch_hub_labels.ckpt", 0.0 );
+    BOOST_CHECK_EQUAL( resumed_stats.resumed_levels, 3 );
+    check_labels( *resumed );
+    BOOST_CHECK( !std::ifstream( "ch_hub_labels.ckpt" ).good() );
+
+    // a checkpoint of other costs is not used
+    std::vector<uint32_t> other_weights( weights );
+    other_weights[0] += 5;
+    std::unique_ptr<CHQuery> other_graph = cch_query_graph( topology, topology.customize( other_weights ), edge_db_id, middle_node );
+    BOOST_CHECK( ch_hub_label_fingerprint( *other_graph ) != labels->fingerprint() );
+    interruption.calls = 0;
+    BOOST_CHECK_THROW( build_ch_hub_labels( *graph, "pedestrian", stats, "ch_hub_labels.ckpt", 0.0, interruption ), std::runtime_error );
+    build_ch_hub_labels( *other_graph, "pedestrian", resumed_stats, "ch_hub_labels.ckpt", 0.0 );
+    BOOST_CHECK_EQUAL( resumed_stats.resumed_levels, 0 );
+
+    std::remove( "ch_hub_labels.bin" );
+}
+
+BOOST_AUTO_TEST_CASE( testCHSectionIndex )
+{
+    // 10x10 grid of nodes 100 apart, slightly moved, and a long diagonal section
+    const uint32_t w = 10;
+    const uint32_t n = w * w;
+    std::vector<float> x( n ), y( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        x[v] = 1000.0f + ( v % w ) * 100.0f + ( v * 37 ) % 11;
+        y[v] = 5000.0f + ( v / w ) * 100.0f + ( v * 13 ) % 7;
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> input_edges;
+    std::vector<CHSection> sections;
+    auto add_section = [&]( uint32_t a, uint32_t b ) {
+        input_edges.push_back( std::make_pair( a, b ) );
+        input_edges.push_back( std::make_pair( b, a ) );
+        sections.push_back( CHSection{ db_id_t( sections.size() + 1 ), a, b, x[a], y[a], x[b], y[b] } );
+    };
+    for ( const auto& street : grid_streets( w ) ) {
+        add_section( street.first, street.second );
+    }
+    add_section( 0, n - 1 );
+
+    // reference: every section
+    auto check_nearest = [&]( const CHSectionIndex& index ) {
+        for ( int i = 0; i < 300; i++ ) {
+            const float px = 900.0f + ( i * 7919 ) % 1200, py = 4900.0f + ( i * 104729 ) % 1200;
+            float expected = std::numeric_limits<float>::max();
+            for ( const CHSection& s : sections ) {
+                const double dx = s.x2 - s.x1, dy = s.y2 - s.y1;
+                const double t = std::min( std::max( ( ( px - s.x1 ) * dx + ( py - s.y1 ) * dy ) / ( dx * dx + dy * dy ), 0.0 ), 1.0 );
+                expected = std::min( expected, float( std::sqrt( std::pow( s.x1 + t * dx - px, 2 ) + std::pow( s.y1 + t * dy - py, 2 ) ) ) );
+            }
+            boost::optional<CHPhantomNode> p = index.nearest( px, py, 1e6f );
+            BOOST_REQUIRE( p );
+            BOOST_CHECK_SMALL( p->distance - expected, 0.01f );
+            // the phantom node is at this distance of the point
+            const CHSection& s = index.section( p->section );
+            BOOST_CHECK( p->ratio >= 0.0f && p->ratio <= 1.0f );
+            const float qx = s.x1 + p->ratio * ( s.x2 - s.x1 ), qy = s.y1 + p->ratio * ( s.y2 - s.y1 );
+            BOOST_CHECK_SMALL( std::sqrt( ( qx - px ) * ( qx - px ) + ( qy - py ) * ( qy - py ) ) - p->distance, 0.01f );
+
+            // nothing beyond the maximum distance
+            BOOST_CHECK_EQUAL( bool( index.nearest( px, py, expected * 0.9f - 0.1f ) ), false );
+        }
+        BOOST_CHECK( !index.nearest( -1e5f, -1e5f, 1000.0f ) );
+    };
+    CHSectionIndex index{ std::vector<CHSection>( sections ) };
+    BOOST_CHECK_EQUAL( index.size(), sections.size() );
+    check_nearest( index );
+
+    CCHTopology topology( n, input_edges );
+    std::vector<db_id_t> edge_db_id( input_edges.size() );
+    std::vector<uint32_t> weights( input_edges.size(), 10 );
+    for ( size_t i = 0; i < input_edges.size(); i++ ) {
+        edge_db_id[i] = i / 2 + 1;
+    }
+    std::vector<db_id_t> node_id( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        node_id[v] = v + 1;
+    }
+    MiddleNodeMap middle_node;
+    CHRoutingData rd( cch_query_graph( topology, topology.customize( weights ), edge_db_id, middle_node ), std::move( middle_node ), std::move( node_id ) );
+    std::vector<CHSection> bad( sections );
+    bad[0].to = n;
+    BOOST_CHECK_THROW( rd.set_section_index( std::unique_ptr<CHSectionIndex>( new CHSectionIndex( std::move( bad ) ) ) ), std::invalid_argument );
+    rd.set_section_index( std::unique_ptr<CHSectionIndex>( new CHSectionIndex( std::vector<CHSection>( sections ) ) ) );
+
+    // costs of the sections, the diagonal being one-way
+    BOOST_CHECK( !rd.section_costs( "" ) );
+    std::vector<CHSectionCosts> costs;
+    for ( uint32_t i = 0; i < sections.size(); i++ ) {
+        costs.push_back( CHSectionCosts{ 10 + i, i + 1 == sections.size() ? CHSectionCosts::no_cost() : 20 + i } );
+    }
+    BOOST_CHECK_THROW( rd.set_section_costs( "", FlatArray<CHSectionCosts>( std::vector<CHSectionCosts>( costs.begin() + 1, costs.end() ) ) ), std::invalid_argument );
+    BOOST_CHECK_THROW( rd.set_section_costs( "car", FlatArray<CHSectionCosts>( std::vector<CHSectionCosts>( costs ) ) ), std::invalid_argument );
+    rd.set_section_costs( "", FlatArray<CHSectionCosts>( std::vector<CHSectionCosts>( costs ) ) );
+    auto check_costs = [&]( const CHRoutingData& data ) {
+        BOOST_REQUIRE( data.section_costs( "" ) );
+        BOOST_REQUIRE_EQUAL( data.section_costs( "" )->size(), costs.size() );
+        for ( uint32_t i = 0; i < costs.size(); i++ ) {
+            BOOST_CHECK_EQUAL( ( *data.section_costs( "" ) )[i].forward, costs[i].forward );
+            BOOST_CHECK_EQUAL( ( *data.section_costs( "" ) )[i].backward, costs[i].backward );
+        }
+    };
+    check_costs( rd );
+
+    // mapped from a file
+    CHRoutingDataBuilder builder;
+    TextProgression progression;
+    builder.file_export( &rd, "ch_dump.bin", progression );
+    {
+        std::unique_ptr<RoutingData> rd2 = builder.file_import( "ch_dump.bin", progression );
+        const CHRoutingData& mapped = static_cast<const CHRoutingData&>( *rd2 );
+        BOOST_REQUIRE( mapped.section_index() );
+        BOOST_CHECK_EQUAL( mapped.section_index()->size(), sections.size() );
+        check_nearest( *mapped.section_index() );
+        check_costs( mapped );
+    }
+
+    // sections follow the vertices when they are renumbered
+    std::vector<CHVertex> new_number = rd.locality_order();
+    rd.renumber_vertices( new_number );
+    BOOST_REQUIRE( rd.section_index() );
+    for ( uint32_t i = 0; i < sections.size(); i++ ) {
+        BOOST_CHECK_EQUAL( rd.section_index()->section( i ).from, new_number[sections[i].from] );
+        BOOST_CHECK_EQUAL( rd.section_index()->section( i ).to, new_number[sections[i].to] );
+    }
+    check_nearest( *rd.section_index() );
+    check_costs( rd );
+
+    // costs do not outlive their index
+    rd.set_section_index( rd.section_index()->renumbered_vertices( std::vector<CHVertex>( new_number.size(), 0 ) ) );
+    BOOST_CHECK( !rd.section_costs( "" ) );
+}
+
+BOOST_AUTO_TEST_CASE( testCHTurnGraph )
+{
+    // 6x6 grid of two-way sections, nodes are numbered by rank
+    const uint32_t w = 6;
+    const uint32_t n = w * w;
+    std::vector<std::pair<uint32_t, uint32_t>> node_edges;
+    std::vector<db_id_t> node_edge_db_id;
+    std::vector<CHTurnVertex> sections;
+    for ( const auto& street : grid_streets( w ) ) {
+        const uint32_t v = street.first, u = street.second;
+        const db_id_t id = node_edges.size() / 2 + 1;
+        const uint32_t cost = 10 + ( id * 7 ) % 13;
+        node_edges.push_back( std::make_pair( v, u ) );
+        node_edges.push_back( std::make_pair( u, v ) );
+        node_edge_db_id.push_back( id );
+        node_edge_db_id.push_back( id );
+        sections.push_back( CHTurnVertex{ id, v, u, cost } );
+        sections.push_back( CHTurnVertex{ id, u, v, cost } );
+    }
+    const uint32_t n_sections = uint32_t( sections.size() );
+
+    // turns between sections, some of them forbidden, some other ones with a penalty
+    std::vector<std::pair<uint32_t, uint32_t>> turns;
+    std::vector<uint32_t> turn_costs;
+    size_t n_forbidden = 0;
+    for ( uint32_t x = 0; x < n_sections; x++ ) {
+        for ( uint32_t y = 0; y < n_sections; y++ ) {
+            if ( sections[x].to != sections[y].from || x == y ) {
+                continue;
+            }
+            if ( ( x * 7 + y ) % 5 == 0 ) {
+                n_forbidden++;
+                continue;
+            }
+            turns.push_back( std::make_pair( x, y ) );
+            turn_costs.push_back( sections[y].cost + ( ( x + y ) % 3 == 0 ? 20 : 0 ) );
+        }
+    }
+    BOOST_REQUIRE( n_forbidden > 0 );
+
+    // hierarchy of sections, built as a CCH
+    std::vector<uint32_t> order = cch_nested_dissection_order( n_sections, turns );
+    std::vector<uint32_t> rank( n_sections );
+    for ( uint32_t r = 0; r < n_sections; r++ ) {
+        rank[order[r]] = r;
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> ranked_turns;
+    std::vector<db_id_t> turn_db_id;
+    for ( const auto& t : turns ) {
+        ranked_turns.push_back( std::make_pair( rank[t.first], rank[t.second] ) );
+        turn_db_id.push_back( sections[t.second].db_id );
+    }
+    std::vector<CHTurnVertex> ranked_sections( n_sections );
+    for ( uint32_t x = 0; x < n_sections; x++ ) {
+        ranked_sections[rank[x]] = sections[x];
+    }
+    CCHTopology topology( n_sections, ranked_turns );
+    MiddleNodeMap turn_middle_node;
+    std::unique_ptr<CHQuery> turn_query = cch_query_graph( topology, topology.customize( turn_costs ), turn_db_id, turn_middle_node );
+    std::unique_ptr<CHQuery> linked( new CHQuery( link_ch_shortcuts( *turn_query, turn_middle_node ) ) );
+    std::unique_ptr<CHTurnGraph> turn_graph( new CHTurnGraph( std::move( linked ), std::move( ranked_sections ), n ) );
+
+    // sections leaving and reaching each node
+    for ( uint32_t v = 0; v < n; v++ ) {
+        size_t n_out = 0, n_in = 0;
+        for ( const uint32_t* it = turn_graph->out_vertices( v ).first; it != turn_graph->out_vertices( v ).second; it++, n_out++ ) {
+            BOOST_CHECK_EQUAL( turn_graph->turn_vertex( *it ).from, v );
+        }
+        for ( const uint32_t* it = turn_graph->in_vertices( v ).first; it != turn_graph->in_vertices( v ).second; it++, n_in++ ) {
+            BOOST_CHECK_EQUAL( turn_graph->turn_vertex( *it ).to, v );
+        }
+        BOOST_CHECK_EQUAL( n_out, n_in );
+        BOOST_CHECK( n_out >= 2 && n_out <= 4 );
+    }
+
+    // node-based graph, for the routing data
+    std::vector<db_id_t> node_id( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        node_id[v] = 100 + v;
+    }
+    CCHTopology node_topology( n, node_edges );
+    std::vector<uint32_t> node_weights( node_edges.size(), 1 );
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> node_query = cch_query_graph( node_topology, node_topology.customize( node_weights ), node_edge_db_id, middle_node );
+    CHRoutingData rd( std::move( node_query ), std::move( middle_node ), std::move( node_id ) );
+    BOOST_CHECK_THROW( rd.set_turn_graph( "car", std::unique_ptr<CHTurnGraph>( new CHTurnGraph( std::unique_ptr<CHQuery>( new CHQuery( turn_graph->query_graph() ) ),
+                                                                                                 std::vector<CHTurnVertex>( turn_graph->vertex_array().begin(), turn_graph->vertex_array().end() ),
+                                                                                                 n + 1 ) ) ),
+                       std::invalid_argument );
+    rd.set_turn_graph( "car", std::move( turn_graph ) );
+    BOOST_CHECK_EQUAL( rd.turn_graph_metric(), "car" );
+
+    // reference: Dijkstra on turns, from each section
+    typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::directedS, boost::no_property, boost::property<boost::edge_weight_t, uint32_t>> RefGraph;
+    RefGraph ref( n_sections );
+    // allowed turns, sections being identified by their ID and the node they reach
+    auto section_key = []( db_id_t id, uint32_t to ) { return id * 1000 + to; };
+    std::set<std::pair<db_id_t, db_id_t>> allowed;
+    for ( size_t i = 0; i < turns.size(); i++ ) {
+        add_edge( turns[i].first, turns[i].second, turn_costs[i], ref );
+        allowed.insert( std::make_pair( section_key( sections[turns[i].first].db_id, sections[turns[i].first].to ),
+                                        section_key( sections[turns[i].second].db_id, sections[turns[i].second].to ) ) );
+    }
+    typedef CHSearchWorkspace<uint32_t, CHVertex> Workspace;
+    std::vector<std::vector<uint32_t>> dist( n_sections, std::vector<uint32_t>( n_sections ) );
+    for ( uint32_t x = 0; x < n_sections; x++ ) {
+        boost::dijkstra_shortest_paths( ref, x, boost::distance_map( &dist[x][0] ).distance_inf( Workspace::infinity() ) );
+    }
+
+    auto weight_map_fn = []( const CHQuery::edge_descriptor& e ) {
+        return uint32_t(e.property().b.cost);
+    };
+    auto weight_map = boost::make_function_property_map<CHQuery::edge_descriptor, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+
+    // queries before and after the mapping of a dump file, and after a renumbering of nodes
+    CHRoutingDataBuilder builder;
+    TextProgression progression;
+    builder.file_export( &rd, "ch_dump.bin", progression );
+    std::unique_ptr<RoutingData> rd2 = builder.file_import( "ch_dump.bin", progression );
+    const CHRoutingData& mapped = static_cast<const CHRoutingData&>( *rd2 );
+    BOOST_REQUIRE( mapped.turn_graph() );
+    BOOST_CHECK_EQUAL( mapped.turn_graph_metric(), "car" );
+    std::vector<CHVertex> same_number( n ), new_number( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        same_number[v] = v;
+        new_number[v] = n - 1 - v;
+    }
+    std::unique_ptr<CHTurnGraph> renumbered = rd.turn_graph()->renumbered_nodes( new_number );
+
+    const std::vector<std::pair<const CHTurnGraph*, const std::vector<CHVertex>*>> graphs = {
+        std::make_pair( rd.turn_graph(), &same_number ),
+        std::make_pair( mapped.turn_graph(), &same_number ),
+        std::make_pair( static_cast<const CHTurnGraph*>( renumbered.get() ), &new_number )
+    };
+    for ( const auto& p : graphs ) {
+        const CHTurnGraph* graph = p.first;
+        Workspace ws( num_vertices( graph->query_graph() ) );
+        for ( uint32_t oo = 0; oo < n; oo += 5 ) {
+            for ( uint32_t dd = 0; dd < n; dd++ ) {
+                if ( oo == dd ) {
+                    continue;
+                }
+                const uint32_t o = (*p.second)[oo];
+                const uint32_t d = (*p.second)[dd];
+                std::vector<std::pair<CHVertex, uint32_t>> sources, targets;
+                uint32_t expected = Workspace::infinity();
+                for ( const uint32_t* it = graph->out_vertices( o ).first; it != graph->out_vertices( o ).second; it++ ) {
+                    sources.push_back( std::make_pair( *it, graph->turn_vertex( *it ).cost ) );
+                }
+                for ( const uint32_t* it = graph->in_vertices( d ).first; it != graph->in_vertices( d ).second; it++ ) {
+                    targets.push_back( std::make_pair( *it, uint32_t( 0 ) ) );
+                    for ( const auto& s : sources ) {
+                        const uint32_t c = dist[order[s.first]][order[*it]];
+                        if ( c != Workspace::infinity() ) {
+                            expected = std::min( expected, s.second + c );
+                        }
+                    }
+                }
+
+                ws.new_query();
+                uint32_t cost = 0;
+                CHVertex first = 0, last = 0;
+                CHQueryStatistics stats;
+                const bool found = bidirectional_ch_dijkstra( graph->query_graph(), sources.begin(), sources.end(), targets.begin(), targets.end(),
+                                                              weight_map, ws, true, cost, first, last, stats );
+                BOOST_CHECK_EQUAL( found, expected != Workspace::infinity() );
+                if ( !found ) {
+                    continue;
+                }
+                BOOST_CHECK_EQUAL( cost, expected );
+
+                // the path goes from the origin to the destination, through allowed turns
+                std::vector<uint32_t> path_turns, stack;
+                unpack_ch_path( graph->query_graph(), ws.path_edges(), path_turns, stack );
+                BOOST_CHECK_EQUAL( graph->turn_vertex( first ).from, o );
+                uint32_t path_cost = graph->turn_vertex( first ).cost;
+                // numberings of the test are their own inverse
+                const std::vector<CHVertex>& original = *p.second;
+                const CHTurnVertex* previous = &graph->turn_vertex( first );
+                for ( uint32_t e : path_turns ) {
+                    path_cost += graph->query_graph().edge_property( e ).b.cost;
+                    // the turn leads to a section leaving the node the previous one reaches
+                    const db_id_t section = graph->query_graph().edge_details( e ).db_id;
+                    const CHTurnVertex* next = nullptr;
+                    for ( const uint32_t* it = graph->out_vertices( previous->to ).first; it != graph->out_vertices( previous->to ).second; it++ ) {
+                        if ( graph->turn_vertex( *it ).db_id == section ) {
+                            next = &graph->turn_vertex( *it );
+                        }
+                    }
+                    BOOST_REQUIRE( next );
+                    BOOST_CHECK( allowed.count( std::make_pair( section_key( previous->db_id, original[previous->to] ),
+                                                                section_key( next->db_id, original[next->to] ) ) ) );
+                    previous = next;
+                }
+                BOOST_CHECK_EQUAL( previous->to, d );
+                BOOST_CHECK_EQUAL( &graph->turn_vertex( last ), previous );
+                BOOST_CHECK_EQUAL( path_cost, cost );
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testCHFlatFile )
+{
+    // 6x6 grid with one-way vertical streets, vertices are numbered by rank
+    const uint32_t w = 6;
+    const uint32_t n = w * w;
+    const GridEdges input_edges = grid_edges( w, []( const std::pair<uint32_t, uint32_t>& street ) {
+            return street.second == street.first + w;
+        } );
+    CCHTopology topology( n, input_edges );
+    std::vector<db_id_t> edge_db_id( input_edges.size() );
+    for ( size_t i = 0; i < input_edges.size(); i++ ) {
+        edge_db_id[i] = i + 1;
+    }
+    std::vector<uint32_t> weights = cyclic_weights( input_edges.size(), 1, 13, 17 );
+    std::vector<uint32_t> weights2 = cyclic_weights( input_edges.size(), 1, 7, 5 );
+    std::vector<db_id_t> node_id = grid_node_ids( n );
+
+    MiddleNodeMap middle_node, middle_node2;
+    std::unique_ptr<CHQuery> graph = cch_query_graph( topology, topology.customize( weights ), edge_db_id, middle_node );
+    std::unique_ptr<CHQuery> graph2 = cch_query_graph( topology, topology.customize( weights2 ), edge_db_id, middle_node2 );
+    const MiddleNodeMap expected_middle_node = middle_node;
+
+    CHRoutingData rd( std::move( graph ), std::move( middle_node ), std::move( node_id ) );
+    rd.set_default_metric_name( "pedestrian" );
+    rd.add_metric( "other", std::move( graph2 ), std::move( middle_node2 ) );
+    BOOST_CHECK( !rd.is_mapped() );
+
+    CHRoutingDataBuilder builder;
+    TextProgression progression;
+    builder.file_export( &rd, "ch_dump.bin", progression );
+    std::unique_ptr<RoutingData> rd2 = builder.file_import( "ch_dump.bin", progression );
+    const CHRoutingData& mapped = static_cast<const CHRoutingData&>( *rd2 );
+    BOOST_CHECK( mapped.is_mapped() );
+
+    // vertex ids
+    for ( uint32_t v = 0; v < n; v++ ) {
+        BOOST_CHECK_EQUAL( mapped.vertex_id( v ), grid_node_id( v ) );
+        BOOST_REQUIRE( mapped.vertex_from_id( grid_node_id( v ) ) );
+        BOOST_CHECK_EQUAL( mapped.vertex_from_id( grid_node_id( v ) ).get(), v );
+    }
+    BOOST_CHECK( !mapped.vertex_from_id( 1001 ) );
+
+    // same edges, in the same order
+    for ( const std::string& metric : { std::string(), std::string( "other" ) } ) {
+        CHQuery& g1 = const_cast<CHQuery&>( rd.ch_query( metric ) );
+        CHQuery& g2 = const_cast<CHQuery&>( mapped.ch_query( metric ) );
+        BOOST_REQUIRE_EQUAL( num_vertices( g1 ), num_vertices( g2 ) );
+        auto it2 = edges( g2 ).first;
+        for ( auto it1 = edges( g1 ).first; it1 != edges( g1 ).second; it1++, it2++ ) {
+            BOOST_REQUIRE( it2 != edges( g2 ).second );
+            BOOST_CHECK_EQUAL( source( *it1, g1 ), source( *it2, g2 ) );
+            BOOST_CHECK_EQUAL( target( *it1, g1 ), target( *it2, g2 ) );
+            BOOST_CHECK_EQUAL( it1->property().b.cost, it2->property().b.cost );
+            BOOST_CHECK_EQUAL( g1.edge_details( *it1 ).db_id, g2.edge_details( *it2 ).db_id );
+        }
+        BOOST_CHECK( it2 == edges( g2 ).second );
+    }
+    std::vector<std::string> names = mapped.metric_names();
+    BOOST_CHECK_EQUAL( names.size(), 1 );
+    BOOST_CHECK_EQUAL( names[0], "other" );
+
+    // the default graph is also reachable by the name of its metric
+    BOOST_CHECK_EQUAL( mapped.default_metric_name(), "pedestrian" );
+    BOOST_CHECK( mapped.has_metric( "pedestrian" ) );
+    BOOST_CHECK( mapped.has_metric( "other" ) );
+    BOOST_CHECK( !mapped.has_metric( "car" ) );
+    BOOST_CHECK( &mapped.ch_query( "pedestrian" ) == &mapped.ch_query() );
+    BOOST_CHECK_THROW( mapped.ch_query( "car" ), std::invalid_argument );
+
+    // middle nodes
+    for ( const auto& p : expected_middle_node ) {
+        CHEdge e;
+        bool found = false;
+        std::tie( e, found ) = edge( p.first.first, p.first.second, mapped.ch_query() );
+        BOOST_REQUIRE( found );
+        BOOST_CHECK( e.property().b.is_shortcut );
+        BOOST_CHECK_EQUAL( mapped.ch_query().edge_details( e ).middle, p.second );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testCHUnpack )
+{
+    // 10x10 grid, vertices are numbered by rank
+    const GridCH grid = make_grid_ch( 10 );
+    const uint32_t n = grid.n;
+    CCHTopology topology( n, grid.edges );
+    std::vector<uint32_t> weights = cyclic_weights( grid.edges.size(), 1, 13, 17 );
+    MiddleNodeMap middle_node;
+    std::unique_ptr<CHQuery> query = cch_query_graph( topology, topology.customize( weights ), grid.edge_db_id, middle_node );
+    CHRoutingData rd( std::move( query ), std::move( middle_node ), std::vector<db_id_t>( n ) );
+    CHQuery& graph = const_cast<CHQuery&>( rd.ch_query() );
+
+    // ends of each edge, by index
+    std::vector<std::pair<CHVertex, CHVertex>> ends( graph.edge_array().size() );
+    for ( auto it = edges( graph ).first; it != edges( graph ).second; it++ ) {
+        ends[graph.edge_index( *it )] = std::make_pair( source( *it, graph ), target( *it, graph ) );
+    }
+
+    CHUnpackCache cache( 1000 );
+    std::vector<uint32_t> path, out, cached_out, stack;
+    size_t n_shortcuts = 0;
+    for ( uint32_t e = 0; e < ends.size(); e++ ) {
+        const CHEdgeCost& p = graph.edge_property( e );
+        path.assign( 1, e );
+        out.clear();
+        unpack_ch_path( graph, path, out, stack );
+        if ( !p.b.is_shortcut ) {
+            BOOST_CHECK_EQUAL( out.size(), 1 );
+            BOOST_CHECK_EQUAL( out[0], e );
+            continue;
+        }
+        n_shortcuts++;
+        // a chain of original edges from the source to the target of the shortcut, of the same cost
+        BOOST_REQUIRE( out.size() >= 2 );
+        uint32_t cost = 0;
+        CHVertex v = ends[e].first;
+        for ( uint32_t oe : out ) {
+            BOOST_CHECK( !graph.edge_property( oe ).b.is_shortcut );
+            BOOST_CHECK( graph.edge_details( oe ).db_id > 0 );
+            BOOST_CHECK_EQUAL( ends[oe].first, v );
+            v = ends[oe].second;
+            cost += graph.edge_property( oe ).b.cost;
+        }
+        BOOST_CHECK_EQUAL( v, ends[e].second );
+        BOOST_CHECK_EQUAL( cost, p.b.cost );
+
+        // the same edges through the cache, once to fill it and once to read it
+        for ( int i = 0; i < 2; i++ ) {
+            cached_out.clear();
+            unpack_ch_path( graph, path, cached_out, stack, &cache );
+            BOOST_CHECK_EQUAL_COLLECTIONS( cached_out.begin(), cached_out.end(), out.begin(), out.end() );
+        }
+    }
+    BOOST_CHECK( n_shortcuts > 0 );
+    BOOST_CHECK( cache.size() > 0 );
+    BOOST_CHECK( cache.size() <= 1000 );
+}
+
+BOOST_AUTO_TEST_CASE( testCHEdgeLayout )
+{
+    // edges 0 -> 2, 1 -> 0, the shortcut 1 -> 2 through 0 and 3 -> 1, in this order in the edge array
+    std::vector<std::pair<CHVertex, CHVertex>> targets = { {0, 2}, {0, 1}, {1, 2}, {1, 3} };
+    std::vector<uint32_t> up_degrees = { 1, 1, 0, 0 };
+    std::vector<CHEdgeProperty> properties( 4 );
+    for ( size_t i = 0; i < properties.size(); i++ ) {
+        std::memset( &properties[i], 0, sizeof( CHEdgeProperty ) );
+        properties[i].b.cost = i + 1;
+        properties[i].db_id = 10 + i;
+    }
+    properties[2].b.cost = 3;
+    properties[2].b.is_shortcut = 1;
+    properties[2].db_id = 0;
+
+    CHQueryAoS aos( targets.begin(), targets.end(), 4, up_degrees.begin(), properties.begin() );
+    CHQuery split( targets.begin(), targets.end(), 4, up_degrees.begin(), properties.begin() );
+    BOOST_CHECK( aos.cold_array().empty() );
+    BOOST_CHECK_EQUAL( split.cold_array().size(), split.edge_array().size() );
+    BOOST_CHECK( sizeof( CHQuery::EdgeData ) < sizeof( CHQueryAoS::EdgeData ) );
+
+    // same edges, in the same order, with the same properties
+    BOOST_REQUIRE_EQUAL( aos.edge_array().size(), split.edge_array().size() );
+    for ( uint32_t i = 0; i < aos.edge_array().size(); i++ ) {
+        BOOST_CHECK_EQUAL( aos.edge_array()[i].target, split.edge_array()[i].target );
+        BOOST_CHECK_EQUAL( aos.edge_property( i ).data, split.edge_property( i ).data );
+        BOOST_CHECK_EQUAL( aos.edge_details( i ).db_id, split.edge_details( i ).db_id );
+    }
+
+    // shortcuts are linked and unpacked the same way with both layouts
+    MiddleNodeMap middle_node;
+    middle_node[std::make_pair( 1, 2 )] = 0;
+    CHQueryAoS linked_aos = link_ch_shortcuts( aos, middle_node );
+    CHQuery linked_split = link_ch_shortcuts( split, middle_node );
+    BOOST_CHECK_EQUAL( linked_split.edge_details( 2 ).middle, 0 );
+    std::vector<uint32_t> path = { 2 }, out_aos, out_split, stack;
+    unpack_ch_path( linked_aos, path, out_aos, stack );
+    unpack_ch_path( linked_split, path, out_split, stack );
+    std::vector<uint32_t> expected = { 1, 0 };
+    BOOST_CHECK_EQUAL_COLLECTIONS( out_aos.begin(), out_aos.end(), expected.begin(), expected.end() );
+    BOOST_CHECK_EQUAL_COLLECTIONS( out_split.begin(), out_split.end(), expected.begin(), expected.end() );
+    // the hot part is untouched
+    for ( uint32_t i = 0; i < split.edge_array().size(); i++ ) {
+        BOOST_CHECK_EQUAL( linked_split.edge_property( i ).data, split.edge_property( i ).data );
+    }
+
+    // a missing middle node, or a middle node above the ends of the shortcut
+    BOOST_CHECK_THROW( link_ch_shortcuts( split, MiddleNodeMap() ), std::runtime_error );
+    middle_node[std::make_pair( 1, 2 )] = 3;
+    BOOST_CHECK_THROW( link_ch_shortcuts( split, middle_node ), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( testCHRenumber )
+{
+    // 8x8 grid, vertices are numbered by rank
+    const GridCH grid = make_grid_ch( 8 );
+    const uint32_t n = grid.n;
+    CCHTopology topology( n, grid.edges );
+    std::vector<uint32_t> weights = cyclic_weights( grid.edges.size(), 1, 13, 17 );
+    std::vector<uint32_t> weights2 = cyclic_weights( grid.edges.size(), 1, 7, 5 );
+    std::vector<db_id_t> node_id = grid_node_ids( n );
+    MiddleNodeMap middle_node, middle_node2;
+    std::unique_ptr<CHQuery> graph = cch_query_graph( topology, topology.customize( weights ), grid.edge_db_id, middle_node );
+    std::unique_ptr<CHQuery> graph2 = cch_query_graph( topology, topology.customize( weights2 ), grid.edge_db_id, middle_node2 );
+    CHRoutingData rd( std::move( graph ), std::move( middle_node ), std::move( node_id ) );
+    rd.add_metric( "other", std::move( graph2 ), std::move( middle_node2 ) );
+
+    // cost and road sections of the path between each pair of vertices, by vertex ID
+    auto weight_map_fn = []( const CHEdge& e ) { return uint32_t( e.property().b.cost ); };
+    auto weight_map = boost::make_function_property_map<CHEdge, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    CHSearchWorkspace<uint32_t> ws( n );
+    CHQueryStatistics stats;
+    auto paths = [&]( const std::string& metric ) {
+        const CHQuery& g = rd.ch_query( metric );
+        std::vector<std::vector<db_id_t>> result;
+        std::vector<uint32_t> out;
+        for ( uint32_t s = 0; s < n; s++ ) {
+            for ( uint32_t t = 0; t < n; t++ ) {
+                ws.new_query();
+                uint32_t cost = 0;
+                BOOST_REQUIRE( bidirectional_ch_dijkstra( g, rd.vertex_from_id( 1000 + s * 2 ).get(), rd.vertex_from_id( 1000 + t * 2 ).get(),
+                                                          weight_map, ws, true, cost, stats ) );
+                out.clear();
+                unpack_ch_path( g, ws.path_edges(), out, ws.unpack_stack() );
+                std::vector<db_id_t> path( 1, cost );
+                for ( uint32_t e : out ) {
+                    path.push_back( g.edge_details( e ).db_id );
+                }
+                result.push_back( path );
+            }
+        }
+        return result;
+    };
+    const auto paths1 = paths( "" ), paths2 = paths( "other" );
+
+    std::vector<CHVertex> new_number = rd.locality_order();
+    BOOST_REQUIRE_EQUAL( new_number.size(), n );
+    std::vector<CHVertex> sorted( new_number );
+    std::sort( sorted.begin(), sorted.end() );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        BOOST_CHECK_EQUAL( sorted[v], v );
+    }
+
+    // an inverted numbering breaks the hierarchy, a numbering that is not a permutation is rejected
+    std::vector<CHVertex> inverted( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        inverted[v] = n - 1 - v;
+    }
+    BOOST_CHECK_THROW( rd.renumber_vertices( inverted ), std::invalid_argument );
+    BOOST_CHECK_THROW( rd.renumber_vertices( std::vector<CHVertex>( n, 0 ) ), std::invalid_argument );
+
+    rd.renumber_vertices( new_number );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        BOOST_CHECK_EQUAL( rd.vertex_id( new_number[v] ), grid_node_id( v ) );
+        BOOST_REQUIRE( rd.vertex_from_id( grid_node_id( v ) ) );
+        BOOST_CHECK_EQUAL( rd.vertex_from_id( grid_node_id( v ) ).get(), new_number[v] );
+    }
+    BOOST_CHECK( paths( "" ) == paths1 );
+    BOOST_CHECK( paths( "other" ) == paths2 );
+
+    // the new numbering is persisted
+    CHRoutingDataBuilder builder;
+    TextProgression progression;
+    builder.file_export( &rd, "ch_dump.bin", progression );
+    std::unique_ptr<RoutingData> rd2 = builder.file_import( "ch_dump.bin", progression );
+    const CHRoutingData& mapped = static_cast<const CHRoutingData&>( *rd2 );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        BOOST_CHECK_EQUAL( mapped.vertex_id( new_number[v] ), grid_node_id( v ) );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testCHMetricRanks )
+{
+    // 8x8 grid, vertices are numbered by rank of the default graph.
+    // The bicycle metric is contracted in another order
+    const GridCH grid = make_grid_ch( 8 );
+    const uint32_t n = grid.n;
+    std::vector<CHVertex> rank( n );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        rank[v] = ( v * 5 + 3 ) % n;
+    }
+    GridEdges ranked_edges;
+    for ( const auto& e : grid.edges ) {
+        ranked_edges.push_back( std::make_pair( rank[e.first], rank[e.second] ) );
+    }
+    CCHTopology topology( n, grid.edges );
+    CCHTopology ranked_topology( n, ranked_edges );
+    std::vector<uint32_t> weights = cyclic_weights( grid.edges.size(), 1, 13, 17 );
+    std::vector<uint32_t> weights2 = cyclic_weights( grid.edges.size(), 1, 7, 5 );
+    MiddleNodeMap middle_node, middle_node2, ranked_middle_node;
+    std::unique_ptr<CHQuery> graph = cch_query_graph( topology, topology.customize( weights ), grid.edge_db_id, middle_node );
+    // the bicycle costs in the order of the default graph, for reference
+    std::unique_ptr<CHQuery> graph2 = cch_query_graph( topology, topology.customize( weights2 ), grid.edge_db_id, middle_node2 );
+    std::unique_ptr<CHQuery> ranked_graph = cch_query_graph( ranked_topology, ranked_topology.customize( weights2 ), grid.edge_db_id, ranked_middle_node );
+    CHRoutingData rd( std::move( graph ), std::move( middle_node ), grid_node_ids( n ) );
+    rd.set_default_metric_name( "car" );
+    rd.add_metric( "reference", std::move( graph2 ), std::move( middle_node2 ) );
+    BOOST_CHECK_THROW( rd.add_metric( "bicycle", std::unique_ptr<CHQuery>( new CHQuery( *ranked_graph ) ), MiddleNodeMap( ranked_middle_node ),
+                                      std::vector<CHVertex>( n, 0 ) ), std::invalid_argument );
+    rd.add_metric( "bicycle", std::move( ranked_graph ), std::move( ranked_middle_node ), std::vector<CHVertex>( rank ) );
+
+    BOOST_CHECK( !rd.metric_ranks( "" ) );
+    BOOST_CHECK( !rd.metric_ranks( "reference" ) );
+    BOOST_REQUIRE( rd.metric_ranks( "bicycle" ) );
+    BOOST_CHECK_THROW( rd.locality_order( "reference" ), std::invalid_argument );
+    BOOST_CHECK_THROW( rd.renumber_metric_vertices( "reference", rd.locality_order() ), std::invalid_argument );
+
+    // hierarchies of the transport modes of requests, see CHPluginRequest::select_graph()
+    BOOST_CHECK_EQUAL( rd.transport_mode_metric( TransportModePrivateCar ), "car" );
+    BOOST_CHECK_EQUAL( rd.transport_mode_metric( TransportModePrivateBicycle ), "bicycle" );
+    BOOST_CHECK_THROW( rd.transport_mode_metric( TransportModeWalking ), std::runtime_error );
+    BOOST_CHECK_THROW( rd.transport_mode_metric( TransportModeTaxi ), std::runtime_error );
+
+    // cost between each pair of vertices, by vertex ID, vertices of the CH graph being translated to ranks of the metric
+    auto weight_map_fn = []( const CHEdge& e ) { return uint32_t( e.property().b.cost ); };
+    auto weight_map = boost::make_function_property_map<CHEdge, uint32_t, decltype(weight_map_fn)>( weight_map_fn );
+    CHSearchWorkspace<uint32_t> ws( n );
+    CHQueryStatistics stats;
+    auto costs = [&]( const CHRoutingData& data, const std::string& metric ) {
+        const CHQuery& g = data.ch_query( metric );
+        const CHMetricRanks* ranks = data.metric_ranks( metric );
+        std::vector<uint32_t> result;
+        for ( uint32_t s = 0; s < n; s++ ) {
+            for ( uint32_t t = 0; t < n; t++ ) {
+                CHVertex u = data.vertex_from_id( grid_node_id( s ) ).get();
+                CHVertex v = data.vertex_from_id( grid_node_id( t ) ).get();
+                if ( ranks ) {
+                    u = ranks->rank[u];
+                    v = ranks->rank[v];
+                }
+                ws.new_query();
+                uint32_t cost = 0;
+                BOOST_REQUIRE( bidirectional_ch_dijkstra( g, u, v, weight_map, ws, true, cost, stats ) );
+                result.push_back( cost );
+            }
+        }
+        return result;
+    };
+    const std::vector<uint32_t> expected = costs( rd, "reference" );
+    BOOST_CHECK( costs( rd, "bicycle" ) == expected );
+
+    // vertices of the CH graph keep their rank in the metric
+    const std::vector<CHVertex> new_number = rd.locality_order();
+    rd.renumber_vertices( new_number );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        BOOST_CHECK_EQUAL( rd.metric_ranks( "bicycle" )->rank[new_number[v]], rank[v] );
+        BOOST_CHECK_EQUAL( rd.metric_ranks( "bicycle" )->vertex[rank[v]], new_number[v] );
+    }
+    BOOST_CHECK( costs( rd, "bicycle" ) == expected );
+    // ranks of the metric are renumbered on their own
+    rd.renumber_metric_vertices( "bicycle", rd.locality_order( "bicycle" ) );
+    BOOST_CHECK( costs( rd, "bicycle" ) == expected );
+
+    // ranks are persisted, and kept when a mapped graph is renumbered
+    CHRoutingDataBuilder builder;
+    TextProgression progression;
+    builder.file_export( &rd, "ch_dump.bin", progression );
+    std::unique_ptr<RoutingData> rd2 = builder.file_import( "ch_dump.bin", progression );
+    CHRoutingData& mapped = static_cast<CHRoutingData&>( *rd2 );
+    BOOST_REQUIRE( mapped.metric_ranks( "bicycle" ) );
+    BOOST_CHECK( !mapped.metric_ranks( "reference" ) );
+    for ( uint32_t v = 0; v < n; v++ ) {
+        BOOST_CHECK_EQUAL( mapped.metric_ranks( "bicycle" )->rank[v], rd.metric_ranks( "bicycle" )->rank[v] );
+    }
+    BOOST_CHECK( costs( mapped, "bicycle" ) == expected );
+    mapped.renumber_vertices( mapped.locality_order() );
+    BOOST_CHECK( !mapped.is_mapped() );
+    BOOST_CHECK( costs( mapped, "bicycle" ) == expected );
+}
+
+BOOST_AUTO_TEST_CASE( testHilbertOrder )
+{
+    // every cell of a 4x4 grid, each one next to the previous one
+    std::vector<bool> seen( 16, false );
+    std::vector<std::pair<uint32_t, uint32_t>> cells( 16 );
+    for ( uint32_t x = 0; x < 4; x++ ) {
+        for ( uint32_t y = 0; y < 4; y++ ) {
+            uint64_t d = hilbert_index( x, y, 2 );
+            BOOST_REQUIRE( d < 16 );
+            BOOST_CHECK( !seen[d] );
+            seen[d] = true;
+            cells[d] = std::make_pair( x, y );
+        }
+    }
+    for ( size_t d = 1; d < 16; d++ ) {
+        int dx = int( cells[d].first ) - int( cells[d-1].first );
+        int dy = int( cells[d].second ) - int( cells[d-1].second );
+        BOOST_CHECK_EQUAL( std::abs( dx ) + std::abs( dy ), 1 );
+    }
+
+    // points are sorted along the curve over their bounding box
+    std::vector<Point2D> points = { Point2D( 10.0, 0.0 ), Point2D( 0.0, 0.0 ), Point2D( 0.0, 10.0 ), Point2D( 10.0, 10.0 ) };
+    std::vector<size_t> order = hilbert_order( points );
+    std::vector<size_t> expected = { 1, 2, 3, 0 };
+    BOOST_CHECK_EQUAL_COLLECTIONS( order.begin(), order.end(), expected.begin(), expected.end() );
+}
+
+BOOST_AUTO_TEST_CASE( testTravelTimeFunction )
+{
+    // 1 km at 60 km/h, 30 km/h from 8:00 to 9:00
+    std::vector<std::pair<double, double>> speeds = { { 0.0, 60.0 }, { 480.0, 30.0 }, { 540.0, 60.0 } };
+    TravelTimeFunction f = TravelTimeFunction::from_speeds( 1000.0, speeds );
+    BOOST_CHECK_CLOSE( f.evaluate( 0.0 ), 1.0, 1e-6 );
+    BOOST_CHECK_CLOSE( f.evaluate( 478.0 ), 1.0, 1e-6 );
+    BOOST_CHECK_CLOSE( f.evaluate( 479.0 ), 1.0, 1e-6 );
+    BOOST_CHECK_CLOSE( f.evaluate( 479.5 ), 1.5, 1e-6 );
+    BOOST_CHECK_CLOSE( f.evaluate( 500.0 ), 2.0, 1e-6 );
+    BOOST_CHECK_CLOSE( f.evaluate( 539.0 ), 1.5, 1e-6 );
+    BOOST_CHECK_CLOSE( f.evaluate( 540.0 + 1440.0 ), 1.0, 1e-6 );
+    BOOST_CHECK_THROW( TravelTimeFunction::from_speeds( 1000.0, { { 0.0, 0.0 } } ), std::invalid_argument );
+
+    // linked functions, checked against the evaluation of each part
+    TravelTimeFunction g = TravelTimeFunction::from_speeds( 3000.0, { { 100.0, 20.0 }, { 481.0, 90.0 }, { 1400.0, 10.0 } } );
+    TravelTimeFunction h = TravelTimeFunction::link( f.view(), g.view(), 7 );
+    TravelTimeFunction m = TravelTimeFunction::merge( h.view(), TravelTimeFunction::constant( 6.0, 8 ).view() );
+    for ( double t = 0.0; t < 1440.0; t += 0.25 ) {
+        const double ft = f.evaluate( t );
+        BOOST_CHECK_CLOSE( h.evaluate( t ), ft + g.evaluate( t + ft ), 1e-6 );
+        BOOST_CHECK_EQUAL( h.view().middle( t ), 7 );
+        BOOST_CHECK_CLOSE( m.evaluate( t ), std::min( h.evaluate( t ), 6.0 ), 1e-6 );
+        if ( std::abs( h.evaluate( t ) - 6.0 ) > 1e-6 ) {
+            BOOST_CHECK_EQUAL( m.view().middle( t ), h.evaluate( t ) < 6.0 ? 7 : 8 );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( testTDCH )
+{
+    // 8x8 grid, vertices are numbered by rank, speeds of some streets drop during the day
+    const GridCH grid = make_grid_ch( 8 );
+    const uint32_t n = grid.n;
+    std::vector<TDInputEdge> td_edges;
+    for ( size_t i = 0; i < grid.edges.size(); i++ ) {
+        const double length = 100.0 + ( i * 37 ) % 400;
+        std::vector<std::pair<double, double>> speeds = { { 0.0, 50.0 } };
+        if ( i % 3 == 0 ) {
+            speeds.push_back( { 420.0 + ( i % 7 ) * 10.0, 5.0 + ( i % 4 ) * 5.0 } );
+            speeds.push_back( { 600.0, 50.0 } );
+        }
+        td_edges.push_back( TDInputEdge{ grid.edges[i].first, grid.edges[i].second, TravelTimeFunction::from_speeds( length, speeds ), db_id_t( i + 1 ) } );
+    }
+    std::unique_ptr<TDCHGraph> td_graph = td_contraction( n, td_edges );
+
+    // time-dependent Dijkstra on the input graph
+    auto dijkstra = [&]( uint32_t origin, double departure ) {
+        std::vector<double> arrival( n, std::numeric_limits<double>::infinity() );
+        std::vector<bool> settled( n, false );
+        arrival[origin] = departure;
+        for ( uint32_t k = 0; k < n; k++ ) {
+            uint32_t u = n;
+            for ( uint32_t v = 0; v < n; v++ ) {
+                if ( !settled[v] && ( u == n || arrival[v] < arrival[u] ) ) {
+                    u = v;
+                }
+            }
+            settled[u] = true;
+            for ( const TDInputEdge& e : td_edges ) {
+                if ( e.from == u ) {
+                    arrival[e.to] = std::min( arrival[e.to], arrival[u] + e.ttf.evaluate( arrival[u] ) );
+                }
+            }
+        }
+        return arrival;
+    };
+
+    // dummy static graphs with the same vertices, to store the time-dependent one
+    std::vector<std::pair<CHVertex, CHVertex>> targets;
+    std::vector<uint32_t> up_degrees( n, 0 );
+    std::vector<CHEdgeProperty> properties;
+    auto empty_graph = [&]() {
+        return std::unique_ptr<CHQuery>( new CHQuery( targets.begin(), targets.end(), n, up_degrees.begin(), properties.begin() ) );
+    };
+    // in the order of the CH graph, then in the one of a car metric contracted in its own order
+    for ( bool own_order : { false, true } ) {
+        std::vector<CHVertex> rank( n );
+        std::vector<db_id_t> node_id( n );
+        for ( uint32_t v = 0; v < n; v++ ) {
+            rank[v] = own_order ? ( v * 5 + 3 ) % n : v;
+            node_id[v] = rank[v] + 1;
+        }
+        CHRoutingData rd( empty_graph(), MiddleNodeMap(), std::move( node_id ) );
+        if ( own_order ) {
+            rd.add_metric( "car", empty_graph(), MiddleNodeMap(), std::move( rank ) );
+            BOOST_CHECK_THROW( rd.set_td_graph( td_contraction( n, td_edges ), "bicycle" ), std::invalid_argument );
+            rd.set_td_graph( td_contraction( n, td_edges ), "car" );
+        }
+        else {
+            rd.set_td_graph( std::move( td_graph ) );
+        }
+        rd.renumber_vertices( rd.locality_order() );
+        if ( own_order ) {
+            rd.renumber_metric_vertices( "car", rd.locality_order( "car" ) );
+        }
+        CHRoutingDataBuilder builder;
+        TextProgression progression;
+        builder.file_export( &rd, "ch_dump.bin", progression );
+        std::unique_ptr<RoutingData> rd2 = builder.file_import( "ch_dump.bin", progression );
+        const CHRoutingData& mapped = static_cast<const CHRoutingData&>( *rd2 );
+        BOOST_REQUIRE( mapped.td_graph() );
+        const TDCHGraph& graph = *mapped.td_graph();
+        BOOST_CHECK_EQUAL( mapped.td_graph_metric(), own_order ? "car" : "" );
+        const CHMetricRanks* td_ranks = mapped.metric_ranks( mapped.td_graph_metric() );
+        BOOST_CHECK_EQUAL( td_ranks != nullptr, own_order );
+
+        CHSearchWorkspace<double, CHVertex> ws( n );
+        for ( uint32_t s = 0; s < n; s += 5 ) {
+            for ( double departure : { 0.0, 425.0, 450.0, 1439.0 } ) {
+                std::vector<double> expected = dijkstra( s, departure );
+                for ( uint32_t t = 0; t < n; t += 3 ) {
+                    CHVertex origin = mapped.vertex_from_id( s + 1 ).get();
+                    CHVertex destination = mapped.vertex_from_id( t + 1 ).get();
+                    if ( td_ranks ) {
+                        origin = td_ranks->rank[origin];
+                        destination = td_ranks->rank[destination];
+                    }
+                    ws.new_query();
+                    CHQueryStatistics stats;
+                    std::vector<std::pair<uint32_t, uint32_t>> path;
+                    boost::optional<double> arrival = td_ch_query( graph, origin, destination, departure, ws, stats, path );
+                    BOOST_REQUIRE( arrival );
+                    BOOST_CHECK_CLOSE( arrival.get(), expected[t], 1e-6 );
+
+                    // road sections of the path, from the origin to the destination
+                    std::vector<TDPathEdge> road_edges;
+                    td_unpack_path( graph, path, departure, road_edges );
+                    double time = departure;
+                    db_id_t previous_head = s + 1;
+                    for ( const TDPathEdge& e : road_edges ) {
+                        BOOST_CHECK( !graph.is_shortcut( e.edge ) );
+                        BOOST_CHECK_CLOSE( e.departure, time, 1e-6 );
+                        const TDInputEdge& input = td_edges[graph.edge( e.edge ).db_id - 1];
+                        BOOST_CHECK_EQUAL( input.from + 1, previous_head );
+                        previous_head = input.to + 1;
+                        time += e.travel_time;
+                    }
+                    BOOST_CHECK_EQUAL( previous_head, t + 1 );
+                    BOOST_CHECK_CLOSE( time, expected[t], 1e-6 );
+                }
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 